@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <string>
+
+#include <Windows.h>
+
+#include <dirty_t.h>
+
+#include "RenderStateTable.h"
+
+/**
+ * \brief The part of \c Direct3DDevice8 that \c SetRenderState writes to, with the same members, so that
+ * \c RenderStateTable can be instantiated for it and benchmarked without Direct3D. The constant buffers
+ * and depth/stencil flags are reduced to the \c dirty_t members the handlers touch.
+ */
+class RenderStateModel
+{
+public:
+	struct
+	{
+		dirty_t<uint32_t> src_blend;
+		dirty_t<uint32_t> dst_blend;
+		dirty_t<uint32_t> blend_op;
+		dirty_t<float>    fog_start;
+		dirty_t<float>    fog_end;
+		dirty_t<float>    fog_density;
+		dirty_t<float4>   fog_color;
+		dirty_t<float>    alpha_test_reference;
+		dirty_t<float4>   texture_factor;
+	} m_per_pixel;
+
+	struct
+	{
+		struct
+		{
+			dirty_t<uint32_t> diffuse;
+			dirty_t<uint32_t> specular;
+			dirty_t<uint32_t> ambient;
+			dirty_t<uint32_t> emissive;
+		} material_sources;
+
+		dirty_t<float4> ambient;
+		dirty_t<bool>   color_vertex;
+	} m_per_model;
+
+	struct
+	{
+		dirty_t<DepthStencilFlags::type> flags;
+		dirty_t<DepthFlags::type>        depth_flags;
+		dirty_t<StencilFlags::type>      stencil_flags;
+	} m_depth_stencil_flags;
+
+	dirty_t<uint32_t> m_blend_flags;
+	dirty_t<uint32_t> m_raster_flags;
+	ShaderFlags::type m_shader_flags = 0;
+
+	std::array<dirty_t<DWORD>, RENDER_STATE_COUNT> m_render_state_values;
+	std::bitset<RENDER_STATE_COUNT> m_applied_render_states;
+	std::array<uint8_t, RENDER_STATE_COUNT> m_unhandled_render_state_logs {};
+
+	// stands in for OutputDebugStringA
+	size_t logged_bytes = 0;
+
+	void log(const std::string& message)
+	{
+		logged_bytes += message.size();
+	}
+
+	void log_unhandled_render_state(D3DRENDERSTATETYPE state, DWORD value)
+	{
+		uint8_t& count = m_unhandled_render_state_logs[state];
+
+		if (count > UNHANDLED_RENDER_STATE_LOG_LIMIT)
+		{
+			return;
+		}
+
+		++count;
+
+		const std::string name(RenderStateTable<RenderStateModel>::TABLE[state].name);
+
+		if (count > UNHANDLED_RENDER_STATE_LOG_LIMIT)
+		{
+			log(std::string(__func__) + ": not logging further changes to unhandled render state " + name + "\n");
+			return;
+		}
+
+		log(std::string(__func__) + ": unhandled render state type: " + name + "; value: " + std::to_string(value) + "\n");
+	}
+
+private:
+	static constexpr uint8_t UNHANDLED_RENDER_STATE_LOG_LIMIT = 4;
+};
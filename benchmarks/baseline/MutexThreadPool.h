@@ -0,0 +1,228 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h" // TaskPriority
+
+/**
+ * \brief The thread pool as it was before it became work-stealing: one mutex-guarded queue per priority
+ * and a condition variable, with a \c std::shared_ptr task entry and a heap-allocated callable per task.
+ * Kept only as a baseline for the benchmarks.
+ */
+class MutexThreadPool
+{
+	struct TaskEntry;
+
+public:
+	class TaskHandle
+	{
+	public:
+		TaskHandle() = default;
+
+	private:
+		friend class MutexThreadPool;
+
+		explicit TaskHandle(const std::shared_ptr<TaskEntry>& entry)
+			: m_entry(entry)
+		{
+		}
+
+		std::weak_ptr<TaskEntry> m_entry;
+	};
+
+	template <typename T>
+	struct Task
+	{
+		std::future<T> future;
+		TaskHandle handle;
+	};
+
+	explicit MutexThreadPool(size_t thread_count)
+		: m_thread_count(thread_count)
+	{
+		m_running = true;
+		m_threads.reserve(m_thread_count);
+
+		for (size_t i = 0; i < m_thread_count; ++i)
+		{
+			m_threads.emplace_back(&MutexThreadPool::thread_function, this);
+		}
+	}
+
+	~MutexThreadPool()
+	{
+		m_running = false;
+		m_pending_task_cv.notify_all();
+
+		for (std::thread& t : m_threads)
+		{
+			t.join();
+		}
+	}
+
+	MutexThreadPool(const MutexThreadPool&) = delete;
+	MutexThreadPool& operator=(const MutexThreadPool&) = delete;
+
+	void wait()
+	{
+		std::unique_lock queue_lock(m_queue_mutex);
+		auto wait_predicate = [this] { return m_running == false || m_pending_task_count == 0; };
+		m_tasks_complete_cv.wait(queue_lock, wait_predicate);
+	}
+
+	template <typename Func, typename... Args>
+	[[nodiscard]] auto enqueue(TaskPriority priority, Func func, Args&&... args)
+	{
+		using invoke_result_t = std::invoke_result_t<Func, Args...>;
+
+		std::promise<invoke_result_t> promise;
+		auto future = promise.get_future();
+
+		auto wrapper_fn =
+			[
+				func     = std::move(func),
+				...largs = std::forward<Args>(args),
+				promise  = std::move(promise)
+			]() mutable
+			{
+				if constexpr (std::is_void_v<invoke_result_t>)
+				{
+					func(std::forward<Args>(largs)...);
+					promise.set_value();
+				}
+				else
+				{
+					promise.set_value(func(std::forward<Args>(largs)...));
+				}
+			};
+
+		std::unique_ptr<FunctionWrapperBase> wrapper(new FunctionWrapper(std::move(wrapper_fn)));
+		const auto entry = enqueue_internal(std::move(wrapper), priority);
+
+		return Task<invoke_result_t> { std::move(future), TaskHandle(entry) };
+	}
+
+private:
+	class FunctionWrapperBase
+	{
+	public:
+		virtual ~FunctionWrapperBase() = default;
+		virtual void operator()() = 0;
+	};
+
+	template <typename Func>
+	class FunctionWrapper : public FunctionWrapperBase
+	{
+	public:
+		explicit FunctionWrapper(Func&& function)
+			: m_function(std::forward<Func>(function))
+		{
+		}
+
+		void operator()() override
+		{
+			m_function();
+		}
+
+	private:
+		Func m_function;
+	};
+
+	struct TaskEntry
+	{
+		std::unique_ptr<FunctionWrapperBase> function;
+		TaskPriority priority;
+		bool claimed = false;
+	};
+
+	std::shared_ptr<TaskEntry> enqueue_internal(std::unique_ptr<FunctionWrapperBase> wrapper, TaskPriority priority)
+	{
+		auto entry = std::make_shared<TaskEntry>();
+		entry->function = std::move(wrapper);
+		entry->priority = priority;
+
+		{
+			std::lock_guard queue_lock(m_queue_mutex);
+			m_queues[static_cast<size_t>(priority)].push_back(entry);
+			++m_queued_task_count;
+			++m_pending_task_count;
+		}
+
+		m_pending_task_cv.notify_one();
+		return entry;
+	}
+
+	std::shared_ptr<TaskEntry> pop_task()
+	{
+		for (auto& queue : m_queues | std::views::reverse)
+		{
+			while (!queue.empty())
+			{
+				std::shared_ptr<TaskEntry> entry = std::move(queue.front());
+				queue.pop_front();
+
+				if (!entry->claimed)
+				{
+					entry->claimed = true;
+					--m_queued_task_count;
+					return entry;
+				}
+			}
+		}
+
+		return nullptr;
+	}
+
+	void thread_function()
+	{
+		auto wait_predicate = [this] { return m_queued_task_count != 0 || m_running == false; };
+
+		while (true)
+		{
+			std::unique_lock queue_lock(m_queue_mutex);
+			m_pending_task_cv.wait(queue_lock, wait_predicate);
+
+			if (m_queued_task_count == 0 && m_running == false)
+			{
+				break;
+			}
+
+			const std::shared_ptr<TaskEntry> task = pop_task();
+			queue_lock.unlock();
+
+			(*task->function)();
+			task->function.reset();
+
+			// unlike the original, the count is updated under the lock so that wait() can't miss the notification
+			queue_lock.lock();
+
+			if (--m_pending_task_count == 0)
+			{
+				m_tasks_complete_cv.notify_all();
+			}
+		}
+	}
+
+	size_t m_thread_count;
+	std::vector<std::thread> m_threads;
+
+	std::atomic_bool m_running;
+	std::mutex m_queue_mutex;
+	std::condition_variable m_pending_task_cv;
+	size_t m_pending_task_count = 0;
+	size_t m_queued_task_count = 0;
+	std::array<std::deque<std::shared_ptr<TaskEntry>>, static_cast<size_t>(TaskPriority::count)> m_queues;
+	std::condition_variable m_tasks_complete_cv;
+};
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <bit>
+#include <string>
+#include <unordered_map>
+
+#include "RenderStateModel.h"
+
+// SetRenderState as it was before it dispatched through RenderStateTable: a switch over every state,
+// with the names of unhandled states looked up in a hash map. Kept only as a baseline for the benchmarks.
+
+inline const std::unordered_map<uint32_t, std::string> SWITCH_RS_STRINGS = {
+	{ D3DRS_ZENABLE,                  "D3DRS_ZENABLE" },
+	{ D3DRS_FILLMODE,                 "D3DRS_FILLMODE" },
+	{ D3DRS_SHADEMODE,                "D3DRS_SHADEMODE" },
+	{ D3DRS_LINEPATTERN,              "D3DRS_LINEPATTERN" },
+	{ D3DRS_ZWRITEENABLE,             "D3DRS_ZWRITEENABLE" },
+	{ D3DRS_ALPHATESTENABLE,          "D3DRS_ALPHATESTENABLE" },
+	{ D3DRS_LASTPIXEL,                "D3DRS_LASTPIXEL" },
+	{ D3DRS_SRCBLEND,                 "D3DRS_SRCBLEND" },
+	{ D3DRS_DESTBLEND,                "D3DRS_DESTBLEND" },
+	{ D3DRS_CULLMODE,                 "D3DRS_CULLMODE" },
+	{ D3DRS_ZFUNC,                    "D3DRS_ZFUNC" },
+	{ D3DRS_ALPHAREF,                 "D3DRS_ALPHAREF" },
+	{ D3DRS_ALPHAFUNC,                "D3DRS_ALPHAFUNC" },
+	{ D3DRS_DITHERENABLE,             "D3DRS_DITHERENABLE" },
+	{ D3DRS_ALPHABLENDENABLE,         "D3DRS_ALPHABLENDENABLE" },
+	{ D3DRS_FOGENABLE,                "D3DRS_FOGENABLE" },
+	{ D3DRS_SPECULARENABLE,           "D3DRS_SPECULARENABLE" },
+	{ D3DRS_ZVISIBLE,                 "D3DRS_ZVISIBLE" },
+	{ D3DRS_FOGCOLOR,                 "D3DRS_FOGCOLOR" },
+	{ D3DRS_FOGTABLEMODE,             "D3DRS_FOGTABLEMODE" },
+	{ D3DRS_FOGSTART,                 "D3DRS_FOGSTART" },
+	{ D3DRS_FOGEND,                   "D3DRS_FOGEND" },
+	{ D3DRS_FOGDENSITY,               "D3DRS_FOGDENSITY" },
+	{ D3DRS_EDGEANTIALIAS,            "D3DRS_EDGEANTIALIAS" },
+	{ D3DRS_ZBIAS,                    "D3DRS_ZBIAS" },
+	{ D3DRS_RANGEFOGENABLE,           "D3DRS_RANGEFOGENABLE" },
+	{ D3DRS_STENCILENABLE,            "D3DRS_STENCILENABLE" },
+	{ D3DRS_STENCILFAIL,              "D3DRS_STENCILFAIL" },
+	{ D3DRS_STENCILZFAIL,             "D3DRS_STENCILZFAIL" },
+	{ D3DRS_STENCILPASS,              "D3DRS_STENCILPASS" },
+	{ D3DRS_STENCILFUNC,              "D3DRS_STENCILFUNC" },
+	{ D3DRS_STENCILREF,               "D3DRS_STENCILREF" },
+	{ D3DRS_STENCILMASK,              "D3DRS_STENCILMASK" },
+	{ D3DRS_STENCILWRITEMASK,         "D3DRS_STENCILWRITEMASK" },
+	{ D3DRS_TEXTUREFACTOR,            "D3DRS_TEXTUREFACTOR" },
+	{ D3DRS_WRAP0,                    "D3DRS_WRAP0" },
+	{ D3DRS_WRAP1,                    "D3DRS_WRAP1" },
+	{ D3DRS_WRAP2,                    "D3DRS_WRAP2" },
+	{ D3DRS_WRAP3,                    "D3DRS_WRAP3" },
+	{ D3DRS_WRAP4,                    "D3DRS_WRAP4" },
+	{ D3DRS_WRAP5,                    "D3DRS_WRAP5" },
+	{ D3DRS_WRAP6,                    "D3DRS_WRAP6" },
+	{ D3DRS_WRAP7,                    "D3DRS_WRAP7" },
+	{ D3DRS_CLIPPING,                 "D3DRS_CLIPPING" },
+	{ D3DRS_LIGHTING,                 "D3DRS_LIGHTING" },
+	{ D3DRS_AMBIENT,                  "D3DRS_AMBIENT" },
+	{ D3DRS_FOGVERTEXMODE,            "D3DRS_FOGVERTEXMODE" },
+	{ D3DRS_COLORVERTEX,              "D3DRS_COLORVERTEX" },
+	{ D3DRS_LOCALVIEWER,              "D3DRS_LOCALVIEWER" },
+	{ D3DRS_NORMALIZENORMALS,         "D3DRS_NORMALIZENORMALS" },
+	{ D3DRS_DIFFUSEMATERIALSOURCE,    "D3DRS_DIFFUSEMATERIALSOURCE" },
+	{ D3DRS_SPECULARMATERIALSOURCE,   "D3DRS_SPECULARMATERIALSOURCE" },
+	{ D3DRS_AMBIENTMATERIALSOURCE,    "D3DRS_AMBIENTMATERIALSOURCE" },
+	{ D3DRS_EMISSIVEMATERIALSOURCE,   "D3DRS_EMISSIVEMATERIALSOURCE" },
+	{ D3DRS_VERTEXBLEND,              "D3DRS_VERTEXBLEND" },
+	{ D3DRS_CLIPPLANEENABLE,          "D3DRS_CLIPPLANEENABLE" },
+	{ D3DRS_SOFTWAREVERTEXPROCESSING, "D3DRS_SOFTWAREVERTEXPROCESSING" },
+	{ D3DRS_POINTSIZE,                "D3DRS_POINTSIZE" },
+	{ D3DRS_POINTSIZE_MIN,            "D3DRS_POINTSIZE_MIN" },
+	{ D3DRS_POINTSPRITEENABLE,        "D3DRS_POINTSPRITEENABLE" },
+	{ D3DRS_POINTSCALEENABLE,         "D3DRS_POINTSCALEENABLE" },
+	{ D3DRS_POINTSCALE_A,             "D3DRS_POINTSCALE_A" },
+	{ D3DRS_POINTSCALE_B,             "D3DRS_POINTSCALE_B" },
+	{ D3DRS_POINTSCALE_C,             "D3DRS_POINTSCALE_C" },
+	{ D3DRS_MULTISAMPLEANTIALIAS,     "D3DRS_MULTISAMPLEANTIALIAS" },
+	{ D3DRS_MULTISAMPLEMASK,          "D3DRS_MULTISAMPLEMASK" },
+	{ D3DRS_PATCHEDGESTYLE,           "D3DRS_PATCHEDGESTYLE" },
+	{ D3DRS_PATCHSEGMENTS,            "D3DRS_PATCHSEGMENTS" },
+	{ D3DRS_DEBUGMONITORTOKEN,        "D3DRS_DEBUGMONITORTOKEN" },
+	{ D3DRS_POINTSIZE_MAX,            "D3DRS_POINTSIZE_MAX" },
+	{ D3DRS_INDEXEDVERTEXBLENDENABLE, "D3DRS_INDEXEDVERTEXBLENDENABLE" },
+	{ D3DRS_COLORWRITEENABLE,         "D3DRS_COLORWRITEENABLE" },
+	{ D3DRS_TWEENFACTOR,              "D3DRS_TWEENFACTOR" },
+	{ D3DRS_BLENDOP,                  "D3DRS_BLENDOP" },
+	{ D3DRS_POSITIONORDER,            "D3DRS_POSITIONORDER" },
+	{ D3DRS_NORMALORDER,              "D3DRS_NORMALORDER" }
+};
+
+inline HRESULT set_render_state_switch(RenderStateModel& device, D3DRENDERSTATETYPE State, DWORD Value)
+{
+	switch (static_cast<DWORD>(State))
+	{
+		case D3DRS_LINEPATTERN:
+		case D3DRS_ZVISIBLE:
+		case D3DRS_EDGEANTIALIAS:
+		case D3DRS_PATCHSEGMENTS:
+		case D3DRS_CLIPPLANEENABLE:
+		case D3DRS_ZBIAS:
+			return D3DERR_INVALIDCALL;
+
+		case D3DRS_SOFTWAREVERTEXPROCESSING:
+			return D3D_OK;
+
+		default:
+			break;
+	}
+
+	if (State < D3DRS_ZENABLE || State > D3DRS_NORMALORDER)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	// even if we do custom handling for a render state, we
+	// store its value so the caller can retrieve it later in
+	// Direct3DDevice8::GetRenderState
+	auto& ref = device.m_render_state_values[State];
+
+	auto set_stencil_flags = [&](auto shift)
+	{
+		auto flags = device.m_depth_stencil_flags.stencil_flags.data();
+		flags &= ~(StencilFlags::op_mask << shift);
+		flags |= (Value & StencilFlags::op_mask) << shift;
+		device.m_depth_stencil_flags.stencil_flags = flags;
+	};
+
+	auto set_stencil_rw = [&](auto shift)
+	{
+		auto flags = device.m_depth_stencil_flags.stencil_flags.data();
+		flags &= ~(StencilFlags::rw_mask << shift);
+		flags |= (Value & StencilFlags::rw_mask) << shift;
+		device.m_depth_stencil_flags.stencil_flags = flags;
+	};
+
+	switch (State)
+	{
+		default:
+		{
+			ref = Value;
+
+			if (!ref.dirty())
+			{
+				break;
+			}
+
+			ref.clear();
+			const auto it = SWITCH_RS_STRINGS.find(State);
+
+			if (it == SWITCH_RS_STRINGS.end())
+			{
+				break;
+			}
+
+			const std::string str = std::string(__func__) + " unhandled render state type: " + it->second + "; value: " + std::to_string(Value) + "\n";
+
+			device.log(str);
+			break;
+		}
+
+		case D3DRS_COLORWRITEENABLE:
+		{
+			device.m_blend_flags = (device.m_blend_flags.data() & ~(0xF << BLEND_COLORMASK_SHIFT)) | ((Value & 0xF) << BLEND_COLORMASK_SHIFT);
+			ref = Value;
+			break;
+		}
+
+		case D3DRS_TEXTUREFACTOR:
+			device.m_per_pixel.texture_factor = to_color4(Value);
+			ref = Value;
+			break;
+
+		case D3DRS_FOGSTART:
+			device.m_per_pixel.fog_start = std::bit_cast<float>(Value);
+			ref = Value;
+			break;
+
+		case D3DRS_FOGEND:
+			device.m_per_pixel.fog_end = std::bit_cast<float>(Value);
+			ref = Value;
+			break;
+
+		case D3DRS_FOGCOLOR:
+			device.m_per_pixel.fog_color = to_color4(Value);
+			ref = Value;
+			break;
+
+		case D3DRS_FOGTABLEMODE:
+			device.m_shader_flags &= ~ShaderFlags::rs_fog_mode_mask;
+			device.m_shader_flags |= (static_cast<ShaderFlags::type>(Value) << ShaderFlags::rs_fog_mode_shift) & ShaderFlags::rs_fog_mode_mask;
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_FOGDENSITY:
+			device.m_per_pixel.fog_density = std::bit_cast<float>(Value);
+			ref = Value;
+			break;
+
+		case D3DRS_SPECULARENABLE:
+			if (Value != 0)
+			{
+				device.m_shader_flags |= ShaderFlags::rs_specular;
+			}
+			else
+			{
+				device.m_shader_flags &= ~ShaderFlags::rs_specular;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_LIGHTING:
+			if (Value == 1)
+			{
+				device.m_shader_flags |= ShaderFlags::rs_lighting;
+			}
+			else
+			{
+				device.m_shader_flags &= ~ShaderFlags::rs_lighting;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_FOGENABLE:
+			if (Value != 0)
+			{
+				device.m_shader_flags |= ShaderFlags::rs_fog;
+			}
+			else
+			{
+				device.m_shader_flags &= ~ShaderFlags::rs_fog;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_ALPHATESTENABLE:
+		{
+			if (Value != 0)
+			{
+				device.m_shader_flags |= ShaderFlags::rs_alpha_test;
+			}
+			else
+			{
+				device.m_shader_flags &= ~ShaderFlags::rs_alpha_test;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+		}
+
+		case D3DRS_ALPHAFUNC:
+		{
+			if (!Value)
+			{
+				return D3DERR_INVALIDCALL;
+			}
+
+			device.m_shader_flags &= ~ShaderFlags::rs_alpha_test_mode_mask;
+			device.m_shader_flags |= (static_cast<ShaderFlags::type>(Value) << ShaderFlags::rs_alpha_test_mode_shift) & ShaderFlags::rs_alpha_test_mode_mask;
+
+			ref = Value;
+			ref.clear();
+			break;
+		}
+
+		case D3DRS_ALPHAREF:
+		{
+			device.m_per_pixel.alpha_test_reference = static_cast<float>(Value) / 255.0f;
+			ref = Value;
+			ref.clear();
+			break;
+		}
+
+		case D3DRS_CULLMODE:
+		{
+			device.m_raster_flags = (device.m_raster_flags.data() & ~RasterFlags::cull_mask) | (Value & 3);
+			ref = Value;
+			ref.clear();
+			break;
+		}
+
+		case D3DRS_FILLMODE:
+		{
+			device.m_raster_flags = (device.m_raster_flags.data() & ~RasterFlags::fill_mask) | ((Value & 3) << 2);
+			ref = Value;
+			ref.clear();
+			break;
+		}
+
+		case D3DRS_ZENABLE:
+		{
+			if (Value)
+			{
+				device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() | DepthStencilFlags::depth_test_enabled;
+			}
+			else
+			{
+				device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() & ~DepthStencilFlags::depth_test_enabled;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+		}
+
+		case D3DRS_ZFUNC:
+		{
+			if (!Value)
+			{
+				return D3DERR_INVALIDCALL;
+			}
+
+			device.m_depth_stencil_flags.depth_flags = (device.m_depth_stencil_flags.depth_flags.data() & ~DepthFlags::comparison_mask) | Value;
+			ref = Value;
+			ref.clear();
+			break;
+		}
+
+		case D3DRS_ZWRITEENABLE:
+			if (Value)
+			{
+				device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() | DepthStencilFlags::depth_write_enabled;
+			}
+			else
+			{
+				device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() & ~DepthStencilFlags::depth_write_enabled;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_STENCILENABLE:
+			if (Value)
+			{
+				device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() | DepthStencilFlags::stencil_enabled;
+			}
+			else
+			{
+				device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() & ~DepthStencilFlags::stencil_enabled;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_STENCILFAIL:
+			set_stencil_flags(StencilFlags::fail_shift);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_STENCILZFAIL:
+			set_stencil_flags(StencilFlags::zfail_shift);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_STENCILPASS:
+			set_stencil_flags(StencilFlags::pass_shift);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_STENCILFUNC:
+			set_stencil_flags(StencilFlags::func_shift);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_STENCILREF:
+			ref = Value;
+			break;
+
+		case D3DRS_STENCILMASK:
+			set_stencil_rw(StencilFlags::read_shift);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_STENCILWRITEMASK:
+			set_stencil_rw(StencilFlags::write_shift);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_AMBIENT:
+			device.m_per_model.ambient = to_color4(Value);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_DIFFUSEMATERIALSOURCE:
+			device.m_per_model.material_sources.diffuse = Value;
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_SPECULARMATERIALSOURCE:
+			device.m_per_model.material_sources.specular = Value;
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_AMBIENTMATERIALSOURCE:
+			device.m_per_model.material_sources.ambient = Value;
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_EMISSIVEMATERIALSOURCE:
+			device.m_per_model.material_sources.emissive = Value;
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_COLORVERTEX:
+			device.m_per_model.color_vertex = !!Value;
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_SRCBLEND:
+			device.m_per_pixel.src_blend = Value;
+			device.m_blend_flags = (device.m_blend_flags.data() & ~0x0F) | Value;
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_DESTBLEND:
+			device.m_per_pixel.dst_blend = Value;
+			device.m_blend_flags = (device.m_blend_flags.data() & ~0xF0) | (Value << 4);
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_ALPHABLENDENABLE:
+			device.m_blend_flags = (device.m_blend_flags.data() & ~0x8000) | (Value ? 0x8000 : 0);
+
+			if (Value != 1)
+			{
+				device.m_shader_flags &= ~ShaderFlags::rs_alpha;
+			}
+			else
+			{
+				device.m_shader_flags |= ShaderFlags::rs_alpha;
+			}
+
+			ref = Value;
+			ref.clear();
+			break;
+
+		case D3DRS_BLENDOP:
+			device.m_blend_flags = (device.m_blend_flags.data() & ~0xF00) | (Value << 8);
+			device.m_per_pixel.blend_op = Value;
+
+			ref = Value;
+			ref.clear();
+			break;
+	}
+
+	return D3D_OK;
+}
+
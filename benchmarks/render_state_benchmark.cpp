@@ -0,0 +1,173 @@
+// Compares SetRenderState dispatched through RenderStateTable, the code Direct3DDevice8 runs, against the
+// switch it replaced, replaying the same stream of render state changes through both.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "RenderStateModel.h"
+#include "RenderStateTable.h"
+#include "baseline/SwitchRenderState.h"
+
+namespace
+{
+enum class Dispatch
+{
+	switch_,
+	table,
+};
+
+struct RenderStateChange
+{
+	D3DRENDERSTATETYPE state;
+	DWORD value;
+};
+
+/**
+ * \brief Builds a stream of render state changes for \p draw_count draws, each setting a few of the
+ * states games typically set per draw. The stream is synthesized, not recorded from a game.
+ * \param distinct_values If \c true, every change sets a new value, so nothing can be skipped as redundant.
+ * Otherwise values are picked from a few alternatives, so most changes are redundant, as in real frames.
+ */
+std::vector<RenderStateChange> make_stream(size_t draw_count, bool distinct_values)
+{
+	struct Candidate
+	{
+		D3DRENDERSTATETYPE state;
+		std::array<DWORD, 2> values;
+	};
+
+	static constexpr std::array<Candidate, 20> candidates = { {
+		{ D3DRS_ZENABLE,               { 1, 0 } },
+		{ D3DRS_ZWRITEENABLE,          { 1, 0 } },
+		{ D3DRS_ZFUNC,                 { D3DCMP_LESSEQUAL, D3DCMP_ALWAYS } },
+		{ D3DRS_CULLMODE,              { D3DCULL_CCW, D3DCULL_NONE } },
+		{ D3DRS_ALPHABLENDENABLE,      { 0, 1 } },
+		{ D3DRS_SRCBLEND,              { D3DBLEND_SRCALPHA, D3DBLEND_ONE } },
+		{ D3DRS_DESTBLEND,             { D3DBLEND_INVSRCALPHA, D3DBLEND_ONE } },
+		{ D3DRS_BLENDOP,               { D3DBLENDOP_ADD, D3DBLENDOP_REVSUBTRACT } },
+		{ D3DRS_ALPHATESTENABLE,       { 0, 1 } },
+		{ D3DRS_ALPHAFUNC,             { D3DCMP_GREATER, D3DCMP_GREATEREQUAL } },
+		{ D3DRS_ALPHAREF,              { 0, 128 } },
+		{ D3DRS_LIGHTING,              { 1, 0 } },
+		{ D3DRS_SPECULARENABLE,        { 0, 1 } },
+		{ D3DRS_FOGENABLE,             { 1, 0 } },
+		{ D3DRS_FOGCOLOR,              { 0xFF808080, 0xFF000000 } },
+		{ D3DRS_TEXTUREFACTOR,         { 0xFFFFFFFF, 0x80FFFFFF } },
+		{ D3DRS_COLORVERTEX,           { 1, 0 } },
+		{ D3DRS_DIFFUSEMATERIALSOURCE, { D3DMCS_COLOR1, D3DMCS_MATERIAL } },
+		{ D3DRS_COLORWRITEENABLE,      { 0xF, 0x7 } },
+		{ D3DRS_DITHERENABLE,          { 1, 0 } }, // unhandled; only stored and logged
+	} };
+
+	constexpr size_t changes_per_draw = 8;
+
+	std::mt19937 rng(1);
+	std::vector<RenderStateChange> stream;
+	stream.reserve(draw_count * changes_per_draw);
+
+	// which of its values each candidate was last set to
+	std::array<size_t, candidates.size()> last {};
+
+	for (size_t draw = 0; draw < draw_count; ++draw)
+	{
+		for (size_t i = 0; i < changes_per_draw; ++i)
+		{
+			const size_t c = rng() % candidates.size();
+
+			if (distinct_values)
+			{
+				last[c] ^= 1;
+			}
+			else
+			{
+				last[c] = (rng() % 4) == 0 ? 1 : 0;
+			}
+
+			stream.push_back({ candidates[c].state, candidates[c].values[last[c]] });
+		}
+	}
+
+	return stream;
+}
+
+/**
+ * \brief Checks that both dispatches leave the device in the same state after \p stream.
+ */
+bool dispatches_agree(const std::vector<RenderStateChange>& stream)
+{
+	RenderStateModel table_device;
+	RenderStateModel switch_device;
+
+	for (const RenderStateChange& change : stream)
+	{
+		if (RenderStateTable<RenderStateModel>::set(table_device, change.state, change.value) != set_render_state_switch(switch_device, change.state, change.value))
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < RENDER_STATE_COUNT; ++i)
+	{
+		if (table_device.m_render_state_values[i].data() != switch_device.m_render_state_values[i].data())
+		{
+			return false;
+		}
+	}
+
+	return table_device.m_blend_flags.data() == switch_device.m_blend_flags.data() &&
+	       table_device.m_raster_flags.data() == switch_device.m_raster_flags.data() &&
+	       table_device.m_depth_stencil_flags.flags.data() == switch_device.m_depth_stencil_flags.flags.data() &&
+	       table_device.m_depth_stencil_flags.depth_flags.data() == switch_device.m_depth_stencil_flags.depth_flags.data() &&
+	       table_device.m_depth_stencil_flags.stencil_flags.data() == switch_device.m_depth_stencil_flags.stencil_flags.data() &&
+	       table_device.m_shader_flags == switch_device.m_shader_flags;
+}
+
+template <Dispatch dispatch>
+void set_render_states(benchmark::State& state)
+{
+	const auto stream = make_stream(static_cast<size_t>(state.range(0)), state.range(1) != 0);
+
+	if (!dispatches_agree(stream))
+	{
+		state.SkipWithError("the table and the switch disagree");
+		return;
+	}
+
+	RenderStateModel device;
+
+	for (auto _ : state)
+	{
+		for (const RenderStateChange& change : stream)
+		{
+			if constexpr (dispatch == Dispatch::table)
+			{
+				benchmark::DoNotOptimize(RenderStateTable<RenderStateModel>::set(device, change.state, change.value));
+			}
+			else
+			{
+				benchmark::DoNotOptimize(set_render_state_switch(device, change.state, change.value));
+			}
+		}
+
+		benchmark::ClobberMemory();
+	}
+
+	benchmark::DoNotOptimize(device);
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(stream.size()));
+}
+
+void apply_streams(benchmark::internal::Benchmark* benchmark)
+{
+	benchmark->ArgNames({ "draws", "distinct" })->ArgsProduct({ { 64, 1024 }, { 0, 1 } });
+}
+}
+
+BENCHMARK(set_render_states<Dispatch::switch_>)->Apply(apply_streams);
+BENCHMARK(set_render_states<Dispatch::table>)->Apply(apply_streams);
+
+BENCHMARK_MAIN();
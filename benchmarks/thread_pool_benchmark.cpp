@@ -0,0 +1,114 @@
+// Compares the work-stealing ThreadPool against the mutex and condition variable pool it replaced.
+// Throughput: enqueue a batch of small tasks and wait for all of them.
+// Latency: the round trip of one task, from enqueue until its future is ready.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "ThreadPool.h"
+#include "baseline/MutexThreadPool.h"
+
+namespace
+{
+constexpr int64_t BATCH_SIZE = 4096;
+
+template <typename Pool>
+void throughput_external(benchmark::State& state)
+{
+	Pool pool(static_cast<size_t>(state.range(0)));
+	std::atomic<uint64_t> sum { 0 };
+
+	for (auto _ : state)
+	{
+		for (int64_t i = 0; i < BATCH_SIZE; ++i)
+		{
+			std::ignore = pool.enqueue(TaskPriority::normal, [&sum, i]() { sum.fetch_add(static_cast<uint64_t>(i), std::memory_order_relaxed); });
+		}
+
+		pool.wait();
+	}
+
+	benchmark::DoNotOptimize(sum.load());
+	state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+}
+
+// every task enqueues another until a chain of BATCH_SIZE / thread count tasks has run on each thread,
+// which exercises the workers' own deques instead of the queue shared with outside threads
+template <typename Pool>
+void throughput_nested(benchmark::State& state)
+{
+	const auto thread_count = static_cast<size_t>(state.range(0));
+	Pool pool(thread_count);
+	const int64_t chain_length = BATCH_SIZE / static_cast<int64_t>(thread_count);
+
+	struct Chain
+	{
+		Pool* pool;
+		std::atomic<int64_t> remaining;
+
+		void step()
+		{
+			if (remaining.fetch_sub(1, std::memory_order_relaxed) > 1)
+			{
+				std::ignore = pool->enqueue(TaskPriority::normal, [this]() { step(); });
+			}
+		}
+	};
+
+	std::vector<Chain> chains(thread_count);
+
+	for (auto _ : state)
+	{
+		for (Chain& chain : chains)
+		{
+			chain.pool = &pool;
+			chain.remaining.store(chain_length, std::memory_order_relaxed);
+			std::ignore = pool.enqueue(TaskPriority::normal, [&chain]() { chain.step(); });
+		}
+
+		pool.wait();
+	}
+
+	state.SetItemsProcessed(state.iterations() * chain_length * static_cast<int64_t>(thread_count));
+}
+
+template <typename Pool>
+void round_trip_latency(benchmark::State& state)
+{
+	Pool pool(static_cast<size_t>(state.range(0)));
+
+	for (auto _ : state)
+	{
+		auto task = pool.enqueue(TaskPriority::high, []() { return 1; });
+		benchmark::DoNotOptimize(task.future.get());
+	}
+}
+
+void apply_thread_counts(benchmark::internal::Benchmark* benchmark)
+{
+	const int64_t hardware_threads = std::max<int64_t>(1, std::thread::hardware_concurrency());
+
+	for (int64_t thread_count = 1; thread_count < hardware_threads; thread_count *= 2)
+	{
+		benchmark->Arg(thread_count);
+	}
+
+	benchmark->Arg(hardware_threads)->ArgName("threads")->UseRealTime();
+}
+}
+
+BENCHMARK(throughput_external<ThreadPool>)->Apply(apply_thread_counts);
+BENCHMARK(throughput_external<MutexThreadPool>)->Apply(apply_thread_counts);
+BENCHMARK(throughput_nested<ThreadPool>)->Apply(apply_thread_counts);
+BENCHMARK(throughput_nested<MutexThreadPool>)->Apply(apply_thread_counts);
+BENCHMARK(round_trip_latency<ThreadPool>)->Apply(apply_thread_counts);
+BENCHMARK(round_trip_latency<MutexThreadPool>)->Apply(apply_thread_counts);
+
+BENCHMARK_MAIN();
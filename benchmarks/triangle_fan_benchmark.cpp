@@ -0,0 +1,94 @@
+// Compares the scalar, SSE2 and AVX2 paths of triangle_fan_to_list for 16-bit and 32-bit indices.
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "triangle_fan.h"
+
+namespace
+{
+enum class Path
+{
+	scalar,
+	sse2,
+	avx2,
+	dispatch,
+};
+
+template <typename T, Path path>
+void fan_to_list(benchmark::State& state)
+{
+	const auto primitive_count = static_cast<size_t>(state.range(0));
+
+	std::vector<T> input(primitive_count + 2);
+	std::vector<T> output(3 * primitive_count);
+
+	std::mt19937 rng(1);
+
+	for (T& index : input)
+	{
+		index = static_cast<T>(rng());
+	}
+
+#ifdef D3D8TO11_TRIANGLE_FAN_AVX2
+	if (path == Path::avx2 && !d3d8to11::detail::cpu_has_avx2())
+	{
+		state.SkipWithError("AVX2 is not supported");
+		return;
+	}
+#else
+	if (path == Path::sse2 || path == Path::avx2)
+	{
+		state.SkipWithError("not built with SIMD support");
+		return;
+	}
+#endif
+
+	for (auto _ : state)
+	{
+		size_t i = 0;
+
+		if constexpr (path == Path::dispatch)
+		{
+			d3d8to11::triangle_fan_to_list(input.data(), primitive_count, output.data());
+			i = primitive_count;
+		}
+#ifdef D3D8TO11_TRIANGLE_FAN_AVX2
+		else if constexpr (path == Path::avx2)
+		{
+			i = d3d8to11::detail::triangle_fan_to_list_avx2(input.data(), primitive_count, output.data());
+		}
+		else if constexpr (path == Path::sse2)
+		{
+			i = d3d8to11::detail::triangle_fan_to_list_sse2(input.data(), primitive_count, output.data(), 0);
+		}
+#endif
+
+		d3d8to11::triangle_fan_to_list_scalar(input.data(), primitive_count, output.data(), i);
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(primitive_count));
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(output.size() * sizeof(T)));
+}
+
+void apply_sizes(benchmark::internal::Benchmark* benchmark)
+{
+	benchmark->ArgName("primitives")->Arg(16)->Arg(256)->Arg(4096)->Arg(65536);
+}
+}
+
+BENCHMARK(fan_to_list<uint16_t, Path::scalar>)->Apply(apply_sizes);
+BENCHMARK(fan_to_list<uint16_t, Path::sse2>)->Apply(apply_sizes);
+BENCHMARK(fan_to_list<uint16_t, Path::avx2>)->Apply(apply_sizes);
+BENCHMARK(fan_to_list<uint16_t, Path::dispatch>)->Apply(apply_sizes);
+BENCHMARK(fan_to_list<uint32_t, Path::scalar>)->Apply(apply_sizes);
+BENCHMARK(fan_to_list<uint32_t, Path::sse2>)->Apply(apply_sizes);
+BENCHMARK(fan_to_list<uint32_t, Path::avx2>)->Apply(apply_sizes);
+BENCHMARK(fan_to_list<uint32_t, Path::dispatch>)->Apply(apply_sizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,318 @@
+/**
+ * d3d8to11-shaderc: compiles every shader variant needed by a set of recorded shader
+ * permutations into a shader pack, so that a pre-warmed cache can ship with a build.
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <d3dcompiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "defs.h"
+#include "filesystem.h"
+#include "ShaderCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderFlags.h"
+#include "ShaderIncluder.h"
+#include "ShaderPack.h"
+#include "ThreadPool.h"
+
+namespace
+{
+enum class ShaderStage
+{
+	vertex,
+	pixel
+};
+
+struct Variant
+{
+	ShaderFlags::type flags;
+	bool is_uber;
+	ShaderStage stage;
+
+	bool operator<(const Variant& other) const
+	{
+		return std::tie(flags, is_uber, stage) < std::tie(other.flags, other.is_uber, other.stage);
+	}
+};
+
+struct Options
+{
+	std::filesystem::path source_dir;
+	std::filesystem::path output_path;
+	std::vector<std::filesystem::path> permutation_paths;
+	size_t thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+	uint32_t oit_max_fragments = static_cast<uint32_t>(MAX_FRAGMENTS_DEFAULT);
+};
+
+void print_usage()
+{
+	std::cerr <<
+		"usage: d3d8to11-shaderc [options] <shader source directory> <output pack>\n"
+		"\n"
+		"Compiles the standard and uber vertex and pixel shaders for every permutation\n"
+		"recorded in the output pack and in the given permutation files.\n"
+		"\n"
+		"options:\n"
+		"  -p, --permutations <file>  add the permutations from a shader pack or a legacy\n"
+		"                             permutations.bin; may be given more than once\n"
+		"  -j, --jobs <count>         number of compiler threads (default: one per core)\n"
+		"  --oit-fragments <count>    value of OIT_MAX_FRAGMENTS (default: "
+		<< MAX_FRAGMENTS_DEFAULT << ")\n";
+}
+
+bool parse_options(int argc, wchar_t* argv[], Options& options)
+{
+	std::vector<std::filesystem::path> positional;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::wstring arg = argv[i];
+		const bool has_value = i + 1 < argc;
+
+		if ((arg == L"-p" || arg == L"--permutations") && has_value)
+		{
+			options.permutation_paths.emplace_back(argv[++i]);
+		}
+		else if ((arg == L"-j" || arg == L"--jobs") && has_value)
+		{
+			options.thread_count = std::max<size_t>(1, std::stoul(argv[++i]));
+		}
+		else if (arg == L"--oit-fragments" && has_value)
+		{
+			options.oit_max_fragments = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (!arg.starts_with(L"-"))
+		{
+			positional.emplace_back(arg);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	if (positional.size() != 2)
+	{
+		return false;
+	}
+
+	options.source_dir  = std::filesystem::absolute(positional[0]);
+	options.output_path = std::filesystem::absolute(positional[1]);
+	return true;
+}
+
+/**
+ * \brief Reads the permutations from either a shader pack or a file of raw flags, as written by older versions.
+ */
+bool read_permutations(const std::filesystem::path& path, std::vector<ShaderFlags::type>& permutations)
+{
+	uint32_t magic = 0;
+
+	{
+		std::ifstream file(path, std::ios::binary);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	}
+
+	if (magic == ShaderPack::HEADER_MAGIC)
+	{
+		ShaderPack pack;
+
+		if (!pack.open(path))
+		{
+			return false;
+		}
+
+		const std::vector<ShaderFlags::type> pack_permutations = pack.get_permutations();
+		permutations.insert(permutations.end(), pack_permutations.begin(), pack_permutations.end());
+		return true;
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	ShaderFlags::type flags = 0;
+
+	while (file.read(reinterpret_cast<char*>(&flags), sizeof(flags)))
+	{
+		permutations.push_back(flags);
+	}
+
+	return true;
+}
+
+/**
+ * \brief Collects every shader the device could ask for when drawing the given permutations.
+ */
+std::set<Variant> get_variants(const std::vector<ShaderFlags::type>& permutations)
+{
+	std::set<Variant> variants;
+
+	for (const ShaderFlags::type flags : permutations)
+	{
+		const ShaderFlags::type sanitized = ShaderFlags::sanitize(flags);
+
+		variants.insert({ ShaderFlags::sanitize(sanitized & ShaderFlags::vs_mask), false, ShaderStage::vertex });
+		variants.insert({ ShaderFlags::sanitize(sanitized & ShaderFlags::ps_mask), false, ShaderStage::pixel });
+		variants.insert({ ShaderFlags::sanitize(sanitized & ShaderFlags::uber_vs_mask), true, ShaderStage::vertex });
+		variants.insert({ ShaderFlags::sanitize(sanitized & ShaderFlags::uber_ps_mask), true, ShaderStage::pixel });
+	}
+
+	// the fallbacks the device queues first on startup
+	for (const ShaderFlags::type position : { D3DFVF_XYZ, D3DFVF_XYZRHW })
+	{
+		variants.insert({ ShaderFlags::generic_uber_vs(position), true, ShaderStage::vertex });
+		variants.insert({ ShaderFlags::generic_uber_ps(position), true, ShaderStage::pixel });
+	}
+
+	return variants;
+}
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+	Options options;
+
+	try
+	{
+		if (!parse_options(argc, argv, options))
+		{
+			print_usage();
+			return 2;
+		}
+	}
+	catch (std::exception&)
+	{
+		print_usage();
+		return 2;
+	}
+
+	d3d8to11::filesystem::initialize();
+
+	const std::filesystem::path shader_path = options.source_dir / "shader.hlsl";
+
+	if (!std::filesystem::exists(shader_path))
+	{
+		std::cerr << std::format("{} not found\n", shader_path.string());
+		return 1;
+	}
+
+	ShaderIncluder includer;
+	includer.set_base_directory(options.source_dir);
+	includer.add_include_directory(options.source_dir);
+
+	ShaderCache cache(includer);
+	cache.open(options.output_path);
+
+	if (!cache.is_open())
+	{
+		std::cerr << std::format("failed to open {}\n", options.output_path.string());
+		return 1;
+	}
+
+	for (const std::filesystem::path& path : options.permutation_paths)
+	{
+		std::vector<ShaderFlags::type> permutations;
+
+		if (!read_permutations(path, permutations))
+		{
+			std::cerr << std::format("failed to read permutations from {}\n", path.string());
+			return 1;
+		}
+
+		for (const ShaderFlags::type flags : permutations)
+		{
+			// same filter the pack's compaction applies
+			if ((flags & ~ShaderFlags::mask) == 0)
+			{
+				std::ignore = cache.add_permutation(ShaderFlags::sanitize(flags));
+			}
+		}
+	}
+
+	ShaderCompiler compiler(includer, cache);
+	compiler.set_source_path(shader_path);
+	compiler.set_oit_max_fragments(options.oit_max_fragments);
+
+	const std::vector<ShaderFlags::type> permutations = cache.get_permutations();
+	const std::set<Variant> variants = get_variants(permutations);
+
+	std::cout << std::format("compiling {} shader(s) for {} permutation(s) on {} thread(s)...\n",
+	                         variants.size(), permutations.size(), options.thread_count);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::pair<Variant, ThreadPool::Task<void>>> tasks;
+	tasks.reserve(variants.size());
+
+	{
+		ThreadPool thread_pool(options.thread_count);
+
+		auto compile = [&compiler](const Variant& variant)
+		{
+			if (variant.stage == ShaderStage::vertex)
+			{
+				std::ignore = compiler.compile_vertex_shader(variant.flags, variant.is_uber);
+			}
+			else
+			{
+				std::ignore = compiler.compile_pixel_shader(variant.flags, variant.is_uber);
+			}
+		};
+
+		for (const Variant& variant : variants)
+		{
+			tasks.emplace_back(variant, thread_pool.enqueue(TaskPriority::normal, compile, variant));
+		}
+
+		thread_pool.wait();
+	}
+
+	size_t failed_count = 0;
+
+	for (auto& [variant, task] : tasks)
+	{
+		try
+		{
+			task.future.get();
+		}
+		catch (std::exception& ex)
+		{
+			++failed_count;
+
+			std::cerr << std::format("{} {} shader 0x{:016X} failed:\n{}\n",
+			                         variant.is_uber ? "uber" : "standard",
+			                         variant.stage == ShaderStage::vertex ? "vertex" : "pixel",
+			                         variant.flags, ex.what());
+		}
+	}
+
+	cache.flush();
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
+
+	std::cout << std::format("done: {} compiled, {} failed in {} ms\n",
+	                         tasks.size() - failed_count, failed_count, elapsed.count());
+
+	return failed_count == 0 ? 0 : 1;
+}
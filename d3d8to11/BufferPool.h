@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+#include <wrl/client.h>
+
+/**
+ * \brief Pools idle \c Direct3DVertexBuffer8 or \c Direct3DIndexBuffer8 objects by power-of-two size.
+ *
+ * Each size class keeps its own free list, so acquiring and releasing a buffer are O(1).
+ * Released buffers are appended to the back of their list, so the front always holds
+ * the buffer that has been idle the longest, which is what \c trim removes.
+ */
+template <typename T>
+class BufferPool
+{
+public:
+	static constexpr size_t BUCKET_COUNT = 32; // up to 2 GiB, which is more than D3D11 allows for a buffer
+
+	struct BucketStats
+	{
+		size_t hits           = 0; // acquires served by an idle buffer
+		size_t misses         = 0; // acquires that needed a new buffer
+		size_t trimmed        = 0; // idle buffers released by trim
+		size_t resident_count = 0; // idle buffers currently held
+		size_t resident_bytes = 0;
+	};
+
+	/**
+	 * \brief Returns the size class for a buffer of \p size bytes, or \c BUCKET_COUNT if it is too large.
+	 */
+	[[nodiscard]] static constexpr size_t get_bucket_index(size_t size)
+	{
+		return size == 0 ? 0 : std::min<size_t>(std::bit_width(size - 1), BUCKET_COUNT);
+	}
+
+	[[nodiscard]] static constexpr size_t get_bucket_size(size_t bucket_index)
+	{
+		return size_t(1) << bucket_index;
+	}
+
+	/**
+	 * \brief Takes an idle buffer of exactly \c get_bucket_size(get_bucket_index(size)) bytes.
+	 * \return The buffer, or \c nullptr if the caller needs to create one.
+	 */
+	[[nodiscard]] Microsoft::WRL::ComPtr<T> acquire(size_t size)
+	{
+		const size_t bucket_index = get_bucket_index(size);
+
+		if (bucket_index >= BUCKET_COUNT)
+		{
+			return nullptr;
+		}
+
+		Bucket& bucket = m_buckets[bucket_index];
+
+		if (bucket.entries.empty())
+		{
+			++bucket.stats.misses;
+			return nullptr;
+		}
+
+		Microsoft::WRL::ComPtr<T> buffer = std::move(bucket.entries.back().buffer);
+		bucket.entries.pop_back();
+
+		++bucket.stats.hits;
+		--bucket.stats.resident_count;
+		bucket.stats.resident_bytes -= get_bucket_size(bucket_index);
+
+		return buffer;
+	}
+
+	/**
+	 * \brief Returns an idle buffer to the pool. Buffers whose size is not a power of two are dropped.
+	 */
+	void release(Microsoft::WRL::ComPtr<T> buffer, uint64_t frame)
+	{
+		if (buffer == nullptr)
+		{
+			return;
+		}
+
+		const size_t size = buffer->get_d3d8_desc().Size;
+
+		if (!std::has_single_bit(size))
+		{
+			return;
+		}
+
+		const size_t bucket_index = get_bucket_index(size);
+
+		if (bucket_index >= BUCKET_COUNT)
+		{
+			return;
+		}
+
+		Bucket& bucket = m_buckets[bucket_index];
+		bucket.entries.push_back({ std::move(buffer), frame });
+
+		++bucket.stats.resident_count;
+		bucket.stats.resident_bytes += size;
+	}
+
+	/**
+	 * \brief Releases every buffer that has been idle for more than \p max_idle_frames frames.
+	 */
+	void trim(uint64_t frame, uint64_t max_idle_frames)
+	{
+		for (size_t i = 0; i < BUCKET_COUNT; ++i)
+		{
+			Bucket& bucket = m_buckets[i];
+
+			while (!bucket.entries.empty() && frame - bucket.entries.front().last_used_frame > max_idle_frames)
+			{
+				bucket.entries.pop_front();
+
+				++bucket.stats.trimmed;
+				--bucket.stats.resident_count;
+				bucket.stats.resident_bytes -= get_bucket_size(i);
+			}
+		}
+	}
+
+	[[nodiscard]] const BucketStats& get_stats(size_t bucket_index) const
+	{
+		return m_buckets[bucket_index].stats;
+	}
+
+private:
+	struct Entry
+	{
+		Microsoft::WRL::ComPtr<T> buffer;
+		uint64_t last_used_frame;
+	};
+
+	struct Bucket
+	{
+		std::deque<Entry> entries;
+		BucketStats stats;
+	};
+
+	std::array<Bucket, BUCKET_COUNT> m_buckets;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * \brief A shader stage's constant registers, remembering which ones changed since they were last uploaded.
+ *
+ * Games tend to rewrite a handful of registers per draw, often with the values they already hold,
+ * so only registers whose value actually changes are marked dirty, and \c flush hands out the
+ * runs of dirty registers so that only those have to be uploaded. The version is bumped with every
+ * change so that anything derived from the registers can tell whether it's stale.
+ */
+template <size_t N>
+class ConstantRegisterFile
+{
+public:
+	using Register = std::array<float, 4>;
+
+	static constexpr size_t REGISTER_COUNT = N;
+	static constexpr size_t REGISTER_SIZE  = sizeof(Register);
+
+	/**
+	 * \brief Returns whether registers \p first through \p first + \p count - 1 exist.
+	 */
+	[[nodiscard]] static constexpr bool contains(size_t first, size_t count)
+	{
+		return first < N && count <= N - first;
+	}
+
+	/**
+	 * \brief Copies \p count registers from \p data starting at register \p first, which must be \c contains.
+	 */
+	void set(size_t first, const void* data, size_t count)
+	{
+		const auto* source = static_cast<const Register*>(data);
+		bool changed = false;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			Register& target = m_registers[first + i];
+
+			if (std::memcmp(&target, &source[i], REGISTER_SIZE) == 0)
+			{
+				continue;
+			}
+
+			std::memcpy(&target, &source[i], REGISTER_SIZE);
+			m_dirty[(first + i) / 32] |= 1u << ((first + i) % 32);
+			changed = true;
+		}
+
+		if (changed)
+		{
+			++m_version;
+		}
+	}
+
+	void get(size_t first, void* data, size_t count) const
+	{
+		std::memcpy(data, &m_registers[first], count * REGISTER_SIZE);
+	}
+
+	[[nodiscard]] const Register* data() const
+	{
+		return m_registers.data();
+	}
+
+	[[nodiscard]] uint64_t version() const
+	{
+		return m_version;
+	}
+
+	[[nodiscard]] bool dirty() const
+	{
+		for (const uint32_t word : m_dirty)
+		{
+			if (word != 0)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * \brief Marks every register dirty, e.g. because the buffer they were uploaded to was replaced.
+	 */
+	void mark()
+	{
+		++m_version;
+
+		for (size_t i = 0; i < m_dirty.size(); ++i)
+		{
+			m_dirty[i] = i + 1 < m_dirty.size() || N % 32 == 0 ? ~0u : (1u << (N % 32)) - 1;
+		}
+	}
+
+	/**
+	 * \brief Calls \p callback with the first register and length of every run of dirty registers,
+	 * from the lowest up, then marks them all clean. Runs continue across words of the dirty mask.
+	 */
+	template <typename Callback>
+	void flush(Callback&& callback)
+	{
+		size_t run_first = 0;
+		size_t run_count = 0;
+
+		for (size_t word_index = 0; word_index < m_dirty.size(); ++word_index)
+		{
+			uint32_t word = m_dirty[word_index];
+			m_dirty[word_index] = 0;
+
+			while (word)
+			{
+				const size_t first = word_index * 32 + std::countr_zero(word);
+				const size_t count = std::countr_one(word >> (first % 32));
+
+				if (run_count != 0 && run_first + run_count == first)
+				{
+					run_count += count;
+				}
+				else
+				{
+					if (run_count != 0)
+					{
+						callback(run_first, run_count);
+					}
+
+					run_first = first;
+					run_count = count;
+				}
+
+				word &= ~static_cast<uint32_t>(((uint64_t(1) << count) - 1) << (first % 32));
+			}
+		}
+
+		if (run_count != 0)
+		{
+			callback(run_first, run_count);
+		}
+	}
+
+private:
+	std::array<Register, N> m_registers {};
+	std::array<uint32_t, (N + 31) / 32> m_dirty {};
+	uint64_t m_version = 0;
+};
@@ -27,3 +27,21 @@ bool DepthStencilFlags::operator==(const DepthStencilFlags& rhs) const
 	       depth_flags.data() == rhs.depth_flags.data() &&
 	       stencil_flags.data() == rhs.stencil_flags.data();
 }
+
+uint64_t DepthStencilFlags::to_key() const
+{
+	return static_cast<uint64_t>(stencil_flags.data()) |
+	       static_cast<uint64_t>(depth_flags.data() & DepthFlags::comparison_mask) << 32 |
+	       static_cast<uint64_t>(flags.data()) << 36;
+}
+
+DepthStencilFlags DepthStencilFlags::from_key(uint64_t key)
+{
+	DepthStencilFlags result;
+
+	result.stencil_flags = static_cast<StencilFlags::type>(key & 0xFFFFFFFF);
+	result.depth_flags   = static_cast<DepthFlags::type>((key >> 32) & DepthFlags::comparison_mask);
+	result.flags         = static_cast<type>(key >> 36);
+
+	return result;
+}
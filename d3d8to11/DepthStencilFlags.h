@@ -53,6 +53,12 @@ struct DepthStencilFlags : dirty_impl
 	void mark() override;
 
 	bool operator==(const DepthStencilFlags& rhs) const;
+
+	/**
+	 * \brief Packs all of the flags into one value, e.g. to use as a cache key.
+	 */
+	[[nodiscard]] uint64_t to_key() const;
+	[[nodiscard]] static DepthStencilFlags from_key(uint64_t key);
 };
 
 template <>
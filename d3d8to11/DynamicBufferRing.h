@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#include <wrl/client.h>
+
+#include "alignment.h"
+#include "d3d8types.h"
+
+/**
+ * \brief Suballocates a dynamic \c Direct3DVertexBuffer8 or \c Direct3DIndexBuffer8 as a ring.
+ *
+ * Each allocation is locked with \c D3DLOCK_NOOVERWRITE directly after the previous one, so the GPU can keep
+ * reading what was written earlier. The buffer is only discarded when an allocation doesn't fit before the end
+ * and wraps around to the start.
+ */
+template <typename T>
+class DynamicBufferRing
+{
+public:
+	void reset(Microsoft::WRL::ComPtr<T> buffer)
+	{
+		m_buffer        = std::move(buffer);
+		m_capacity      = m_buffer ? m_buffer->get_d3d8_desc().Size : 0;
+		m_offset        = 0;
+		m_needs_discard = true;
+	}
+
+	[[nodiscard]] T* get() const
+	{
+		return m_buffer.Get();
+	}
+
+	[[nodiscard]] UINT capacity() const
+	{
+		return m_capacity;
+	}
+
+	/**
+	 * \brief Locks \p size bytes at the next offset that is a multiple of \p alignment.
+	 * The caller is responsible for unlocking the buffer.
+	 * \param offset Receives the offset of the allocation in bytes.
+	 * \return The locked memory, or \c nullptr if the allocation can never fit or the lock failed.
+	 */
+	[[nodiscard]] BYTE* lock(UINT size, UINT alignment, UINT& offset)
+	{
+		if (m_buffer == nullptr || size == 0 || size > m_capacity)
+		{
+			return nullptr;
+		}
+
+		uint64_t aligned = align_up(static_cast<uint64_t>(m_offset), alignment);
+
+		if (aligned + size > m_capacity)
+		{
+			aligned         = 0;
+			m_needs_discard = true;
+		}
+
+		const DWORD flags = m_needs_discard ? D3DLOCK_DISCARD : D3DLOCK_NOOVERWRITE;
+
+		BYTE* data = nullptr;
+
+		if (FAILED(m_buffer->Lock(static_cast<UINT>(aligned), size, &data, flags)))
+		{
+			return nullptr;
+		}
+
+		m_needs_discard = false;
+		m_offset        = static_cast<UINT>(aligned) + size;
+		offset          = static_cast<UINT>(aligned);
+		return data;
+	}
+
+private:
+	Microsoft::WRL::ComPtr<T> m_buffer;
+	UINT m_capacity = 0;
+	UINT m_offset = 0;
+	bool m_needs_discard = true;
+};
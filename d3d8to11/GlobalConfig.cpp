@@ -109,6 +109,16 @@ const std::filesystem::path& GlobalConfig::get_shader_cache_variants_file_path()
 	return m_shader_cache_variants_file_path;
 }
 
+const std::filesystem::path& GlobalConfig::get_shader_cache_pack_file_path()
+{
+	return m_shader_cache_pack_file_path;
+}
+
+const std::filesystem::path& GlobalConfig::get_state_object_keys_file_path()
+{
+	return m_state_object_keys_file_path;
+}
+
 const std::filesystem::path& GlobalConfig::get_shader_source_dir()
 {
 	return m_shader_source_dir;
@@ -195,6 +205,8 @@ void GlobalConfig::set_paths()
 
 	// TODO: if m_shader_cache_variants_file_path ends up empty, report some kind of error
 	m_shader_cache_variants_file_path = maybe_extended_length_or_empty(m_shader_cache_dir / "permutations.bin");
+	m_shader_cache_pack_file_path     = maybe_extended_length_or_empty(m_shader_cache_dir / "shaders.pack");
+	m_state_object_keys_file_path     = maybe_extended_length_or_empty(m_shader_cache_dir / "states.bin");
 
 	{
 		std::filesystem::path env_shader_source_dir = maybe_extended_length_or_empty(read_environment_variable(SHADER_SOURCE_DIR_ENV_NAME));
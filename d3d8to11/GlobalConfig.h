@@ -19,6 +19,8 @@ public:
 
 	[[nodiscard]] const std::filesystem::path& get_shader_cache_dir();
 	[[nodiscard]] const std::filesystem::path& get_shader_cache_variants_file_path();
+	[[nodiscard]] const std::filesystem::path& get_shader_cache_pack_file_path();
+	[[nodiscard]] const std::filesystem::path& get_state_object_keys_file_path();
 	[[nodiscard]] const std::filesystem::path& get_shader_source_dir();
 
 	[[nodiscard]] OITConfig& get_oit_config();
@@ -30,6 +32,8 @@ private:
 	std::filesystem::path m_config_file_path;
 	std::filesystem::path m_shader_cache_dir;
 	std::filesystem::path m_shader_cache_variants_file_path;
+	std::filesystem::path m_shader_cache_pack_file_path;
+	std::filesystem::path m_state_object_keys_file_path;
 	std::filesystem::path m_shader_source_dir;
 
 	OITConfig m_oit_config;
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+/**
+ * \brief Bounded lock-free multi-producer multi-consumer FIFO queue (Vyukov).
+ * \tparam T A trivially copyable type.
+ */
+template <typename T>
+class MpmcQueue
+{
+	static_assert(std::is_trivially_copyable_v<T>);
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+public:
+	/**
+	 * \param capacity The maximum number of elements. Must be a power of two.
+	 */
+	explicit MpmcQueue(size_t capacity)
+		: m_mask(capacity - 1),
+		  m_cells(std::make_unique<Cell[]>(capacity))
+	{
+		for (size_t i = 0; i < capacity; ++i)
+		{
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	MpmcQueue(const MpmcQueue&)     = delete;
+	MpmcQueue(MpmcQueue&&) noexcept = delete;
+
+	MpmcQueue& operator=(const MpmcQueue&)     = delete;
+	MpmcQueue& operator=(MpmcQueue&&) noexcept = delete;
+
+	/**
+	 * \return \c false if the queue is full.
+	 */
+	bool try_push(T value)
+	{
+		Cell* cell;
+		size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			cell = &m_cells[pos & m_mask];
+			const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+			if (diff == 0)
+			{
+				if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = m_enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->data = value;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \return \c false if the queue is empty.
+	 */
+	bool try_pop(T& value)
+	{
+		Cell* cell;
+		size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			cell = &m_cells[pos & m_mask];
+			const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+			if (diff == 0)
+			{
+				if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = m_dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = cell->data;
+		cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	const size_t m_mask;
+	std::unique_ptr<Cell[]> m_cells;
+
+	alignas(64) std::atomic<size_t> m_enqueue_pos { 0 };
+	alignas(64) std::atomic<size_t> m_dequeue_pos { 0 };
+};
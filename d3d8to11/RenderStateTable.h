@@ -0,0 +1,427 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+#include "d3d8types.hpp"
+#include "DepthStencilFlags.h"
+#include "RasterFlags.h"
+#include "ShaderFlags.h"
+#include "simple_math.h"
+
+constexpr size_t RENDER_STATE_COUNT = D3DRS_NORMALORDER + 1;
+
+// where D3DRS_COLORWRITEENABLE is stored in the blend flags
+constexpr uint32_t BLEND_COLORMASK_SHIFT = 28;
+
+/**
+ * \brief The state a render state is translated into.
+ */
+struct RenderStateGroup
+{
+	using type = uint32_t;
+
+	enum T : type
+	{
+		none          = 0,
+		blend         = 1 << 0, // m_blend_flags
+		depth_stencil = 1 << 1, // m_depth_stencil_flags and D3DRS_STENCILREF
+		raster        = 1 << 2, // m_raster_flags
+		per_pixel     = 1 << 3, // m_per_pixel
+		per_model     = 1 << 4, // m_per_model
+		shader_flags  = 1 << 5, // m_shader_flags
+	};
+};
+
+/**
+ * \brief \c SetRenderState, dispatched through a table of handlers indexed by render state.
+ *
+ * Templated on what the render states are written to so that the benchmarks can replay render states
+ * through the same code as \c Direct3DDevice8. \p Device provides the members named in \c RenderStateGroup,
+ * \c m_render_state_values, \c m_applied_render_states and \c log_unhandled_render_state, and must befriend this class
+ * if they aren't public.
+ */
+template <typename Device>
+class RenderStateTable
+{
+public:
+	using Handler = HRESULT (*)(Device& device, DWORD value);
+
+	struct Info
+	{
+		Handler handler = nullptr; // nullptr if the value is only stored
+		RenderStateGroup::type groups = RenderStateGroup::none;
+		std::string_view name;
+	};
+
+	static const std::array<Info, RENDER_STATE_COUNT> TABLE;
+
+	/**
+	 * \brief Stores \p value for \p state and translates it into the state of \p device,
+	 * unless \p state was already set to \p value.
+	 */
+	static HRESULT set(Device& device, D3DRENDERSTATETYPE state, DWORD value);
+
+private:
+	static constexpr std::array<Info, RENDER_STATE_COUNT> make_table();
+
+	template <StencilFlags::type shift>
+	static HRESULT set_stencil_op(Device& device, DWORD value);
+	template <StencilFlags::type shift>
+	static HRESULT set_stencil_mask(Device& device, DWORD value);
+	template <ShaderFlags::type flag>
+	static HRESULT set_shader_flag(Device& device, DWORD value);
+	template <DepthStencilFlags::type flag>
+	static HRESULT set_depth_stencil_flag(Device& device, DWORD value);
+};
+
+template <typename Device>
+template <StencilFlags::type shift>
+HRESULT RenderStateTable<Device>::set_stencil_op(Device& device, DWORD value)
+{
+	auto flags = device.m_depth_stencil_flags.stencil_flags.data();
+	flags &= ~(StencilFlags::op_mask << shift);
+	flags |= (value & StencilFlags::op_mask) << shift;
+	device.m_depth_stencil_flags.stencil_flags = flags;
+	return D3D_OK;
+}
+
+template <typename Device>
+template <StencilFlags::type shift>
+HRESULT RenderStateTable<Device>::set_stencil_mask(Device& device, DWORD value)
+{
+	auto flags = device.m_depth_stencil_flags.stencil_flags.data();
+	flags &= ~(StencilFlags::rw_mask << shift);
+	flags |= (value & StencilFlags::rw_mask) << shift;
+	device.m_depth_stencil_flags.stencil_flags = flags;
+	return D3D_OK;
+}
+
+template <typename Device>
+template <ShaderFlags::type flag>
+HRESULT RenderStateTable<Device>::set_shader_flag(Device& device, DWORD value)
+{
+	if (value != 0)
+	{
+		device.m_shader_flags |= flag;
+	}
+	else
+	{
+		device.m_shader_flags &= ~flag;
+	}
+
+	return D3D_OK;
+}
+
+template <typename Device>
+template <DepthStencilFlags::type flag>
+HRESULT RenderStateTable<Device>::set_depth_stencil_flag(Device& device, DWORD value)
+{
+	if (value)
+	{
+		device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() | flag;
+	}
+	else
+	{
+		device.m_depth_stencil_flags.flags = device.m_depth_stencil_flags.flags.data() & ~flag;
+	}
+
+	return D3D_OK;
+}
+
+template <typename Device>
+constexpr std::array<typename RenderStateTable<Device>::Info, RENDER_STATE_COUNT> RenderStateTable<Device>::make_table()
+{
+	std::array<Info, RENDER_STATE_COUNT> table {};
+
+	auto add = [&](D3DRENDERSTATETYPE state, std::string_view name, RenderStateGroup::type groups = RenderStateGroup::none,
+	               Handler handler = nullptr)
+	{
+		table[state] = { handler, groups, name };
+	};
+
+	// stored for GetRenderState, but otherwise unhandled
+	add(D3DRS_SHADEMODE,                "D3DRS_SHADEMODE");
+	add(D3DRS_LINEPATTERN,              "D3DRS_LINEPATTERN");
+	add(D3DRS_LASTPIXEL,                "D3DRS_LASTPIXEL");
+	add(D3DRS_DITHERENABLE,             "D3DRS_DITHERENABLE");
+	add(D3DRS_ZVISIBLE,                 "D3DRS_ZVISIBLE");
+	add(D3DRS_EDGEANTIALIAS,            "D3DRS_EDGEANTIALIAS");
+	add(D3DRS_ZBIAS,                    "D3DRS_ZBIAS");
+	add(D3DRS_RANGEFOGENABLE,           "D3DRS_RANGEFOGENABLE");
+	add(D3DRS_WRAP0,                    "D3DRS_WRAP0");
+	add(D3DRS_WRAP1,                    "D3DRS_WRAP1");
+	add(D3DRS_WRAP2,                    "D3DRS_WRAP2");
+	add(D3DRS_WRAP3,                    "D3DRS_WRAP3");
+	add(D3DRS_WRAP4,                    "D3DRS_WRAP4");
+	add(D3DRS_WRAP5,                    "D3DRS_WRAP5");
+	add(D3DRS_WRAP6,                    "D3DRS_WRAP6");
+	add(D3DRS_WRAP7,                    "D3DRS_WRAP7");
+	add(D3DRS_CLIPPING,                 "D3DRS_CLIPPING");
+	add(D3DRS_FOGVERTEXMODE,            "D3DRS_FOGVERTEXMODE");
+	add(D3DRS_LOCALVIEWER,              "D3DRS_LOCALVIEWER");
+	add(D3DRS_NORMALIZENORMALS,         "D3DRS_NORMALIZENORMALS");
+	add(D3DRS_VERTEXBLEND,              "D3DRS_VERTEXBLEND");
+	add(D3DRS_CLIPPLANEENABLE,          "D3DRS_CLIPPLANEENABLE");
+	add(D3DRS_SOFTWAREVERTEXPROCESSING, "D3DRS_SOFTWAREVERTEXPROCESSING");
+	add(D3DRS_POINTSIZE,                "D3DRS_POINTSIZE");
+	add(D3DRS_POINTSIZE_MIN,            "D3DRS_POINTSIZE_MIN");
+	add(D3DRS_POINTSPRITEENABLE,        "D3DRS_POINTSPRITEENABLE");
+	add(D3DRS_POINTSCALEENABLE,         "D3DRS_POINTSCALEENABLE");
+	add(D3DRS_POINTSCALE_A,             "D3DRS_POINTSCALE_A");
+	add(D3DRS_POINTSCALE_B,             "D3DRS_POINTSCALE_B");
+	add(D3DRS_POINTSCALE_C,             "D3DRS_POINTSCALE_C");
+	add(D3DRS_MULTISAMPLEANTIALIAS,     "D3DRS_MULTISAMPLEANTIALIAS");
+	add(D3DRS_MULTISAMPLEMASK,          "D3DRS_MULTISAMPLEMASK");
+	add(D3DRS_PATCHEDGESTYLE,           "D3DRS_PATCHEDGESTYLE");
+	add(D3DRS_PATCHSEGMENTS,            "D3DRS_PATCHSEGMENTS");
+	add(D3DRS_DEBUGMONITORTOKEN,        "D3DRS_DEBUGMONITORTOKEN");
+	add(D3DRS_POINTSIZE_MAX,            "D3DRS_POINTSIZE_MAX");
+	add(D3DRS_INDEXEDVERTEXBLENDENABLE, "D3DRS_INDEXEDVERTEXBLENDENABLE");
+	add(D3DRS_TWEENFACTOR,              "D3DRS_TWEENFACTOR");
+	add(D3DRS_POSITIONORDER,            "D3DRS_POSITIONORDER");
+	add(D3DRS_NORMALORDER,              "D3DRS_NORMALORDER");
+
+	// read directly from m_render_state_values by update_depth
+	add(D3DRS_STENCILREF, "D3DRS_STENCILREF", RenderStateGroup::depth_stencil);
+
+	add(D3DRS_COLORWRITEENABLE, "D3DRS_COLORWRITEENABLE", RenderStateGroup::blend, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_blend_flags = (device.m_blend_flags.data() & ~(0xF << BLEND_COLORMASK_SHIFT)) | ((value & 0xF) << BLEND_COLORMASK_SHIFT);
+		return D3D_OK;
+	});
+
+	add(D3DRS_TEXTUREFACTOR, "D3DRS_TEXTUREFACTOR", RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.texture_factor = to_color4(value);
+		return D3D_OK;
+	});
+
+	add(D3DRS_FOGSTART, "D3DRS_FOGSTART", RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.fog_start = std::bit_cast<float>(value);
+		return D3D_OK;
+	});
+
+	add(D3DRS_FOGEND, "D3DRS_FOGEND", RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.fog_end = std::bit_cast<float>(value);
+		return D3D_OK;
+	});
+
+	add(D3DRS_FOGCOLOR, "D3DRS_FOGCOLOR", RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.fog_color = to_color4(value);
+		return D3D_OK;
+	});
+
+	add(D3DRS_FOGDENSITY, "D3DRS_FOGDENSITY", RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.fog_density = std::bit_cast<float>(value);
+		return D3D_OK;
+	});
+
+	add(D3DRS_FOGTABLEMODE, "D3DRS_FOGTABLEMODE", RenderStateGroup::shader_flags, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_shader_flags &= ~ShaderFlags::rs_fog_mode_mask;
+		device.m_shader_flags |= (static_cast<ShaderFlags::type>(value) << ShaderFlags::rs_fog_mode_shift) & ShaderFlags::rs_fog_mode_mask;
+		return D3D_OK;
+	});
+
+	add(D3DRS_SPECULARENABLE,  "D3DRS_SPECULARENABLE",  RenderStateGroup::shader_flags, &set_shader_flag<ShaderFlags::rs_specular>);
+	add(D3DRS_FOGENABLE,       "D3DRS_FOGENABLE",       RenderStateGroup::shader_flags, &set_shader_flag<ShaderFlags::rs_fog>);
+	add(D3DRS_ALPHATESTENABLE, "D3DRS_ALPHATESTENABLE", RenderStateGroup::shader_flags, &set_shader_flag<ShaderFlags::rs_alpha_test>);
+
+	add(D3DRS_LIGHTING, "D3DRS_LIGHTING", RenderStateGroup::shader_flags, [](Device& device, DWORD value) -> HRESULT
+	{
+		return set_shader_flag<ShaderFlags::rs_lighting>(device, value == 1);
+	});
+
+	add(D3DRS_ALPHAFUNC, "D3DRS_ALPHAFUNC", RenderStateGroup::shader_flags, [](Device& device, DWORD value) -> HRESULT
+	{
+		if (!value)
+		{
+			return D3DERR_INVALIDCALL;
+		}
+
+		device.m_shader_flags &= ~ShaderFlags::rs_alpha_test_mode_mask;
+		device.m_shader_flags |= (static_cast<ShaderFlags::type>(value) << ShaderFlags::rs_alpha_test_mode_shift) & ShaderFlags::rs_alpha_test_mode_mask;
+		return D3D_OK;
+	});
+
+	add(D3DRS_ALPHAREF, "D3DRS_ALPHAREF", RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.alpha_test_reference = static_cast<float>(value) / 255.0f;
+		return D3D_OK;
+	});
+
+	add(D3DRS_CULLMODE, "D3DRS_CULLMODE", RenderStateGroup::raster, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_raster_flags = (device.m_raster_flags.data() & ~RasterFlags::cull_mask) | (value & 3);
+		return D3D_OK;
+	});
+
+	add(D3DRS_FILLMODE, "D3DRS_FILLMODE", RenderStateGroup::raster, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_raster_flags = (device.m_raster_flags.data() & ~RasterFlags::fill_mask) | ((value & 3) << 2);
+		return D3D_OK;
+	});
+
+	add(D3DRS_ZENABLE,       "D3DRS_ZENABLE",       RenderStateGroup::depth_stencil, &set_depth_stencil_flag<DepthStencilFlags::depth_test_enabled>);
+	add(D3DRS_ZWRITEENABLE,  "D3DRS_ZWRITEENABLE",  RenderStateGroup::depth_stencil, &set_depth_stencil_flag<DepthStencilFlags::depth_write_enabled>);
+	add(D3DRS_STENCILENABLE, "D3DRS_STENCILENABLE", RenderStateGroup::depth_stencil, &set_depth_stencil_flag<DepthStencilFlags::stencil_enabled>);
+
+	add(D3DRS_ZFUNC, "D3DRS_ZFUNC", RenderStateGroup::depth_stencil, [](Device& device, DWORD value) -> HRESULT
+	{
+		if (!value)
+		{
+			return D3DERR_INVALIDCALL;
+		}
+
+		device.m_depth_stencil_flags.depth_flags = (device.m_depth_stencil_flags.depth_flags.data() & ~DepthFlags::comparison_mask) | value;
+		return D3D_OK;
+	});
+
+	add(D3DRS_STENCILFAIL,      "D3DRS_STENCILFAIL",      RenderStateGroup::depth_stencil, &set_stencil_op<StencilFlags::fail_shift>);
+	add(D3DRS_STENCILZFAIL,     "D3DRS_STENCILZFAIL",     RenderStateGroup::depth_stencil, &set_stencil_op<StencilFlags::zfail_shift>);
+	add(D3DRS_STENCILPASS,      "D3DRS_STENCILPASS",      RenderStateGroup::depth_stencil, &set_stencil_op<StencilFlags::pass_shift>);
+	add(D3DRS_STENCILFUNC,      "D3DRS_STENCILFUNC",      RenderStateGroup::depth_stencil, &set_stencil_op<StencilFlags::func_shift>);
+	add(D3DRS_STENCILMASK,      "D3DRS_STENCILMASK",      RenderStateGroup::depth_stencil, &set_stencil_mask<StencilFlags::read_shift>);
+	add(D3DRS_STENCILWRITEMASK, "D3DRS_STENCILWRITEMASK", RenderStateGroup::depth_stencil, &set_stencil_mask<StencilFlags::write_shift>);
+
+	add(D3DRS_AMBIENT, "D3DRS_AMBIENT", RenderStateGroup::per_model, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_model.ambient = to_color4(value);
+		return D3D_OK;
+	});
+
+	add(D3DRS_DIFFUSEMATERIALSOURCE, "D3DRS_DIFFUSEMATERIALSOURCE", RenderStateGroup::per_model, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_model.material_sources.diffuse = value;
+		return D3D_OK;
+	});
+
+	add(D3DRS_SPECULARMATERIALSOURCE, "D3DRS_SPECULARMATERIALSOURCE", RenderStateGroup::per_model, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_model.material_sources.specular = value;
+		return D3D_OK;
+	});
+
+	add(D3DRS_AMBIENTMATERIALSOURCE, "D3DRS_AMBIENTMATERIALSOURCE", RenderStateGroup::per_model, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_model.material_sources.ambient = value;
+		return D3D_OK;
+	});
+
+	add(D3DRS_EMISSIVEMATERIALSOURCE, "D3DRS_EMISSIVEMATERIALSOURCE", RenderStateGroup::per_model, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_model.material_sources.emissive = value;
+		return D3D_OK;
+	});
+
+	add(D3DRS_COLORVERTEX, "D3DRS_COLORVERTEX", RenderStateGroup::per_model, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_model.color_vertex = !!value;
+		return D3D_OK;
+	});
+
+	add(D3DRS_SRCBLEND, "D3DRS_SRCBLEND", RenderStateGroup::blend | RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.src_blend = value;
+		device.m_blend_flags = (device.m_blend_flags.data() & ~0x0F) | value;
+		return D3D_OK;
+	});
+
+	add(D3DRS_DESTBLEND, "D3DRS_DESTBLEND", RenderStateGroup::blend | RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_per_pixel.dst_blend = value;
+		device.m_blend_flags = (device.m_blend_flags.data() & ~0xF0) | (value << 4);
+		return D3D_OK;
+	});
+
+	add(D3DRS_ALPHABLENDENABLE, "D3DRS_ALPHABLENDENABLE", RenderStateGroup::blend | RenderStateGroup::shader_flags, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_blend_flags = (device.m_blend_flags.data() & ~0x8000) | (value ? 0x8000 : 0);
+		return set_shader_flag<ShaderFlags::rs_alpha>(device, value == 1);
+	});
+
+	add(D3DRS_BLENDOP, "D3DRS_BLENDOP", RenderStateGroup::blend | RenderStateGroup::per_pixel, [](Device& device, DWORD value) -> HRESULT
+	{
+		device.m_blend_flags = (device.m_blend_flags.data() & ~0xF00) | (value << 8);
+		device.m_per_pixel.blend_op = value;
+		return D3D_OK;
+	});
+
+	return table;
+}
+
+template <typename Device>
+constinit const std::array<typename RenderStateTable<Device>::Info, RENDER_STATE_COUNT> RenderStateTable<Device>::TABLE =
+	make_table();
+
+template <typename Device>
+HRESULT RenderStateTable<Device>::set(Device& device, D3DRENDERSTATETYPE state, DWORD value)
+{
+	switch (static_cast<DWORD>(state))
+	{
+		case D3DRS_LINEPATTERN:
+		case D3DRS_ZVISIBLE:
+		case D3DRS_EDGEANTIALIAS:
+		case D3DRS_PATCHSEGMENTS:
+		case D3DRS_CLIPPLANEENABLE:
+		case D3DRS_ZBIAS:
+			return D3DERR_INVALIDCALL;
+
+		case D3DRS_SOFTWAREVERTEXPROCESSING:
+			return D3D_OK;
+
+		default:
+			break;
+	}
+
+	if (state < D3DRS_ZENABLE || state > D3DRS_NORMALORDER)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	// even if we do custom handling for a render state, we
+	// store its value so the caller can retrieve it later in
+	// Direct3DDevice8::GetRenderState
+	auto& ref = device.m_render_state_values[state];
+
+	// setting a render state to the value it already has can't change anything it feeds into
+	if (device.m_applied_render_states[state] && ref.data() == value)
+	{
+		return D3D_OK;
+	}
+
+	const Info& info = TABLE[state];
+
+	if (info.handler != nullptr)
+	{
+		const HRESULT result = info.handler(device, value);
+
+		if (FAILED(result))
+		{
+			return result;
+		}
+
+		ref = value;
+		ref.clear();
+	}
+	else
+	{
+		ref = value;
+
+		if (info.groups == RenderStateGroup::none && ref.dirty())
+		{
+			ref.clear();
+			device.log_unhandled_render_state(state, value);
+		}
+	}
+
+	device.m_applied_render_states[state] = true;
+	return D3D_OK;
+}
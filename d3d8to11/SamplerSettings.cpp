@@ -1,68 +1,147 @@
 #include "pch.h"
 
+#include <algorithm>
+#include <bit>
+
 #include "SamplerSettings.h"
 
 SamplerSettings::SamplerSettings()
 {
-	address_u = D3DTADDRESS_WRAP;
-	address_v = D3DTADDRESS_WRAP;
-	address_w = D3DTADDRESS_WRAP;
-	filter_mag = D3DTEXF_POINT;
-	filter_min = D3DTEXF_POINT;
-	filter_mip = D3DTEXF_NONE;
-	mip_lod_bias = 0.0f;
-	max_mip_level = 0;
-	max_anisotropy = 1;
+	address_u(D3DTADDRESS_WRAP);
+	address_v(D3DTADDRESS_WRAP);
+	address_w(D3DTADDRESS_WRAP);
+	filter_mag(D3DTEXF_POINT);
+	filter_min(D3DTEXF_POINT);
+	filter_mip(D3DTEXF_NONE);
+	mip_lod_bias(0.0f);
+	max_mip_level(0);
+	max_anisotropy(1);
 }
 
 bool SamplerSettings::operator==(const SamplerSettings& s) const
 {
-	return address_u.data() == s.address_u.data() &&
-	       address_v.data() == s.address_v.data() &&
-	       address_w.data() == s.address_w.data() &&
-	       filter_mag.data() == s.filter_mag.data() &&
-	       filter_min.data() == s.filter_min.data() &&
-	       filter_mip.data() == s.filter_mip.data() &&
-	       mip_lod_bias.data() == s.mip_lod_bias.data() &&
-	       max_mip_level.data() == s.max_mip_level.data() &&
-	       max_anisotropy.data() == s.max_anisotropy.data();
+	return key.data() == s.key.data();
 }
 
 bool SamplerSettings::dirty() const
 {
-	return address_u.dirty() ||
-	       address_v.dirty() ||
-	       address_w.dirty() ||
-	       filter_mag.dirty() ||
-	       filter_min.dirty() ||
-	       filter_mip.dirty() ||
-	       mip_lod_bias.dirty() ||
-	       max_mip_level.dirty() ||
-	       max_anisotropy.dirty();
+	return key.dirty();
 }
 
 void SamplerSettings::clear()
 {
-	address_u.clear();
-	address_v.clear();
-	address_w.clear();
-	filter_mag.clear();
-	filter_min.clear();
-	filter_mip.clear();
-	mip_lod_bias.clear();
-	max_mip_level.clear();
-	max_anisotropy.clear();
+	key.clear();
 }
 
 void SamplerSettings::mark()
 {
-	address_u.mark();
-	address_v.mark();
-	address_w.mark();
-	filter_mag.mark();
-	filter_min.mark();
-	filter_mip.mark();
-	mip_lod_bias.mark();
-	max_mip_level.mark();
-	max_anisotropy.mark();
+	key.mark();
+}
+
+D3DTEXTUREADDRESS SamplerSettings::address_u() const
+{
+	return static_cast<D3DTEXTUREADDRESS>(get(address_u_shift, address_mask));
+}
+
+D3DTEXTUREADDRESS SamplerSettings::address_v() const
+{
+	return static_cast<D3DTEXTUREADDRESS>(get(address_v_shift, address_mask));
+}
+
+D3DTEXTUREADDRESS SamplerSettings::address_w() const
+{
+	return static_cast<D3DTEXTUREADDRESS>(get(address_w_shift, address_mask));
+}
+
+D3DTEXTUREFILTERTYPE SamplerSettings::filter_mag() const
+{
+	return static_cast<D3DTEXTUREFILTERTYPE>(get(filter_mag_shift, filter_mask));
+}
+
+D3DTEXTUREFILTERTYPE SamplerSettings::filter_min() const
+{
+	return static_cast<D3DTEXTUREFILTERTYPE>(get(filter_min_shift, filter_mask));
+}
+
+D3DTEXTUREFILTERTYPE SamplerSettings::filter_mip() const
+{
+	return static_cast<D3DTEXTUREFILTERTYPE>(get(filter_mip_shift, filter_mask));
+}
+
+uint32_t SamplerSettings::max_anisotropy() const
+{
+	return static_cast<uint32_t>(get(max_anisotropy_shift, max_anisotropy_mask));
+}
+
+uint32_t SamplerSettings::max_mip_level() const
+{
+	return static_cast<uint32_t>(get(max_mip_level_shift, max_mip_level_mask));
+}
+
+float SamplerSettings::mip_lod_bias() const
+{
+	return std::bit_cast<float>(static_cast<uint32_t>(key.data() >> mip_lod_bias_shift));
+}
+
+void SamplerSettings::address_u(D3DTEXTUREADDRESS value)
+{
+	set(address_u_shift, address_mask, value);
+}
+
+void SamplerSettings::address_v(D3DTEXTUREADDRESS value)
+{
+	set(address_v_shift, address_mask, value);
+}
+
+void SamplerSettings::address_w(D3DTEXTUREADDRESS value)
+{
+	set(address_w_shift, address_mask, value);
+}
+
+void SamplerSettings::filter_mag(D3DTEXTUREFILTERTYPE value)
+{
+	set(filter_mag_shift, filter_mask, value);
+}
+
+void SamplerSettings::filter_min(D3DTEXTUREFILTERTYPE value)
+{
+	set(filter_min_shift, filter_mask, value);
+}
+
+void SamplerSettings::filter_mip(D3DTEXTUREFILTERTYPE value)
+{
+	set(filter_mip_shift, filter_mask, value);
+}
+
+void SamplerSettings::max_anisotropy(uint32_t value)
+{
+	set(max_anisotropy_shift, max_anisotropy_mask, std::min(value, 16u));
+}
+
+void SamplerSettings::max_mip_level(uint32_t value)
+{
+	set(max_mip_level_shift, max_mip_level_mask, std::min(value, static_cast<uint32_t>(max_mip_level_mask)));
+}
+
+void SamplerSettings::mip_lod_bias(float value)
+{
+	const type bits = static_cast<type>(std::bit_cast<uint32_t>(value)) << mip_lod_bias_shift;
+	key = (key.data() & ~(type(0xFFFFFFFF) << mip_lod_bias_shift)) | bits;
+}
+
+SamplerSettings SamplerSettings::from_key(type key)
+{
+	SamplerSettings result;
+	result.key = key;
+	return result;
+}
+
+SamplerSettings::type SamplerSettings::get(type shift, type mask) const
+{
+	return (key.data() >> shift) & mask;
+}
+
+void SamplerSettings::set(type shift, type mask, type value)
+{
+	key = (key.data() & ~(mask << shift)) | ((value & mask) << shift);
 }
@@ -1,17 +1,39 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 
 #include <dirty_t.h>
 
-#include "hash_combine.h"
-
+/**
+ * \brief The sampler state of one texture stage, packed into a single 64-bit key.
+ *
+ * Bits 0-8 hold the U, V and W address modes, bits 9-17 the mag, min and mip filters,
+ * bits 18-22 the max anisotropy, bits 23-30 the max mip level and bits 32-63 the bits of the mip LOD bias.
+ */
 struct SamplerSettings : dirty_impl
 {
-	dirty_t<D3DTEXTUREADDRESS> address_u, address_v, address_w;
-	dirty_t<D3DTEXTUREFILTERTYPE> filter_mag, filter_min, filter_mip;
-	dirty_t<float> mip_lod_bias;
-	dirty_t<uint32_t> max_mip_level, max_anisotropy;
+	using type = uint64_t;
+
+	static constexpr type address_mask    = 0x7;
+	static constexpr type address_u_shift = 0;
+	static constexpr type address_v_shift = 3;
+	static constexpr type address_w_shift = 6;
+
+	static constexpr type filter_mask      = 0x7;
+	static constexpr type filter_mag_shift = 9;
+	static constexpr type filter_min_shift = 12;
+	static constexpr type filter_mip_shift = 15;
+
+	static constexpr type max_anisotropy_mask  = 0x1F;
+	static constexpr type max_anisotropy_shift = 18;
+
+	static constexpr type max_mip_level_mask  = 0xFF;
+	static constexpr type max_mip_level_shift = 23;
+
+	static constexpr type mip_lod_bias_shift = 32;
+
+	dirty_t<type> key;
 
 	SamplerSettings();
 
@@ -20,6 +42,34 @@ struct SamplerSettings : dirty_impl
 	[[nodiscard]] bool dirty() const override;
 	void clear() override;
 	void mark() override;
+
+	[[nodiscard]] D3DTEXTUREADDRESS address_u() const;
+	[[nodiscard]] D3DTEXTUREADDRESS address_v() const;
+	[[nodiscard]] D3DTEXTUREADDRESS address_w() const;
+	[[nodiscard]] D3DTEXTUREFILTERTYPE filter_mag() const;
+	[[nodiscard]] D3DTEXTUREFILTERTYPE filter_min() const;
+	[[nodiscard]] D3DTEXTUREFILTERTYPE filter_mip() const;
+	[[nodiscard]] uint32_t max_anisotropy() const;
+	[[nodiscard]] uint32_t max_mip_level() const;
+	[[nodiscard]] float mip_lod_bias() const;
+
+	void address_u(D3DTEXTUREADDRESS value);
+	void address_v(D3DTEXTUREADDRESS value);
+	void address_w(D3DTEXTUREADDRESS value);
+	void filter_mag(D3DTEXTUREFILTERTYPE value);
+	void filter_min(D3DTEXTUREFILTERTYPE value);
+	void filter_mip(D3DTEXTUREFILTERTYPE value);
+	// clamped to 16, the maximum reported in the device caps
+	void max_anisotropy(uint32_t value);
+	// clamped to 255, far more levels than a texture can have
+	void max_mip_level(uint32_t value);
+	void mip_lod_bias(float value);
+
+	[[nodiscard]] static SamplerSettings from_key(type key);
+
+private:
+	[[nodiscard]] type get(type shift, type mask) const;
+	void set(type shift, type mask, type value);
 };
 
 template <>
@@ -27,17 +77,6 @@ struct std::hash<SamplerSettings>
 {
 	std::size_t operator()(const SamplerSettings& s) const noexcept
 	{
-		size_t h = std::hash<size_t>()(s.address_u.data());
-
-		hash_combine(h, static_cast<size_t>(s.address_v.data()));
-		hash_combine(h, static_cast<size_t>(s.address_w.data()));
-		hash_combine(h, static_cast<size_t>(s.filter_mag.data()));
-		hash_combine(h, static_cast<size_t>(s.filter_min.data()));
-		hash_combine(h, static_cast<size_t>(s.filter_mip.data()));
-		hash_combine(h, s.mip_lod_bias.data());
-		hash_combine(h, static_cast<size_t>(s.max_mip_level.data()));
-		hash_combine(h, static_cast<size_t>(s.max_anisotropy.data()));
-
-		return h;
+		return std::hash<SamplerSettings::type>()(s.key.data());
 	}
 };
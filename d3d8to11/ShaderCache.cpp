@@ -0,0 +1,273 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <fstream>
+#include <ranges>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "filesystem.h"
+#include "fnv1a.h"
+#include "ShaderIncluder.h"
+
+#include "ShaderCache.h"
+
+using namespace Microsoft::WRL;
+
+namespace fs = d3d8to11::filesystem;
+
+uint64_t ShaderCacheKey::hash() const
+{
+	uint64_t result = fnv1a_64_value(flags);
+	result = fnv1a_64_value(static_cast<uint8_t>(is_uber), result);
+	result = fnv1a_64(entry_point.data(), entry_point.size(), result);
+	result = fnv1a_64(profile.data(), profile.size(), result);
+	result = fnv1a_64_value(compiler_flags, result);
+
+	// only mixed in when set so that existing keys stay the same
+	if (translation_hash != 0)
+	{
+		result = fnv1a_64_value(translation_hash, result);
+	}
+
+	return result;
+}
+
+ShaderCache::ShaderCache(ShaderIncluder& includer)
+	: m_includer(includer)
+{
+}
+
+void ShaderCache::open(const std::filesystem::path& pack_path, const std::filesystem::path& legacy_permutations_path)
+{
+	if (m_pack.open(pack_path))
+	{
+		const std::string str = std::format("opened shader pack with {} permutation(s)\n", m_pack.get_permutations().size());
+		OutputDebugStringA(str.c_str());
+
+		prime_sources();
+
+		// imported first so that compaction drops their duplicates and invalid flags too
+		import_legacy_permutations(legacy_permutations_path);
+		compact();
+	}
+}
+
+void ShaderCache::import_legacy_permutations(const std::filesystem::path& path)
+{
+	if (path.empty() || !std::filesystem::exists(path))
+	{
+		return;
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	ShaderFlags::type flags = 0;
+
+	while (file.read(reinterpret_cast<char*>(&flags), sizeof(flags)))
+	{
+		std::ignore = add_permutation(flags);
+	}
+
+	file.close();
+
+	// only deleted once its contents are safely in the pack
+	if (m_pack.commit())
+	{
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+	}
+}
+
+void ShaderCache::compact()
+{
+	const ShaderPack::Stats before = m_pack.get_stats();
+	const std::vector<ShaderFlags::type> permutations = m_pack.get_permutations();
+
+	// a permutation is only ever used to derive these four keys, so two entries that
+	// produce the same four keys are redundant no matter how their other bits differ.
+	using PermutationKey = std::array<ShaderFlags::type, 4>;
+
+	std::vector<std::pair<PermutationKey, ShaderFlags::type>> keyed;
+	keyed.reserve(permutations.size());
+
+	size_t invalid_count = 0;
+
+	for (const ShaderFlags::type flags : permutations)
+	{
+		if ((flags & ~ShaderFlags::mask) != 0)
+		{
+			++invalid_count;
+			continue;
+		}
+
+		const ShaderFlags::type sanitized = ShaderFlags::sanitize(flags);
+
+		const PermutationKey key = {
+			ShaderFlags::sanitize(sanitized & ShaderFlags::vs_mask),
+			ShaderFlags::sanitize(sanitized & ShaderFlags::ps_mask),
+			ShaderFlags::sanitize(sanitized & ShaderFlags::uber_vs_mask),
+			ShaderFlags::sanitize(sanitized & ShaderFlags::uber_ps_mask)
+		};
+
+		keyed.emplace_back(key, sanitized);
+	}
+
+	std::ranges::sort(keyed);
+	const auto [first, last] = std::ranges::unique(keyed, {}, &decltype(keyed)::value_type::first);
+	keyed.erase(first, last);
+
+	std::vector<ShaderFlags::type> compacted;
+	compacted.reserve(keyed.size());
+
+	for (const ShaderFlags::type flags : keyed | std::views::values)
+	{
+		compacted.push_back(flags);
+	}
+
+	const bool permutations_shrank = compacted.size() != permutations.size();
+	const bool has_garbage = before.file_size > before.live_size + before.live_size / 4;
+
+	if (!permutations_shrank && !has_garbage)
+	{
+		return;
+	}
+
+	const uint64_t source_hash = m_includer.get_source_hash();
+	size_t stale_count = 0;
+
+	const bool compacted_pack = m_pack.compact(std::move(compacted), [&](const ShaderPack::IndexEntry& entry)
+	{
+		if (entry.source_hash != source_hash)
+		{
+			++stale_count;
+			return false;
+		}
+
+		return true;
+	});
+
+	if (!compacted_pack)
+	{
+		OutputDebugStringA("failed to compact shader pack\n");
+		return;
+	}
+
+	const ShaderPack::Stats after = m_pack.get_stats();
+
+	const std::string str =
+		std::format("compacted shader pack: {} -> {} permutation(s) ({} duplicate, {} invalid), "
+		            "{} -> {} bytecode entries ({} stale), {} -> {} bytes\n",
+		            before.permutation_count, after.permutation_count,
+		            permutations.size() - invalid_count - after.permutation_count, invalid_count,
+		            before.entry_count, after.entry_count, stale_count,
+		            before.file_size, after.file_size);
+
+	OutputDebugStringA(str.c_str());
+}
+
+bool ShaderCache::is_open() const
+{
+	return m_pack.is_open();
+}
+
+void ShaderCache::prime_sources()
+{
+	const std::filesystem::path base_directory = m_includer.get_base_directory();
+
+	for (const std::filesystem::path& path : m_pack.get_source_paths())
+	{
+		std::filesystem::path source_path = path.is_relative() ? base_directory / path : path;
+
+		if (fs::should_extend_length(source_path))
+		{
+			if (!fs::extended_length_paths_supported())
+			{
+				continue;
+			}
+
+			source_path = fs::as_extended_length(source_path);
+		}
+
+		// missing files are skipped; the resulting hash mismatch invalidates dependent entries.
+		if (std::filesystem::exists(source_path))
+		{
+			std::ignore = m_includer.get_shader_source(source_path);
+		}
+	}
+}
+
+ComPtr<ID3DBlob> ShaderCache::load(const ShaderCacheKey& key)
+{
+	if (!is_open())
+	{
+		return nullptr;
+	}
+
+	uint64_t source_hash = 0;
+	ComPtr<ID3DBlob> blob = m_pack.find(key.hash(), &source_hash);
+
+	if (blob == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (source_hash != m_includer.get_source_hash())
+	{
+		const std::string str = std::format("discarding stale cached shader 0x{:016X} ({})\n", key.flags, key.profile);
+		OutputDebugStringA(str.c_str());
+		return nullptr;
+	}
+
+	return blob;
+}
+
+void ShaderCache::store(const ShaderCacheKey& key, ID3DBlob* blob)
+{
+	if (!is_open() || blob == nullptr)
+	{
+		return;
+	}
+
+	m_pack.set_source_paths(m_includer.get_source_paths());
+	m_pack.insert(key.hash(), key.flags, m_includer.get_source_hash(), blob);
+
+	if (m_pack.pending_count() >= COMMIT_THRESHOLD)
+	{
+		flush();
+	}
+}
+
+bool ShaderCache::add_permutation(ShaderFlags::type flags)
+{
+	return is_open() && m_pack.add_permutation(flags);
+}
+
+std::vector<ShaderFlags::type> ShaderCache::get_permutations()
+{
+	return m_pack.get_permutations();
+}
+
+void ShaderCache::flush_if_due()
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	if (!m_pack.is_dirty() || (m_pack.pending_count() < COMMIT_THRESHOLD && now - m_last_commit < COMMIT_INTERVAL))
+	{
+		return;
+	}
+
+	m_last_commit = now;
+	flush();
+}
+
+void ShaderCache::flush()
+{
+	if (!m_pack.commit())
+	{
+		OutputDebugStringA("failed to write shader pack\n");
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include <d3dcommon.h>
+#include <wrl/client.h>
+
+#include "ShaderFlags.h"
+#include "ShaderPack.h"
+
+class ShaderIncluder;
+
+struct ShaderCacheKey
+{
+	ShaderFlags::type flags            = ShaderFlags::none;
+	bool              is_uber          = false;
+	std::string_view  entry_point;
+	std::string_view  profile;
+	uint32_t          compiler_flags   = 0;
+	// identifies the generated source of a translated shader; 0 for the fixed-function shaders
+	uint64_t          translation_hash = 0;
+
+	[[nodiscard]] uint64_t hash() const;
+};
+
+/**
+ * \brief Persistent cache of compiled shader bytecode and recorded shader permutations, backed by a \c ShaderPack.
+ *
+ * Each entry is stored alongside the source hash reported by the \c ShaderIncluder
+ * at the time it was compiled, so editing any served HLSL file invalidates it.
+ * The list of served source files is persisted so that the source hash can be
+ * computed on the next run before anything has been compiled.
+ */
+class ShaderCache
+{
+public:
+	/**
+	 * \brief Number of pending entries at which \c store commits them to disk without waiting for the next \c flush.
+	 */
+	static constexpr size_t COMMIT_THRESHOLD = 32;
+
+	/**
+	 * \brief How long \c flush_if_due lets fewer than \c COMMIT_THRESHOLD pending entries or permutations wait.
+	 */
+	static constexpr std::chrono::seconds COMMIT_INTERVAL { 10 };
+
+	explicit ShaderCache(ShaderIncluder& includer);
+
+	ShaderCache(const ShaderCache&)     = delete;
+	ShaderCache(ShaderCache&&) noexcept = delete;
+
+	ShaderCache& operator=(const ShaderCache&)     = delete;
+	ShaderCache& operator=(ShaderCache&&) noexcept = delete;
+
+	/**
+	 * \brief Opens the pack and compacts it.
+	 * \param legacy_permutations_path The separate file of raw permutation flags that older versions recorded.
+	 * If it exists, its permutations are imported before compacting and it is deleted.
+	 */
+	void open(const std::filesystem::path& pack_path, const std::filesystem::path& legacy_permutations_path);
+	[[nodiscard]] bool is_open() const;
+
+	/**
+	 * \brief Loads every source file listed in the manifest into the includer
+	 * so that \c ShaderIncluder::get_source_hash matches the previous run.
+	 */
+	void prime_sources();
+
+	[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> load(const ShaderCacheKey& key);
+	void store(const ShaderCacheKey& key, ID3DBlob* blob);
+
+	bool add_permutation(ShaderFlags::type flags);
+	[[nodiscard]] std::vector<ShaderFlags::type> get_permutations();
+
+	/**
+	 * \brief Commits pending entries and permutations.
+	 */
+	void flush();
+
+	/**
+	 * \brief Commits pending entries and permutations once \c COMMIT_THRESHOLD of them have piled up
+	 * or \c COMMIT_INTERVAL has passed since the last commit, so that warming up doesn't write the pack
+	 * every frame. Called by the device once per frame.
+	 */
+	void flush_if_due();
+
+private:
+	/**
+	 * \brief Drops invalid and redundant permutations and rewrites the pack if it has shrunk
+	 * or accumulated too much superseded data.
+	 */
+	void compact();
+
+	void import_legacy_permutations(const std::filesystem::path& path);
+
+	ShaderIncluder& m_includer;
+	ShaderPack m_pack;
+
+	// only touched by flush_if_due
+	std::chrono::steady_clock::time_point m_last_commit = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,329 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <d3dcompiler.h>
+
+#include <format>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+
+#include "defs.h"
+#include "filesystem.h"
+#include "ShaderCache.h"
+#include "ShaderIncluder.h"
+
+#include "ShaderCompiler.h"
+
+using namespace Microsoft::WRL;
+
+namespace fs = d3d8to11::filesystem;
+
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+
+ShaderCompiler::ShaderCompiler(ShaderIncluder& includer, ShaderCache& cache)
+	: m_includer(includer),
+	  m_cache(cache),
+	  m_oit_fragments_str(std::to_string(MAX_FRAGMENTS_DEFAULT))
+{
+	for (size_t i = 0; i < m_digit_strings.size(); ++i)
+	{
+		m_digit_strings[i] = std::to_string(i);
+	}
+}
+
+void ShaderCompiler::set_source_path(std::filesystem::path path)
+{
+	if (fs::should_extend_length(path))
+	{
+		path = fs::as_extended_length(path);
+	}
+
+	m_source_path = std::move(path);
+}
+
+void ShaderCompiler::set_oit_max_fragments(uint32_t max_fragments)
+{
+	std::unique_lock lock(m_definitions_mutex);
+
+	// the interned definitions point into the old string
+	for (auto& definitions : m_definitions)
+	{
+		definitions.clear();
+	}
+
+	m_oit_fragments_str = std::to_string(max_fragments);
+}
+
+const std::string& ShaderCompiler::get_digit_string(size_t value) const
+{
+	return m_digit_strings.at(value);
+}
+
+const std::vector<D3D_SHADER_MACRO>& ShaderCompiler::get_definitions(ShaderFlags::type flags, bool is_uber) const
+{
+	const ShaderFlags::type sanitized_flags = ShaderFlags::sanitize(flags);
+	auto& definitions = m_definitions[is_uber ? 1 : 0];
+
+	{
+		std::shared_lock lock(m_definitions_mutex);
+
+		const auto it = definitions.find(sanitized_flags);
+
+		if (it != definitions.end())
+		{
+			return it->second;
+		}
+	}
+
+	std::vector<D3D_SHADER_MACRO> built;
+	preprocess(sanitized_flags, is_uber, built);
+	built.shrink_to_fit();
+
+	std::unique_lock lock(m_definitions_mutex);
+	return definitions.try_emplace(sanitized_flags, std::move(built)).first->second;
+}
+
+void ShaderCompiler::preprocess(ShaderFlags::type sanitized_flags, bool is_uber, std::vector<D3D_SHADER_MACRO>& definitions) const
+{
+	static const std::array texcoord_size_strings = {
+		"FVF_TEXCOORD0_SIZE",
+		"FVF_TEXCOORD1_SIZE",
+		"FVF_TEXCOORD2_SIZE",
+		"FVF_TEXCOORD3_SIZE",
+		"FVF_TEXCOORD4_SIZE",
+		"FVF_TEXCOORD5_SIZE",
+		"FVF_TEXCOORD6_SIZE",
+		"FVF_TEXCOORD7_SIZE"
+	};
+
+	static const std::array texcoord_size_types = {
+		"FVF_TEXCOORD0_TYPE",
+		"FVF_TEXCOORD1_TYPE",
+		"FVF_TEXCOORD2_TYPE",
+		"FVF_TEXCOORD3_TYPE",
+		"FVF_TEXCOORD4_TYPE",
+		"FVF_TEXCOORD5_TYPE",
+		"FVF_TEXCOORD6_TYPE",
+		"FVF_TEXCOORD7_TYPE"
+	};
+
+	static const std::array texcoord_format_types = {
+		"float2",
+		"float3",
+		"float4",
+		"float1",
+	};
+
+	definitions.clear();
+	definitions.emplace_back("OIT_MAX_FRAGMENTS", m_oit_fragments_str.c_str());
+	definitions.emplace_back("TEXTURE_STAGE_MAX", TOSTRING(TEXTURE_STAGE_MAX));
+
+	auto uv_format = (sanitized_flags & ShaderFlags::fvf_texfmt) >> ShaderFlags::fvf_texfmt_shift;
+	const auto tex_count = static_cast<size_t>(((sanitized_flags & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT) & 0xF);
+
+	for (size_t i = 0; i < tex_count; i++)
+	{
+		const auto f = static_cast<size_t>(uv_format & 3u);
+		uv_format >>= ShaderFlags::fvf_texfmt_bits;
+
+		switch (f)
+		{
+			case D3DFVF_TEXTUREFORMAT2:
+				definitions.push_back({ texcoord_size_strings[i], "2" });
+				break;
+
+			case D3DFVF_TEXTUREFORMAT3:
+				definitions.push_back({ texcoord_size_strings[i], "3" });
+				break;
+
+			case D3DFVF_TEXTUREFORMAT4:
+				definitions.push_back({ texcoord_size_strings[i], "4" });
+				break;
+
+			case D3DFVF_TEXTUREFORMAT1:
+				definitions.push_back({ texcoord_size_strings[i], "1" });
+				break;
+
+			default:
+				continue;
+		}
+
+		definitions.push_back({ texcoord_size_types[i], texcoord_format_types[f] });
+	}
+
+	{
+		const size_t stage_count = (sanitized_flags & ShaderFlags::stage_count_mask) >> ShaderFlags::stage_count_shift;
+		const std::string& digit_string = m_digit_strings.at(stage_count);
+		definitions.push_back({ "TEXTURE_STAGE_COUNT", digit_string.c_str() });
+	}
+
+	if ((sanitized_flags & D3DFVF_POSITION_MASK) == D3DFVF_XYZRHW)
+	{
+		definitions.push_back({ "FVF_RHW", "1" });
+	}
+
+	if ((sanitized_flags & D3DFVF_POSITION_MASK) == D3DFVF_XYZ)
+	{
+		definitions.push_back({ "FVF_XYZ", "1" });
+	}
+
+	if ((sanitized_flags & D3DFVF_NORMAL) != 0)
+	{
+		definitions.push_back({ "FVF_NORMAL", "1" });
+	}
+
+	if ((sanitized_flags & D3DFVF_DIFFUSE) != 0)
+	{
+		definitions.push_back({ "FVF_DIFFUSE", "1" });
+	}
+
+	if ((sanitized_flags & D3DFVF_SPECULAR) != 0)
+	{
+		definitions.push_back({ "FVF_SPECULAR", "1" });
+	}
+
+	if (sanitized_flags & D3DFVF_TEXCOUNT_MASK)
+	{
+		const size_t texcount = (sanitized_flags & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT;
+		const std::string& digit_string = m_digit_strings.at(texcount);
+		definitions.push_back({ "FVF_TEXCOUNT", digit_string.c_str() });
+	}
+	else
+	{
+		definitions.push_back({ "FVF_TEXCOUNT", "0" });
+	}
+
+	auto one_or_zero = [&](ShaderFlags::type mask)
+	{
+		return (sanitized_flags & mask) != 0 ? "1" : "0";
+	};
+
+	if (is_uber)
+	{
+		definitions.push_back({ "UBER", "1" });
+	}
+	else
+	{
+		definitions.push_back({ "UBER", "0" });
+
+		definitions.push_back({ "RS_LIGHTING", one_or_zero(ShaderFlags::rs_lighting) });
+		definitions.push_back({ "RS_SPECULAR", one_or_zero(ShaderFlags::rs_specular) });
+		definitions.push_back({ "RS_ALPHA", one_or_zero(ShaderFlags::rs_alpha) });
+		definitions.push_back({ "RS_ALPHA_TEST", one_or_zero(ShaderFlags::rs_alpha_test) });
+		definitions.push_back({ "RS_FOG", one_or_zero(ShaderFlags::rs_fog) });
+		definitions.push_back({ "RS_OIT", one_or_zero(ShaderFlags::rs_oit) });
+
+		const auto alpha_test_mode = static_cast<size_t>((sanitized_flags & ShaderFlags::rs_alpha_test_mode_mask) >> ShaderFlags::rs_alpha_test_mode_shift);
+		const auto fog_mode        = static_cast<size_t>((sanitized_flags & ShaderFlags::rs_fog_mode_mask) >> ShaderFlags::rs_fog_mode_shift);
+
+		definitions.push_back({ "RS_ALPHA_TEST_MODE", m_digit_strings.at(alpha_test_mode).c_str() });
+		definitions.push_back({ "RS_FOG_MODE", m_digit_strings.at(fog_mode).c_str() });
+	}
+}
+
+ComPtr<ID3DBlob> ShaderCompiler::compile(ShaderFlags::type flags, bool is_uber, const char* entry_point, const char* profile)
+{
+	const ShaderCacheKey cache_key {
+		.flags          = ShaderFlags::sanitize(flags),
+		.is_uber        = is_uber,
+		.entry_point    = entry_point,
+		.profile        = profile,
+		.compiler_flags = COMPILER_FLAGS
+	};
+
+	// loaded before the cache lookup so that it counts towards the source hash
+	const auto shader_source = m_includer.get_shader_source(m_source_path);
+
+	ComPtr<ID3DBlob> blob = m_cache.load(cache_key);
+
+	if (blob != nullptr)
+	{
+		return blob;
+	}
+
+	const auto source = std::string_view(reinterpret_cast<const char*>(shader_source.data()), shader_source.size());
+
+	blob = compile_source(source, flags, is_uber, entry_point, profile, flags);
+	m_cache.store(cache_key, blob.Get());
+	return blob;
+}
+
+ComPtr<ID3DBlob> ShaderCompiler::compile_translated(uint64_t translation_hash, const char* profile, const std::function<std::string()>& translate)
+{
+	const ShaderCacheKey cache_key {
+		.flags            = ShaderFlags::none,
+		.is_uber          = true,
+		.entry_point      = "main",
+		.profile          = profile,
+		.compiler_flags   = COMPILER_FLAGS,
+		.translation_hash = translation_hash
+	};
+
+	// the translation includes this, so it counts towards the source hash too
+	static_cast<void>(m_includer.get_shader_source(m_source_path));
+
+	ComPtr<ID3DBlob> blob = m_cache.load(cache_key);
+
+	if (blob != nullptr)
+	{
+		return blob;
+	}
+
+	const std::string source = translate();
+
+	blob = compile_source(source, ShaderFlags::none, true, "main", profile, translation_hash);
+	m_cache.store(cache_key, blob.Get());
+	return blob;
+}
+
+ComPtr<ID3DBlob> ShaderCompiler::compile_source(std::string_view source, ShaderFlags::type flags, bool is_uber,
+                                                const char* entry_point, const char* profile, uint64_t id)
+{
+	ComPtr<ID3DBlob> blob;
+	ComPtr<ID3DBlob> errors;
+
+	const std::vector<D3D_SHADER_MACRO>& definitions = get_definitions(flags, is_uber);
+
+	std::vector<D3D_SHADER_MACRO> preproc;
+	preproc.reserve(definitions.size() + 1);
+	preproc.assign(definitions.begin(), definitions.end());
+	preproc.push_back({});
+
+	HRESULT hr;
+
+	{
+		// unfortunately a necessary evil :(
+		const std::string shader_path_string = m_source_path.string();
+		hr = D3DCompile(source.data(), source.size(), shader_path_string.c_str(), preproc.data(), &m_includer, entry_point, profile, COMPILER_FLAGS, 0, &blob, &errors);
+	}
+
+	if (errors != nullptr)
+	{
+		const bool failed = FAILED(hr);
+
+		const std::string str(static_cast<char*>(errors->GetBufferPointer()), 0, errors->GetBufferSize());
+		const std::string message = std::format("\n" __FUNCTION__ "\n{} while compiling {} shader 0x{:016X}:\n{}\n", failed ? "error" : "warning", profile, id, str);
+		OutputDebugStringA(message.c_str());
+
+		if (failed)
+		{
+			throw std::runtime_error(str);
+		}
+	}
+
+	return blob;
+}
+
+ComPtr<ID3DBlob> ShaderCompiler::compile_vertex_shader(ShaderFlags::type flags, bool is_uber)
+{
+	return compile(flags, is_uber, "vs_main", "vs_5_0");
+}
+
+ComPtr<ID3DBlob> ShaderCompiler::compile_pixel_shader(ShaderFlags::type flags, bool is_uber)
+{
+	return compile(flags, is_uber, "ps_main", "ps_5_0");
+}
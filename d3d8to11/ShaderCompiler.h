@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <d3dcommon.h>
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+
+#include "defs.h"
+#include "ShaderFlags.h"
+
+class ShaderCache;
+class ShaderIncluder;
+
+/**
+ * \brief Turns shader permutation flags into preprocessor definitions and compiles them,
+ * going through a \c ShaderCache.
+ *
+ * This doesn't need a device, so it's shared by \c Direct3DDevice8 and the offline precompiler.
+ * \c compile may be called from several threads at once, but the setters may not.
+ */
+class ShaderCompiler
+{
+public:
+	static constexpr uint32_t COMPILER_FLAGS =
+		D3DCOMPILE_PREFER_FLOW_CONTROL |
+		D3DCOMPILE_DEBUG
+	// just keeping optimization on for now
+	#if 1 || !defined(_DEBUG)
+		| D3DCOMPILE_OPTIMIZATION_LEVEL3
+	#endif
+	;
+
+	ShaderCompiler(ShaderIncluder& includer, ShaderCache& cache);
+
+	ShaderCompiler(const ShaderCompiler&)     = delete;
+	ShaderCompiler(ShaderCompiler&&) noexcept = delete;
+
+	ShaderCompiler& operator=(const ShaderCompiler&)     = delete;
+	ShaderCompiler& operator=(ShaderCompiler&&) noexcept = delete;
+
+	/**
+	 * \brief Sets the path of the file containing \c vs_main and \c ps_main.
+	 */
+	void set_source_path(std::filesystem::path path);
+	void set_oit_max_fragments(uint32_t max_fragments);
+
+	[[nodiscard]] const std::string& get_digit_string(size_t value) const;
+
+	/**
+	 * \brief Returns the preprocessor definitions for the given permutation, without a null terminator.
+	 * Each set is built once per sanitized permutation and kept until the OIT fragment count changes,
+	 * so the returned reference stays valid until then.
+	 */
+	[[nodiscard]] const std::vector<D3D_SHADER_MACRO>& get_definitions(ShaderFlags::type flags, bool is_uber) const;
+
+	/**
+	 * \brief Returns the cached bytecode for the given permutation, compiling and caching it if necessary.
+	 * \throws std::runtime_error with the compiler output if compilation fails.
+	 */
+	[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> compile(ShaderFlags::type flags, bool is_uber, const char* entry_point, const char* profile);
+	[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> compile_vertex_shader(ShaderFlags::type flags, bool is_uber);
+	[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> compile_pixel_shader(ShaderFlags::type flags, bool is_uber);
+
+	/**
+	 * \brief Returns the cached bytecode for a translated D3D8 shader identified by \p translation_hash,
+	 * calling \p translate for its source and compiling it with the uber shader definitions if necessary.
+	 * The source is compiled as if it were in the same directory as the source path so that it can include it.
+	 * \throws std::runtime_error with the compiler output if compilation fails.
+	 */
+	[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> compile_translated(uint64_t translation_hash, const char* profile,
+	                                                                  const std::function<std::string()>& translate);
+
+private:
+	void preprocess(ShaderFlags::type sanitized_flags, bool is_uber, std::vector<D3D_SHADER_MACRO>& definitions) const;
+
+	/**
+	 * \brief Compiles \p source with the definitions for the given permutation; \p id identifies it in the log.
+	 */
+	[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> compile_source(std::string_view source, ShaderFlags::type flags, bool is_uber,
+	                                                              const char* entry_point, const char* profile, uint64_t id);
+
+	ShaderIncluder& m_includer;
+	ShaderCache& m_cache;
+
+	std::filesystem::path m_source_path;
+	std::string m_oit_fragments_str;
+	std::array<std::string, std::max<size_t>(TEXTURE_STAGE_MAX, FVF_TEXCOORD_MAX) + 1> m_digit_strings;
+
+	// indexed by is_uber; node-based so that references survive rehashing
+	mutable std::shared_mutex m_definitions_mutex;
+	mutable std::array<std::unordered_map<ShaderFlags::type, std::vector<D3D_SHADER_MACRO>>, 2> m_definitions;
+};
@@ -1,4 +1,7 @@
-#include "pch.h"
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include "defs.h"
 #include "ShaderFlags.h"
 
 ShaderFlags::type ShaderFlags::sanitize(type flags)
@@ -41,3 +44,16 @@ ShaderFlags::type ShaderFlags::sanitize(type flags)
 
 	return flags;
 }
+
+ShaderFlags::type ShaderFlags::generic_uber_vs(type flags)
+{
+	return sanitize(flags & (D3DFVF_POSITION_MASK | fvf_lastbeta));
+}
+
+ShaderFlags::type ShaderFlags::generic_uber_ps(type flags)
+{
+	constexpr type stage_count = static_cast<type>(TEXTURE_STAGE_MAX) << stage_count_shift;
+	constexpr type inputs = D3DFVF_NORMAL | D3DFVF_DIFFUSE | D3DFVF_SPECULAR;
+
+	return sanitize((flags & D3DFVF_XYZRHW) | inputs | stage_count);
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 #include "d3d8types.h" // for D3DFVF
@@ -33,6 +34,16 @@ struct ShaderFlags
 	static constexpr type stage_count_shift        = 32;
 	static constexpr type rs_alpha_test_mode_shift = 36;
 	static constexpr type rs_fog_mode_shift        = 40;
+	static constexpr type fvf_texfmt_shift         = 16;
+	static constexpr type fvf_texfmt_bits          = 2; // per texture coordinate set
+
+	/**
+	 * \brief Returns the part of \c fvf_texfmt that holds the formats of the first \p texcount texture coordinate sets.
+	 */
+	static constexpr type fvf_texfmt_mask(size_t texcount)
+	{
+		return ((type(1) << (texcount * fvf_texfmt_bits)) - 1) << fvf_texfmt_shift;
+	}
 
 	static constexpr type light_sanitize_flags = rs_lighting | rs_specular |
 		D3DFVF_DIFFUSE | D3DFVF_SPECULAR | D3DFVF_NORMAL | D3DFVF_XYZRHW;
@@ -44,4 +55,18 @@ struct ShaderFlags
 	static constexpr type uber_ps_mask = stage_count_mask | (light_sanitize_flags & ~rs_mask);
 
 	static type sanitize(type flags);
+
+	/**
+	 * \brief Returns the flags of the uber vertex shader that reads nothing but the position,
+	 * which can be bound to any vertex format with the same position type as \p flags.
+	 */
+	static type generic_uber_vs(type flags);
+
+	/**
+	 * \brief Returns the flags of the uber pixel shader that reads every interpolated input and runs every
+	 * texture stage; the texture stage loop stops at the first disabled stage anyway.
+	 */
+	static type generic_uber_ps(type flags);
 };
+
+static_assert(ShaderFlags::fvf_texfmt_mask(8) == ShaderFlags::fvf_texfmt);
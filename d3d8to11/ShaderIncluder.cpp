@@ -1,7 +1,10 @@
-#include "pch.h"
+#include <algorithm>
+#include <exception>
 #include <fstream>
+#include <ranges>
 
 #include "filesystem.h"
+#include "fnv1a.h"
 
 #include "ShaderIncluder.h"
 
@@ -118,6 +121,12 @@ void ShaderIncluder::set_base_directory(std::filesystem::path dir)
 	m_base_directory = std::move(dir);
 }
 
+std::filesystem::path ShaderIncluder::get_base_directory()
+{
+	std::shared_lock directories_lock(m_directories_mutex);
+	return m_base_directory;
+}
+
 void ShaderIncluder::add_include_directory(std::filesystem::path dir)
 {
 	if (dir.empty())
@@ -178,6 +187,7 @@ std::span<const uint8_t> ShaderIncluder::get_shader_source(const std::filesystem
 
 	const std::span<const uint8_t> result(buffer);
 	m_shader_sources[file_path_key] = std::move(buffer);
+	m_source_hash.reset();
 	return result;
 }
 
@@ -185,6 +195,7 @@ void ShaderIncluder::clear_shader_source_cache()
 {
 	std::lock_guard sources_lock(m_sources_mutex);
 	m_shader_sources.clear();
+	m_source_hash.reset();
 }
 
 void ShaderIncluder::shrink_to_fit()
@@ -192,3 +203,71 @@ void ShaderIncluder::shrink_to_fit()
 	std::unique_lock directories_lock(m_directories_mutex);
 	m_include_directories.shrink_to_fit();
 }
+
+uint64_t ShaderIncluder::get_source_hash()
+{
+	std::lock_guard sources_lock(m_sources_mutex);
+
+	if (m_source_hash.has_value())
+	{
+		return *m_source_hash;
+	}
+
+	// sort by path so that the hash doesn't depend on load order
+	std::vector<std::pair<std::filesystem::path, const std::vector<uint8_t>*>> sources;
+	sources.reserve(m_shader_sources.size());
+
+	for (const auto& [path, data] : m_shader_sources)
+	{
+		sources.emplace_back(relative_to_base_directory(path), &data);
+	}
+
+	std::ranges::sort(sources, {}, &decltype(sources)::value_type::first);
+
+	uint64_t hash = FNV1A_64_OFFSET;
+
+	for (const auto& [path, data] : sources)
+	{
+		const auto& native = path.native();
+		hash = fnv1a_64(native.data(), native.size() * sizeof(native[0]), hash);
+		hash = fnv1a_64(*data, hash);
+	}
+
+	m_source_hash = hash;
+	return hash;
+}
+
+std::vector<std::filesystem::path> ShaderIncluder::get_source_paths()
+{
+	std::lock_guard sources_lock(m_sources_mutex);
+
+	std::vector<std::filesystem::path> result;
+	result.reserve(m_shader_sources.size());
+
+	for (const auto& path : m_shader_sources | std::views::keys)
+	{
+		result.push_back(relative_to_base_directory(path));
+	}
+
+	std::ranges::sort(result);
+	return result;
+}
+
+std::filesystem::path ShaderIncluder::relative_to_base_directory(const std::filesystem::path& path)
+{
+	std::shared_lock directories_lock(m_directories_mutex);
+
+	if (m_base_directory.empty())
+	{
+		return path;
+	}
+
+	std::filesystem::path relative = path.lexically_relative(m_base_directory);
+
+	if (relative.empty() || *relative.begin() == "..")
+	{
+		return path;
+	}
+
+	return relative;
+}
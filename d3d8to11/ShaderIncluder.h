@@ -1,8 +1,12 @@
 #pragma once
-#include <d3d11_1.h>
 
+#include <d3dcommon.h>
+
+#include <cstdint>
 #include <filesystem>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <span>
 #include <unordered_map>
 #include <vector>
@@ -23,16 +27,32 @@ public:
 	HRESULT __stdcall Close(LPCVOID pData) noexcept override;
 
 	void set_base_directory(std::filesystem::path dir);
+	[[nodiscard]] std::filesystem::path get_base_directory();
 	void add_include_directory(std::filesystem::path dir);
 	std::span<const uint8_t> get_shader_source(const std::filesystem::path& file_path);
 	void clear_shader_source_cache();
 	void shrink_to_fit();
 
+	/**
+	 * \brief Computes a hash of the path and contents of every source file served so far.
+	 * Paths are hashed relative to the base directory so that the hash doesn't depend on where the
+	 * shaders are installed. The result is cached until another file is loaded or the source cache is cleared.
+	 */
+	[[nodiscard]] uint64_t get_source_hash();
+
+	/**
+	 * \brief Returns the path of every source file served so far, relative to the base directory where possible.
+	 */
+	[[nodiscard]] std::vector<std::filesystem::path> get_source_paths();
+
 private:
+	[[nodiscard]] std::filesystem::path relative_to_base_directory(const std::filesystem::path& path);
+
 	std::shared_mutex m_directories_mutex;
 	std::filesystem::path m_base_directory;
 	std::vector<std::filesystem::path> m_include_directories;
 
 	std::recursive_mutex m_sources_mutex;
 	std::unordered_map<std::filesystem::path, std::vector<uint8_t>> m_shader_sources;
+	std::optional<uint64_t> m_source_hash;
 };
@@ -0,0 +1,660 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <ranges>
+#include <string_view>
+
+#include "alignment.h"
+#include "fnv1a.h"
+
+#include "ShaderPack.h"
+
+using namespace Microsoft::WRL;
+
+struct ShaderPack::Mapping
+{
+	HANDLE handle = nullptr;
+	const uint8_t* view = nullptr;
+	size_t size = 0;
+
+	Mapping() = default;
+
+	Mapping(const Mapping&)     = delete;
+	Mapping(Mapping&&) noexcept = delete;
+
+	Mapping& operator=(const Mapping&)     = delete;
+	Mapping& operator=(Mapping&&) noexcept = delete;
+
+	~Mapping()
+	{
+		if (view != nullptr)
+		{
+			UnmapViewOfFile(view);
+		}
+
+		if (handle != nullptr)
+		{
+			CloseHandle(handle);
+		}
+	}
+};
+
+namespace
+{
+/**
+ * \brief An \c ID3DBlob that points into a mapped pack file and keeps the mapping alive.
+ */
+class MappedBlob final : public ID3DBlob
+{
+public:
+	MappedBlob(std::shared_ptr<const void> owner, const void* data, size_t size)
+		: m_owner(std::move(owner)),
+		  m_data(data),
+		  m_size(size)
+	{
+	}
+
+	MappedBlob(const MappedBlob&)     = delete;
+	MappedBlob(MappedBlob&&) noexcept = delete;
+
+	MappedBlob& operator=(const MappedBlob&)     = delete;
+	MappedBlob& operator=(MappedBlob&&) noexcept = delete;
+
+	HRESULT __stdcall QueryInterface(REFIID riid, void** ppvObject) override
+	{
+		if (ppvObject == nullptr)
+		{
+			return E_POINTER;
+		}
+
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D10Blob))
+		{
+			*ppvObject = static_cast<ID3DBlob*>(this);
+			AddRef();
+			return S_OK;
+		}
+
+		*ppvObject = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG __stdcall AddRef() override
+	{
+		return static_cast<ULONG>(InterlockedIncrement(&m_ref_count));
+	}
+
+	ULONG __stdcall Release() override
+	{
+		const auto result = static_cast<ULONG>(InterlockedDecrement(&m_ref_count));
+
+		if (result == 0)
+		{
+			delete this;
+		}
+
+		return result;
+	}
+
+	LPVOID __stdcall GetBufferPointer() override
+	{
+		return const_cast<void*>(m_data);
+	}
+
+	SIZE_T __stdcall GetBufferSize() override
+	{
+		return m_size;
+	}
+
+private:
+	~MappedBlob() = default;
+
+	volatile LONG m_ref_count = 1;
+	std::shared_ptr<const void> m_owner;
+	const void* m_data;
+	size_t m_size;
+};
+
+uint64_t footer_checksum(std::span<const uint8_t> tables, const ShaderPack::Footer& footer)
+{
+	const uint64_t hash = fnv1a_64(tables);
+	return fnv1a_64(&footer, offsetof(ShaderPack::Footer, checksum), hash);
+}
+}
+
+ShaderPack::~ShaderPack()
+{
+	close();
+}
+
+bool ShaderPack::open(const std::filesystem::path& path)
+{
+	close();
+
+	std::unique_lock lock(m_mutex);
+
+	m_file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+	                     OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		const std::string str = std::format("Unable to open or create shader pack \"{}\" (error {}). Shaders will not be cached.\n",
+		                                    path.string(), GetLastError());
+		OutputDebugStringA(str.c_str());
+		return false;
+	}
+
+	LARGE_INTEGER file_size {};
+	GetFileSizeEx(m_file, &file_size);
+
+	Header header {};
+	DWORD read = 0;
+	OVERLAPPED overlapped {};
+
+	bool valid = static_cast<uint64_t>(file_size.QuadPart) >= sizeof(Header) &&
+	             ReadFile(m_file, &header, sizeof(header), &read, &overlapped) &&
+	             read == sizeof(header) &&
+	             header.magic == HEADER_MAGIC &&
+	             header.version == VERSION &&
+	             header.committed_size >= sizeof(Header) &&
+	             header.committed_size <= static_cast<uint64_t>(file_size.QuadPart);
+
+	if (valid && header.footer_offset != 0)
+	{
+		valid = map_committed(header.committed_size, header.footer_offset);
+	}
+
+	if (!valid)
+	{
+		if (file_size.QuadPart != 0)
+		{
+			OutputDebugStringA("shader pack is invalid or from an older version; starting a new one.\n");
+		}
+
+		m_mapping.reset();
+		m_index = {};
+		m_permutations.clear();
+		m_source_paths.clear();
+
+		header = {};
+		header.magic          = HEADER_MAGIC;
+		header.version        = VERSION;
+		header.committed_size = sizeof(Header);
+
+		LARGE_INTEGER end {};
+		end.QuadPart = sizeof(Header);
+
+		if (!write_at(0, &header, sizeof(header)) ||
+		    !SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN) ||
+		    !SetEndOfFile(m_file))
+		{
+			CloseHandle(m_file);
+			m_file = INVALID_HANDLE_VALUE;
+			return false;
+		}
+
+		FlushFileBuffers(m_file);
+	}
+
+	m_path = path;
+	m_committed_size = header.committed_size;
+	return true;
+}
+
+void ShaderPack::close()
+{
+	commit();
+
+	std::unique_lock lock(m_mutex);
+
+	m_index = {};
+	m_mapping.reset();
+	m_pending.clear();
+	m_permutations.clear();
+	m_source_paths.clear();
+	m_committed_size = 0;
+	m_dirty = false;
+
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		FlushFileBuffers(m_file);
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool ShaderPack::is_open() const
+{
+	return m_file != INVALID_HANDLE_VALUE;
+}
+
+ComPtr<ID3DBlob> ShaderPack::find(uint64_t key_hash, uint64_t* source_hash)
+{
+	std::shared_lock lock(m_mutex);
+
+	{
+		const auto it = m_pending.find(key_hash);
+
+		if (it != m_pending.end())
+		{
+			*source_hash = it->second.source_hash;
+			return it->second.blob;
+		}
+	}
+
+	const auto it = std::ranges::lower_bound(m_index, key_hash, {}, &IndexEntry::key_hash);
+
+	if (it == m_index.end() || it->key_hash != key_hash ||
+	    it->offset + it->size > m_mapping->size)
+	{
+		return nullptr;
+	}
+
+	*source_hash = it->source_hash;
+
+	ComPtr<ID3DBlob> result;
+	result.Attach(new MappedBlob(m_mapping, m_mapping->view + it->offset, static_cast<size_t>(it->size)));
+	return result;
+}
+
+void ShaderPack::insert(uint64_t key_hash, ShaderFlags::type flags, uint64_t source_hash, ID3DBlob* blob)
+{
+	std::unique_lock lock(m_mutex);
+
+	if (!is_open())
+	{
+		return;
+	}
+
+	m_pending[key_hash] = PendingEntry { flags, source_hash, blob };
+	m_dirty = true;
+}
+
+bool ShaderPack::add_permutation(ShaderFlags::type flags)
+{
+	std::unique_lock lock(m_mutex);
+
+	const auto it = std::ranges::lower_bound(m_permutations, flags);
+
+	if (it != m_permutations.end() && *it == flags)
+	{
+		return false;
+	}
+
+	m_permutations.insert(it, flags);
+	m_dirty = true;
+	return true;
+}
+
+std::vector<ShaderFlags::type> ShaderPack::get_permutations()
+{
+	std::shared_lock lock(m_mutex);
+	return m_permutations;
+}
+
+std::vector<std::filesystem::path> ShaderPack::get_source_paths()
+{
+	std::shared_lock lock(m_mutex);
+	return m_source_paths;
+}
+
+void ShaderPack::set_source_paths(std::vector<std::filesystem::path> paths)
+{
+	std::unique_lock lock(m_mutex);
+
+	if (paths != m_source_paths)
+	{
+		m_source_paths = std::move(paths);
+		m_dirty = true;
+	}
+}
+
+size_t ShaderPack::pending_count()
+{
+	std::shared_lock lock(m_mutex);
+	return m_pending.size();
+}
+
+bool ShaderPack::is_dirty()
+{
+	std::shared_lock lock(m_mutex);
+	return m_dirty;
+}
+
+bool ShaderPack::commit()
+{
+	std::unique_lock lock(m_mutex);
+
+	if (!is_open() || !m_dirty)
+	{
+		return true;
+	}
+
+	std::vector<IndexEntry> index;
+	index.reserve(m_index.size() + m_pending.size());
+
+	for (const IndexEntry& entry : m_index)
+	{
+		if (!m_pending.contains(entry.key_hash))
+		{
+			index.push_back(entry);
+		}
+	}
+
+	uint64_t offset = m_committed_size;
+
+	for (const auto& [key_hash, pending] : m_pending)
+	{
+		const void* data = pending.blob->GetBufferPointer();
+		const size_t size = pending.blob->GetBufferSize();
+
+		if (!write_at(offset, data, size))
+		{
+			return false;
+		}
+
+		index.push_back({
+			.key_hash    = key_hash,
+			.flags       = pending.flags,
+			.source_hash = pending.source_hash,
+			.data_hash   = fnv1a_64(data, size),
+			.offset      = offset,
+			.size        = size
+		});
+
+		offset += size;
+	}
+
+	std::ranges::sort(index, {}, &IndexEntry::key_hash);
+
+	Footer footer {};
+	const std::vector<uint8_t> tables = build_tables(index, align_up(offset, sizeof(uint64_t)), footer);
+	const uint64_t footer_offset = footer.sources_offset + footer.sources_size;
+
+	if (!write_at(footer.index_offset, tables.data(), tables.size()) ||
+	    !write_at(footer_offset, &footer, sizeof(footer)))
+	{
+		return false;
+	}
+
+	// only now that the whole segment is written do we publish it
+	Header header {};
+
+	header.magic          = HEADER_MAGIC;
+	header.version        = VERSION;
+	header.committed_size = footer_offset + sizeof(Footer);
+	header.footer_offset  = footer_offset;
+
+	if (!write_at(0, &header, sizeof(header)))
+	{
+		return false;
+	}
+
+	m_committed_size = header.committed_size;
+	m_pending.clear();
+	m_dirty = false;
+
+	if (!map_committed(header.committed_size, header.footer_offset))
+	{
+		OutputDebugStringA("failed to remap shader pack after commit\n");
+		m_index = {};
+		m_mapping.reset();
+		return false;
+	}
+
+	return true;
+}
+
+ShaderPack::Stats ShaderPack::get_stats()
+{
+	std::shared_lock lock(m_mutex);
+
+	Stats stats {};
+
+	stats.entry_count       = m_index.size();
+	stats.permutation_count = m_permutations.size();
+	stats.file_size         = m_committed_size;
+	stats.live_size         = sizeof(Header) + sizeof(Footer) + m_index.size_bytes() + m_permutations.size() * sizeof(ShaderFlags::type);
+
+	for (const IndexEntry& entry : m_index)
+	{
+		stats.live_size += entry.size;
+	}
+
+	return stats;
+}
+
+bool ShaderPack::compact(std::vector<ShaderFlags::type> permutations, const std::function<bool(const IndexEntry&)>& keep)
+{
+	commit();
+
+	std::filesystem::path path;
+
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (!is_open())
+		{
+			return false;
+		}
+
+		path = m_path;
+
+		std::filesystem::path temp_path = path;
+		temp_path += ".tmp";
+
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		std::vector<IndexEntry> index;
+		index.reserve(m_index.size());
+
+		uint64_t offset = sizeof(Header);
+		file.seekp(static_cast<std::streamoff>(offset));
+
+		for (const IndexEntry& entry : m_index)
+		{
+			if (entry.offset + entry.size > m_mapping->size || !keep(entry))
+			{
+				continue;
+			}
+
+			file.write(reinterpret_cast<const char*>(m_mapping->view + entry.offset), static_cast<std::streamsize>(entry.size));
+
+			IndexEntry& new_entry = index.emplace_back(entry);
+			new_entry.offset = offset;
+			offset += entry.size;
+		}
+
+		std::ranges::sort(permutations);
+		const auto [first, last] = std::ranges::unique(permutations);
+		permutations.erase(first, last);
+		m_permutations = std::move(permutations);
+
+		// index is already sorted since it was filtered from a sorted index
+		Footer footer {};
+		const std::vector<uint8_t> tables = build_tables(index, align_up(offset, sizeof(uint64_t)), footer);
+		const uint64_t footer_offset = footer.sources_offset + footer.sources_size;
+
+		file.seekp(static_cast<std::streamoff>(footer.index_offset));
+		file.write(reinterpret_cast<const char*>(tables.data()), static_cast<std::streamsize>(tables.size()));
+		file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+		Header header {};
+
+		header.magic          = HEADER_MAGIC;
+		header.version        = VERSION;
+		header.committed_size = footer_offset + sizeof(Footer);
+		header.footer_offset  = footer_offset;
+
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.close();
+
+		if (!file.good())
+		{
+			std::error_code ec;
+			std::filesystem::remove(temp_path, ec);
+			return false;
+		}
+
+		m_index = {};
+		m_mapping.reset();
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+
+		if (!MoveFileExW(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		{
+			std::error_code ec;
+			std::filesystem::remove(temp_path, ec);
+		}
+	}
+
+	// the old file is reopened unchanged if the replacement failed
+	return open(path);
+}
+
+std::vector<uint8_t> ShaderPack::build_tables(std::span<const IndexEntry> index, uint64_t index_offset, Footer& footer) const
+{
+	std::string sources;
+
+	for (const std::filesystem::path& path : m_source_paths)
+	{
+		const std::u8string str = path.u8string();
+		sources.append(reinterpret_cast<const char*>(str.data()), str.size());
+		sources.push_back('\n');
+	}
+
+	footer = {};
+
+	footer.magic               = FOOTER_MAGIC;
+	footer.version             = VERSION;
+	footer.index_offset        = index_offset;
+	footer.index_count         = index.size();
+	footer.permutations_offset = footer.index_offset + index.size() * sizeof(IndexEntry);
+	footer.permutations_count  = m_permutations.size();
+	footer.sources_offset      = footer.permutations_offset + m_permutations.size() * sizeof(ShaderFlags::type);
+	footer.sources_size        = sources.size();
+
+	// the checksum covers the tables as well, so build them contiguously first
+	std::vector<uint8_t> tables(static_cast<size_t>(footer.sources_offset + footer.sources_size - footer.index_offset));
+	uint8_t* dest = tables.data();
+	dest = std::copy_n(reinterpret_cast<const uint8_t*>(index.data()), index.size() * sizeof(IndexEntry), dest);
+	dest = std::copy_n(reinterpret_cast<const uint8_t*>(m_permutations.data()), m_permutations.size() * sizeof(ShaderFlags::type), dest);
+	std::ranges::copy(sources, dest);
+
+	footer.checksum = footer_checksum(tables, footer);
+	return tables;
+}
+
+bool ShaderPack::map_committed(uint64_t committed_size, uint64_t footer_offset)
+{
+	if (footer_offset + sizeof(Footer) != committed_size)
+	{
+		return false;
+	}
+
+	auto mapping = std::make_shared<Mapping>();
+
+	LARGE_INTEGER size {};
+	size.QuadPart = static_cast<LONGLONG>(committed_size);
+
+	mapping->handle = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, size.HighPart, size.LowPart, nullptr);
+
+	if (mapping->handle == nullptr)
+	{
+		return false;
+	}
+
+	mapping->view = static_cast<const uint8_t*>(MapViewOfFile(mapping->handle, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(committed_size)));
+
+	if (mapping->view == nullptr)
+	{
+		return false;
+	}
+
+	mapping->size = static_cast<size_t>(committed_size);
+
+	Footer footer {};
+	std::memcpy(&footer, mapping->view + footer_offset, sizeof(Footer));
+
+	// the counts are bounded by the space before the footer first so that the offset arithmetic below can't overflow
+	if (footer.magic != FOOTER_MAGIC ||
+	    footer.version != VERSION ||
+	    footer.index_offset < sizeof(Header) ||
+	    footer.index_offset > footer_offset ||
+	    footer.index_count > (footer_offset - footer.index_offset) / sizeof(IndexEntry) ||
+	    footer.permutations_count > (footer_offset - footer.index_offset) / sizeof(ShaderFlags::type) ||
+	    footer.sources_size > footer_offset - footer.index_offset ||
+	    footer.permutations_offset != footer.index_offset + footer.index_count * sizeof(IndexEntry) ||
+	    footer.sources_offset != footer.permutations_offset + footer.permutations_count * sizeof(ShaderFlags::type) ||
+	    footer.sources_offset + footer.sources_size != footer_offset ||
+	    footer.checksum != footer_checksum(std::span(mapping->view + footer.index_offset, static_cast<size_t>(footer_offset - footer.index_offset)), footer))
+	{
+		return false;
+	}
+
+	const auto* index = reinterpret_cast<const IndexEntry*>(mapping->view + footer.index_offset);
+	m_index = std::span(index, static_cast<size_t>(footer.index_count));
+
+	const auto* permutations = reinterpret_cast<const ShaderFlags::type*>(mapping->view + footer.permutations_offset);
+	const auto permutations_count = static_cast<size_t>(footer.permutations_count);
+
+	for (const ShaderFlags::type flags : std::span(permutations, permutations_count))
+	{
+		const auto it = std::ranges::lower_bound(m_permutations, flags);
+
+		if (it == m_permutations.end() || *it != flags)
+		{
+			m_permutations.insert(it, flags);
+		}
+	}
+
+	m_source_paths.clear();
+
+	const std::string_view sources(reinterpret_cast<const char*>(mapping->view + footer.sources_offset), static_cast<size_t>(footer.sources_size));
+
+	for (const auto line : sources | std::views::split('\n'))
+	{
+		if (!line.empty())
+		{
+			m_source_paths.emplace_back(std::u8string(line.begin(), line.end()));
+		}
+	}
+
+	m_mapping = std::move(mapping);
+	return true;
+}
+
+bool ShaderPack::write_at(uint64_t offset, const void* data, size_t size) const
+{
+	const auto* bytes = static_cast<const uint8_t*>(data);
+
+	while (size > 0)
+	{
+		OVERLAPPED overlapped {};
+		overlapped.Offset     = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+		const auto chunk = static_cast<DWORD>(std::min<size_t>(size, 0x40000000));
+		DWORD written = 0;
+
+		if (!WriteFile(m_file, bytes, chunk, &written, &overlapped) || written == 0)
+		{
+			return false;
+		}
+
+		bytes  += written;
+		offset += written;
+		size   -= written;
+	}
+
+	return true;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <d3dcommon.h>
+#include <wrl/client.h>
+
+#include "ShaderFlags.h"
+
+/**
+ * \brief A single memory-mapped file holding compiled shader bytecode and the recorded shader permutations.
+ *
+ * Layout: a fixed header, followed by any number of appended segments. Each segment contains
+ * the bytecode blobs added since the previous commit, followed by a complete sorted index of
+ * every entry, the permutation list, the source manifest and a checksummed footer.
+ * The header's \c committed_size and \c footer_offset are only updated after a segment has been
+ * fully written, so a torn append is ignored (and overwritten) on the next open. Commits don't wait for
+ * the data to reach the disk, which only \c close does; a process crash can't lose what the system has,
+ * and a pack whose footer didn't make it to disk in a system crash fails validation and starts over.
+ */
+class ShaderPack
+{
+public:
+	static constexpr uint32_t HEADER_MAGIC = 0x4B503844; // 'D8PK'
+	static constexpr uint32_t FOOTER_MAGIC = 0x46503844; // 'D8PF'
+	static constexpr uint32_t VERSION      = 1;
+
+#pragma pack(push, 1)
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t committed_size;
+		uint64_t footer_offset;
+		uint64_t reserved[5];
+	};
+
+	struct IndexEntry
+	{
+		uint64_t key_hash;
+		uint64_t flags;
+		uint64_t source_hash;
+		uint64_t data_hash;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct Footer
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t index_offset;
+		uint64_t index_count;
+		uint64_t permutations_offset;
+		uint64_t permutations_count;
+		uint64_t sources_offset;
+		uint64_t sources_size;
+		uint64_t checksum;
+	};
+#pragma pack(pop)
+
+	struct Stats
+	{
+		size_t entry_count;
+		size_t permutation_count;
+		uint64_t file_size;
+		uint64_t live_size; // bytes that a freshly written pack would occupy
+	};
+
+	static_assert(sizeof(Header) == 64);
+	static_assert(sizeof(IndexEntry) == 48);
+
+	ShaderPack() = default;
+	~ShaderPack();
+
+	ShaderPack(const ShaderPack&)     = delete;
+	ShaderPack(ShaderPack&&) noexcept = delete;
+
+	ShaderPack& operator=(const ShaderPack&)     = delete;
+	ShaderPack& operator=(ShaderPack&&) noexcept = delete;
+
+	bool open(const std::filesystem::path& path);
+	void close();
+	[[nodiscard]] bool is_open() const;
+
+	/**
+	 * \brief Looks up the bytecode stored under \p key_hash.
+	 * Committed entries are returned as a blob that points directly into the mapped file.
+	 * \param key_hash The key to look up.
+	 * \param source_hash Receives the source hash the entry was stored with.
+	 * \return The bytecode, or \c nullptr if there is no such entry.
+	 */
+	[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> find(uint64_t key_hash, uint64_t* source_hash);
+	void insert(uint64_t key_hash, ShaderFlags::type flags, uint64_t source_hash, ID3DBlob* blob);
+
+	bool add_permutation(ShaderFlags::type flags);
+	[[nodiscard]] std::vector<ShaderFlags::type> get_permutations();
+
+	[[nodiscard]] std::vector<std::filesystem::path> get_source_paths();
+	void set_source_paths(std::vector<std::filesystem::path> paths);
+
+	[[nodiscard]] size_t pending_count();
+
+	/**
+	 * \brief Whether there are entries, permutations or sources that \c commit would write.
+	 */
+	[[nodiscard]] bool is_dirty();
+
+	/**
+	 * \brief Appends all pending entries, permutations and sources to the file and remaps it.
+	 */
+	bool commit();
+
+	[[nodiscard]] Stats get_stats();
+
+	/**
+	 * \brief Rewrites the pack as a single segment, dropping superseded data.
+	 * Must not be called while blobs returned by \c find are still alive, as they keep the old file mapped.
+	 * \param permutations The permutation list to store in place of the current one.
+	 * \param keep Returns \c false for index entries that should be dropped.
+	 */
+	bool compact(std::vector<ShaderFlags::type> permutations, const std::function<bool(const IndexEntry&)>& keep);
+
+private:
+	struct Mapping;
+
+	[[nodiscard]] bool map_committed(uint64_t committed_size, uint64_t footer_offset);
+	[[nodiscard]] bool write_at(uint64_t offset, const void* data, size_t size) const;
+	[[nodiscard]] std::vector<uint8_t> build_tables(std::span<const IndexEntry> index, uint64_t index_offset, Footer& footer) const;
+
+	std::shared_mutex m_mutex;
+	std::filesystem::path m_path;
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	uint64_t m_committed_size = 0;
+	std::shared_ptr<const Mapping> m_mapping;
+	std::span<const IndexEntry> m_index;
+
+	struct PendingEntry
+	{
+		ShaderFlags::type flags;
+		uint64_t source_hash;
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	};
+
+	std::unordered_map<uint64_t, PendingEntry> m_pending;
+	std::vector<ShaderFlags::type> m_permutations; // sorted
+	std::vector<std::filesystem::path> m_source_paths;
+	bool m_dirty = false;
+};
@@ -0,0 +1,1238 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "defs.h"
+#include "fnv1a.h"
+#include "VertexDeclaration.h"
+
+#include "ShaderTranslator.h"
+
+using namespace d3d8to11;
+
+namespace
+{
+	constexpr DWORD SHADER_TYPE_MASK   = 0xFFFF0000;
+	constexpr DWORD VERTEX_SHADER_TYPE = 0xFFFE0000;
+	constexpr DWORD PIXEL_SHADER_TYPE  = 0xFFFF0000;
+
+	constexpr DWORD VS_TEMP_REGISTER_MAX      = 12;
+	constexpr DWORD VS_INPUT_REGISTER_MAX     = 16;
+	constexpr DWORD VS_COLOR_OUTPUT_MAX       = 2;
+	constexpr DWORD PS_TEMP_REGISTER_MAX      = 2;
+	constexpr DWORD PS_1_4_TEMP_REGISTER_MAX  = 6;
+	constexpr DWORD PS_TEXTURE_REGISTER_MAX   = 4;
+	constexpr DWORD PS_COLOR_INPUT_MAX        = 2;
+
+	constexpr std::string_view COMPONENTS = "xyzw";
+
+	// shared by both stages; the outputs of a translated vertex shader match VS_OUTPUT so either kind of pixel shader can follow it
+	constexpr std::string_view PRELUDE = R"(#define OIT_NODE_WRITE
+#include "d3d8to11.hlsl"
+)";
+
+	constexpr std::string_view VERTEX_SHADER_HELPERS = R"(
+float4 d3d8_lit(float4 s)
+{
+	float4 result = float4(1, 0, 0, 1);
+
+	if (s.x > 0)
+	{
+		result.y = s.x;
+
+		if (s.y > 0)
+		{
+			result.z = pow(s.y, clamp(s.w, -128, 128));
+		}
+	}
+
+	return result;
+}
+
+float4 d3d8_dst(float4 a, float4 b)
+{
+	return float4(1, a.y * b.y, a.z, b.w);
+}
+
+float4 d3d8_expp(float w)
+{
+	return float4(exp2(floor(w)), frac(w), exp2(w), 1);
+}
+
+float4 d3d8_logp(float w)
+{
+	float value    = abs(w);
+	float exponent = floor(log2(value));
+	return float4(exponent, value / exp2(exponent), log2(value), 1);
+}
+
+// the pixel shaders compute the fog factor from a distance, so oFog is turned back into one
+float d3d8_fog_distance(float factor)
+{
+	factor = saturate(factor);
+
+	switch (rs_fog_mode)
+	{
+		case FOGMODE_LINEAR:
+			return fog_end - factor * (fog_end - fog_start);
+
+		case FOGMODE_EXP:
+			return -log(factor) / fog_density;
+
+		case FOGMODE_EXP2:
+			return sqrt(-log(factor)) / fog_density;
+
+		default:
+			return 0;
+	}
+}
+)";
+
+	constexpr std::string_view PIXEL_SHADER_HELPERS = R"(
+float2 d3d8_bump(uint s, float4 bump)
+{
+	return float2(texture_stages[s].bump_env_mat00 * bump.x + texture_stages[s].bump_env_mat10 * bump.y,
+	              texture_stages[s].bump_env_mat01 * bump.x + texture_stages[s].bump_env_mat11 * bump.y);
+}
+
+float d3d8_luminance(uint s, float4 bump)
+{
+	return saturate(bump.z * texture_stages[s].bump_env_lscale + texture_stages[s].bump_env_loffset);
+}
+)";
+
+	constexpr std::string_view PIXEL_SHADER_MAIN = R"(
+float4 main(VS_OUTPUT input) : SV_TARGET
+{
+	float4 result = apply_fog(translated_main(input), input.fog);
+
+	const bool standard_blending = is_standard_blending();
+
+	do_alpha_test(result, standard_blending);
+	do_oit(result, input, standard_blending);
+
+	return result;
+}
+)";
+
+	bool is_pixel_shader_version(DWORD version)
+	{
+		return (version & SHADER_TYPE_MASK) == PIXEL_SHADER_TYPE;
+	}
+
+	size_t parameter_count(DWORD opcode, DWORD version)
+	{
+		switch (opcode)
+		{
+			case D3DSIO_NOP:
+			case D3DSIO_PHASE:
+				return 0;
+
+			case D3DSIO_TEXKILL:
+			case D3DSIO_TEXDEPTH:
+				return 1;
+
+			// ps.1.4 gave these a source
+			case D3DSIO_TEX:
+			case D3DSIO_TEXCOORD:
+				return version >= D3DPS_VERSION(1, 4) ? 2 : 1;
+
+			case D3DSIO_MOV:
+			case D3DSIO_RCP:
+			case D3DSIO_RSQ:
+			case D3DSIO_EXP:
+			case D3DSIO_LOG:
+			case D3DSIO_LIT:
+			case D3DSIO_FRC:
+			case D3DSIO_EXPP:
+			case D3DSIO_LOGP:
+			case D3DSIO_TEXBEM:
+			case D3DSIO_TEXBEML:
+			case D3DSIO_TEXREG2AR:
+			case D3DSIO_TEXREG2GB:
+			case D3DSIO_TEXREG2RGB:
+			case D3DSIO_TEXM3x2PAD:
+			case D3DSIO_TEXM3x2TEX:
+			case D3DSIO_TEXM3x3PAD:
+			case D3DSIO_TEXM3x3TEX:
+			case D3DSIO_TEXM3x3DIFF:
+			case D3DSIO_TEXM3x3VSPEC:
+			case D3DSIO_TEXDP3TEX:
+			case D3DSIO_TEXM3x2DEPTH:
+			case D3DSIO_TEXDP3:
+			case D3DSIO_TEXM3x3:
+				return 2;
+
+			case D3DSIO_ADD:
+			case D3DSIO_SUB:
+			case D3DSIO_MUL:
+			case D3DSIO_DP3:
+			case D3DSIO_DP4:
+			case D3DSIO_MIN:
+			case D3DSIO_MAX:
+			case D3DSIO_SLT:
+			case D3DSIO_SGE:
+			case D3DSIO_DST:
+			case D3DSIO_M4x4:
+			case D3DSIO_M4x3:
+			case D3DSIO_M3x4:
+			case D3DSIO_M3x3:
+			case D3DSIO_M3x2:
+			case D3DSIO_TEXM3x3SPEC:
+			case D3DSIO_BEM:
+				return 3;
+
+			case D3DSIO_MAD:
+			case D3DSIO_LRP:
+			case D3DSIO_CND:
+			case D3DSIO_CMP:
+				return 4;
+
+			// the register and four literal floats
+			case D3DSIO_DEF:
+				return 5;
+
+			default:
+				throw std::runtime_error(std::format("unsupported shader instruction 0x{:04X}", opcode));
+		}
+	}
+
+	/**
+	 * \brief Calls \p callback with each instruction token and its parameters, skipping comments.
+	 * \return The number of tokens up to and including the end token.
+	 */
+	template <typename Callback>
+	size_t for_each_instruction(const DWORD* tokens, size_t size, Callback&& callback)
+	{
+		size_t i = 1;
+
+		for (;;)
+		{
+			if (i >= size)
+			{
+				throw std::runtime_error("shader function has no end token");
+			}
+
+			const DWORD token  = tokens[i++];
+			const DWORD opcode = token & D3DSI_OPCODE_MASK;
+
+			if (opcode == D3DSIO_END)
+			{
+				return i;
+			}
+
+			if (opcode == D3DSIO_COMMENT)
+			{
+				i += (token & D3DSI_COMMENTSIZE_MASK) >> D3DSI_COMMENTSIZE_SHIFT;
+				continue;
+			}
+
+			const size_t count = parameter_count(opcode, tokens[0]);
+
+			if (count > size - i)
+			{
+				throw std::runtime_error("shader function ends in the middle of an instruction");
+			}
+
+			callback(token, std::span(tokens + i, count));
+			i += count;
+		}
+	}
+
+	std::string mask_string(DWORD mask)
+	{
+		if (mask == 0xF)
+		{
+			return {};
+		}
+
+		std::string result = ".";
+
+		for (size_t i = 0; i < COMPONENTS.size(); ++i)
+		{
+			if (mask & (1u << i))
+			{
+				result += COMPONENTS[i];
+			}
+		}
+
+		return result;
+	}
+
+	std::string swizzle_string(DWORD token)
+	{
+		const DWORD swizzle = (token & D3DVS_SWIZZLE_MASK) >> D3DVS_SWIZZLE_SHIFT;
+
+		if (swizzle == (D3DVS_NOSWIZZLE >> D3DVS_SWIZZLE_SHIFT))
+		{
+			return {};
+		}
+
+		std::string result = ".";
+
+		for (size_t i = 0; i < COMPONENTS.size(); ++i)
+		{
+			result += COMPONENTS[(swizzle >> (i * 2)) & 3];
+		}
+
+		return result;
+	}
+
+	std::string float_literal(DWORD bits)
+	{
+		const auto value = std::bit_cast<float>(bits);
+
+		if (!std::isfinite(value))
+		{
+			return std::format("asfloat(0x{:08X})", bits);
+		}
+
+		// enough digits to round-trip
+		return std::format("{:.9g}", value);
+	}
+
+	class Translator
+	{
+	public:
+		Translator(std::span<const DWORD> function, const VertexDeclaration* declaration)
+			: m_function(function),
+			  m_declaration(declaration),
+			  m_version(function.empty() ? 0 : function[0])
+		{
+		}
+
+		[[nodiscard]] std::string translate();
+
+	private:
+		struct Write
+		{
+			size_t      line;
+			std::string target; // including the mask
+			std::string value;
+			std::string mask;
+		};
+
+		[[nodiscard]] bool is_pixel_shader() const;
+		[[nodiscard]] bool is_ps_1_4() const;
+
+		void translate_instruction(DWORD opcode, std::span<const DWORD> p, bool coissue);
+		void translate_texture_instruction(DWORD opcode, std::span<const DWORD> p);
+		[[nodiscard]] std::string matrix_product(DWORD vector, DWORD matrix, size_t columns, size_t rows);
+
+		[[nodiscard]] std::string temp(DWORD number);
+		[[nodiscard]] std::string input(DWORD number);
+		[[nodiscard]] std::string constant(DWORD number, bool relative) const;
+		[[nodiscard]] std::string texture(DWORD number);
+		[[nodiscard]] std::string texture_coordinates(DWORD number) const;
+		[[nodiscard]] std::string sample(DWORD stage, const std::string& uv) const;
+		[[nodiscard]] std::string source(DWORD token, DWORD offset = 0);
+		[[nodiscard]] std::string destination(DWORD token);
+
+		/**
+		 * \brief Applies the result modifiers of \p token to \p value and assigns it.
+		 * \param components Further limits the components written, for instructions that don't produce all four.
+		 */
+		void write(DWORD token, std::string value, bool coissue, DWORD components = 0xF);
+		void assign(DWORD token, const std::string& value, bool coissue, DWORD components = 0xF);
+
+		[[nodiscard]] std::string vertex_shader_source() const;
+		[[nodiscard]] std::string pixel_shader_source() const;
+		[[nodiscard]] std::string body() const;
+
+		std::span<const DWORD> m_function;
+		const VertexDeclaration* m_declaration;
+		DWORD m_version;
+
+		std::vector<std::string> m_lines;
+		// rewritten if the next instruction is co-issued with it
+		std::optional<Write> m_last_write;
+		size_t m_coissue_count = 0;
+
+		uint32_t m_temps            = 0; // r registers used
+		uint32_t m_inputs           = 0; // v registers read by a vertex shader
+		uint32_t m_textures         = 0; // t registers used by a ps.1.0 through ps.1.3 shader
+		uint32_t m_texcoord_outputs = 0; // oT registers written
+		bool     m_writes_fog       = false;
+
+		// pixel shader constants defined by the shader itself
+		std::array<std::optional<std::array<DWORD, 4>>, PS_CONSTANT_REGISTER_MAX> m_definitions;
+	};
+
+	bool Translator::is_pixel_shader() const
+	{
+		return is_pixel_shader_version(m_version);
+	}
+
+	bool Translator::is_ps_1_4() const
+	{
+		return m_version >= D3DPS_VERSION(1, 4);
+	}
+
+	std::string Translator::translate()
+	{
+		if (is_pixel_shader())
+		{
+			if (m_version < D3DPS_VERSION(1, 0) || m_version > D3DPS_VERSION(1, 4))
+			{
+				throw std::runtime_error(std::format("unsupported pixel shader version {}.{}",
+				                                     D3DSHADER_VERSION_MAJOR(m_version), D3DSHADER_VERSION_MINOR(m_version)));
+			}
+		}
+		else if (m_version != D3DVS_VERSION(1, 0) && m_version != D3DVS_VERSION(1, 1))
+		{
+			throw std::runtime_error(std::format("unsupported vertex shader version 0x{:08X}", m_version));
+		}
+
+		// constants are defined before anything that reads them, but collecting them up front keeps that out of the way
+		for_each_instruction(m_function.data(), m_function.size(), [&](DWORD token, std::span<const DWORD> p)
+		{
+			if ((token & D3DSI_OPCODE_MASK) != D3DSIO_DEF)
+			{
+				return;
+			}
+
+			const DWORD number = p[0] & D3DSP_REGNUM_MASK;
+
+			if (!is_pixel_shader() || (p[0] & D3DSP_REGTYPE_MASK) != D3DSPR_CONST || number >= PS_CONSTANT_REGISTER_MAX)
+			{
+				throw std::runtime_error(std::format("invalid constant definition 0x{:08X}", p[0]));
+			}
+
+			m_definitions[number] = { p[1], p[2], p[3], p[4] };
+		});
+
+		for_each_instruction(m_function.data(), m_function.size(), [&](DWORD token, std::span<const DWORD> p)
+		{
+			translate_instruction(token & D3DSI_OPCODE_MASK, p, (token & D3DSI_COISSUE) != 0);
+		});
+
+		return is_pixel_shader() ? pixel_shader_source() : vertex_shader_source();
+	}
+
+	void Translator::translate_instruction(DWORD opcode, std::span<const DWORD> p, bool coissue)
+	{
+		const auto s = [&](size_t i)
+		{
+			return source(p[i]);
+		};
+
+		switch (opcode)
+		{
+			case D3DSIO_NOP:
+			case D3DSIO_PHASE: // registers keep their values across phases, so there's nothing to do
+			case D3DSIO_DEF:
+				return;
+
+			case D3DSIO_MOV:
+				write(p[0], s(1), coissue);
+				return;
+
+			case D3DSIO_ADD:
+				write(p[0], std::format("{} + {}", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_SUB:
+				write(p[0], std::format("{} - {}", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_MAD:
+				write(p[0], std::format("{} * {} + {}", s(1), s(2), s(3)), coissue);
+				return;
+
+			case D3DSIO_MUL:
+				write(p[0], std::format("{} * {}", s(1), s(2)), coissue);
+				return;
+
+			// the scalar instructions read the last component, which is the replicated one if there's a swizzle
+			case D3DSIO_RCP:
+				write(p[0], std::format("(float4)(1 / {}.w)", s(1)), coissue);
+				return;
+
+			case D3DSIO_RSQ:
+				write(p[0], std::format("(float4)rsqrt(abs({}.w))", s(1)), coissue);
+				return;
+
+			case D3DSIO_DP3:
+				write(p[0], std::format("(float4)dot({}.xyz, {}.xyz)", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_DP4:
+				write(p[0], std::format("(float4)dot({}, {})", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_MIN:
+				write(p[0], std::format("min({}, {})", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_MAX:
+				write(p[0], std::format("max({}, {})", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_SLT:
+				write(p[0], std::format("(float4)({} < {})", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_SGE:
+				write(p[0], std::format("(float4)({} >= {})", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_EXP:
+				write(p[0], std::format("(float4)exp2({}.w)", s(1)), coissue);
+				return;
+
+			case D3DSIO_LOG:
+				write(p[0], std::format("(float4)log2(abs({}.w))", s(1)), coissue);
+				return;
+
+			case D3DSIO_EXPP:
+				write(p[0], std::format("d3d8_expp({}.w)", s(1)), coissue);
+				return;
+
+			case D3DSIO_LOGP:
+				write(p[0], std::format("d3d8_logp({}.w)", s(1)), coissue);
+				return;
+
+			case D3DSIO_LIT:
+				write(p[0], std::format("d3d8_lit({})", s(1)), coissue);
+				return;
+
+			case D3DSIO_DST:
+				write(p[0], std::format("d3d8_dst({}, {})", s(1), s(2)), coissue);
+				return;
+
+			case D3DSIO_LRP:
+				write(p[0], std::format("lerp({2}, {1}, {0})", s(1), s(2), s(3)), coissue);
+				return;
+
+			case D3DSIO_FRC:
+				write(p[0], std::format("frac({})", s(1)), coissue);
+				return;
+
+			case D3DSIO_M4x4:
+				write(p[0], matrix_product(p[1], p[2], 4, 4), coissue);
+				return;
+
+			case D3DSIO_M4x3:
+				write(p[0], matrix_product(p[1], p[2], 4, 3), coissue, 0x7);
+				return;
+
+			case D3DSIO_M3x4:
+				write(p[0], matrix_product(p[1], p[2], 3, 4), coissue);
+				return;
+
+			case D3DSIO_M3x3:
+				write(p[0], matrix_product(p[1], p[2], 3, 3), coissue, 0x7);
+				return;
+
+			case D3DSIO_M3x2:
+				write(p[0], matrix_product(p[1], p[2], 3, 2), coissue, 0x3);
+				return;
+
+			case D3DSIO_CND:
+				write(p[0], std::format("({} > 0.5 ? {} : {})", s(1), s(2), s(3)), coissue);
+				return;
+
+			case D3DSIO_CMP:
+				write(p[0], std::format("({} >= 0 ? {} : {})", s(1), s(2), s(3)), coissue);
+				return;
+
+			case D3DSIO_BEM:
+			{
+				const DWORD stage = p[0] & D3DSP_REGNUM_MASK;
+				write(p[0], std::format("float4({}.xy + d3d8_bump({}, {}), 0, 0)", s(1), stage, s(2)), coissue, 0x3);
+				return;
+			}
+
+			default:
+				translate_texture_instruction(opcode, p);
+				return;
+		}
+	}
+
+	void Translator::translate_texture_instruction(DWORD opcode, std::span<const DWORD> p)
+	{
+		if (!is_pixel_shader())
+		{
+			throw std::runtime_error(std::format("instruction 0x{:04X} is only valid in pixel shaders", opcode));
+		}
+
+		// every texture instruction addresses the stage of its destination register
+		const DWORD stage = p[0] & D3DSP_REGNUM_MASK;
+
+		if (stage >= TEXTURE_STAGE_MAX)
+		{
+			throw std::runtime_error(std::format("invalid texture register 0x{:08X}", p[0]));
+		}
+
+		const std::string coordinates = texture_coordinates(stage);
+
+		const auto dot = [&]
+		{
+			return std::format("dot({}.xyz, {}.xyz)", coordinates, source(p[1]));
+		};
+
+		switch (opcode)
+		{
+			case D3DSIO_TEX:
+				assign(p[0], sample(stage, is_ps_1_4() ? source(p[1]) : coordinates), false);
+				return;
+
+			case D3DSIO_TEXCOORD:
+				if (is_ps_1_4())
+				{
+					assign(p[0], source(p[1]), false);
+				}
+				else
+				{
+					assign(p[0], std::format("float4(saturate({}.xyz), 1)", coordinates), false);
+				}
+
+				return;
+
+			case D3DSIO_TEXKILL:
+			{
+				// only ps.1.4 can test a temporary register; otherwise it's the stage's texture coordinates
+				const bool is_temp = is_ps_1_4() && (p[0] & D3DSP_REGTYPE_MASK) == D3DSPR_TEMP;
+				m_lines.push_back(std::format("clip({}.xyz);", is_temp ? temp(stage) : coordinates));
+				m_last_write.reset();
+				return;
+			}
+
+			case D3DSIO_TEXBEM:
+				assign(p[0], sample(stage, std::format("{}.xy + d3d8_bump({}, {})", coordinates, stage, source(p[1]))), false);
+				return;
+
+			case D3DSIO_TEXBEML:
+			{
+				const std::string bump = source(p[1]);
+
+				assign(p[0], std::format("{} * d3d8_luminance({}, {})",
+				                         sample(stage, std::format("{}.xy + d3d8_bump({}, {})", coordinates, stage, bump)), stage, bump), false);
+				return;
+			}
+
+			case D3DSIO_TEXREG2AR:
+				assign(p[0], sample(stage, std::format("{}.wx", source(p[1]))), false);
+				return;
+
+			case D3DSIO_TEXREG2GB:
+				assign(p[0], sample(stage, std::format("{}.yz", source(p[1]))), false);
+				return;
+
+			// only two-dimensional textures exist, so the third coordinate goes unused
+			case D3DSIO_TEXREG2RGB:
+				assign(p[0], sample(stage, source(p[1])), false);
+				return;
+
+			case D3DSIO_TEXM3x2PAD:
+			case D3DSIO_TEXM3x3PAD:
+			case D3DSIO_TEXDP3:
+				assign(p[0], std::format("(float4){}", dot()), false);
+				return;
+
+			case D3DSIO_TEXM3x2TEX:
+				if (stage < 1)
+				{
+					break;
+				}
+
+				assign(p[0], sample(stage, std::format("float2({}.x, {})", texture(stage - 1), dot())), false);
+				return;
+
+			case D3DSIO_TEXM3x3:
+				if (stage < 2)
+				{
+					break;
+				}
+
+				assign(p[0], std::format("float4({}.x, {}.x, {}, 1)", texture(stage - 2), texture(stage - 1), dot()), false);
+				return;
+
+			case D3DSIO_TEXDP3TEX:
+				assign(p[0], sample(stage, std::format("float2({}, 0)", dot())), false);
+				return;
+
+			case D3DSIO_TEXM3x3TEX:
+			case D3DSIO_TEXM3x3DIFF:
+			case D3DSIO_TEXM3x3SPEC:
+			case D3DSIO_TEXM3x3VSPEC:
+				throw std::runtime_error(std::format("instruction 0x{:04X} samples a cube or volume texture, which isn't supported", opcode));
+
+			case D3DSIO_TEXM3x2DEPTH:
+			case D3DSIO_TEXDEPTH:
+				throw std::runtime_error(std::format("instruction 0x{:04X} writes depth, which isn't supported", opcode));
+
+			default:
+				break;
+		}
+
+		throw std::runtime_error(std::format("invalid use of instruction 0x{:04X}", opcode));
+	}
+
+	std::string Translator::matrix_product(DWORD vector, DWORD matrix, size_t columns, size_t rows)
+	{
+		const std::string v = source(vector);
+		std::string result = "float4(";
+
+		for (DWORD row = 0; row < 4; ++row)
+		{
+			if (row != 0)
+			{
+				result += ", ";
+			}
+
+			if (row >= rows)
+			{
+				result += "0";
+			}
+			else if (columns == 4)
+			{
+				result += std::format("dot({}, {})", v, source(matrix, row));
+			}
+			else
+			{
+				result += std::format("dot({}.xyz, {}.xyz)", v, source(matrix, row));
+			}
+		}
+
+		return result + ")";
+	}
+
+	std::string Translator::temp(DWORD number)
+	{
+		const DWORD count = !is_pixel_shader() ? VS_TEMP_REGISTER_MAX : is_ps_1_4() ? PS_1_4_TEMP_REGISTER_MAX : PS_TEMP_REGISTER_MAX;
+
+		if (number >= count)
+		{
+			throw std::runtime_error(std::format("invalid temporary register r{}", number));
+		}
+
+		m_temps |= 1u << number;
+		return std::format("r{}", number);
+	}
+
+	std::string Translator::input(DWORD number)
+	{
+		if (is_pixel_shader())
+		{
+			if (number >= PS_COLOR_INPUT_MAX)
+			{
+				throw std::runtime_error(std::format("invalid color register v{}", number));
+			}
+
+			// interpolated colors are clamped like they would be in an 8-bit color register
+			return number == 0 ? "saturate(input.diffuse)" : "saturate(input.specular)";
+		}
+
+		if (number >= VS_INPUT_REGISTER_MAX)
+		{
+			throw std::runtime_error(std::format("invalid input register v{}", number));
+		}
+
+		m_inputs |= 1u << number;
+		return std::format("v{}", number);
+	}
+
+	std::string Translator::constant(DWORD number, bool relative) const
+	{
+		if (!is_pixel_shader())
+		{
+			// out of range relative reads return 0 like they would from a constant buffer
+			if (relative)
+			{
+				return std::format("vs_c[a0.x + {}]", number);
+			}
+
+			if (number < VS_CONSTANT_REGISTER_MAX)
+			{
+				return std::format("vs_c[{}]", number);
+			}
+		}
+		else if (!relative && number < PS_CONSTANT_REGISTER_MAX)
+		{
+			return m_definitions[number].has_value() ? std::format("def_c{}", number) : std::format("ps_c[{}]", number);
+		}
+
+		throw std::runtime_error(std::format("invalid constant register c{}", number));
+	}
+
+	std::string Translator::texture(DWORD number)
+	{
+		if (is_ps_1_4() || number >= PS_TEXTURE_REGISTER_MAX)
+		{
+			throw std::runtime_error(std::format("invalid texture register t{}", number));
+		}
+
+		m_textures |= 1u << number;
+		return std::format("t{}", number);
+	}
+
+	std::string Translator::texture_coordinates(DWORD number) const
+	{
+		if (number >= FVF_TEXCOORD_MAX)
+		{
+			throw std::runtime_error(std::format("invalid texture coordinate register t{}", number));
+		}
+
+		return std::format("input.uv[{}]", number);
+	}
+
+	std::string Translator::sample(DWORD stage, const std::string& uv) const
+	{
+		return std::format("textures[{0}].Sample(samplers[{0}], ({1}).xy)", stage, uv);
+	}
+
+	std::string Translator::source(DWORD token, DWORD offset)
+	{
+		const DWORD type   = token & D3DSP_REGTYPE_MASK;
+		const DWORD number = (token & D3DSP_REGNUM_MASK) + offset;
+
+		std::string result;
+
+		switch (type)
+		{
+			case D3DSPR_TEMP:
+				result = temp(number);
+				break;
+
+			case D3DSPR_INPUT:
+				result = input(number);
+				break;
+
+			case D3DSPR_CONST:
+				result = constant(number, (token & D3DVS_ADDRESSMODE_MASK) == D3DVS_ADDRMODE_RELATIVE);
+				break;
+
+			// ps.1.4 reads texture coordinates from t registers; before that they're the results of texture instructions
+			case D3DSPR_TEXTURE:
+				if (is_pixel_shader())
+				{
+					result = is_ps_1_4() ? texture_coordinates(number) : texture(number);
+					break;
+				}
+
+				[[fallthrough]];
+
+			default:
+				throw std::runtime_error(std::format("invalid source parameter 0x{:08X}", token));
+		}
+
+		result += swizzle_string(token);
+
+		switch (token & D3DSP_SRCMOD_MASK)
+		{
+			case D3DSPSM_NONE:
+				return result;
+
+			case D3DSPSM_NEG:
+				return "-" + result;
+
+			case D3DSPSM_BIAS:
+				return std::format("({} - 0.5)", result);
+
+			case D3DSPSM_BIASNEG:
+				return std::format("(0.5 - {})", result);
+
+			case D3DSPSM_SIGN:
+				return std::format("({} * 2 - 1)", result);
+
+			case D3DSPSM_SIGNNEG:
+				return std::format("(1 - {} * 2)", result);
+
+			case D3DSPSM_COMP:
+				return std::format("(1 - {})", result);
+
+			case D3DSPSM_X2:
+				return std::format("({} * 2)", result);
+
+			case D3DSPSM_X2NEG:
+				return std::format("({} * -2)", result);
+
+			case D3DSPSM_DZ:
+				return std::format("({0} / {0}.z)", result);
+
+			case D3DSPSM_DW:
+				return std::format("({0} / {0}.w)", result);
+
+			default:
+				throw std::runtime_error(std::format("invalid source modifier in parameter 0x{:08X}", token));
+		}
+	}
+
+	std::string Translator::destination(DWORD token)
+	{
+		const DWORD type   = token & D3DSP_REGTYPE_MASK;
+		const DWORD number = token & D3DSP_REGNUM_MASK;
+
+		if (is_pixel_shader())
+		{
+			switch (type)
+			{
+				case D3DSPR_TEMP:
+					return temp(number);
+
+				case D3DSPR_TEXTURE:
+					if (!is_ps_1_4())
+					{
+						return texture(number);
+					}
+
+					break;
+
+				default:
+					break;
+			}
+		}
+		else
+		{
+			switch (type)
+			{
+				case D3DSPR_TEMP:
+					return temp(number);
+
+				case D3DSPR_ADDR:
+					if (number == 0)
+					{
+						return "a0";
+					}
+
+					break;
+
+				case D3DSPR_RASTOUT:
+					switch (number)
+					{
+						case D3DSRO_POSITION:
+							return "o_pos";
+
+						case D3DSRO_FOG:
+							m_writes_fog = true;
+							return "o_fog";
+
+						// there are no point sprites to size
+						case D3DSRO_POINT_SIZE:
+							return "o_pts";
+
+						default:
+							break;
+					}
+
+					break;
+
+				case D3DSPR_ATTROUT:
+					if (number < VS_COLOR_OUTPUT_MAX)
+					{
+						return std::format("o_d{}", number);
+					}
+
+					break;
+
+				case D3DSPR_TEXCRDOUT:
+					if (number < FVF_TEXCOORD_MAX)
+					{
+						m_texcoord_outputs |= 1u << number;
+						return std::format("o_t{}", number);
+					}
+
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		throw std::runtime_error(std::format("invalid destination parameter 0x{:08X}", token));
+	}
+
+	void Translator::write(DWORD token, std::string value, bool coissue, DWORD components)
+	{
+		const DWORD shift = (token & D3DSP_DSTSHIFT_MASK) >> D3DSP_DSTSHIFT_SHIFT;
+
+		if (shift != 0)
+		{
+			// a signed 4-bit power of two
+			const int exponent = shift < 8 ? static_cast<int>(shift) : static_cast<int>(shift) - 16;
+			value = std::format("({}) * {}", value, std::ldexp(1.0f, exponent));
+		}
+
+		if ((token & D3DSP_DSTMOD_MASK) == D3DSPDM_SATURATE)
+		{
+			value = std::format("saturate({})", value);
+		}
+		else if (is_pixel_shader())
+		{
+			value = std::format("clamp({}, {}, {})", value, -PS_VALUE_MAX, PS_VALUE_MAX);
+		}
+
+		assign(token, value, coissue, components);
+	}
+
+	void Translator::assign(DWORD token, const std::string& value, bool coissue, DWORD components)
+	{
+		const DWORD mask = ((token & D3DSP_WRITEMASK_ALL) >> 16) & components;
+
+		if (mask == 0)
+		{
+			throw std::runtime_error(std::format("destination parameter 0x{:08X} writes nothing", token));
+		}
+
+		std::string target = destination(token);
+		const std::string mask_str = mask_string(mask);
+
+		// the address register is an integer, and vs.1.1 floors what's moved into it
+		const std::string converted = target == "a0" ? std::format("(int4)floor({})", value) : value;
+
+		target += mask_str;
+
+		if (coissue && m_last_write.has_value())
+		{
+			// co-issued instructions read their sources before either of them writes its result
+			const std::string name = std::format("coissue{}", m_coissue_count++);
+
+			m_lines[m_last_write->line] = std::format("const float4 {} = {};", name, m_last_write->value);
+			m_lines.push_back(std::format("{} = ({}){};", target, converted, mask_str));
+			m_lines.push_back(std::format("{} = {}{};", m_last_write->target, name, m_last_write->mask));
+			m_last_write.reset();
+			return;
+		}
+
+		m_last_write = Write { m_lines.size(), target, converted, mask_str };
+		m_lines.push_back(std::format("{} = ({}){};", target, converted, mask_str));
+	}
+
+	std::string Translator::body() const
+	{
+		std::string result;
+
+		for (const std::string& line : m_lines)
+		{
+			result += '\t';
+			result += line;
+			result += '\n';
+		}
+
+		return result;
+	}
+
+	std::string Translator::vertex_shader_source() const
+	{
+		std::string result = std::format("// translated from vs.{}.{}\n", D3DSHADER_VERSION_MAJOR(m_version), D3DSHADER_VERSION_MINOR(m_version));
+
+		result += PRELUDE;
+		result += std::format("\ncbuffer VertexShaderConstants : register(b{})\n{{\n\tfloat4 vs_c[{}];\n}}\n",
+		                      SHADER_CONSTANT_BUFFER_SLOT, VS_CONSTANT_REGISTER_MAX);
+		result += VERTEX_SHADER_HELPERS;
+
+		std::string parameters;
+		std::string locals;
+
+		for (DWORD i = 0; i < VS_INPUT_REGISTER_MAX; ++i)
+		{
+			if (!(m_inputs & (1u << i)))
+			{
+				continue;
+			}
+
+			const auto& elements = m_declaration->get_elements();
+
+			const auto it = std::ranges::find_if(elements, [i](const VertexDeclaration::Element& element)
+			{
+				return element.vertex_register == i;
+			});
+
+			if (!parameters.empty())
+			{
+				parameters += ", ";
+			}
+
+			if (it == elements.end())
+			{
+				// not loaded by the declaration
+				locals += std::format("\tconst float4 v{} = float4(0, 0, 0, 1);\n", i);
+				continue;
+			}
+
+			const std::string semantic = std::format("{}{}", VertexDeclaration::SHADER_INPUT_SEMANTIC, i);
+
+			switch (it->type)
+			{
+				case D3DVSDT_UBYTE4:
+					parameters += std::format("uint4 input_v{} : {}", i, semantic);
+					locals += std::format("\tconst float4 v{0} = (float4)input_v{0};\n", i);
+					break;
+
+				case D3DVSDT_SHORT2:
+				case D3DVSDT_SHORT4:
+					parameters += std::format("int4 input_v{} : {}", i, semantic);
+					locals += std::format("\tconst float4 v{0} = (float4)input_v{0};\n", i);
+					break;
+
+				// the input assembler expands narrower formats to (x, 0, 0, 1) just like D3D8
+				default:
+					parameters += std::format("float4 v{} : {}", i, semantic);
+					break;
+			}
+		}
+
+		// parameters for undeclared inputs were skipped, which can leave a trailing separator
+		if (parameters.ends_with(", "))
+		{
+			parameters.resize(parameters.size() - 2);
+		}
+
+		for (DWORD i = 0; i < VS_TEMP_REGISTER_MAX; ++i)
+		{
+			if (m_temps & (1u << i))
+			{
+				locals += std::format("\tfloat4 r{} = 0;\n", i);
+			}
+		}
+
+		locals += "\tint4 a0 = 0;\n";
+		locals += "\tfloat4 o_pos = 0;\n";
+		locals += "\tfloat4 o_fog = 0;\n";
+		locals += "\tfloat4 o_pts = 0;\n";
+		locals += "\tfloat4 o_d0 = 1;\n";
+		locals += "\tfloat4 o_d1 = 0;\n";
+
+		for (DWORD i = 0; i < FVF_TEXCOORD_MAX; ++i)
+		{
+			if (m_texcoord_outputs & (1u << i))
+			{
+				locals += std::format("\tfloat4 o_t{} = 0;\n", i);
+			}
+		}
+
+		result += std::format("\nVS_OUTPUT main({})\n{{\n{}\n{}\n", parameters, locals, body());
+
+		result += "\tVS_OUTPUT result = (VS_OUTPUT)0;\n\n";
+		result += "\tresult.position = o_pos;\n";
+		result += "\tresult.depth    = o_pos.zw;\n";
+		// without oFog, this is the view space depth for any ordinary projection
+		result += m_writes_fog ? "\tresult.fog      = d3d8_fog_distance(o_fog.x);\n" : "\tresult.fog      = o_pos.w;\n";
+		result += "\tresult.diffuse  = saturate(o_d0);\n";
+		result += "\tresult.specular = saturate(o_d1);\n\n";
+
+		for (DWORD i = 0; i < FVF_TEXCOORD_MAX; ++i)
+		{
+			if (m_texcoord_outputs & (1u << i))
+			{
+				result += std::format("\tresult.uv[{0}] = o_t{0};\n", i);
+			}
+
+			result += std::format("\tresult.uv_meta[{}].component_count = 4;\n", i);
+		}
+
+		result += "\n\treturn result;\n}\n";
+		return result;
+	}
+
+	std::string Translator::pixel_shader_source() const
+	{
+		std::string result = std::format("// translated from ps.{}.{}\n", D3DSHADER_VERSION_MAJOR(m_version), D3DSHADER_VERSION_MINOR(m_version));
+
+		result += PRELUDE;
+		result += std::format("\ncbuffer PixelShaderConstants : register(b{})\n{{\n\tfloat4 ps_c[{}];\n}}\n",
+		                      SHADER_CONSTANT_BUFFER_SLOT, PS_CONSTANT_REGISTER_MAX);
+
+		if (std::ranges::any_of(m_definitions, [](const auto& definition) { return definition.has_value(); }))
+		{
+			result += '\n';
+		}
+
+		for (size_t i = 0; i < m_definitions.size(); ++i)
+		{
+			if (const auto& definition = m_definitions[i])
+			{
+				result += std::format("static const float4 def_c{} = float4({}, {}, {}, {});\n", i,
+				                      float_literal((*definition)[0]), float_literal((*definition)[1]),
+				                      float_literal((*definition)[2]), float_literal((*definition)[3]));
+			}
+		}
+
+		result += PIXEL_SHADER_HELPERS;
+
+		std::string locals;
+
+		// r0 is the result, so it always exists
+		const uint32_t temps = m_temps | 1u;
+
+		for (DWORD i = 0; i < PS_1_4_TEMP_REGISTER_MAX; ++i)
+		{
+			if (temps & (1u << i))
+			{
+				locals += std::format("\tfloat4 r{} = 0;\n", i);
+			}
+		}
+
+		for (DWORD i = 0; i < PS_TEXTURE_REGISTER_MAX; ++i)
+		{
+			if (m_textures & (1u << i))
+			{
+				locals += std::format("\tfloat4 t{} = 0;\n", i);
+			}
+		}
+
+		result += std::format("\nfloat4 translated_main(VS_OUTPUT input)\n{{\n{}\n{}\n\treturn r0;\n}}\n", locals, body());
+		result += PIXEL_SHADER_MAIN;
+		return result;
+	}
+}
+
+namespace d3d8to11
+{
+size_t shader_token_count(const DWORD* tokens)
+{
+	const DWORD type = tokens[0] & SHADER_TYPE_MASK;
+
+	if (type != VERTEX_SHADER_TYPE && type != PIXEL_SHADER_TYPE)
+	{
+		throw std::runtime_error(std::format("invalid shader version token 0x{:08X}", tokens[0]));
+	}
+
+	return for_each_instruction(tokens, SIZE_MAX, [](DWORD, std::span<const DWORD>) {});
+}
+
+uint64_t vertex_shader_hash(std::span<const DWORD> function, const VertexDeclaration& declaration)
+{
+	uint64_t hash = fnv1a_64_value(SHADER_TRANSLATOR_VERSION);
+	hash = fnv1a_64(function.data(), function.size_bytes(), hash);
+	return fnv1a_64_value(declaration.layout_hash(), hash);
+}
+
+uint64_t pixel_shader_hash(std::span<const DWORD> function)
+{
+	const uint64_t hash = fnv1a_64_value(SHADER_TRANSLATOR_VERSION);
+	return fnv1a_64(function.data(), function.size_bytes(), hash);
+}
+
+std::string translate_vertex_shader(std::span<const DWORD> function, const VertexDeclaration& declaration)
+{
+	if (function.empty() || is_pixel_shader_version(function[0]))
+	{
+		throw std::runtime_error("not a vertex shader");
+	}
+
+	return Translator(function, &declaration).translate();
+}
+
+std::string translate_pixel_shader(std::span<const DWORD> function)
+{
+	if (function.empty() || !is_pixel_shader_version(function[0]))
+	{
+		throw std::runtime_error("not a pixel shader");
+	}
+
+	return Translator(function, nullptr).translate();
+}
+}
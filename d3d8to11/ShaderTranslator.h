@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "d3d8types.h"
+
+class VertexDeclaration;
+
+namespace d3d8to11
+{
+// the size of each stage's constant register file, as reported in the device caps
+constexpr size_t VS_CONSTANT_REGISTER_MAX = 96;
+constexpr size_t PS_CONSTANT_REGISTER_MAX = 8;
+
+// the constant buffer slot translated shaders read their constant registers from, after the ones d3d8to11.hlsl uses
+constexpr UINT SHADER_CONSTANT_BUFFER_SLOT = 5;
+
+// the range pixel shader arithmetic is clamped to, as reported in MaxPixelShaderValue
+constexpr float PS_VALUE_MAX = 8.0f;
+
+// bumped whenever the generated HLSL changes so that cached translations aren't used
+constexpr uint32_t SHADER_TRANSLATOR_VERSION = 1;
+
+/**
+ * \brief Returns the number of tokens in a D3D8 shader function, from the version token
+ * up to and including the end token, stepping over comments (which may contain anything).
+ * \throws std::runtime_error if the first token isn't a vertex or pixel shader version.
+ */
+[[nodiscard]] size_t shader_token_count(const DWORD* tokens);
+
+/**
+ * \brief Identifies the translation of \p function for \p declaration, which is all it depends on
+ * besides the translator itself.
+ */
+[[nodiscard]] uint64_t vertex_shader_hash(std::span<const DWORD> function, const VertexDeclaration& declaration);
+[[nodiscard]] uint64_t pixel_shader_hash(std::span<const DWORD> function);
+
+/**
+ * \brief Translates a vs.1.0 or vs.1.1 function to HLSL SM5 source with a \c main entry point.
+ *
+ * Vertex register n is taken from semantic \c V n as the type \p declaration loads it as,
+ * constant registers from a constant buffer in \c SHADER_CONSTANT_BUFFER_SLOT,
+ * and the result is written to the \c VS_OUTPUT of d3d8to11.hlsl so that it can feed either kind of pixel shader.
+ * \throws std::runtime_error if the function is malformed or uses something that can't be translated.
+ */
+[[nodiscard]] std::string translate_vertex_shader(std::span<const DWORD> function, const VertexDeclaration& declaration);
+
+/**
+ * \brief Translates a ps.1.0 through ps.1.4 function to HLSL SM5 source with a \c main entry point
+ * that takes the \c VS_OUTPUT of d3d8to11.hlsl and applies fog, alpha testing and OIT to its result
+ * the same way the fixed-function pixel shaders do.
+ * \throws std::runtime_error if the function is malformed or uses something that can't be translated.
+ */
+[[nodiscard]] std::string translate_pixel_shader(std::span<const DWORD> function);
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+/**
+ * \brief Lock-free allocator for objects of one type that carves them out of slabs and recycles them through a free list.
+ *
+ * The free list is a Treiber stack of slot indices. Its head carries a tag that changes with every
+ * update, which rules out ABA. Slabs are only freed when the allocator is destroyed, so every object
+ * must be deallocated before then.
+ * \tparam T The type of object to allocate.
+ * \tparam SLAB_SIZE The number of objects per slab.
+ */
+template <typename T, size_t SLAB_SIZE = 64>
+class SlabAllocator
+{
+	static_assert(SLAB_SIZE > 0);
+
+	struct Slot
+	{
+		alignas(T) std::byte storage[sizeof(T)];
+		uint32_t index = 0;
+		std::atomic<uint32_t> next { 0 };
+	};
+
+	static constexpr uint32_t NIL = UINT32_MAX;
+
+public:
+	/**
+	 * \brief The maximum number of slabs, which bounds the number of live objects at <tt>MAX_SLABS * SLAB_SIZE</tt>.
+	 */
+	static constexpr size_t MAX_SLABS = 4096;
+
+	SlabAllocator() = default;
+
+	~SlabAllocator()
+	{
+		const size_t slab_count = m_slab_count.load(std::memory_order_acquire);
+
+		for (size_t i = 0; i < slab_count; ++i)
+		{
+			delete[] m_slabs[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	SlabAllocator(const SlabAllocator&)     = delete;
+	SlabAllocator(SlabAllocator&&) noexcept = delete;
+
+	SlabAllocator& operator=(const SlabAllocator&)     = delete;
+	SlabAllocator& operator=(SlabAllocator&&) noexcept = delete;
+
+	/**
+	 * \brief Constructs a \c T from \p args in a free slot, allocating a new slab only if there are none.
+	 * \throw std::bad_alloc if all \c MAX_SLABS slabs are in use.
+	 */
+	template <typename... Args>
+	[[nodiscard]] T* allocate(Args&&... args)
+	{
+		Slot* slot = pop();
+
+		if (slot == nullptr)
+		{
+			slot = grow();
+		}
+
+		try
+		{
+			return new (slot->storage) T(std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			push(slot, slot);
+			throw;
+		}
+	}
+
+	/**
+	 * \brief Destroys \p object and returns its slot to the free list.
+	 * \param object An object returned by \c allocate of this allocator.
+	 */
+	void deallocate(T* object)
+	{
+		static_assert(offsetof(Slot, storage) == 0);
+
+		object->~T();
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		push(slot, slot);
+	}
+
+private:
+	[[nodiscard]] static uint64_t pack(uint32_t index, uint32_t tag)
+	{
+		return (static_cast<uint64_t>(tag) << 32) | index;
+	}
+
+	[[nodiscard]] static uint32_t index_of(uint64_t head)
+	{
+		return static_cast<uint32_t>(head);
+	}
+
+	[[nodiscard]] static uint32_t tag_of(uint64_t head)
+	{
+		return static_cast<uint32_t>(head >> 32);
+	}
+
+	[[nodiscard]] Slot* slot_at(uint32_t index) const
+	{
+		return &m_slabs[index / SLAB_SIZE].load(std::memory_order_acquire)[index % SLAB_SIZE];
+	}
+
+	Slot* pop()
+	{
+		uint64_t head = m_head.load(std::memory_order_acquire);
+
+		while (index_of(head) != NIL)
+		{
+			// the slot may be popped and reused by another thread before the exchange; its memory stays valid,
+			// and the exchange then fails because the tag has changed
+			Slot* slot = slot_at(index_of(head));
+			const uint32_t next = slot->next.load(std::memory_order_relaxed);
+
+			if (m_head.compare_exchange_weak(head, pack(next, tag_of(head) + 1), std::memory_order_acquire, std::memory_order_acquire))
+			{
+				return slot;
+			}
+		}
+
+		return nullptr;
+	}
+
+	/**
+	 * \brief Pushes the chain of slots from \p first to \p last, which must already be linked through \c Slot::next.
+	 */
+	void push(Slot* first, Slot* last)
+	{
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+
+		do
+		{
+			last->next.store(index_of(head), std::memory_order_relaxed);
+		} while (!m_head.compare_exchange_weak(head, pack(first->index, tag_of(head) + 1), std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	Slot* grow()
+	{
+		std::lock_guard lock(m_grow_mutex);
+
+		const size_t slab_index = m_slab_count.load(std::memory_order_relaxed);
+
+		if (slab_index == MAX_SLABS)
+		{
+			throw std::bad_alloc();
+		}
+
+		auto slab = std::make_unique<Slot[]>(SLAB_SIZE);
+		const auto first_index = static_cast<uint32_t>(slab_index * SLAB_SIZE);
+
+		for (size_t i = 0; i < SLAB_SIZE; ++i)
+		{
+			slab[i].index = first_index + static_cast<uint32_t>(i);
+			slab[i].next.store(first_index + static_cast<uint32_t>(i) + 1, std::memory_order_relaxed);
+		}
+
+		// published before any of its slots can be reached through the free list
+		Slot* result = slab.get();
+		m_slabs[slab_index].store(slab.release(), std::memory_order_release);
+		m_slab_count.store(slab_index + 1, std::memory_order_release);
+
+		// the first slot is returned to the caller; the rest go on the free list
+		if constexpr (SLAB_SIZE > 1)
+		{
+			push(&result[1], &result[SLAB_SIZE - 1]);
+		}
+
+		return result;
+	}
+
+	alignas(64) std::atomic<uint64_t> m_head { pack(NIL, 0) };
+	std::mutex m_grow_mutex;
+	std::atomic_size_t m_slab_count { 0 };
+	std::array<std::atomic<Slot*>, MAX_SLABS> m_slabs {};
+};
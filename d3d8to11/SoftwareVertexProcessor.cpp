@@ -0,0 +1,778 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include <span>
+
+#include "ShaderFlags.h"
+#include "SoftwareVertexProcessor.h"
+
+namespace
+{
+	// vertices processed together, one per lane of an SSE register
+	constexpr size_t LANES = 4;
+
+	// the shaders define their own e (see calc_fog in d3d8to11.hlsl)
+	constexpr float FOG_E = 2.71828f;
+
+	struct Vector3x4
+	{
+		__m128 x, y, z;
+	};
+
+	struct Vector4x4
+	{
+		__m128 x, y, z, w;
+	};
+
+	using Color4x4 = Vector4x4;
+
+	__m128 splat(float value)
+	{
+		return _mm_set1_ps(value);
+	}
+
+	Vector3x4 splat(const float3& value)
+	{
+		return { splat(value.x), splat(value.y), splat(value.z) };
+	}
+
+	Vector4x4 splat(const float4& value)
+	{
+		return { splat(value.x), splat(value.y), splat(value.z), splat(value.w) };
+	}
+
+	__m128 select(__m128 mask, __m128 if_true, __m128 if_false)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, if_true), _mm_andnot_ps(mask, if_false));
+	}
+
+	// _mm_max_ps returns its second operand if either is NaN, so the value always goes first
+	// to end up with the limit instead, like min and max do on the GPU
+	__m128 saturate(__m128 value)
+	{
+		return _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), splat(1.0f));
+	}
+
+	Vector4x4 saturate(const Vector4x4& value)
+	{
+		return { saturate(value.x), saturate(value.y), saturate(value.z), saturate(value.w) };
+	}
+
+	Vector3x4 operator-(const Vector3x4& lhs, const Vector3x4& rhs)
+	{
+		return { _mm_sub_ps(lhs.x, rhs.x), _mm_sub_ps(lhs.y, rhs.y), _mm_sub_ps(lhs.z, rhs.z) };
+	}
+
+	Vector3x4 operator+(const Vector3x4& lhs, const Vector3x4& rhs)
+	{
+		return { _mm_add_ps(lhs.x, rhs.x), _mm_add_ps(lhs.y, rhs.y), _mm_add_ps(lhs.z, rhs.z) };
+	}
+
+	Vector4x4 operator+(const Vector4x4& lhs, const Vector4x4& rhs)
+	{
+		return { _mm_add_ps(lhs.x, rhs.x), _mm_add_ps(lhs.y, rhs.y), _mm_add_ps(lhs.z, rhs.z), _mm_add_ps(lhs.w, rhs.w) };
+	}
+
+	Vector4x4 operator*(const Vector4x4& lhs, const Vector4x4& rhs)
+	{
+		return { _mm_mul_ps(lhs.x, rhs.x), _mm_mul_ps(lhs.y, rhs.y), _mm_mul_ps(lhs.z, rhs.z), _mm_mul_ps(lhs.w, rhs.w) };
+	}
+
+	Vector4x4 operator*(const Vector4x4& lhs, __m128 rhs)
+	{
+		return { _mm_mul_ps(lhs.x, rhs), _mm_mul_ps(lhs.y, rhs), _mm_mul_ps(lhs.z, rhs), _mm_mul_ps(lhs.w, rhs) };
+	}
+
+	__m128 dot(const Vector3x4& lhs, const Vector3x4& rhs)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(lhs.x, rhs.x), _mm_mul_ps(lhs.y, rhs.y)), _mm_mul_ps(lhs.z, rhs.z));
+	}
+
+	__m128 length(const Vector3x4& value)
+	{
+		return _mm_sqrt_ps(dot(value, value));
+	}
+
+	Vector3x4 normalize(const Vector3x4& value)
+	{
+		const __m128 inverse_length = _mm_div_ps(splat(1.0f), length(value));
+		return { _mm_mul_ps(value.x, inverse_length), _mm_mul_ps(value.y, inverse_length), _mm_mul_ps(value.z, inverse_length) };
+	}
+
+	float3 normalize(const float3& value)
+	{
+		const float inverse_length = 1.0f / std::sqrt(value.x * value.x + value.y * value.y + value.z * value.z);
+		return { value.x * inverse_length, value.y * inverse_length, value.z * inverse_length };
+	}
+
+	// there's no SSE pow, so these go one lane at a time
+	__m128 pow(__m128 x, __m128 y)
+	{
+		alignas(16) float x_lanes[LANES];
+		alignas(16) float y_lanes[LANES];
+
+		_mm_store_ps(x_lanes, x);
+		_mm_store_ps(y_lanes, y);
+
+		for (size_t i = 0; i < LANES; ++i)
+		{
+			x_lanes[i] = std::pow(x_lanes[i], y_lanes[i]);
+		}
+
+		return _mm_load_ps(x_lanes);
+	}
+
+	/**
+	 * \brief Row vector times matrix, which is what \c mul(m, v) computes in the shaders
+	 * because the matrices are uploaded untransposed and read as column-major.
+	 */
+	Vector4x4 transform(const Vector4x4& v, const matrix& m)
+	{
+		const auto column = [&](float m1, float m2, float m3, float m4)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(v.x, splat(m1)), _mm_mul_ps(v.y, splat(m2))),
+			                  _mm_add_ps(_mm_mul_ps(v.z, splat(m3)), _mm_mul_ps(v.w, splat(m4))));
+		};
+
+		return {
+			column(m._11, m._21, m._31, m._41),
+			column(m._12, m._22, m._32, m._42),
+			column(m._13, m._23, m._33, m._43),
+			column(m._14, m._24, m._34, m._44),
+		};
+	}
+
+	// mul((float3x3)m, v) in the shaders
+	Vector3x4 transform_normal(const Vector3x4& v, const matrix& m)
+	{
+		const auto column = [&](float m1, float m2, float m3)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(v.x, splat(m1)), _mm_mul_ps(v.y, splat(m2))), _mm_mul_ps(v.z, splat(m3)));
+		};
+
+		return {
+			column(m._11, m._21, m._31),
+			column(m._12, m._22, m._32),
+			column(m._13, m._23, m._33),
+		};
+	}
+
+	// mul(v, (float3x3)m) in the shaders, i.e. the transpose of transform_normal
+	Vector3x4 transform_normal_transposed(const Vector3x4& v, const matrix& m)
+	{
+		const auto column = [&](float m1, float m2, float m3)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(v.x, splat(m1)), _mm_mul_ps(v.y, splat(m2))), _mm_mul_ps(v.z, splat(m3)));
+		};
+
+		return {
+			column(m._11, m._12, m._13),
+			column(m._21, m._22, m._23),
+			column(m._31, m._32, m._33),
+		};
+	}
+
+	float load_float(const uint8_t* data)
+	{
+		float result;
+		std::memcpy(&result, data, sizeof(result));
+		return result;
+	}
+
+	uint32_t load_uint(const uint8_t* data)
+	{
+		uint32_t result;
+		std::memcpy(&result, data, sizeof(result));
+		return result;
+	}
+
+	// loads the float at \p offset of each vertex
+	__m128 load_floats(const std::array<const uint8_t*, LANES>& vertices, size_t offset)
+	{
+		return _mm_setr_ps(load_float(vertices[0] + offset),
+		                   load_float(vertices[1] + offset),
+		                   load_float(vertices[2] + offset),
+		                   load_float(vertices[3] + offset));
+	}
+
+	Vector3x4 load_vector3(const std::array<const uint8_t*, LANES>& vertices, size_t offset)
+	{
+		return {
+			load_floats(vertices, offset),
+			load_floats(vertices, offset + sizeof(float)),
+			load_floats(vertices, offset + sizeof(float) * 2),
+		};
+	}
+
+	// the equivalent of to_color4 for a D3DCOLOR of each vertex
+	Color4x4 load_color(const std::array<const uint8_t*, LANES>& vertices, size_t offset)
+	{
+		const __m128i argb = _mm_setr_epi32(static_cast<int>(load_uint(vertices[0] + offset)),
+		                                    static_cast<int>(load_uint(vertices[1] + offset)),
+		                                    static_cast<int>(load_uint(vertices[2] + offset)),
+		                                    static_cast<int>(load_uint(vertices[3] + offset)));
+
+		const __m128i mask  = _mm_set1_epi32(0xFF);
+		const __m128  scale = splat(1.0f / 255.0f);
+
+		const auto channel = [&](int shift)
+		{
+			return _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(argb, _mm_cvtsi32_si128(shift)), mask)), scale);
+		};
+
+		return { channel(16), channel(8), channel(0), channel(24) };
+	}
+
+	void store_lanes(__m128 value, float (&lanes)[LANES])
+	{
+		_mm_storeu_ps(lanes, value);
+	}
+
+	void store_colors(const Color4x4& color, uint32_t (&lanes)[LANES])
+	{
+		const __m128 scale = splat(255.0f);
+
+		const auto channel = [&](__m128 value, int shift)
+		{
+			return _mm_sll_epi32(_mm_cvtps_epi32(_mm_mul_ps(saturate(value), scale)), _mm_cvtsi32_si128(shift));
+		};
+
+		const __m128i argb = _mm_or_si128(_mm_or_si128(channel(color.x, 16), channel(color.y, 8)),
+		                                  _mm_or_si128(channel(color.z, 0), channel(color.w, 24)));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), argb);
+	}
+
+	/**
+	 * \brief The parts of a light that are the same for every vertex, splatted across the lanes.
+	 */
+	struct LightConstants
+	{
+		int       type;
+		Color4x4  diffuse;
+		Color4x4  specular;
+		Color4x4  ambient;
+		Vector3x4 position;
+		Vector3x4 direction;      // normalize(-direction)
+		Vector3x4 spot_direction; // Ldcs
+		__m128    range;
+		__m128    attenuation0;
+		__m128    attenuation1;
+		__m128    attenuation2;
+		__m128    falloff;
+		__m128    cos_theta2;
+		__m128    cos_phi2;
+	};
+
+	LightConstants make_light_constants(const d3d8to11::FixedFunctionState& state, const Light& light)
+	{
+		LightConstants result {};
+
+		result.type         = light.type;
+		result.diffuse      = splat(light.diffuse);
+		result.specular     = splat(light.specular);
+		result.ambient      = splat(light.ambient);
+		result.position     = splat(light.position);
+		result.direction    = splat(normalize(float3(-light.direction.x, -light.direction.y, -light.direction.z)));
+		result.range        = splat(light.range);
+		result.attenuation0 = splat(light.attenuation0);
+		result.attenuation1 = splat(light.attenuation1);
+		result.attenuation2 = splat(light.attenuation2);
+		result.falloff      = splat(light.falloff);
+
+		// normalize(-mul(mul((float3x3)world_matrix, direction), (float3x3)view_matrix)) like the shaders
+		const Vector3x4 world_direction = transform_normal(splat(light.direction), state.world_matrix);
+		const Vector3x4 spot_direction  = transform_normal_transposed(world_direction, state.view_matrix);
+
+		result.spot_direction = normalize(Vector3x4 { _mm_sub_ps(_mm_setzero_ps(), spot_direction.x),
+		                                              _mm_sub_ps(_mm_setzero_ps(), spot_direction.y),
+		                                              _mm_sub_ps(_mm_setzero_ps(), spot_direction.z) });
+
+		constexpr float pi = 3.14159265358979323846f;
+
+		const float theta = std::clamp(light.theta, 0.0f, pi);
+		const float phi   = std::clamp(light.phi, theta, pi);
+
+		result.cos_theta2 = splat(std::cos(theta / 2.0f));
+		result.cos_phi2   = splat(std::cos(phi / 2.0f));
+
+		return result;
+	}
+
+	/**
+	 * \brief The material colors of \c get_colors in \c d3d8to11.hlsl.
+	 */
+	struct VertexColors
+	{
+		Color4x4 ambient;
+		Color4x4 diffuse;
+		Color4x4 specular;
+		Color4x4 emissive;
+	};
+
+	Color4x4 select_color_source(uint32_t source, const float4& material_color,
+	                             const Color4x4* input_diffuse, const Color4x4* input_specular)
+	{
+		switch (source)
+		{
+			case D3DMCS_MATERIAL:
+				return splat(material_color);
+
+			case D3DMCS_COLOR1:
+				return input_diffuse != nullptr ? *input_diffuse : splat(material_color);
+
+			case D3DMCS_COLOR2:
+				return input_specular != nullptr ? *input_specular : splat(material_color);
+
+			default:
+				return splat(float4(1.0f, 0.0f, 0.0f, 1.0f));
+		}
+	}
+
+	VertexColors get_colors(const d3d8to11::FixedFunctionState& state, const Color4x4* input_diffuse, const Color4x4* input_specular)
+	{
+		const Color4x4 white = splat(float4(1.0f, 1.0f, 1.0f, 1.0f));
+		const Color4x4 black = splat(float4(0.0f, 0.0f, 0.0f, 0.0f));
+
+		VertexColors result { black, black, black, black };
+
+		if (!state.color_vertex)
+		{
+			result.diffuse  = state.rs_lighting ? splat(state.material.diffuse) : white;
+			result.specular = state.rs_lighting ? splat(state.material.specular) : black;
+		}
+		else if (!state.rs_lighting)
+		{
+			result.diffuse  = input_diffuse != nullptr ? *input_diffuse : white;
+			result.specular = input_specular != nullptr ? *input_specular : black;
+		}
+		else
+		{
+			result.ambient  = select_color_source(state.ambient_source, state.material.ambient, input_diffuse, input_specular);
+			result.diffuse  = select_color_source(state.diffuse_source, state.material.diffuse, input_diffuse, input_specular);
+			result.specular = select_color_source(state.specular_source, state.material.specular, input_diffuse, input_specular);
+			result.emissive = select_color_source(state.emissive_source, state.material.emissive, input_diffuse, input_specular);
+		}
+
+		return result;
+	}
+
+	/**
+	 * \brief \c perform_lighting in \c d3d8to11.hlsl, followed by the emissive term that \c fixed_func_vs adds.
+	 * \param normal The normalized world space normal, or \c nullptr if the vertices have none.
+	 */
+	void perform_lighting(const d3d8to11::FixedFunctionState& state,
+	                      std::span<const LightConstants> lights,
+	                      VertexColors& colors,
+	                      const Vector3x4& world_position,
+	                      const Vector3x4* normal)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one  = splat(1.0f);
+
+		Color4x4 ambient  { zero, zero, zero, zero };
+		Color4x4 diffuse  { zero, zero, zero, zero };
+		Color4x4 specular { zero, zero, zero, zero };
+
+		const Color4x4& c_a = colors.ambient;
+		const Color4x4& c_d = colors.diffuse;
+		const Color4x4& c_s = colors.specular;
+
+		__m128 p = zero;
+		Vector3x4 view_dir {};
+
+		if (state.rs_specular)
+		{
+			p = splat(std::max(0.0f, state.material.power));
+			view_dir = normalize(splat(state.view_position) - world_position);
+		}
+
+		for (const LightConstants& light : lights)
+		{
+			// exceptions to the naming style for the sake of the formula
+			__m128 Atten = one;
+			__m128 Spot  = one;
+
+			switch (light.type)
+			{
+				case D3DLIGHT_POINT:
+				{
+					const __m128 d  = length(world_position - light.position);
+					const __m128 d2 = _mm_mul_ps(d, d);
+
+					Atten = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(light.attenuation0, _mm_mul_ps(light.attenuation1, d)),
+					                                   _mm_mul_ps(light.attenuation2, d2)));
+					Atten = _mm_and_ps(_mm_cmple_ps(d, light.range), Atten);
+					break;
+				}
+
+				case D3DLIGHT_SPOT:
+				{
+					const Vector3x4 Ldir = normalize(world_position - light.position);
+					const __m128 rho = dot(light.spot_direction, Ldir);
+
+					const __m128 cone = pow(_mm_max_ps(_mm_div_ps(_mm_sub_ps(light.cos_theta2, light.cos_phi2),
+					                                              _mm_sub_ps(rho, light.cos_phi2)), zero),
+					                        light.falloff);
+
+					Spot = select(_mm_cmpgt_ps(rho, light.cos_theta2), one,
+					              select(_mm_cmple_ps(rho, light.cos_phi2), zero, cone));
+					break;
+				}
+
+				default:
+					break;
+			}
+
+			const __m128 scale = _mm_mul_ps(Atten, Spot);
+			const __m128 NdotLdir = normal != nullptr ? saturate(dot(*normal, light.direction)) : zero;
+
+			// Diffuse Lighting = sum[c_d*Ld*(N.Ldir)*Atten*Spot]
+			diffuse = diffuse + c_d * light.diffuse * _mm_mul_ps(NdotLdir, scale);
+
+			// sum(Atteni*Spoti*Lai)
+			ambient = ambient + light.ambient * scale;
+
+			if (state.rs_specular)
+			{
+				const __m128 NdotH = normal != nullptr
+					? _mm_max_ps(dot(*normal, normalize(view_dir + light.direction)), zero)
+					: zero;
+
+				specular = specular + light.specular * _mm_mul_ps(pow(NdotH, p), scale);
+			}
+		}
+
+		// Ambient Lighting = c_a*[Ga + sum(Atteni*Spoti*Lai)]
+		ambient  = saturate(c_a * saturate(splat(state.global_ambient) + saturate(ambient)));
+		diffuse  = saturate(diffuse);
+		specular = state.rs_specular ? saturate(c_s * saturate(specular)) : Color4x4 { zero, zero, zero, zero };
+
+		const Color4x4 lit = saturate(diffuse + ambient);
+
+		colors.diffuse.x = saturate(_mm_add_ps(colors.emissive.x, lit.x));
+		colors.diffuse.y = saturate(_mm_add_ps(colors.emissive.y, lit.y));
+		colors.diffuse.z = saturate(_mm_add_ps(colors.emissive.z, lit.z));
+
+		colors.specular.x = specular.x;
+		colors.specular.y = specular.y;
+		colors.specular.z = specular.z;
+	}
+
+	// calc_fog in d3d8to11.hlsl
+	__m128 calc_fog(const d3d8to11::FixedFunctionState& state, __m128 d)
+	{
+		switch (state.rs_fog_mode)
+		{
+			case D3DFOG_LINEAR:
+				return saturate(_mm_div_ps(_mm_sub_ps(splat(state.fog_end), d), splat(state.fog_end - state.fog_start)));
+
+			case D3DFOG_EXP:
+				return saturate(_mm_div_ps(splat(1.0f), pow(splat(FOG_E), _mm_mul_ps(d, splat(state.fog_density)))));
+
+			case D3DFOG_EXP2:
+			{
+				const __m128 density = splat(state.fog_density * state.fog_density);
+				return saturate(_mm_div_ps(splat(1.0f), pow(splat(FOG_E), _mm_mul_ps(_mm_mul_ps(d, d), density))));
+			}
+
+			default:
+				return splat(1.0f);
+		}
+	}
+
+	// fix_coord_components in d3d8to11.hlsl
+	void fix_coord_components(uint32_t count, Vector4x4& coords)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one  = splat(1.0f);
+
+		switch (count)
+		{
+			case 1:
+				coords.y = zero;
+				coords.z = zero;
+				coords.w = one;
+				break;
+
+			case 2:
+				coords.z = zero;
+				coords.w = one;
+				break;
+
+			case 3:
+				coords.w = one;
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
+namespace d3d8to11
+{
+bool FVFLayout::assign(uint32_t value)
+{
+	*this = {};
+	fvf = value;
+
+	switch (fvf & D3DFVF_POSITION_MASK)
+	{
+		case D3DFVF_XYZ:
+			position = stride;
+			stride += sizeof(float) * 3;
+			break;
+
+		case D3DFVF_XYZRHW:
+			position = stride;
+			stride += sizeof(float) * 4;
+			break;
+
+		default:
+			// no position, or blend weights
+			return false;
+	}
+
+	if (fvf & D3DFVF_NORMAL)
+	{
+		normal = stride;
+		stride += sizeof(float) * 3;
+	}
+
+	if (fvf & D3DFVF_PSIZE)
+	{
+		stride += sizeof(float);
+	}
+
+	if (fvf & D3DFVF_DIFFUSE)
+	{
+		diffuse = stride;
+		stride += sizeof(uint32_t);
+	}
+
+	if (fvf & D3DFVF_SPECULAR)
+	{
+		specular = stride;
+		stride += sizeof(uint32_t);
+	}
+
+	texcoord_count = (fvf & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT;
+
+	if (texcoord_count > FVF_TEXCOORD_MAX)
+	{
+		return false;
+	}
+
+	// indexed by D3DFVF_TEXTUREFORMATn
+	constexpr std::array<uint32_t, 4> TEXCOORD_SIZES = { 2, 3, 4, 1 };
+
+	for (size_t i = 0; i < texcoord_count; ++i)
+	{
+		texcoord[i]      = stride;
+		texcoord_size[i] = TEXCOORD_SIZES[(fvf >> (ShaderFlags::fvf_texfmt_shift + i * ShaderFlags::fvf_texfmt_bits)) & 3];
+		stride += sizeof(float) * texcoord_size[i];
+	}
+
+	return true;
+}
+
+void process_vertices(const FixedFunctionState& state,
+                      const FVFLayout& source, const uint8_t* src,
+                      const FVFLayout& dest, uint8_t* dst,
+                      size_t count, bool copy_data)
+{
+	std::array<LightConstants, LIGHT_COUNT> light_constants;
+	size_t light_count = 0;
+
+	if (state.rs_lighting)
+	{
+		for (const Light& light : state.lights)
+		{
+			// the shaders stop at the first disabled light too
+			if (!light.enabled)
+			{
+				break;
+			}
+
+			light_constants[light_count++] = make_light_constants(state, light);
+		}
+	}
+
+	const bool has_normal = source.normal != FVFLayout::ABSENT;
+
+	const bool write_diffuse  = dest.diffuse != FVFLayout::ABSENT && (copy_data || state.rs_lighting);
+	const bool write_specular = dest.specular != FVFLayout::ABSENT && (copy_data || state.rs_lighting || state.rs_fog);
+
+	const float half_width  = state.viewport_width / 2.0f;
+	const float half_height = state.viewport_height / 2.0f;
+	const float depth_range = state.viewport_max_z - state.viewport_min_z;
+
+	for (size_t first = 0; first < count; first += LANES)
+	{
+		const size_t lane_count = std::min(LANES, count - first);
+
+		// a partial block repeats its last vertex in the remaining lanes
+		std::array<const uint8_t*, LANES> input {};
+
+		for (size_t i = 0; i < LANES; ++i)
+		{
+			input[i] = src + (first + std::min(i, lane_count - 1)) * source.stride;
+		}
+
+		const Vector3x4 object_position = load_vector3(input, source.position);
+
+		const Vector4x4 world = transform({ object_position.x, object_position.y, object_position.z, splat(1.0f) }, state.world_matrix);
+		const Vector4x4 view  = transform(world, state.view_matrix);
+		const Vector4x4 clip  = transform(view, state.projection_matrix);
+
+		const Vector3x4 world_position { world.x, world.y, world.z };
+
+		Vector3x4 object_normal {};
+		Vector3x4 world_normal {};
+
+		if (has_normal)
+		{
+			object_normal = load_vector3(input, source.normal);
+			world_normal  = normalize(transform_normal(object_normal, state.world_matrix));
+		}
+
+		Color4x4 input_diffuse {};
+		Color4x4 input_specular {};
+
+		if (source.diffuse != FVFLayout::ABSENT)
+		{
+			input_diffuse = load_color(input, source.diffuse);
+		}
+
+		if (source.specular != FVFLayout::ABSENT)
+		{
+			input_specular = load_color(input, source.specular);
+		}
+
+		VertexColors colors = get_colors(state,
+		                                 source.diffuse != FVFLayout::ABSENT ? &input_diffuse : nullptr,
+		                                 source.specular != FVFLayout::ABSENT ? &input_specular : nullptr);
+
+		if (state.rs_lighting)
+		{
+			perform_lighting(state, std::span(light_constants.data(), light_count), colors, world_position,
+			                 has_normal ? &world_normal : nullptr);
+		}
+
+		if (state.rs_fog)
+		{
+			// HACK: abs to match apply_fog in the shaders
+			colors.specular.w = calc_fog(state, _mm_andnot_ps(splat(-0.0f), view.z));
+		}
+
+		// the viewport transform that the rasterizer would otherwise do
+		const __m128 rhw = _mm_div_ps(splat(1.0f), clip.w);
+
+		float screen_x[LANES];
+		float screen_y[LANES];
+		float screen_z[LANES];
+		float screen_rhw[LANES];
+
+		store_lanes(_mm_add_ps(splat(state.viewport_x), _mm_mul_ps(_mm_add_ps(splat(1.0f), _mm_mul_ps(clip.x, rhw)), splat(half_width))), screen_x);
+		store_lanes(_mm_add_ps(splat(state.viewport_y), _mm_mul_ps(_mm_sub_ps(splat(1.0f), _mm_mul_ps(clip.y, rhw)), splat(half_height))), screen_y);
+		store_lanes(_mm_add_ps(splat(state.viewport_min_z), _mm_mul_ps(_mm_mul_ps(clip.z, rhw), splat(depth_range))), screen_z);
+		store_lanes(rhw, screen_rhw);
+
+		uint32_t diffuse[LANES];
+		uint32_t specular[LANES];
+
+		store_colors(colors.diffuse, diffuse);
+		store_colors(colors.specular, specular);
+
+		for (size_t i = 0; i < lane_count; ++i)
+		{
+			uint8_t* output = dst + (first + i) * dest.stride;
+
+			const float position[] = { screen_x[i], screen_y[i], screen_z[i], screen_rhw[i] };
+			std::memcpy(output + dest.position, position, sizeof(position));
+
+			if (write_diffuse)
+			{
+				std::memcpy(output + dest.diffuse, &diffuse[i], sizeof(uint32_t));
+			}
+
+			if (write_specular)
+			{
+				std::memcpy(output + dest.specular, &specular[i], sizeof(uint32_t));
+			}
+		}
+
+		// output_texcoord and the coordinate generation of sample_texture_stage
+		for (size_t s = 0; s < dest.texcoord_count; ++s)
+		{
+			const uint32_t coord_flags = state.texture_stages[s].tex_coord_index;
+			const uint32_t coord_index = coord_flags & 0xFFFF;
+
+			if ((coord_flags & 0xFFFF0000) == D3DTSS_TCI_CAMERASPACENORMAL)
+			{
+				const __m128 zero = _mm_setzero_ps();
+				const Vector3x4 camera_normal = has_normal
+					? transform_normal_transposed(object_normal, state.wv_matrix_inv_t)
+					: Vector3x4 { zero, zero, zero };
+
+				Vector4x4 coords { camera_normal.x, camera_normal.y, camera_normal.z, splat(1.0f) };
+				fix_coord_components(s < source.texcoord_count ? source.texcoord_size[s] : 0, coords);
+				coords = transform(coords, state.texture_stages[s].transform);
+
+				float lanes[4][LANES];
+				store_lanes(coords.x, lanes[0]);
+				store_lanes(coords.y, lanes[1]);
+				store_lanes(coords.z, lanes[2]);
+				store_lanes(coords.w, lanes[3]);
+
+				for (size_t i = 0; i < lane_count; ++i)
+				{
+					uint8_t* output = dst + (first + i) * dest.stride + dest.texcoord[s];
+
+					for (uint32_t c = 0; c < dest.texcoord_size[s]; ++c)
+					{
+						std::memcpy(output + c * sizeof(float), &lanes[c][i], sizeof(float));
+					}
+				}
+
+				continue;
+			}
+
+			// everything else passes the coordinates through, like the shaders do for now
+			if (!copy_data)
+			{
+				continue;
+			}
+
+			const size_t copy_size = coord_index < source.texcoord_count
+				? std::min(source.texcoord_size[coord_index], dest.texcoord_size[s]) * sizeof(float)
+				: 0;
+
+			for (size_t i = 0; i < lane_count; ++i)
+			{
+				uint8_t* output = dst + (first + i) * dest.stride + dest.texcoord[s];
+
+				if (copy_size != 0)
+				{
+					std::memcpy(output, input[i] + source.texcoord[coord_index], copy_size);
+				}
+
+				std::memset(output + copy_size, 0, dest.texcoord_size[s] * sizeof(float) - copy_size);
+			}
+		}
+	}
+}
+
+bool overwrites_vertices(const FVFLayout& dest, bool copy_data)
+{
+	// normals and point sizes are never written, and without copy_data neither are texture coordinates
+	// nor colors that lighting and fog leave alone
+	return copy_data && !(dest.fvf & (D3DFVF_NORMAL | D3DFVF_PSIZE));
+}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "defs.h"
+#include "Light.h"
+#include "Material.h"
+#include "simple_math.h"
+
+namespace d3d8to11
+{
+/**
+ * \brief Byte offsets of the components of a vertex of a flexible vertex format.
+ */
+struct FVFLayout
+{
+	static constexpr size_t ABSENT = SIZE_MAX;
+
+	uint32_t fvf      = 0;
+	size_t   stride   = 0;
+	size_t   position = ABSENT; // D3DFVF_XYZ or D3DFVF_XYZRHW
+	size_t   normal   = ABSENT;
+	size_t   diffuse  = ABSENT;
+	size_t   specular = ABSENT;
+
+	size_t texcoord_count = 0;
+	std::array<size_t, FVF_TEXCOORD_MAX>   texcoord {};
+	std::array<uint32_t, FVF_TEXCOORD_MAX> texcoord_size {}; // components, 1 through 4
+
+	/**
+	 * \brief Lays out the vertex format \p value the way \c fvf_input_elements does.
+	 * \return \c false if \p value has blend weights or more texture coordinates than are supported.
+	 */
+	[[nodiscard]] bool assign(uint32_t value);
+};
+
+/**
+ * \brief Everything the fixed-function vertex pipeline reads, copied out of the device's constant buffers.
+ * The members mirror their counterparts in \c d3d8to11.hlsl.
+ */
+struct FixedFunctionState
+{
+	struct TextureStage
+	{
+		uint32_t tex_coord_index = 0; // D3DTSS_TCI
+		matrix   transform;
+	};
+
+	matrix world_matrix;
+	matrix view_matrix;
+	matrix projection_matrix;
+	matrix wv_matrix_inv_t;
+	float3 view_position;
+
+	// D3DVIEWPORT8
+	float viewport_x      = 0.0f;
+	float viewport_y      = 0.0f;
+	float viewport_width  = 0.0f;
+	float viewport_height = 0.0f;
+	float viewport_min_z  = 0.0f;
+	float viewport_max_z  = 1.0f;
+
+	bool rs_lighting = false;
+	bool rs_specular = false;
+	bool rs_fog      = false;
+
+	uint32_t rs_fog_mode = 0; // D3DFOGMODE
+	float    fog_start   = 0.0f;
+	float    fog_end     = 1.0f;
+	float    fog_density = 1.0f;
+
+	bool color_vertex = false;
+
+	// D3DMATERIALCOLORSOURCE
+	uint32_t diffuse_source  = 0;
+	uint32_t specular_source = 0;
+	uint32_t ambient_source  = 0;
+	uint32_t emissive_source = 0;
+
+	float4 global_ambient;
+	Material material;
+	std::array<Light, LIGHT_COUNT> lights;
+	std::array<TextureStage, TEXTURE_STAGE_MAX> texture_stages;
+};
+
+/**
+ * \brief Transforms, lights and fogs \p count vertices the way \c fixed_func_vs does, then applies
+ * the viewport to produce screen-space vertices like \c IDirect3DDevice8::ProcessVertices.
+ *
+ * Vertices are processed four at a time with SSE, one vertex component per register.
+ * Safe to call concurrently for disjoint ranges of the same buffers.
+ *
+ * \param source      Layout of the vertices in \p src; must have an untransformed position.
+ * \param dest        Layout of the vertices in \p dst; must have a transformed position.
+ * \param copy_data   Whether to write components that the pipeline doesn't change, like texture
+ *                    coordinates that are passed through; \c false for \c D3DPV_DONOTCOPYDATA.
+ */
+void process_vertices(const FixedFunctionState& state,
+                      const FVFLayout& source, const uint8_t* src,
+                      const FVFLayout& dest, uint8_t* dst,
+                      size_t count, bool copy_data);
+
+/**
+ * \brief Whether \c process_vertices sets every byte of each vertex it writes, given the same \p dest and \p copy_data.
+ */
+[[nodiscard]] bool overwrites_vertices(const FVFLayout& dest, bool copy_data);
+}
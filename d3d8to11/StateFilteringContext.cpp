@@ -0,0 +1,5 @@
+#include "pch.h"
+
+#include "StateFilteringContext.h"
+
+template class BasicStateFilteringContext<ID3D11DeviceContext, ID3D11DeviceContext1>;
@@ -0,0 +1,617 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+
+/**
+ * \brief Wraps an \c ID3D11DeviceContext and drops state changes that would bind what is already bound.
+ *
+ * Every state setter the device uses goes through here and is compared against a shadow copy of the
+ * context's state. Multi-slot setters only forward the range of slots that actually changed.
+ * Everything else is forwarded as-is. The shadow stays valid because the context holds a reference to
+ * everything bound to it, so a bound object's address can't be reused by another object.
+ *
+ * Binding render targets or unordered access views can implicitly unbind shader resource views,
+ * so those calls forget the shadowed shader resources.
+ *
+ * \tparam Context The wrapped context: \c ID3D11DeviceContext, or anything with the same methods, like a mock in tests.
+ * \tparam Context1 What \c UpdateSubresource1 is forwarded to if the context can be queried for it.
+ */
+template <typename Context, typename Context1>
+class BasicStateFilteringContext
+{
+public:
+	struct Stats
+	{
+		size_t forwarded = 0; // state changes passed on to the context
+		size_t filtered  = 0; // state changes dropped as redundant
+	};
+
+	BasicStateFilteringContext() = default;
+
+	BasicStateFilteringContext(const BasicStateFilteringContext&)     = delete;
+	BasicStateFilteringContext(BasicStateFilteringContext&&) noexcept = delete;
+
+	BasicStateFilteringContext& operator=(const BasicStateFilteringContext&)     = delete;
+	BasicStateFilteringContext& operator=(BasicStateFilteringContext&&) noexcept = delete;
+
+	/**
+	 * \brief Starts wrapping \p context, whose state is assumed to be unknown.
+	 */
+	void reset(Microsoft::WRL::ComPtr<Context> context);
+
+	/**
+	 * \brief Forgets the shadowed state, e.g. after the context was used directly.
+	 */
+	void invalidate();
+
+	/**
+	 * \brief Makes the counters of the frame so far available through \c get_last_frame_stats and resets them.
+	 */
+	void end_frame();
+
+	[[nodiscard]] const Stats& get_last_frame_stats() const;
+
+	[[nodiscard]] Context* get() const;
+
+	BasicStateFilteringContext* operator->()
+	{
+		return this;
+	}
+
+	void IASetInputLayout(ID3D11InputLayout* input_layout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void IASetVertexBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets);
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* class_instances, UINT num_class_instances);
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* class_instances, UINT num_class_instances);
+	void VSGetShader(ID3D11VertexShader** shader, ID3D11ClassInstance** class_instances, UINT* num_class_instances) const;
+	void PSGetShader(ID3D11PixelShader** shader, ID3D11ClassInstance** class_instances, UINT* num_class_instances) const;
+
+	void VSSetConstantBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers);
+	void PSSetConstantBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers);
+	void PSSetShaderResources(UINT start_slot, UINT num_views, ID3D11ShaderResourceView* const* views);
+	void PSSetSamplers(UINT start_slot, UINT num_samplers, ID3D11SamplerState* const* samplers);
+
+	void RSSetState(ID3D11RasterizerState* state);
+	void RSSetViewports(UINT num_viewports, const D3D11_VIEWPORT* viewports) const;
+
+	void OMSetBlendState(ID3D11BlendState* state, const FLOAT blend_factor[4], UINT sample_mask);
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencil_ref);
+	void OMSetRenderTargets(UINT num_views, ID3D11RenderTargetView* const* render_target_views, ID3D11DepthStencilView* depth_stencil_view);
+	void OMSetRenderTargetsAndUnorderedAccessViews(UINT num_rtvs, ID3D11RenderTargetView* const* render_target_views,
+	                                               ID3D11DepthStencilView* depth_stencil_view, UINT uav_start_slot, UINT num_uavs,
+	                                               ID3D11UnorderedAccessView* const* unordered_access_views, const UINT* uav_initial_counts);
+
+	// not state; forwarded as-is
+
+	void Draw(UINT vertex_count, UINT start_vertex_location) const;
+	void DrawIndexed(UINT index_count, UINT start_index_location, INT base_vertex_location) const;
+	HRESULT Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP map_type, UINT map_flags, D3D11_MAPPED_SUBRESOURCE* mapped_resource) const;
+	void Unmap(ID3D11Resource* resource, UINT subresource) const;
+	void CopySubresourceRegion(ID3D11Resource* dst_resource, UINT dst_subresource, UINT dst_x, UINT dst_y, UINT dst_z,
+	                           ID3D11Resource* src_resource, UINT src_subresource, const D3D11_BOX* src_box) const;
+	void UpdateSubresource(ID3D11Resource* dst_resource, UINT dst_subresource, const D3D11_BOX* dst_box,
+	                       const void* src_data, UINT src_row_pitch, UINT src_depth_pitch) const;
+	// falls back to UpdateSubresource if the context isn't a Context1
+	void UpdateSubresource1(ID3D11Resource* dst_resource, UINT dst_subresource, const D3D11_BOX* dst_box,
+	                        const void* src_data, UINT src_row_pitch, UINT src_depth_pitch, UINT copy_flags) const;
+	void ClearRenderTargetView(ID3D11RenderTargetView* render_target_view, const FLOAT color[4]) const;
+	void ClearDepthStencilView(ID3D11DepthStencilView* depth_stencil_view, UINT clear_flags, FLOAT depth, UINT8 stencil) const;
+	void ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* unordered_access_view, const UINT values[4]) const;
+
+private:
+	template <typename T>
+	struct Tracked
+	{
+		T value {};
+		bool known = false;
+
+		/**
+		 * \brief Stores \p new_value and returns \c true if it differs from what is known to be bound.
+		 */
+		bool update(const T& new_value)
+		{
+			if (known && value == new_value)
+			{
+				return false;
+			}
+
+			value = new_value;
+			known = true;
+			return true;
+		}
+	};
+
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		UINT stride;
+		UINT offset;
+
+		bool operator==(const VertexBufferBinding& other) const = default;
+	};
+
+	struct IndexBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		DXGI_FORMAT format;
+		UINT offset;
+
+		bool operator==(const IndexBufferBinding& other) const = default;
+	};
+
+	struct BlendBinding
+	{
+		ID3D11BlendState* state;
+		std::array<FLOAT, 4> blend_factor;
+		UINT sample_mask;
+
+		bool operator==(const BlendBinding& other) const = default;
+	};
+
+	struct DepthStencilBinding
+	{
+		ID3D11DepthStencilState* state;
+		UINT stencil_ref;
+
+		bool operator==(const DepthStencilBinding& other) const = default;
+	};
+
+	/**
+	 * \brief Updates the shadow of \p count slots from \p start and narrows them to the range that changed.
+	 * \return \c false if nothing changed.
+	 */
+	template <typename T, size_t N, typename Getter>
+	bool update_range(std::array<Tracked<T>, N>& slots, UINT start, UINT count, Getter&& get, UINT& changed_start, UINT& changed_count);
+
+	void count(bool forwarded);
+
+	Microsoft::WRL::ComPtr<Context> m_context;
+	Microsoft::WRL::ComPtr<Context1> m_context1;
+
+	Tracked<ID3D11InputLayout*> m_input_layout;
+	Tracked<D3D11_PRIMITIVE_TOPOLOGY> m_topology;
+	std::array<Tracked<VertexBufferBinding>, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT> m_vertex_buffers;
+	Tracked<IndexBufferBinding> m_index_buffer;
+
+	Tracked<ID3D11VertexShader*> m_vertex_shader;
+	Tracked<ID3D11PixelShader*> m_pixel_shader;
+
+	std::array<Tracked<ID3D11Buffer*>, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT> m_vs_constant_buffers;
+	std::array<Tracked<ID3D11Buffer*>, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT> m_ps_constant_buffers;
+	std::array<Tracked<ID3D11ShaderResourceView*>, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT> m_ps_shader_resources;
+	std::array<Tracked<ID3D11SamplerState*>, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT> m_ps_samplers;
+
+	Tracked<ID3D11RasterizerState*> m_rasterizer_state;
+	Tracked<BlendBinding> m_blend_state;
+	Tracked<DepthStencilBinding> m_depth_stencil_state;
+
+	Stats m_frame_stats;
+	Stats m_last_frame_stats;
+};
+
+template <typename Context, typename Context1>
+template <typename T, size_t N, typename Getter>
+bool BasicStateFilteringContext<Context, Context1>::update_range(std::array<Tracked<T>, N>& slots, UINT start, UINT count, Getter&& get, UINT& changed_start, UINT& changed_count)
+{
+	if (start >= N || count == 0)
+	{
+		return false;
+	}
+
+	count = std::min<UINT>(count, static_cast<UINT>(N) - start);
+
+	UINT first = count;
+	UINT last = 0;
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		if (slots[start + i].update(get(i)))
+		{
+			first = std::min(first, i);
+			last = i;
+		}
+	}
+
+	if (first == count)
+	{
+		return false;
+	}
+
+	changed_start = start + first;
+	changed_count = last - first + 1;
+	return true;
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::reset(Microsoft::WRL::ComPtr<Context> context)
+{
+	m_context = std::move(context);
+	m_context1.Reset();
+
+	if (m_context)
+	{
+		m_context.As(&m_context1);
+	}
+
+	invalidate();
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::invalidate()
+{
+	m_input_layout.known = false;
+	m_topology.known     = false;
+	m_index_buffer.known = false;
+
+	m_vertex_shader.known = false;
+	m_pixel_shader.known  = false;
+
+	m_rasterizer_state.known    = false;
+	m_blend_state.known         = false;
+	m_depth_stencil_state.known = false;
+
+	auto forget = [](auto& slots)
+	{
+		for (auto& slot : slots)
+		{
+			slot.known = false;
+		}
+	};
+
+	forget(m_vertex_buffers);
+	forget(m_vs_constant_buffers);
+	forget(m_ps_constant_buffers);
+	forget(m_ps_shader_resources);
+	forget(m_ps_samplers);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::end_frame()
+{
+	m_last_frame_stats = m_frame_stats;
+	m_frame_stats = {};
+}
+
+template <typename Context, typename Context1>
+const typename BasicStateFilteringContext<Context, Context1>::Stats& BasicStateFilteringContext<Context, Context1>::get_last_frame_stats() const
+{
+	return m_last_frame_stats;
+}
+
+template <typename Context, typename Context1>
+Context* BasicStateFilteringContext<Context, Context1>::get() const
+{
+	return m_context.Get();
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::count(bool forwarded)
+{
+	if (forwarded)
+	{
+		++m_frame_stats.forwarded;
+	}
+	else
+	{
+		++m_frame_stats.filtered;
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::IASetInputLayout(ID3D11InputLayout* input_layout)
+{
+	const bool changed = m_input_layout.update(input_layout);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->IASetInputLayout(input_layout);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	const bool changed = m_topology.update(topology);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->IASetPrimitiveTopology(topology);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::IASetVertexBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	if (buffers == nullptr || strides == nullptr || offsets == nullptr)
+	{
+		// nothing to compare against; this binds nothing anyway
+		m_context->IASetVertexBuffers(start_slot, num_buffers, buffers, strides, offsets);
+		return;
+	}
+
+	UINT changed_start = 0;
+	UINT changed_count = 0;
+
+	auto get = [&](UINT i)
+	{
+		return VertexBufferBinding { buffers[i], strides[i], offsets[i] };
+	};
+
+	const bool changed = update_range(m_vertex_buffers, start_slot, num_buffers, get, changed_start, changed_count);
+	count(changed);
+
+	if (changed)
+	{
+		const UINT i = changed_start - start_slot;
+		m_context->IASetVertexBuffers(changed_start, changed_count, &buffers[i], &strides[i], &offsets[i]);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	const bool changed = m_index_buffer.update({ buffer, format, offset });
+	count(changed);
+
+	if (changed)
+	{
+		m_context->IASetIndexBuffer(buffer, format, offset);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* class_instances, UINT num_class_instances)
+{
+	// class instances aren't shadowed, so anything using them always goes through
+	const bool changed = m_vertex_shader.update(shader) || num_class_instances != 0;
+	count(changed);
+
+	if (changed)
+	{
+		m_context->VSSetShader(shader, class_instances, num_class_instances);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* class_instances, UINT num_class_instances)
+{
+	const bool changed = m_pixel_shader.update(shader) || num_class_instances != 0;
+	count(changed);
+
+	if (changed)
+	{
+		m_context->PSSetShader(shader, class_instances, num_class_instances);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::VSGetShader(ID3D11VertexShader** shader, ID3D11ClassInstance** class_instances, UINT* num_class_instances) const
+{
+	m_context->VSGetShader(shader, class_instances, num_class_instances);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::PSGetShader(ID3D11PixelShader** shader, ID3D11ClassInstance** class_instances, UINT* num_class_instances) const
+{
+	m_context->PSGetShader(shader, class_instances, num_class_instances);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::VSSetConstantBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers)
+{
+	UINT changed_start = 0;
+	UINT changed_count = 0;
+
+	const bool changed = update_range(m_vs_constant_buffers, start_slot, num_buffers, [&](UINT i) { return buffers[i]; }, changed_start, changed_count);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->VSSetConstantBuffers(changed_start, changed_count, &buffers[changed_start - start_slot]);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::PSSetConstantBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers)
+{
+	UINT changed_start = 0;
+	UINT changed_count = 0;
+
+	const bool changed = update_range(m_ps_constant_buffers, start_slot, num_buffers, [&](UINT i) { return buffers[i]; }, changed_start, changed_count);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->PSSetConstantBuffers(changed_start, changed_count, &buffers[changed_start - start_slot]);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::PSSetShaderResources(UINT start_slot, UINT num_views, ID3D11ShaderResourceView* const* views)
+{
+	UINT changed_start = 0;
+	UINT changed_count = 0;
+
+	const bool changed = update_range(m_ps_shader_resources, start_slot, num_views, [&](UINT i) { return views[i]; }, changed_start, changed_count);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->PSSetShaderResources(changed_start, changed_count, &views[changed_start - start_slot]);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::PSSetSamplers(UINT start_slot, UINT num_samplers, ID3D11SamplerState* const* samplers)
+{
+	UINT changed_start = 0;
+	UINT changed_count = 0;
+
+	const bool changed = update_range(m_ps_samplers, start_slot, num_samplers, [&](UINT i) { return samplers[i]; }, changed_start, changed_count);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->PSSetSamplers(changed_start, changed_count, &samplers[changed_start - start_slot]);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::RSSetState(ID3D11RasterizerState* state)
+{
+	const bool changed = m_rasterizer_state.update(state);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->RSSetState(state);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::RSSetViewports(UINT num_viewports, const D3D11_VIEWPORT* viewports) const
+{
+	m_context->RSSetViewports(num_viewports, viewports);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::OMSetBlendState(ID3D11BlendState* state, const FLOAT blend_factor[4], UINT sample_mask)
+{
+	// a null blend factor means { 1, 1, 1, 1 }
+	BlendBinding binding { state, { 1.0f, 1.0f, 1.0f, 1.0f }, sample_mask };
+
+	if (blend_factor != nullptr)
+	{
+		std::copy_n(blend_factor, 4, binding.blend_factor.begin());
+	}
+
+	const bool changed = m_blend_state.update(binding);
+	count(changed);
+
+	if (changed)
+	{
+		m_context->OMSetBlendState(state, blend_factor, sample_mask);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencil_ref)
+{
+	const bool changed = m_depth_stencil_state.update({ state, stencil_ref });
+	count(changed);
+
+	if (changed)
+	{
+		m_context->OMSetDepthStencilState(state, stencil_ref);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::OMSetRenderTargets(UINT num_views, ID3D11RenderTargetView* const* render_target_views, ID3D11DepthStencilView* depth_stencil_view)
+{
+	// the runtime unbinds any shader resource view of a resource bound as a render target
+	for (auto& slot : m_ps_shader_resources)
+	{
+		slot.known = false;
+	}
+
+	m_context->OMSetRenderTargets(num_views, render_target_views, depth_stencil_view);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::OMSetRenderTargetsAndUnorderedAccessViews(UINT num_rtvs, ID3D11RenderTargetView* const* render_target_views,
+                                                                                              ID3D11DepthStencilView* depth_stencil_view, UINT uav_start_slot, UINT num_uavs,
+                                                                                              ID3D11UnorderedAccessView* const* unordered_access_views, const UINT* uav_initial_counts)
+{
+	for (auto& slot : m_ps_shader_resources)
+	{
+		slot.known = false;
+	}
+
+	m_context->OMSetRenderTargetsAndUnorderedAccessViews(num_rtvs, render_target_views, depth_stencil_view,
+	                                                     uav_start_slot, num_uavs, unordered_access_views, uav_initial_counts);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::Draw(UINT vertex_count, UINT start_vertex_location) const
+{
+	m_context->Draw(vertex_count, start_vertex_location);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::DrawIndexed(UINT index_count, UINT start_index_location, INT base_vertex_location) const
+{
+	m_context->DrawIndexed(index_count, start_index_location, base_vertex_location);
+}
+
+template <typename Context, typename Context1>
+HRESULT BasicStateFilteringContext<Context, Context1>::Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP map_type, UINT map_flags, D3D11_MAPPED_SUBRESOURCE* mapped_resource) const
+{
+	return m_context->Map(resource, subresource, map_type, map_flags, mapped_resource);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::Unmap(ID3D11Resource* resource, UINT subresource) const
+{
+	m_context->Unmap(resource, subresource);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::CopySubresourceRegion(ID3D11Resource* dst_resource, UINT dst_subresource, UINT dst_x, UINT dst_y, UINT dst_z,
+                                                                          ID3D11Resource* src_resource, UINT src_subresource, const D3D11_BOX* src_box) const
+{
+	m_context->CopySubresourceRegion(dst_resource, dst_subresource, dst_x, dst_y, dst_z, src_resource, src_subresource, src_box);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::UpdateSubresource(ID3D11Resource* dst_resource, UINT dst_subresource, const D3D11_BOX* dst_box,
+                                                                      const void* src_data, UINT src_row_pitch, UINT src_depth_pitch) const
+{
+	m_context->UpdateSubresource(dst_resource, dst_subresource, dst_box, src_data, src_row_pitch, src_depth_pitch);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::UpdateSubresource1(ID3D11Resource* dst_resource, UINT dst_subresource, const D3D11_BOX* dst_box,
+                                                                       const void* src_data, UINT src_row_pitch, UINT src_depth_pitch, UINT copy_flags) const
+{
+	if (m_context1)
+	{
+		m_context1->UpdateSubresource1(dst_resource, dst_subresource, dst_box, src_data, src_row_pitch, src_depth_pitch, copy_flags);
+	}
+	else
+	{
+		m_context->UpdateSubresource(dst_resource, dst_subresource, dst_box, src_data, src_row_pitch, src_depth_pitch);
+	}
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::ClearRenderTargetView(ID3D11RenderTargetView* render_target_view, const FLOAT color[4]) const
+{
+	m_context->ClearRenderTargetView(render_target_view, color);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::ClearDepthStencilView(ID3D11DepthStencilView* depth_stencil_view, UINT clear_flags, FLOAT depth, UINT8 stencil) const
+{
+	m_context->ClearDepthStencilView(depth_stencil_view, clear_flags, depth, stencil);
+}
+
+template <typename Context, typename Context1>
+void BasicStateFilteringContext<Context, Context1>::ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* unordered_access_view, const UINT values[4]) const
+{
+	m_context->ClearUnorderedAccessViewUint(unordered_access_view, values);
+}
+
+using StateFilteringContext = BasicStateFilteringContext<ID3D11DeviceContext, ID3D11DeviceContext1>;
+
+extern template class BasicStateFilteringContext<ID3D11DeviceContext, ID3D11DeviceContext1>;
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <wrl/client.h>
+
+struct StateObjectCacheStats
+{
+	size_t hits      = 0;
+	size_t misses    = 0;
+	size_t evictions = 0;
+	std::chrono::nanoseconds creation_time {}; // spent creating objects, including pre-warming
+};
+
+/**
+ * \brief Cache of immutable D3D11 state objects, keyed by whatever their description is built from.
+ *
+ * D3D11 allows at most 4096 unique blend, depth-stencil, rasterizer and sampler state objects per device,
+ * so the cache holds at most \c capacity objects and evicts the least recently used one to make room.
+ * An evicted object that is still bound stays alive until it is unbound, since the context holds
+ * a reference to it.
+ *
+ * Entries never move once created; they are found through an open-addressed table of entry indices
+ * with linear probing, and linked by index into a list ordered by last use.
+ */
+template <typename Key, typename Object, typename Hash = std::hash<Key>>
+class StateObjectCache
+{
+public:
+	// leaves some room under the per-device limit of D3D11
+	static constexpr size_t DEFAULT_CAPACITY = 4000;
+
+	explicit StateObjectCache(size_t capacity = DEFAULT_CAPACITY)
+		: m_capacity(capacity),
+		  m_slots(std::bit_ceil(capacity * 2), EMPTY)
+	{
+		m_entries.reserve(capacity);
+	}
+
+	/**
+	 * \brief Returns the object for \p key, calling \p create with \p key to make it if it isn't cached.
+	 * \p create returns a \c ComPtr to the new object and throws if it can't be created.
+	 */
+	template <typename Create>
+	[[nodiscard]] Object* get(const Key& key, Create&& create)
+	{
+		const size_t hash = Hash {}(key);
+		const size_t slot = find_slot(key, hash);
+
+		if (m_slots[slot] != EMPTY)
+		{
+			++m_stats.hits;
+
+			const uint32_t index = m_slots[slot];
+			unlink(index);
+			push_front(index);
+
+			return m_entries[index].object.Get();
+		}
+
+		++m_stats.misses;
+		return insert(key, hash, std::forward<Create>(create));
+	}
+
+	/**
+	 * \brief Creates the object for \p key ahead of time if it isn't cached already,
+	 * without counting it as a hit or a miss.
+	 */
+	template <typename Create>
+	void prewarm(const Key& key, Create&& create)
+	{
+		const size_t hash = Hash {}(key);
+
+		if (m_slots[find_slot(key, hash)] == EMPTY)
+		{
+			std::ignore = insert(key, hash, std::forward<Create>(create));
+		}
+	}
+
+	/**
+	 * \brief Calls \p callback with every cached key, from the least to the most recently used.
+	 */
+	template <typename Callback>
+	void for_each_key(Callback&& callback) const
+	{
+		for (uint32_t i = m_tail; i != EMPTY; i = m_entries[i].prev)
+		{
+			callback(m_entries[i].key);
+		}
+	}
+
+	void clear()
+	{
+		std::ranges::fill(m_slots, EMPTY);
+		m_entries.clear();
+		m_head = EMPTY;
+		m_tail = EMPTY;
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return m_entries.size();
+	}
+
+	[[nodiscard]] size_t capacity() const
+	{
+		return m_capacity;
+	}
+
+	[[nodiscard]] const StateObjectCacheStats& get_stats() const
+	{
+		return m_stats;
+	}
+
+private:
+	static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+	struct Entry
+	{
+		Key key;
+		size_t hash;
+		Microsoft::WRL::ComPtr<Object> object;
+		uint32_t prev; // towards the most recently used
+		uint32_t next; // towards the least recently used
+	};
+
+	[[nodiscard]] size_t mask() const
+	{
+		return m_slots.size() - 1;
+	}
+
+	/**
+	 * \brief Returns the slot holding \p key, or the empty slot where it would go.
+	 */
+	[[nodiscard]] size_t find_slot(const Key& key, size_t hash) const
+	{
+		size_t slot = hash & mask();
+
+		while (m_slots[slot] != EMPTY)
+		{
+			const Entry& entry = m_entries[m_slots[slot]];
+
+			if (entry.hash == hash && entry.key == key)
+			{
+				break;
+			}
+
+			slot = (slot + 1) & mask();
+		}
+
+		return slot;
+	}
+
+	/**
+	 * \brief Empties \p slot and moves any entry after it that can't be found past the gap back into it.
+	 */
+	void erase_slot(size_t slot)
+	{
+		size_t next = slot;
+
+		for (;;)
+		{
+			next = (next + 1) & mask();
+
+			if (m_slots[next] == EMPTY)
+			{
+				break;
+			}
+
+			const size_t home = m_entries[m_slots[next]].hash & mask();
+
+			// an entry whose home is cyclically within (slot, next] is still reachable
+			const bool reachable = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+
+			if (!reachable)
+			{
+				m_slots[slot] = m_slots[next];
+				slot = next;
+			}
+		}
+
+		m_slots[slot] = EMPTY;
+	}
+
+	void unlink(uint32_t index)
+	{
+		Entry& entry = m_entries[index];
+
+		if (entry.prev != EMPTY)
+		{
+			m_entries[entry.prev].next = entry.next;
+		}
+		else
+		{
+			m_head = entry.next;
+		}
+
+		if (entry.next != EMPTY)
+		{
+			m_entries[entry.next].prev = entry.prev;
+		}
+		else
+		{
+			m_tail = entry.prev;
+		}
+	}
+
+	void push_front(uint32_t index)
+	{
+		Entry& entry = m_entries[index];
+
+		entry.prev = EMPTY;
+		entry.next = m_head;
+
+		if (m_head != EMPTY)
+		{
+			m_entries[m_head].prev = index;
+		}
+
+		m_head = index;
+
+		if (m_tail == EMPTY)
+		{
+			m_tail = index;
+		}
+	}
+
+	template <typename Create>
+	Object* insert(const Key& key, size_t hash, Create&& create)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		Microsoft::WRL::ComPtr<Object> object = create(key);
+		m_stats.creation_time += std::chrono::high_resolution_clock::now() - start;
+
+		uint32_t index;
+
+		if (m_entries.size() < m_capacity)
+		{
+			index = static_cast<uint32_t>(m_entries.size());
+			m_entries.push_back({ key, hash, nullptr, EMPTY, EMPTY });
+		}
+		else
+		{
+			index = m_tail;
+			Entry& evicted = m_entries[index];
+
+			erase_slot(find_slot(evicted.key, evicted.hash));
+			unlink(index);
+			++m_stats.evictions;
+
+			evicted.key  = key;
+			evicted.hash = hash;
+		}
+
+		// the eviction may have moved entries around, so look for a free slot only now
+		m_slots[find_slot(key, hash)] = index;
+		m_entries[index].object = std::move(object);
+		push_front(index);
+
+		return m_entries[index].object.Get();
+	}
+
+	size_t m_capacity;
+	std::vector<uint32_t> m_slots;
+	std::vector<Entry> m_entries;
+	uint32_t m_head = EMPTY; // most recently used
+	uint32_t m_tail = EMPTY; // least recently used
+	StateObjectCacheStats m_stats;
+};
@@ -1,6 +1,13 @@
-#include "pch.h"
 #include "ThreadPool.h"
 
+namespace
+{
+// identifies the worker (if any) running on the current thread so that
+// tasks enqueued from inside a task go to that worker's own deque
+thread_local const ThreadPool* t_current_pool = nullptr;
+thread_local size_t t_worker_index = 0;
+}
+
 ThreadPool::ThreadPool(size_t thread_count)
 	: m_thread_count(thread_count),
 	  m_running(false),
@@ -27,11 +34,17 @@ void ThreadPool::start()
 	}
 
 	m_running = true;
-	m_threads.reserve(m_thread_count);
+	m_workers.reserve(m_thread_count);
 
+	// all deques must exist before any worker starts stealing from them
 	for (size_t i = 0; i < m_thread_count; ++i)
 	{
-		m_threads.emplace_back(&ThreadPool::thread_function, this);
+		m_workers.emplace_back(std::make_unique<Worker>());
+	}
+
+	for (size_t i = 0; i < m_thread_count; ++i)
+	{
+		m_workers[i]->thread = std::thread(&ThreadPool::thread_function, this, i);
 	}
 }
 
@@ -43,58 +56,198 @@ void ThreadPool::shutdown()
 	}
 
 	m_running = false;
-	m_pending_task_cv.notify_all();
+	m_wake_epoch.fetch_add(1, std::memory_order_seq_cst);
+	m_wake_epoch.notify_all();
 
-	for (std::thread& t : m_threads)
+	for (auto& worker : m_workers)
 	{
-		t.join();
+		worker->thread.join();
 	}
 
-	m_threads.clear();
+	m_workers.clear();
 }
 
 void ThreadPool::wait()
 {
-	std::unique_lock queue_lock(m_queue_mutex);
-	auto wait_predicate = [this] { return m_running == false || m_queue.empty(); };
-	m_tasks_complete_cv.wait(queue_lock, wait_predicate);
+	size_t pending = m_pending_task_count.load(std::memory_order_acquire);
+
+	while (pending != 0 && m_running == true)
+	{
+		m_pending_task_count.wait(pending, std::memory_order_acquire);
+		pending = m_pending_task_count.load(std::memory_order_acquire);
+	}
+}
+
+bool ThreadPool::boost(const TaskHandle& handle, TaskPriority priority)
+{
+	TaskEntry* entry = handle.m_entry;
+
+	if (entry == nullptr || entry->claimed.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	TaskPriority current = entry->priority.load(std::memory_order_relaxed);
+
+	while (priority > current)
+	{
+		if (entry->priority.compare_exchange_weak(current, priority, std::memory_order_relaxed))
+		{
+			// the entry stays in its old queue too; whichever copy is popped first claims it
+			entry->add_ref();
+			push_task(entry, priority);
+			break;
+		}
+	}
+
+	return true;
 }
 
-void ThreadPool::enqueue_internal(std::unique_ptr<FunctionWrapperBase> wrapper)
+void ThreadPool::push_task(TaskEntry* entry, TaskPriority priority)
 {
+	const auto priority_index = static_cast<size_t>(priority);
+
+	if (t_current_pool == this)
 	{
-		std::lock_guard queue_lock(m_queue_mutex);
-		m_queue.emplace(std::move(wrapper));
-		++m_pending_task_count;
+		m_workers[t_worker_index]->deques[priority_index].push(entry);
 	}
+	else
+	{
+		InjectionQueue& injection = m_injection_queues[priority_index];
 
-	m_pending_task_cv.notify_one();
+		if (!injection.queue.try_push(entry))
+		{
+			std::lock_guard overflow_lock(injection.overflow_mutex);
+			injection.overflow.push_back(entry);
+			injection.overflow_count.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	wake_one();
 }
 
-void ThreadPool::thread_function()
+ThreadPool::TaskEntry* ThreadPool::pop_injected(TaskPriority priority)
 {
-	auto wait_predicate = [this] { return !m_queue.empty() || m_running == false; };
+	InjectionQueue& injection = m_injection_queues[static_cast<size_t>(priority)];
+
+	TaskEntry* entry = nullptr;
+
+	if (injection.queue.try_pop(entry))
+	{
+		return entry;
+	}
+
+	if (injection.overflow_count.load(std::memory_order_acquire) == 0)
+	{
+		return nullptr;
+	}
+
+	std::lock_guard overflow_lock(injection.overflow_mutex);
+
+	if (injection.overflow.empty())
+	{
+		return nullptr;
+	}
+
+	entry = injection.overflow.front();
+	injection.overflow.pop_front();
+	injection.overflow_count.fetch_sub(1, std::memory_order_relaxed);
+	return entry;
+}
+
+ThreadPool::TaskEntry* ThreadPool::find_task(size_t worker_index)
+{
+	const size_t worker_count = m_workers.size();
+
+	// highest priority first: own deque, then the injection queue, then steal from the others
+	for (size_t p = PRIORITY_COUNT; p-- > 0;)
+	{
+		if (TaskEntry* entry = m_workers[worker_index]->deques[p].pop())
+		{
+			return entry;
+		}
+
+		if (TaskEntry* entry = pop_injected(static_cast<TaskPriority>(p)))
+		{
+			return entry;
+		}
+
+		for (size_t i = 1; i < worker_count; ++i)
+		{
+			const size_t victim = (worker_index + i) % worker_count;
+
+			if (TaskEntry* entry = m_workers[victim]->deques[p].steal())
+			{
+				return entry;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+void ThreadPool::run_task(TaskEntry* entry)
+{
+	// a boosted task is queued more than once; only the first copy to be popped runs it
+	if (!entry->claimed.exchange(true, std::memory_order_acq_rel))
+	{
+		entry->function();
+		entry->function.reset();
+
+		if (m_pending_task_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			m_pending_task_count.notify_all();
+		}
+	}
+
+	entry->release();
+}
+
+void ThreadPool::wake_one()
+{
+	m_wake_epoch.fetch_add(1, std::memory_order_seq_cst);
+
+	if (m_sleeping_count.load(std::memory_order_seq_cst) != 0)
+	{
+		m_wake_epoch.notify_one();
+	}
+}
+
+void ThreadPool::thread_function(size_t worker_index)
+{
+	t_current_pool = this;
+	t_worker_index = worker_index;
 
 	while (true)
 	{
-		std::unique_lock queue_lock(m_queue_mutex);
-		m_pending_task_cv.wait(queue_lock, wait_predicate);
+		// read before searching so that anything pushed after the search changes it and cancels the wait below
+		const uint32_t epoch = m_wake_epoch.load(std::memory_order_seq_cst);
+
+		if (TaskEntry* entry = find_task(worker_index))
+		{
+			run_task(entry);
+			continue;
+		}
 
 		// don't actually exit the loop until all queue items have been consumed
-		if (m_queue.empty() && m_running == false)
+		if (m_running == false)
 		{
 			break;
 		}
 
-		auto task = std::move(m_queue.front());
-		m_queue.pop();
-		queue_lock.unlock();
-
-		(*task)();
-
-		if (--m_pending_task_count == 0)
+		if (m_sleeping_count.fetch_add(1, std::memory_order_seq_cst) + 1 == m_thread_count)
 		{
-			m_tasks_complete_cv.notify_all();
+			// every other worker is asleep too, so none of them can be partway through stealing from an array retired by
+			// one of this worker's deques, and any that wakes up later reads the current array
+			for (auto& deque : m_workers[worker_index]->deques)
+			{
+				deque.reclaim();
+			}
 		}
+
+		m_wake_epoch.wait(epoch, std::memory_order_seq_cst);
+		m_sleeping_count.fetch_sub(1, std::memory_order_seq_cst);
 	}
+
+	t_current_pool = nullptr;
 }
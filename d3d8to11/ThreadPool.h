@@ -1,18 +1,238 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono> // used by is_future_ready
-#include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <future>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+#include "MpmcQueue.h"
+#include "SlabAllocator.h"
+#include "WorkStealingDeque.h"
+
+enum class TaskPriority : uint8_t
+{
+	low,    // speculative work, e.g. precompiling recorded shader permutations
+	normal, // work that has a usable fallback, e.g. uber shaders
+	high,   // work that is needed right now
+	count
+};
+
+/**
+ * \brief Shared flag used to cancel tasks that have not started yet.
+ * A default-constructed token can never be cancelled.
+ */
+class CancellationToken
+{
+public:
+	CancellationToken() = default;
+
+	[[nodiscard]] static CancellationToken create()
+	{
+		CancellationToken token;
+		token.m_state = std::make_shared<std::atomic_bool>(false);
+		return token;
+	}
+
+	void cancel() const
+	{
+		if (m_state)
+		{
+			m_state->store(true, std::memory_order_release);
+		}
+	}
+
+	[[nodiscard]] bool is_cancelled() const
+	{
+		return m_state && m_state->load(std::memory_order_acquire);
+	}
+
+private:
+	std::shared_ptr<std::atomic_bool> m_state;
+};
+
+/**
+ * \brief Stored in the future of a task that was cancelled before it started.
+ */
+class TaskCancelledError : public std::runtime_error
+{
+public:
+	TaskCancelledError()
+		: std::runtime_error("task cancelled")
+	{
+	}
+};
+
+/**
+ * \brief A move-only callable stored inline when it fits in \c BUFFER_SIZE bytes,
+ * so that enqueueing a typical task doesn't need a separate allocation for it.
+ */
+class TaskFunction
+{
+public:
+	static constexpr size_t BUFFER_SIZE = 80;
+
+	TaskFunction() = default;
+
+	template <typename Func>
+	explicit TaskFunction(Func&& function)
+	{
+		using function_t = std::decay_t<Func>;
+
+		if constexpr (sizeof(function_t) <= BUFFER_SIZE &&
+		              alignof(function_t) <= alignof(std::max_align_t) &&
+		              std::is_nothrow_move_constructible_v<function_t>)
+		{
+			m_target  = new (m_buffer) function_t(std::forward<Func>(function));
+			m_destroy = [](void* target) { static_cast<function_t*>(target)->~function_t(); };
+		}
+		else
+		{
+			m_target  = new function_t(std::forward<Func>(function));
+			m_destroy = [](void* target) { delete static_cast<function_t*>(target); };
+		}
+
+		m_invoke = [](void* target) { (*static_cast<function_t*>(target))(); };
+	}
+
+	~TaskFunction()
+	{
+		reset();
+	}
+
+	TaskFunction(const TaskFunction&)     = delete;
+	TaskFunction(TaskFunction&&) noexcept = delete;
+
+	TaskFunction& operator=(const TaskFunction&)     = delete;
+	TaskFunction& operator=(TaskFunction&&) noexcept = delete;
+
+	void operator()() const
+	{
+		m_invoke(m_target);
+	}
+
+	void reset()
+	{
+		if (m_target != nullptr)
+		{
+			m_destroy(m_target);
+			m_target = nullptr;
+		}
+	}
+
+private:
+	alignas(std::max_align_t) std::byte m_buffer[BUFFER_SIZE] {};
+	void* m_target = nullptr;
+	void (*m_invoke)(void*) = nullptr;
+	void (*m_destroy)(void*) = nullptr;
+};
+
+/**
+ * \brief Work-stealing thread pool with task priorities.
+ *
+ * Each worker owns one Chase-Lev deque per priority for tasks it enqueues itself; tasks enqueued from
+ * any other thread go into a lock-free injection queue per priority. Idle workers steal from each other.
+ * Workers sleep on an atomic wake counter, so neither enqueueing nor dequeueing takes a lock.
+ * Task entries are recycled through a slab allocator, so enqueueing a task whose callable fits in
+ * \c TaskFunction::BUFFER_SIZE bytes doesn't allocate once the pool has warmed up.
+ */
 class ThreadPool
 {
+	struct TaskEntry
+	{
+		template <typename Func>
+		TaskEntry(SlabAllocator<TaskEntry>& allocator, TaskPriority priority, Func&& function)
+			: function(std::forward<Func>(function)),
+			  allocator(allocator),
+			  priority(priority)
+		{
+		}
+
+		TaskFunction function;
+		SlabAllocator<TaskEntry>& allocator;
+		std::atomic<uint32_t> ref_count { 1 };
+		std::atomic<TaskPriority> priority;
+		std::atomic_bool claimed { false }; // set once a worker takes the task; stale queue entries left behind by boost are then skipped
+
+		void add_ref()
+		{
+			ref_count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void release()
+		{
+			if (ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				allocator.deallocate(this);
+			}
+		}
+	};
+
 public:
+	/**
+	 * \brief Refers to a queued task so that its priority can be raised with \c ThreadPool::boost.
+	 * Must not outlive the pool that created it.
+	 */
+	class TaskHandle
+	{
+	public:
+		TaskHandle() = default;
+
+		~TaskHandle()
+		{
+			if (m_entry != nullptr)
+			{
+				m_entry->release();
+			}
+		}
+
+		TaskHandle(const TaskHandle& other)
+			: m_entry(other.m_entry)
+		{
+			if (m_entry != nullptr)
+			{
+				m_entry->add_ref();
+			}
+		}
+
+		TaskHandle(TaskHandle&& other) noexcept
+			: m_entry(std::exchange(other.m_entry, nullptr))
+		{
+		}
+
+		TaskHandle& operator=(TaskHandle other) noexcept
+		{
+			std::swap(m_entry, other.m_entry);
+			return *this;
+		}
+
+	private:
+		friend class ThreadPool;
+
+		explicit TaskHandle(TaskEntry* entry)
+			: m_entry(entry)
+		{
+		}
+
+		TaskEntry* m_entry = nullptr;
+	};
+
+	template <typename T>
+	struct Task
+	{
+		std::future<T> future;
+		TaskHandle handle;
+	};
+
 	explicit ThreadPool(size_t thread_count);
 	ThreadPool(ThreadPool&& other) noexcept = delete;
 	ThreadPool(const ThreadPool& other) = delete;
@@ -26,61 +246,81 @@ public:
 	void start();
 	void shutdown();
 
+	/**
+	 * \brief Blocks until every enqueued task has finished running.
+	 */
 	void wait();
 
 	template <typename Func, typename... Args>
-	[[nodiscard]] auto enqueue(Func func, Args&&... args);
+	[[nodiscard]] auto enqueue(TaskPriority priority, Func func, Args&&... args);
+
+	/**
+	 * \brief Enqueues a task that is skipped if \p token is cancelled before it starts.
+	 * The future of a skipped task holds a \c TaskCancelledError.
+	 */
+	template <typename Func, typename... Args>
+	[[nodiscard]] auto enqueue(TaskPriority priority, const CancellationToken& token, Func func, Args&&... args);
+
+	/**
+	 * \brief Raises the priority of a task that has not started yet.
+	 * \return \c true if the task is still queued.
+	 */
+	bool boost(const TaskHandle& handle, TaskPriority priority);
 
 private:
-	class FunctionWrapperBase
+	static constexpr size_t PRIORITY_COUNT = static_cast<size_t>(TaskPriority::count);
+	static constexpr size_t INJECTION_QUEUE_CAPACITY = 4096;
+
+	struct Worker
 	{
-	public:
-		virtual ~FunctionWrapperBase() = default;
-		virtual void operator()() = 0;
+		std::array<WorkStealingDeque<TaskEntry*>, PRIORITY_COUNT> deques;
+		std::thread thread;
 	};
 
-	template <typename Func>
-	class FunctionWrapper : public FunctionWrapperBase
+	struct InjectionQueue
 	{
-	public:
-		explicit FunctionWrapper(Func&& function)
-			: m_function(std::forward<Func>(function))
+		InjectionQueue()
+			: queue(INJECTION_QUEUE_CAPACITY)
 		{
 		}
 
-		~FunctionWrapper() override = default;
-
-		FunctionWrapper(const FunctionWrapper&) = delete;
-		FunctionWrapper(FunctionWrapper&&) noexcept = default;
-
-		FunctionWrapper& operator=(const FunctionWrapper&) = delete;
-		FunctionWrapper& operator=(FunctionWrapper&&) noexcept = default;
+		MpmcQueue<TaskEntry*> queue;
 
-		void operator()() override
-		{
-			m_function();
-		}
-
-	private:
-		Func m_function;
+		// used only when the lock-free queue is full, which should be rare
+		std::atomic_size_t overflow_count { 0 };
+		std::mutex overflow_mutex;
+		std::deque<TaskEntry*> overflow;
 	};
 
-	void enqueue_internal(std::unique_ptr<FunctionWrapperBase> wrapper);
-	void thread_function();
+	void push_task(TaskEntry* entry, TaskPriority priority);
+	[[nodiscard]] TaskEntry* find_task(size_t worker_index);
+	[[nodiscard]] TaskEntry* pop_injected(TaskPriority priority);
+	void run_task(TaskEntry* entry);
+	void wake_one();
+	void thread_function(size_t worker_index);
 
 	size_t m_thread_count;
-	std::vector<std::thread> m_threads;
+
+	// declared before everything that can hold task entries so that it's destroyed after them
+	SlabAllocator<TaskEntry> m_task_entries;
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::array<InjectionQueue, PRIORITY_COUNT> m_injection_queues;
 
 	std::atomic_bool m_running;
-	std::mutex m_queue_mutex;
-	std::condition_variable m_pending_task_cv;
+	std::atomic<uint32_t> m_wake_epoch { 0 };
+	std::atomic<uint32_t> m_sleeping_count { 0 };
 	std::atomic_size_t m_pending_task_count;
-	std::queue<std::unique_ptr<FunctionWrapperBase>> m_queue;
-	std::condition_variable m_tasks_complete_cv;
 };
 
 template <typename Func, typename... Args>
-auto ThreadPool::enqueue(Func func, Args&&... args)
+auto ThreadPool::enqueue(TaskPriority priority, Func func, Args&&... args)
+{
+	return enqueue(priority, CancellationToken(), std::move(func), std::forward<Args>(args)...);
+}
+
+template <typename Func, typename... Args>
+auto ThreadPool::enqueue(TaskPriority priority, const CancellationToken& token, Func func, Args&&... args)
 {
 	using invoke_result_t = std::invoke_result_t<Func, Args...>;
 
@@ -89,26 +329,44 @@ auto ThreadPool::enqueue(Func func, Args&&... args)
 
 	auto wrapper_fn =
 		[
+			token,
 			func     = std::move(func),
 			...largs = std::forward<Args>(args),
 			promise  = std::move(promise)
 		]() mutable
 		{
-			if constexpr (std::is_void_v<invoke_result_t>)
+			if (token.is_cancelled())
 			{
-				func(std::forward<Args>(largs)...);
-				promise.set_value();
+				promise.set_exception(std::make_exception_ptr(TaskCancelledError()));
+				return;
 			}
-			else
+
+			try
 			{
-				promise.set_value(func(std::forward<Args>(largs)...));
+				if constexpr (std::is_void_v<invoke_result_t>)
+				{
+					func(std::forward<Args>(largs)...);
+					promise.set_value();
+				}
+				else
+				{
+					promise.set_value(func(std::forward<Args>(largs)...));
+				}
+			}
+			catch (...)
+			{
+				promise.set_exception(std::current_exception());
 			}
 		};
 
-	std::unique_ptr<FunctionWrapperBase> wrapper(new FunctionWrapper(std::move(wrapper_fn)));
-	enqueue_internal(std::move(wrapper));
+	TaskEntry* entry = m_task_entries.allocate(m_task_entries, priority, std::move(wrapper_fn));
+
+	// one reference for the queue, one for the handle
+	entry->add_ref();
+	m_pending_task_count.fetch_add(1, std::memory_order_relaxed);
+	push_task(entry, priority);
 
-	return future;
+	return Task<invoke_result_t> { std::move(future), TaskHandle(entry) };
 }
 
 // TODO: move is_future_ready somewhere else
@@ -0,0 +1,371 @@
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+#include "fnv1a.h"
+#include "ShaderFlags.h"
+
+#include "VertexDeclaration.h"
+
+namespace
+{
+	struct Semantic
+	{
+		const char* name;
+		UINT        index;
+	};
+
+	// indexed by D3DVSDE_*
+	constexpr std::array<Semantic, D3DVSDE_NORMAL2 + 1> FIXED_FUNCTION_SEMANTICS = {
+		Semantic { "POSITION", 0 },     // D3DVSDE_POSITION
+		Semantic { "BLENDWEIGHT", 0 },  // D3DVSDE_BLENDWEIGHT
+		Semantic { "BLENDINDICES", 0 }, // D3DVSDE_BLENDINDICES
+		Semantic { "NORMAL", 0 },       // D3DVSDE_NORMAL
+		Semantic { "PSIZE", 0 },        // D3DVSDE_PSIZE
+		Semantic { "COLOR", 0 },        // D3DVSDE_DIFFUSE
+		Semantic { "COLOR", 1 },        // D3DVSDE_SPECULAR
+		Semantic { "TEXCOORD", 0 },     // D3DVSDE_TEXCOORD0
+		Semantic { "TEXCOORD", 1 },
+		Semantic { "TEXCOORD", 2 },
+		Semantic { "TEXCOORD", 3 },
+		Semantic { "TEXCOORD", 4 },
+		Semantic { "TEXCOORD", 5 },
+		Semantic { "TEXCOORD", 6 },
+		Semantic { "TEXCOORD", 7 },     // D3DVSDE_TEXCOORD7
+		Semantic { "POSITION", 1 },     // D3DVSDE_POSITION2
+		Semantic { "NORMAL", 1 },       // D3DVSDE_NORMAL2
+	};
+
+	// the fixed-function shaders declare all of their inputs as floats
+	bool is_float_type(DWORD type)
+	{
+		return type <= D3DVSDT_D3DCOLOR;
+	}
+
+	DWORD token_type(DWORD token)
+	{
+		return (token & D3DVSD_TOKENTYPEMASK) >> D3DVSD_TOKENTYPESHIFT;
+	}
+}
+
+VertexDeclaration::VertexDeclaration(const DWORD* tokens)
+{
+	bool has_stream = false;
+	UINT stream = 0;
+	UINT offset = 0;
+
+	for (const DWORD* token = tokens;; ++token)
+	{
+		m_tokens.push_back(*token);
+
+		if (*token == D3DVSD_END())
+		{
+			break;
+		}
+
+		switch (token_type(*token))
+		{
+			case D3DVSD_TOKEN_NOP:
+				break;
+
+			case D3DVSD_TOKEN_STREAM:
+				if (*token & D3DVSD_STREAMTESSMASK)
+				{
+					throw std::runtime_error("tessellator streams are not supported");
+				}
+
+				has_stream = true;
+				stream = (*token & D3DVSD_STREAMNUMBERMASK) >> D3DVSD_STREAMNUMBERSHIFT;
+				offset = 0;
+				break;
+
+			case D3DVSD_TOKEN_STREAMDATA:
+			{
+				if (!has_stream)
+				{
+					throw std::runtime_error("vertex declaration loads data before selecting a stream");
+				}
+
+				if (*token & D3DVSD_DATALOADTYPEMASK)
+				{
+					offset += ((*token & D3DVSD_SKIPCOUNTMASK) >> D3DVSD_SKIPCOUNTSHIFT) * sizeof(DWORD);
+					break;
+				}
+
+				const DWORD vertex_register = (*token & D3DVSD_VERTEXREGMASK) >> D3DVSD_VERTEXREGSHIFT;
+				const DWORD type = (*token & D3DVSD_DATATYPEMASK) >> D3DVSD_DATATYPESHIFT;
+
+				if (vertex_register > D3DVSDE_NORMAL2 || type > D3DVSDT_SHORT4)
+				{
+					throw std::runtime_error(std::format("invalid vertex declaration token 0x{:08X}", *token));
+				}
+
+				m_elements.push_back({ stream, offset, vertex_register, type });
+				offset += type_size(type);
+				break;
+			}
+
+			case D3DVSD_TOKEN_CONSTMEM:
+			{
+				const DWORD count   = (*token & D3DVSD_CONSTCOUNTMASK) >> D3DVSD_CONSTCOUNTSHIFT;
+				const DWORD address = (*token & D3DVSD_CONSTADDRESSMASK) >> D3DVSD_CONSTADDRESSSHIFT;
+
+				for (DWORD i = 0; i < count; ++i)
+				{
+					Constant constant { address + i, {} };
+					std::memcpy(constant.value.data(), token + 1, sizeof(constant.value));
+
+					m_tokens.insert(m_tokens.end(), token + 1, token + 5);
+					m_constants.push_back(constant);
+
+					token += 4;
+				}
+
+				break;
+			}
+
+			case D3DVSD_TOKEN_EXT:
+			{
+				// extension data is opaque; keep it so the declaration reads back the same
+				const DWORD count = (*token & D3DVSD_EXTCOUNTMASK) >> D3DVSD_EXTCOUNTSHIFT;
+
+				m_tokens.insert(m_tokens.end(), token + 1, token + 1 + count);
+				token += count;
+				break;
+			}
+
+			case D3DVSD_TOKEN_TESSELLATOR:
+				throw std::runtime_error("the tessellator is not supported");
+
+			default:
+				throw std::runtime_error(std::format("invalid vertex declaration token 0x{:08X}", *token));
+		}
+	}
+}
+
+const std::vector<DWORD>& VertexDeclaration::get_tokens() const
+{
+	return m_tokens;
+}
+
+const std::vector<VertexDeclaration::Element>& VertexDeclaration::get_elements() const
+{
+	return m_elements;
+}
+
+const std::vector<VertexDeclaration::Constant>& VertexDeclaration::get_constants() const
+{
+	return m_constants;
+}
+
+DWORD VertexDeclaration::to_fvf() const
+{
+	DWORD fvf = 0;
+	uint32_t texcoords = 0;
+	DWORD texcoord_formats = 0;
+
+	for (const Element& element : m_elements)
+	{
+		DWORD flag;
+
+		switch (element.vertex_register)
+		{
+			case D3DVSDE_POSITION:
+				flag = D3DFVF_XYZ;
+				break;
+
+			case D3DVSDE_NORMAL:
+				flag = D3DFVF_NORMAL;
+				break;
+
+			case D3DVSDE_DIFFUSE:
+				flag = D3DFVF_DIFFUSE;
+				break;
+
+			case D3DVSDE_SPECULAR:
+				flag = D3DFVF_SPECULAR;
+				break;
+
+			case D3DVSDE_TEXCOORD0:
+			case D3DVSDE_TEXCOORD1:
+			case D3DVSDE_TEXCOORD2:
+			case D3DVSDE_TEXCOORD3:
+			case D3DVSDE_TEXCOORD4:
+			case D3DVSDE_TEXCOORD5:
+			case D3DVSDE_TEXCOORD6:
+			case D3DVSDE_TEXCOORD7:
+			{
+				const DWORD index = element.vertex_register - D3DVSDE_TEXCOORD0;
+				flag = 0;
+				texcoords |= 1u << index;
+
+				DWORD format;
+
+				switch (element.type)
+				{
+					case D3DVSDT_FLOAT1:
+						format = D3DFVF_TEXTUREFORMAT1;
+						break;
+
+					case D3DVSDT_FLOAT2:
+						format = D3DFVF_TEXTUREFORMAT2;
+						break;
+
+					case D3DVSDT_FLOAT3:
+						format = D3DFVF_TEXTUREFORMAT3;
+						break;
+
+					default:
+						format = D3DFVF_TEXTUREFORMAT4;
+						break;
+				}
+
+				texcoord_formats |= format << (ShaderFlags::fvf_texfmt_shift + index * ShaderFlags::fvf_texfmt_bits);
+				break;
+			}
+
+			default:
+				// blend weights, point size and the second position and normal aren't used by the fixed-function shaders
+				continue;
+		}
+
+		if (!is_float_type(element.type))
+		{
+			throw std::runtime_error(std::format("vertex register {} can't be loaded from type {} for fixed-function processing",
+			                                     element.vertex_register, element.type));
+		}
+
+		fvf |= flag;
+	}
+
+	if (!(fvf & D3DFVF_XYZ))
+	{
+		throw std::runtime_error("vertex declaration has no position");
+	}
+
+	// the shaders take texture coordinates 0 through count - 1, so they can't have gaps
+	const auto texcoord_count = static_cast<DWORD>(std::bit_width(texcoords));
+
+	if (texcoords != (1u << texcoord_count) - 1)
+	{
+		throw std::runtime_error("vertex declaration skips texture coordinates");
+	}
+
+	return fvf | texcoord_formats | (texcoord_count << D3DFVF_TEXCOUNT_SHIFT);
+}
+
+std::vector<D3D11_INPUT_ELEMENT_DESC> VertexDeclaration::fixed_function_input_elements() const
+{
+	std::vector<D3D11_INPUT_ELEMENT_DESC> result;
+	result.reserve(m_elements.size());
+
+	for (const Element& element : m_elements)
+	{
+		const Semantic& semantic = FIXED_FUNCTION_SEMANTICS[element.vertex_register];
+
+		D3D11_INPUT_ELEMENT_DESC e {};
+
+		e.SemanticName      = semantic.name;
+		e.SemanticIndex     = semantic.index;
+		e.Format            = to_dxgi(element.type);
+		e.InputSlot         = element.stream;
+		e.AlignedByteOffset = element.offset;
+		e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
+
+		result.push_back(e);
+	}
+
+	return result;
+}
+
+std::vector<D3D11_INPUT_ELEMENT_DESC> VertexDeclaration::shader_input_elements() const
+{
+	std::vector<D3D11_INPUT_ELEMENT_DESC> result;
+	result.reserve(m_elements.size());
+
+	for (const Element& element : m_elements)
+	{
+		D3D11_INPUT_ELEMENT_DESC e {};
+
+		e.SemanticName      = SHADER_INPUT_SEMANTIC;
+		e.SemanticIndex     = element.vertex_register;
+		e.Format            = to_dxgi(element.type);
+		e.InputSlot         = element.stream;
+		e.AlignedByteOffset = element.offset;
+		e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
+
+		result.push_back(e);
+	}
+
+	return result;
+}
+
+uint64_t VertexDeclaration::layout_hash() const
+{
+	static_assert(sizeof(Element) == 4 * sizeof(DWORD), "elements are hashed as raw bytes");
+	return fnv1a_64(m_elements.data(), m_elements.size() * sizeof(Element));
+}
+
+DXGI_FORMAT VertexDeclaration::to_dxgi(DWORD type)
+{
+	switch (type)
+	{
+		case D3DVSDT_FLOAT1:
+			return DXGI_FORMAT_R32_FLOAT;
+
+		case D3DVSDT_FLOAT2:
+			return DXGI_FORMAT_R32G32_FLOAT;
+
+		case D3DVSDT_FLOAT3:
+			return DXGI_FORMAT_R32G32B32_FLOAT;
+
+		case D3DVSDT_FLOAT4:
+			return DXGI_FORMAT_R32G32B32A32_FLOAT;
+
+		case D3DVSDT_D3DCOLOR:
+			return DXGI_FORMAT_B8G8R8A8_UNORM;
+
+		case D3DVSDT_UBYTE4:
+			return DXGI_FORMAT_R8G8B8A8_UINT;
+
+		case D3DVSDT_SHORT2:
+			return DXGI_FORMAT_R16G16_SINT;
+
+		case D3DVSDT_SHORT4:
+			return DXGI_FORMAT_R16G16B16A16_SINT;
+
+		default:
+			return DXGI_FORMAT_UNKNOWN;
+	}
+}
+
+UINT VertexDeclaration::type_size(DWORD type)
+{
+	switch (type)
+	{
+		case D3DVSDT_FLOAT1:
+		case D3DVSDT_D3DCOLOR:
+		case D3DVSDT_UBYTE4:
+		case D3DVSDT_SHORT2:
+			return 4;
+
+		case D3DVSDT_FLOAT2:
+		case D3DVSDT_SHORT4:
+			return 8;
+
+		case D3DVSDT_FLOAT3:
+			return 12;
+
+		case D3DVSDT_FLOAT4:
+			return 16;
+
+		default:
+			return 0;
+	}
+}
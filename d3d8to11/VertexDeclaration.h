@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <d3d11.h>
+
+#include "d3d8types.h"
+
+/**
+ * \brief A parsed D3D8 vertex shader declaration (\c D3DVSD_* tokens): which vertex register each
+ * component of each stream is loaded into, and any constants it loads.
+ */
+class VertexDeclaration
+{
+public:
+	struct Element
+	{
+		UINT  stream;
+		UINT  offset;          // in bytes from the start of the vertex in its stream
+		DWORD vertex_register; // D3DVSDE_* for fixed-function processing
+		DWORD type;            // D3DVSDT_*
+	};
+
+	struct Constant
+	{
+		DWORD index;
+		std::array<float, 4> value;
+	};
+
+	// translated vertex shaders take vertex register n from semantic index n of this name
+	static constexpr const char* SHADER_INPUT_SEMANTIC = "V";
+
+	VertexDeclaration() = default;
+
+	/**
+	 * \brief Parses the tokens up to and including \c D3DVSD_END.
+	 * \throws std::runtime_error if the declaration is malformed or uses something that isn't supported.
+	 */
+	explicit VertexDeclaration(const DWORD* tokens);
+
+	[[nodiscard]] const std::vector<DWORD>& get_tokens() const;
+	[[nodiscard]] const std::vector<Element>& get_elements() const;
+	[[nodiscard]] const std::vector<Constant>& get_constants() const;
+
+	/**
+	 * \brief Returns the FVF with the same inputs for the fixed-function shaders,
+	 * which take their inputs by semantic and don't care which stream they come from.
+	 * \throws std::runtime_error if fixed-function shaders can't take these inputs.
+	 */
+	[[nodiscard]] DWORD to_fvf() const;
+
+	/**
+	 * \brief Returns the input elements for the fixed-function shaders, one per element,
+	 * each bound to the slot of its stream.
+	 */
+	[[nodiscard]] std::vector<D3D11_INPUT_ELEMENT_DESC> fixed_function_input_elements() const;
+
+	/**
+	 * \brief Returns the input elements for a translated vertex shader, one per element,
+	 * each named by its vertex register rather than its fixed-function meaning.
+	 */
+	[[nodiscard]] std::vector<D3D11_INPUT_ELEMENT_DESC> shader_input_elements() const;
+
+	/**
+	 * \brief Hashes the elements, which is all the input layout depends on.
+	 */
+	[[nodiscard]] uint64_t layout_hash() const;
+
+	[[nodiscard]] static DXGI_FORMAT to_dxgi(DWORD type);
+	[[nodiscard]] static UINT type_size(DWORD type);
+
+private:
+	std::vector<DWORD> m_tokens;
+	std::vector<Element> m_elements;
+	std::vector<Constant> m_constants;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * \brief Chase-Lev work-stealing deque.
+ *
+ * Only the owning thread may call \c push and \c pop (LIFO end); any thread may call \c steal (FIFO end).
+ * Based on "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al., 2013).
+ * \tparam T A trivially copyable type. A value-initialized \c T is returned when the deque is empty.
+ */
+template <typename T>
+class WorkStealingDeque
+{
+	static_assert(std::is_trivially_copyable_v<T>);
+
+	struct Array
+	{
+		explicit Array(int64_t capacity)
+			: capacity(capacity),
+			  data(std::make_unique<std::atomic<T>[]>(static_cast<size_t>(capacity)))
+		{
+		}
+
+		[[nodiscard]] T get(int64_t i) const
+		{
+			return data[static_cast<size_t>(i & (capacity - 1))].load(std::memory_order_relaxed);
+		}
+
+		void put(int64_t i, T value)
+		{
+			data[static_cast<size_t>(i & (capacity - 1))].store(value, std::memory_order_relaxed);
+		}
+
+		const int64_t capacity;
+		std::unique_ptr<std::atomic<T>[]> data;
+	};
+
+public:
+	explicit WorkStealingDeque(int64_t capacity = 256)
+	{
+		m_arrays.emplace_back(std::make_unique<Array>(capacity));
+		m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+	}
+
+	WorkStealingDeque(const WorkStealingDeque&)     = delete;
+	WorkStealingDeque(WorkStealingDeque&&) noexcept = delete;
+
+	WorkStealingDeque& operator=(const WorkStealingDeque&)     = delete;
+	WorkStealingDeque& operator=(WorkStealingDeque&&) noexcept = delete;
+
+	[[nodiscard]] bool empty() const
+	{
+		const int64_t b = m_bottom.load(std::memory_order_relaxed);
+		const int64_t t = m_top.load(std::memory_order_relaxed);
+		return b <= t;
+	}
+
+	void push(T value)
+	{
+		const int64_t b = m_bottom.load(std::memory_order_relaxed);
+		const int64_t t = m_top.load(std::memory_order_acquire);
+		Array* array = m_array.load(std::memory_order_relaxed);
+
+		if (b - t > array->capacity - 1)
+		{
+			array = grow(array, b, t);
+		}
+
+		array->put(b, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	T pop()
+	{
+		const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+		Array* array = m_array.load(std::memory_order_relaxed);
+		m_bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = m_top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+			return T {};
+		}
+
+		T value = array->get(b);
+
+		if (t == b)
+		{
+			// last element; race against thieves for it
+			if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				value = T {};
+			}
+
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return value;
+	}
+
+	T steal()
+	{
+		int64_t t = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = m_bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+		{
+			return T {};
+		}
+
+		const Array* array = m_array.load(std::memory_order_acquire);
+		T value = array->get(t);
+
+		if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return T {};
+		}
+
+		return value;
+	}
+
+	/**
+	 * \brief Frees the arrays retired by growing the deque.
+	 * Only the owning thread may call this, and only while no thread is inside \c steal.
+	 */
+	void reclaim()
+	{
+		if (m_arrays.size() > 1)
+		{
+			m_arrays.erase(m_arrays.begin(), m_arrays.end() - 1);
+		}
+	}
+
+private:
+	Array* grow(const Array* array, int64_t b, int64_t t)
+	{
+		auto new_array = std::make_unique<Array>(array->capacity * 2);
+
+		for (int64_t i = t; i < b; ++i)
+		{
+			new_array->put(i, array->get(i));
+		}
+
+		// thieves may still be reading the old array, so it's retired until reclaim rather than freed
+		Array* result = new_array.get();
+		m_arrays.emplace_back(std::move(new_array));
+		m_array.store(result, std::memory_order_release);
+		return result;
+	}
+
+	alignas(64) std::atomic<int64_t> m_top { 0 };
+	alignas(64) std::atomic<int64_t> m_bottom { 0 };
+	alignas(64) std::atomic<Array*> m_array { nullptr };
+	std::vector<std::unique_ptr<Array>> m_arrays; // owner-only
+};
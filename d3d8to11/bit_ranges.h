@@ -0,0 +1,22 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+/**
+ * \brief Calls \p callback with the index of the first bit and the length of every run of consecutive set bits in \p mask,
+ * from the least significant bit up.
+ */
+template <typename Callback>
+void for_each_bit_range(uint32_t mask, Callback&& callback)
+{
+	while (mask)
+	{
+		const int first = std::countr_zero(mask);
+		const int count = std::countr_one(mask >> first);
+
+		callback(static_cast<uint32_t>(first), static_cast<uint32_t>(count));
+
+		mask &= ~static_cast<uint32_t>(((uint64_t(1) << count) - 1) << first);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+#include <d3d11.h>
+
+namespace d3d8to11
+{
+/**
+ * \brief Writes bytes [\p offset, \p offset + \p size) of the dynamic buffer \p buffer through \p write,
+ * which receives a pointer to them, without losing anything outside that range.
+ *
+ * A dynamic buffer can only be mapped to discard all of it or to write without any synchronization,
+ * so unless the range is the whole buffer and \p write sets all of it, the range is written into
+ * \p scratch and copied over, which keeps the rest of the buffer and is ordered after earlier draws that read it.
+ *
+ * \param buffer_size      Size of \p buffer in bytes.
+ * \param scratch          A staging buffer of at least \p size bytes with CPU write access.
+ * \param overwrites_range Whether \p write sets every byte of the range. If not, \p scratch is filled
+ *                         with the current contents of the range first.
+ * \return \c false if mapping failed, in which case \p write wasn't called.
+ */
+template <typename Context, typename Write>
+bool write_buffer_range(Context& context, ID3D11Resource* buffer, UINT buffer_size, ID3D11Resource* scratch,
+                        UINT offset, UINT size, bool overwrites_range, Write&& write)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped {};
+
+	if (overwrites_range && offset == 0 && size == buffer_size)
+	{
+		if (FAILED(context.Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			return false;
+		}
+
+		write(static_cast<uint8_t*>(mapped.pData));
+		context.Unmap(buffer, 0);
+		return true;
+	}
+
+	D3D11_BOX box {};
+	box.bottom = 1;
+	box.back   = 1;
+
+	if (!overwrites_range)
+	{
+		box.left  = offset;
+		box.right = offset + size;
+
+		context.CopySubresourceRegion(scratch, 0, 0, 0, 0, buffer, 0, &box);
+	}
+
+	// a staging buffer keeps its contents when mapped for writing; this also waits for the copy above
+	if (FAILED(context.Map(scratch, 0, D3D11_MAP_WRITE, 0, &mapped)))
+	{
+		return false;
+	}
+
+	write(static_cast<uint8_t*>(mapped.pData));
+	context.Unmap(scratch, 0);
+
+	box.left  = 0;
+	box.right = size;
+
+	context.CopySubresourceRegion(buffer, 0, offset, 0, 0, scratch, 0, &box);
+	return true;
+}
+}
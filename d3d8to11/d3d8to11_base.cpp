@@ -9,6 +9,7 @@
 #include <wrl/client.h>
 
 #include "d3d8to11_base.h"
+#include "ShaderTranslator.h"
 
 #include "not_implemented.h"
 
@@ -437,10 +438,14 @@ HRESULT STDMETHODCALLTYPE Direct3D8::GetDeviceCaps(UINT Adapter, D3DDEVTYPE Devi
 	pCaps->MaxActiveLights          = LIGHT_COUNT;
 	pCaps->MaxPrimitiveCount        = 16777215; // taken from real device report
 	pCaps->MaxVertexIndex           = 16777215; // taken from real device report
-	pCaps->MaxStreams               = 16; // taken from real device report
+	pCaps->MaxStreams               = STREAM_SOURCE_MAX; // taken from real device report
 	pCaps->MaxStreamStride          = 255; // taken from real device report;
 	pCaps->MaxTextureBlendStages    = TEXTURE_STAGE_MAX;
 	pCaps->MaxSimultaneousTextures  = TEXTURE_STAGE_MAX;
+	pCaps->VertexShaderVersion      = D3DVS_VERSION(1, 1);
+	pCaps->MaxVertexShaderConst     = static_cast<DWORD>(VS_CONSTANT_REGISTER_MAX);
+	pCaps->PixelShaderVersion       = D3DPS_VERSION(1, 4);
+	pCaps->MaxPixelShaderValue      = PS_VALUE_MAX;
 
 	return D3D_OK;
 }
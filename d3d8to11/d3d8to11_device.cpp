@@ -8,25 +8,38 @@
 #include <d3d11_1.h> // TODO: switch to newer header (11.3, 11.4)
 #include <DirectXMath.h>
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cstdint>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <limits>
+#include <memory>
 #include <ranges>
 
 #include <CBufferWriter.h>
 
 #include "alignment.h"
+#include "bit_ranges.h"
+#include "buffer_range.h"
 #include "d3d8to11.hpp"
+#include "fvf_input_layout.h"
 #include "globals.h"
 #include "ini_file.h"
 #include "Material.h"
 #include "not_implemented.h"
 #include "RasterFlags.h"
 #include "safe_release.h"
+#include "scope_exit.h"
+#include "ShaderCache.h"
+#include "ShaderCompiler.h"
 #include "ShaderFlags.h"
 #include "ShaderIncluder.h"
+#include "ShaderTranslator.h"
 #include "SimpleMath.h"
+#include "triangle_fan.h"
 
 #include "d3d8to11_device.h"
 
@@ -39,87 +52,6 @@
 using namespace Microsoft::WRL;
 using namespace d3d8to11;
 
-static constexpr uint32_t BLEND_COLORMASK_SHIFT = 28;
-
-static const std::unordered_map<uint32_t, std::string> RS_STRINGS = {
-	{ D3DRS_ZENABLE,                  "D3DRS_ZENABLE" },
-	{ D3DRS_FILLMODE,                 "D3DRS_FILLMODE" },
-	{ D3DRS_SHADEMODE,                "D3DRS_SHADEMODE" },
-	{ D3DRS_LINEPATTERN,              "D3DRS_LINEPATTERN" },
-	{ D3DRS_ZWRITEENABLE,             "D3DRS_ZWRITEENABLE" },
-	{ D3DRS_ALPHATESTENABLE,          "D3DRS_ALPHATESTENABLE" },
-	{ D3DRS_LASTPIXEL,                "D3DRS_LASTPIXEL" },
-	{ D3DRS_SRCBLEND,                 "D3DRS_SRCBLEND" },
-	{ D3DRS_DESTBLEND,                "D3DRS_DESTBLEND" },
-	{ D3DRS_CULLMODE,                 "D3DRS_CULLMODE" },
-	{ D3DRS_ZFUNC,                    "D3DRS_ZFUNC" },
-	{ D3DRS_ALPHAREF,                 "D3DRS_ALPHAREF" },
-	{ D3DRS_ALPHAFUNC,                "D3DRS_ALPHAFUNC" },
-	{ D3DRS_DITHERENABLE,             "D3DRS_DITHERENABLE" },
-	{ D3DRS_ALPHABLENDENABLE,         "D3DRS_ALPHABLENDENABLE" },
-	{ D3DRS_FOGENABLE,                "D3DRS_FOGENABLE" },
-	{ D3DRS_SPECULARENABLE,           "D3DRS_SPECULARENABLE" },
-	{ D3DRS_ZVISIBLE,                 "D3DRS_ZVISIBLE" },
-	{ D3DRS_FOGCOLOR,                 "D3DRS_FOGCOLOR" },
-	{ D3DRS_FOGTABLEMODE,             "D3DRS_FOGTABLEMODE" },
-	{ D3DRS_FOGSTART,                 "D3DRS_FOGSTART" },
-	{ D3DRS_FOGEND,                   "D3DRS_FOGEND" },
-	{ D3DRS_FOGDENSITY,               "D3DRS_FOGDENSITY" },
-	{ D3DRS_EDGEANTIALIAS,            "D3DRS_EDGEANTIALIAS" },
-	{ D3DRS_ZBIAS,                    "D3DRS_ZBIAS" },
-	{ D3DRS_RANGEFOGENABLE,           "D3DRS_RANGEFOGENABLE" },
-	{ D3DRS_STENCILENABLE,            "D3DRS_STENCILENABLE" },
-	{ D3DRS_STENCILFAIL,              "D3DRS_STENCILFAIL" },
-	{ D3DRS_STENCILZFAIL,             "D3DRS_STENCILZFAIL" },
-	{ D3DRS_STENCILPASS,              "D3DRS_STENCILPASS" },
-	{ D3DRS_STENCILFUNC,              "D3DRS_STENCILFUNC" },
-	{ D3DRS_STENCILREF,               "D3DRS_STENCILREF" },
-	{ D3DRS_STENCILMASK,              "D3DRS_STENCILMASK" },
-	{ D3DRS_STENCILWRITEMASK,         "D3DRS_STENCILWRITEMASK" },
-	{ D3DRS_TEXTUREFACTOR,            "D3DRS_TEXTUREFACTOR" },
-	{ D3DRS_WRAP0,                    "D3DRS_WRAP0" },
-	{ D3DRS_WRAP1,                    "D3DRS_WRAP1" },
-	{ D3DRS_WRAP2,                    "D3DRS_WRAP2" },
-	{ D3DRS_WRAP3,                    "D3DRS_WRAP3" },
-	{ D3DRS_WRAP4,                    "D3DRS_WRAP4" },
-	{ D3DRS_WRAP5,                    "D3DRS_WRAP5" },
-	{ D3DRS_WRAP6,                    "D3DRS_WRAP6" },
-	{ D3DRS_WRAP7,                    "D3DRS_WRAP7" },
-	{ D3DRS_CLIPPING,                 "D3DRS_CLIPPING" },
-	{ D3DRS_LIGHTING,                 "D3DRS_LIGHTING" },
-	{ D3DRS_AMBIENT,                  "D3DRS_AMBIENT" },
-	{ D3DRS_FOGVERTEXMODE,            "D3DRS_FOGVERTEXMODE" },
-	{ D3DRS_COLORVERTEX,              "D3DRS_COLORVERTEX" },
-	{ D3DRS_LOCALVIEWER,              "D3DRS_LOCALVIEWER" },
-	{ D3DRS_NORMALIZENORMALS,         "D3DRS_NORMALIZENORMALS" },
-	{ D3DRS_DIFFUSEMATERIALSOURCE,    "D3DRS_DIFFUSEMATERIALSOURCE" },
-	{ D3DRS_SPECULARMATERIALSOURCE,   "D3DRS_SPECULARMATERIALSOURCE" },
-	{ D3DRS_AMBIENTMATERIALSOURCE,    "D3DRS_AMBIENTMATERIALSOURCE" },
-	{ D3DRS_EMISSIVEMATERIALSOURCE,   "D3DRS_EMISSIVEMATERIALSOURCE" },
-	{ D3DRS_VERTEXBLEND,              "D3DRS_VERTEXBLEND" },
-	{ D3DRS_CLIPPLANEENABLE,          "D3DRS_CLIPPLANEENABLE" },
-	{ D3DRS_SOFTWAREVERTEXPROCESSING, "D3DRS_SOFTWAREVERTEXPROCESSING" },
-	{ D3DRS_POINTSIZE,                "D3DRS_POINTSIZE" },
-	{ D3DRS_POINTSIZE_MIN,            "D3DRS_POINTSIZE_MIN" },
-	{ D3DRS_POINTSPRITEENABLE,        "D3DRS_POINTSPRITEENABLE" },
-	{ D3DRS_POINTSCALEENABLE,         "D3DRS_POINTSCALEENABLE" },
-	{ D3DRS_POINTSCALE_A,             "D3DRS_POINTSCALE_A" },
-	{ D3DRS_POINTSCALE_B,             "D3DRS_POINTSCALE_B" },
-	{ D3DRS_POINTSCALE_C,             "D3DRS_POINTSCALE_C" },
-	{ D3DRS_MULTISAMPLEANTIALIAS,     "D3DRS_MULTISAMPLEANTIALIAS" },
-	{ D3DRS_MULTISAMPLEMASK,          "D3DRS_MULTISAMPLEMASK" },
-	{ D3DRS_PATCHEDGESTYLE,           "D3DRS_PATCHEDGESTYLE" },
-	{ D3DRS_PATCHSEGMENTS,            "D3DRS_PATCHSEGMENTS" },
-	{ D3DRS_DEBUGMONITORTOKEN,        "D3DRS_DEBUGMONITORTOKEN" },
-	{ D3DRS_POINTSIZE_MAX,            "D3DRS_POINTSIZE_MAX" },
-	{ D3DRS_INDEXEDVERTEXBLENDENABLE, "D3DRS_INDEXEDVERTEXBLENDENABLE" },
-	{ D3DRS_COLORWRITEENABLE,         "D3DRS_COLORWRITEENABLE" },
-	{ D3DRS_TWEENFACTOR,              "D3DRS_TWEENFACTOR" },
-	{ D3DRS_BLENDOP,                  "D3DRS_BLENDOP" },
-	{ D3DRS_POSITIONORDER,            "D3DRS_POSITIONORDER" },
-	{ D3DRS_NORMALORDER,              "D3DRS_NORMALORDER" }
-};
-
 static const std::array FEATURE_LEVELS =
 {
 	D3D_FEATURE_LEVEL_12_1,
@@ -145,211 +77,17 @@ size_t Direct3DDevice8::count_texture_stages() const
 	return n;
 }
 
-#define STRINGIFY(x) #x
-#define TOSTRING(x) STRINGIFY(x)
-
-void Direct3DDevice8::shader_preprocess(ShaderFlags::type flags, bool is_uber, std::vector<D3D_SHADER_MACRO>& definitions) const
-{
-	static const std::array texcoord_size_strings = {
-		"FVF_TEXCOORD0_SIZE",
-		"FVF_TEXCOORD1_SIZE",
-		"FVF_TEXCOORD2_SIZE",
-		"FVF_TEXCOORD3_SIZE",
-		"FVF_TEXCOORD4_SIZE",
-		"FVF_TEXCOORD5_SIZE",
-		"FVF_TEXCOORD6_SIZE",
-		"FVF_TEXCOORD7_SIZE"
-	};
-
-	static const std::array texcoord_size_types = {
-		"FVF_TEXCOORD0_TYPE",
-		"FVF_TEXCOORD1_TYPE",
-		"FVF_TEXCOORD2_TYPE",
-		"FVF_TEXCOORD3_TYPE",
-		"FVF_TEXCOORD4_TYPE",
-		"FVF_TEXCOORD5_TYPE",
-		"FVF_TEXCOORD6_TYPE",
-		"FVF_TEXCOORD7_TYPE"
-	};
-
-	static const std::array texcoord_format_types = {
-		"float2",
-		"float3",
-		"float4",
-		"float1",
-	};
-
-	const ShaderFlags::type sanitized_flags = ShaderFlags::sanitize(flags);
-
-	definitions.clear();
-	definitions.emplace_back("OIT_MAX_FRAGMENTS", m_oit_fragments_str.c_str());
-	definitions.emplace_back("TEXTURE_STAGE_MAX", TOSTRING(TEXTURE_STAGE_MAX));
-
-	auto uv_format = sanitized_flags >> 16u; // FIXME: magic number
-	const auto tex_count = static_cast<size_t>(((sanitized_flags & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT) & 0xF);
-
-	for (size_t i = 0; i < tex_count; i++)
-	{
-		const auto f = static_cast<size_t>(uv_format & 3u);
-		uv_format >>= 2;
-
-		switch (f)
-		{
-			case D3DFVF_TEXTUREFORMAT2:
-				definitions.push_back({ texcoord_size_strings[i], "2" });
-				break;
-
-			case D3DFVF_TEXTUREFORMAT3:
-				definitions.push_back({ texcoord_size_strings[i], "3" });
-				break;
-
-			case D3DFVF_TEXTUREFORMAT4:
-				definitions.push_back({ texcoord_size_strings[i], "4" });
-				break;
-
-			case D3DFVF_TEXTUREFORMAT1:
-				definitions.push_back({ texcoord_size_strings[i], "1" });
-				break;
-
-			default:
-				continue;
-		}
-
-		definitions.push_back({ texcoord_size_types[i], texcoord_format_types[f] });
-	}
-
-	{
-		const size_t stage_count = (sanitized_flags & ShaderFlags::stage_count_mask) >> ShaderFlags::stage_count_shift;
-		const std::string& digit_string = m_digit_strings.at(stage_count);
-		definitions.push_back({ "TEXTURE_STAGE_COUNT", digit_string.c_str() });
-	}
-
-	if ((sanitized_flags & D3DFVF_POSITION_MASK) == D3DFVF_XYZRHW)
-	{
-		definitions.push_back({ "FVF_RHW", "1" });
-	}
-
-	if ((sanitized_flags & D3DFVF_POSITION_MASK) == D3DFVF_XYZ)
-	{
-		definitions.push_back({ "FVF_XYZ", "1" });
-	}
-
-	if ((sanitized_flags & D3DFVF_NORMAL) != 0)
-	{
-		definitions.push_back({ "FVF_NORMAL", "1" });
-	}
-
-	if ((sanitized_flags & D3DFVF_DIFFUSE) != 0)
-	{
-		definitions.push_back({ "FVF_DIFFUSE", "1" });
-	}
-
-	if ((sanitized_flags & D3DFVF_SPECULAR) != 0)
-	{
-		definitions.push_back({ "FVF_SPECULAR", "1" });
-	}
-
-	if (sanitized_flags & D3DFVF_TEXCOUNT_MASK)
-	{
-		const size_t texcount = (sanitized_flags & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT;
-		const std::string& digit_string = m_digit_strings.at(texcount);
-		definitions.push_back({ "FVF_TEXCOUNT", digit_string.c_str() });
-	}
-	else
-	{
-		definitions.push_back({ "FVF_TEXCOUNT", "0" });
-	}
-
-	auto one_or_zero = [&](ShaderFlags::type mask)
-	{
-		return (sanitized_flags & mask) != 0 ? "1" : "0";
-	};
-
-	if (is_uber)
-	{
-		definitions.push_back({ "UBER", "1" });
-	}
-	else
-	{
-		definitions.push_back({ "UBER", "0" });
-
-		definitions.push_back({ "RS_LIGHTING", one_or_zero(ShaderFlags::rs_lighting) });
-		definitions.push_back({ "RS_SPECULAR", one_or_zero(ShaderFlags::rs_specular) });
-		definitions.push_back({ "RS_ALPHA", one_or_zero(ShaderFlags::rs_alpha) });
-		definitions.push_back({ "RS_ALPHA_TEST", one_or_zero(ShaderFlags::rs_alpha_test) });
-		definitions.push_back({ "RS_FOG", one_or_zero(ShaderFlags::rs_fog) });
-		definitions.push_back({ "RS_OIT", one_or_zero(ShaderFlags::rs_oit) });
-
-		const auto alpha_test_mode = static_cast<size_t>((sanitized_flags & ShaderFlags::rs_alpha_test_mode_mask) >> ShaderFlags::rs_alpha_test_mode_shift);
-		const auto fog_mode        = static_cast<size_t>((sanitized_flags & ShaderFlags::rs_fog_mode_mask) >> ShaderFlags::rs_fog_mode_shift);
-
-		definitions.push_back({ "RS_ALPHA_TEST_MODE", m_digit_strings.at(alpha_test_mode).c_str() });
-		definitions.push_back({ "RS_FOG_MODE", m_digit_strings.at(fog_mode).c_str() });
-	}
-}
-
-std::vector<D3D_SHADER_MACRO> Direct3DDevice8::shader_preprocess(ShaderFlags::type flags, bool is_uber) const
-{
-	std::vector<D3D_SHADER_MACRO> definitions;
-	shader_preprocess(flags, is_uber, definitions);
-	return definitions;
-}
-
 void Direct3DDevice8::draw_call_increment()
 {
 	m_per_model.draw_call = (m_per_model.draw_call.data() + 1) % 65536;
 }
 
-static constexpr auto SHADER_COMPILER_FLAGS =
-	D3DCOMPILE_PREFER_FLOW_CONTROL |
-	D3DCOMPILE_DEBUG
-// just keeping optimization on for now
-#if 1 || !defined(_DEBUG)
-	| D3DCOMPILE_OPTIMIZATION_LEVEL3
-#endif
-;
-
 VertexShader Direct3DDevice8::compile_vertex_shader(ShaderFlags::type flags, bool is_uber)
 {
-	ComPtr<ID3DBlob> errors;
-	ComPtr<ID3DBlob> blob;
+	ComPtr<ID3DBlob> blob = m_shader_compiler.compile_vertex_shader(flags, is_uber);
 	ComPtr<ID3D11VertexShader> shader;
 
-	std::filesystem::path shader_path = d3d8to11::config->get_shader_source_dir() / "shader.hlsl";
-
-	if (d3d8to11::filesystem::should_extend_length(shader_path))
-	{
-		shader_path = d3d8to11::filesystem::as_extended_length(shader_path);
-	}
-
-	const auto shader_source = m_shader_includer.get_shader_source(shader_path);
-
-	std::vector<D3D_SHADER_MACRO> preproc = shader_preprocess(flags, is_uber);
-	preproc.push_back({});
-
-	HRESULT hr;
-
-	{
-		// unfortunately a necessary evil :(
-		const std::string shader_path_string = shader_path.string();
-		hr = D3DCompile(shader_source.data(), shader_source.size(), shader_path_string.c_str(), preproc.data(), &m_shader_includer, "vs_main", "vs_5_0", SHADER_COMPILER_FLAGS, 0, &blob, &errors);
-	}
-
-	if (errors != nullptr)
-	{
-		const bool failed = FAILED(hr);
-
-		const std::string str(static_cast<char*>(errors->GetBufferPointer()), 0, errors->GetBufferSize());
-		const std::string message = std::format("\n" __FUNCTION__ "\n{} while compiling shader 0x{:016X}:\n{}\n", failed ? "error" : "warning", flags, str);
-		OutputDebugStringA(message.c_str());
-
-		if (failed)
-		{
-			throw std::runtime_error(str);
-		}
-	}
-
-	hr = m_device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader);
+	const HRESULT hr = m_device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader);
 
 	if (FAILED(hr))
 	{
@@ -361,45 +99,10 @@ VertexShader Direct3DDevice8::compile_vertex_shader(ShaderFlags::type flags, boo
 
 PixelShader Direct3DDevice8::compile_pixel_shader(ShaderFlags::type flags, bool is_uber)
 {
-	ComPtr<ID3DBlob> errors;
-	ComPtr<ID3DBlob> blob;
+	ComPtr<ID3DBlob> blob = m_shader_compiler.compile_pixel_shader(flags, is_uber);
 	ComPtr<ID3D11PixelShader> shader;
 
-	std::filesystem::path shader_path = d3d8to11::config->get_shader_source_dir() / "shader.hlsl";
-
-	if (d3d8to11::filesystem::should_extend_length(shader_path))
-	{
-		shader_path = d3d8to11::filesystem::as_extended_length(shader_path);
-	}
-
-	const auto shader_source = m_shader_includer.get_shader_source(shader_path);
-
-	std::vector<D3D_SHADER_MACRO> preproc = shader_preprocess(flags, is_uber);
-	preproc.push_back({});
-
-	HRESULT hr;
-
-	{
-		// unfortunately a necessary evil :(
-		const std::string shader_path_string = shader_path.string();
-		hr = D3DCompile(shader_source.data(), shader_source.size(), shader_path_string.c_str(), preproc.data(), &m_shader_includer, "ps_main", "ps_5_0", SHADER_COMPILER_FLAGS, 0, &blob, &errors);
-	}
-
-	if (errors != nullptr)
-	{
-		const bool failed = FAILED(hr);
-
-		const std::string str(static_cast<char*>(errors->GetBufferPointer()), 0, errors->GetBufferSize());
-		const std::string message = std::format("\n" __FUNCTION__ "\n{} while compiling shader 0x{:016X}:\n{}\n", failed ? "error" : "warning", flags, str);
-		OutputDebugStringA(message.c_str());
-
-		if (failed)
-		{
-			throw std::runtime_error(str);
-		}
-	}
-
-	hr = m_device->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader);
+	const HRESULT hr = m_device->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader);
 
 	if (FAILED(hr))
 	{
@@ -411,13 +114,10 @@ PixelShader Direct3DDevice8::compile_pixel_shader(ShaderFlags::type flags, bool
 
 void Direct3DDevice8::store_permutation_flags(ShaderFlags::type flags)
 {
-	if (m_permutation_cache_file.is_open() &&
-	    m_permutation_flags.insert(flags).second == true)
+	if (m_shader_cache.add_permutation(flags))
 	{
 		const std::string str = std::format("writing shader permutation to cache: 0x{:016X}\n", flags);
 		OutputDebugStringA(str.c_str());
-		m_permutation_cache_file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
-		m_permutation_cache_file.flush();
 	}
 }
 
@@ -447,7 +147,7 @@ VertexShader Direct3DDevice8::get_vertex_shader(ShaderFlags::type flags)
 
 		if (it == m_compiling_vertex_shaders.end())
 		{
-			auto compilation_task = m_thread_pool.enqueue(enqueue_function, base_flags);
+			auto compilation_task = m_thread_pool.enqueue(TaskPriority::high, m_shader_compile_token, enqueue_function, base_flags);
 
 			// we *could* check *right now* to see if this shader is somehow already done
 			// and skip the compiling queue, but nah.
@@ -456,7 +156,7 @@ VertexShader Direct3DDevice8::get_vertex_shader(ShaderFlags::type flags)
 		}
 		else
 		{
-			auto& future = it->second;
+			auto& future = it->second.future;
 
 			if (is_future_ready(future))
 			{
@@ -465,6 +165,9 @@ VertexShader Direct3DDevice8::get_vertex_shader(ShaderFlags::type flags)
 				m_vertex_shaders[base_flags] = shader;
 				return shader;
 			}
+
+			// this may have been queued speculatively; it's needed now, so move it to the front.
+			m_thread_pool.boost(it->second.handle, TaskPriority::high);
 		}
 #else
 		store_permutation_flags(base_flags);
@@ -481,13 +184,40 @@ VertexShader Direct3DDevice8::get_vertex_shader(ShaderFlags::type flags)
 
 		if (it != m_uber_vertex_shaders.end())
 		{
+			++m_vertex_shader_fallback_stats.uber;
 			return it->second;
 		}
 	}
 
-	auto shader = compile_vertex_shader(uber_flags, true);
-	m_uber_vertex_shaders[uber_flags] = shader;
-	return shader;
+	{
+		const auto it = m_failed_uber_vertex_shaders.find(uber_flags);
+
+		if (it != m_failed_uber_vertex_shaders.end())
+		{
+			std::rethrow_exception(it->second);
+		}
+	}
+
+	{
+		const auto it = m_compiling_uber_vertex_shaders.find(uber_flags);
+
+		if (it != m_compiling_uber_vertex_shaders.end() && is_future_ready(it->second.future))
+		{
+			auto future = std::move(it->second.future);
+			m_compiling_uber_vertex_shaders.erase(it);
+			m_pending_uber_shader_count.fetch_sub(1, std::memory_order_relaxed);
+
+			auto shader = future.get();
+			m_uber_vertex_shaders[uber_flags] = shader;
+			++m_vertex_shader_fallback_stats.uber;
+			return shader;
+		}
+	}
+
+	// compiling here would stall the render thread, so queue it and make do with whatever is ready.
+	enqueue_uber_vertex_shader(uber_flags, TaskPriority::high);
+	m_using_fallback_shaders = true;
+	return get_fallback_vertex_shader(uber_flags);
 }
 
 PixelShader Direct3DDevice8::get_pixel_shader(ShaderFlags::type flags)
@@ -516,7 +246,7 @@ PixelShader Direct3DDevice8::get_pixel_shader(ShaderFlags::type flags)
 
 		if (it == m_compiling_pixel_shaders.end())
 		{
-			auto compilation_task = m_thread_pool.enqueue(enqueue_function, base_flags);
+			auto compilation_task = m_thread_pool.enqueue(TaskPriority::high, m_shader_compile_token, enqueue_function, base_flags);
 
 			// we *could* check *right now* to see if this shader is somehow already done
 			// and skip the compiling queue, but nah.
@@ -525,7 +255,7 @@ PixelShader Direct3DDevice8::get_pixel_shader(ShaderFlags::type flags)
 		}
 		else
 		{
-			auto& future = it->second;
+			auto& future = it->second.future;
 
 			if (is_future_ready(future))
 			{
@@ -534,6 +264,9 @@ PixelShader Direct3DDevice8::get_pixel_shader(ShaderFlags::type flags)
 				m_pixel_shaders[base_flags] = shader;
 				return shader;
 			}
+
+			// this may have been queued speculatively; it's needed now, so move it to the front.
+			m_thread_pool.boost(it->second.handle, TaskPriority::high);
 		}
 #else
 		store_permutation_flags(base_flags);
@@ -550,144 +283,496 @@ PixelShader Direct3DDevice8::get_pixel_shader(ShaderFlags::type flags)
 
 		if (it != m_uber_pixel_shaders.end())
 		{
+			++m_pixel_shader_fallback_stats.uber;
 			return it->second;
 		}
 	}
 
-	auto shader = compile_pixel_shader(uber_flags, true);
-	m_uber_pixel_shaders[uber_flags] = shader;
-	return shader;
-}
+	{
+		const auto it = m_failed_uber_pixel_shaders.find(uber_flags);
 
-void Direct3DDevice8::create_depth_stencil()
-{
-	m_depth_stencil = new Direct3DTexture8(this, m_present_params.BackBufferWidth, m_present_params.BackBufferHeight, 1,
-	                                       D3DUSAGE_DEPTHSTENCIL, m_present_params.AutoDepthStencilFormat, D3DPOOL_DEFAULT);
+		if (it != m_failed_uber_pixel_shaders.end())
+		{
+			std::rethrow_exception(it->second);
+		}
+	}
 
-	m_depth_stencil->create_native();
-	m_depth_stencil->GetSurfaceLevel(0, &m_current_depth_stencil);
+	{
+		const auto it = m_compiling_uber_pixel_shaders.find(uber_flags);
+
+		if (it != m_compiling_uber_pixel_shaders.end() && is_future_ready(it->second.future))
+		{
+			auto future = std::move(it->second.future);
+			m_compiling_uber_pixel_shaders.erase(it);
+			m_pending_uber_shader_count.fetch_sub(1, std::memory_order_relaxed);
+
+			auto shader = future.get();
+			m_uber_pixel_shaders[uber_flags] = shader;
+			++m_pixel_shader_fallback_stats.uber;
+			return shader;
+		}
+	}
+
+	// compiling here would stall the render thread, so queue it and make do with whatever is ready.
+	enqueue_uber_pixel_shader(uber_flags, TaskPriority::high);
+	m_using_fallback_shaders = true;
+	return get_fallback_pixel_shader(uber_flags);
 }
 
-void Direct3DDevice8::create_composite_texture(D3D11_TEXTURE2D_DESC* tex_desc)
+/**
+ * \brief Moves every finished task out of \p tasks into \p shaders, or into \p failed if it threw.
+ * \return The number of tasks removed.
+ */
+template <typename T>
+static size_t collect_compiled_shaders(std::unordered_map<ShaderFlags::type, ThreadPool::Task<T>>& tasks,
+                                     std::unordered_map<ShaderFlags::type, T>& shaders,
+                                     std::unordered_map<ShaderFlags::type, std::exception_ptr>& failed)
 {
-	tex_desc->Usage     = D3D11_USAGE_DEFAULT;
-	tex_desc->BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-
-	HRESULT hr = m_device->CreateTexture2D(tex_desc, nullptr, &m_oit_composite_texture);
+	const size_t task_count = tasks.size();
 
-	if (FAILED(hr))
+	for (auto it = tasks.begin(); it != tasks.end();)
 	{
-		throw std::runtime_error("Failed to create composite target texture");
-	}
-
-	D3D11_RENDER_TARGET_VIEW_DESC view_desc {};
+		if (!is_future_ready(it->second.future))
+		{
+			++it;
+			continue;
+		}
 
-	view_desc.Format             = tex_desc->Format;
-	view_desc.ViewDimension      = D3D11_RTV_DIMENSION_TEXTURE2D;
-	view_desc.Texture2D.MipSlice = 0;
+		try
+		{
+			shaders[it->first] = it->second.future.get();
+		}
+		catch (std::exception& ex)
+		{
+			const std::string str = std::format("uber shader 0x{:016X} failed to compile: {}\n", it->first, ex.what());
+			OutputDebugStringA(str.c_str());
 
-	hr = m_device->CreateRenderTargetView(m_oit_composite_texture.Get(), &view_desc, &m_oit_composite_view);
+			// kept so that the next draw that needs it reports the error
+			failed[it->first] = std::current_exception();
+		}
 
-	if (FAILED(hr))
-	{
-		throw std::runtime_error("Failed to create composite target view");
+		it = tasks.erase(it);
 	}
 
-	std::string composite_view_name = "m_oit_composite_view";
-	m_oit_composite_view->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(composite_view_name.size()), composite_view_name.data());
+	return task_count - tasks.size();
+}
 
-	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc {};
+static size_t get_fvf_texcount(ShaderFlags::type flags)
+{
+	return static_cast<size_t>((flags & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT);
+}
 
-	srv_desc.Format                    = tex_desc->Format;
-	srv_desc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srv_desc.Texture2D.MostDetailedMip = 0;
-	srv_desc.Texture2D.MipLevels       = 1;
+// An uber vertex shader built for one vertex format can stand in for another
+// as long as the vertex data provides every input it reads, in the same format.
+static bool is_vertex_input_subset(ShaderFlags::type candidate, ShaderFlags::type required)
+{
+	constexpr ShaderFlags::type exact_mask = D3DFVF_POSITION_MASK | ShaderFlags::fvf_lastbeta;
 
-	hr = m_device->CreateShaderResourceView(m_oit_composite_texture.Get(), &srv_desc, &m_oit_composite_srv);
+	if ((candidate & exact_mask) != (required & exact_mask))
+	{
+		return false;
+	}
 
-	if (FAILED(hr))
+	if ((candidate & ShaderFlags::fvf_fields & ~required) != 0)
 	{
-		throw std::runtime_error("Failed to create composite resource view");
+		return false;
 	}
 
-	std::string composite_srv_name = "m_oit_composite_srv";
-	m_oit_composite_srv->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(composite_srv_name.size()), composite_srv_name.data());
+	const size_t texcount = get_fvf_texcount(candidate);
 
-	m_oit_composite_wrapper = new Direct3DTexture8(this, tex_desc->Width, tex_desc->Height, tex_desc->MipLevels, D3DUSAGE_RENDERTARGET, m_present_params.BackBufferFormat, D3DPOOL_DEFAULT);
-	m_oit_composite_wrapper->create_native(m_oit_composite_texture.Get());
+	if (texcount > get_fvf_texcount(required))
+	{
+		return false;
+	}
+
+	const ShaderFlags::type texfmt_mask = ShaderFlags::fvf_texfmt_mask(texcount);
+	return (candidate & texfmt_mask) == (required & texfmt_mask);
 }
 
-void Direct3DDevice8::create_render_target(D3D11_TEXTURE2D_DESC* tex_desc)
+void Direct3DDevice8::enqueue_uber_vertex_shader(ShaderFlags::type uber_flags, TaskPriority priority)
 {
-	tex_desc->Usage     = D3D11_USAGE_DEFAULT;
-	tex_desc->BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	if (m_uber_vertex_shaders.contains(uber_flags) || m_failed_uber_vertex_shaders.contains(uber_flags))
+	{
+		return;
+	}
 
-	HRESULT hr = m_device->CreateTexture2D(tex_desc, nullptr, &m_render_target_texture);
+	const auto it = m_compiling_uber_vertex_shaders.find(uber_flags);
 
-	if (FAILED(hr))
+	if (it != m_compiling_uber_vertex_shaders.end())
 	{
-		throw std::runtime_error("Failed to create render target texture");
+		m_thread_pool.boost(it->second.handle, priority);
+		return;
 	}
 
-	D3D11_RENDER_TARGET_VIEW_DESC view_desc {};
+	const std::string str = std::format("enqueueing uber vertex shader: 0x{:016X}\n", uber_flags);
+	OutputDebugStringA(str.c_str());
 
-	view_desc.Format             = tex_desc->Format;
-	view_desc.ViewDimension      = D3D11_RTV_DIMENSION_TEXTURE2D;
-	view_desc.Texture2D.MipSlice = 0;
+	auto compile = [this](ShaderFlags::type flags)
+	{
+		return compile_vertex_shader(flags, true);
+	};
 
-	hr = m_device->CreateRenderTargetView(m_render_target_texture.Get(), &view_desc, &m_render_target_view);
+	m_compiling_uber_vertex_shaders[uber_flags] = m_thread_pool.enqueue(priority, m_shader_compile_token, compile, uber_flags);
+	m_pending_uber_shader_count.fetch_add(1, std::memory_order_relaxed);
+}
 
-	if (FAILED(hr))
+void Direct3DDevice8::enqueue_uber_pixel_shader(ShaderFlags::type uber_flags, TaskPriority priority)
+{
+	if (m_uber_pixel_shaders.contains(uber_flags) || m_failed_uber_pixel_shaders.contains(uber_flags))
 	{
-		throw std::runtime_error("Failed to create render target view");
+		return;
 	}
 
-	std::string view_name = "m_render_target_view";
-	m_render_target_view->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(view_name.size()), view_name.data());
-
-	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc {};
-
-	srv_desc.Format                    = tex_desc->Format;
-	srv_desc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srv_desc.Texture2D.MostDetailedMip = 0;
-	srv_desc.Texture2D.MipLevels       = 1;
+	const auto it = m_compiling_uber_pixel_shaders.find(uber_flags);
 
-	hr = m_device->CreateShaderResourceView(m_render_target_texture.Get(), &srv_desc, &m_render_target_srv);
-
-	if (FAILED(hr))
+	if (it != m_compiling_uber_pixel_shaders.end())
 	{
-		throw std::runtime_error("Failed to create composite resource view");
+		m_thread_pool.boost(it->second.handle, priority);
+		return;
 	}
 
-	std::string render_target_srv_name = "m_render_target_srv";
-	m_render_target_srv->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(render_target_srv_name.size()), render_target_srv_name.data());
+	const std::string str = std::format("enqueueing uber pixel shader: 0x{:016X}\n", uber_flags);
+	OutputDebugStringA(str.c_str());
 
-	m_render_target_wrapper = new Direct3DTexture8(this, tex_desc->Width, tex_desc->Height, tex_desc->MipLevels, D3DUSAGE_RENDERTARGET, m_present_params.BackBufferFormat, D3DPOOL_DEFAULT);
-	m_render_target_wrapper->create_native(m_render_target_texture.Get());
+	auto compile = [this](ShaderFlags::type flags)
+	{
+		return compile_pixel_shader(flags, true);
+	};
+
+	m_compiling_uber_pixel_shaders[uber_flags] = m_thread_pool.enqueue(priority, m_shader_compile_token, compile, uber_flags);
+	m_pending_uber_shader_count.fetch_add(1, std::memory_order_relaxed);
 }
 
-void Direct3DDevice8::get_back_buffer()
+VertexShader Direct3DDevice8::get_fallback_vertex_shader(ShaderFlags::type uber_flags)
 {
-	ID3D11Texture2D* pBackBuffer = nullptr;
-	m_swap_chain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<LPVOID*>(&pBackBuffer));
+	const auto generic_flags = ShaderFlags::generic_uber_vs(uber_flags);
 
-	D3D11_TEXTURE2D_DESC tex_desc {};
-	pBackBuffer->GetDesc(&tex_desc);
+	// prefer the compatible shader that uses the most of the vertex data
+	const VertexShader* best = nullptr;
+	size_t best_input_count = 0;
 
-	m_back_buffer = new Direct3DTexture8(this, tex_desc.Width, tex_desc.Height, tex_desc.MipLevels, D3DUSAGE_RENDERTARGET, m_present_params.BackBufferFormat, D3DPOOL_DEFAULT);
-	m_back_buffer->create_native(pBackBuffer);
+	for (const auto& [flags, shader] : m_uber_vertex_shaders)
+	{
+		if (flags == generic_flags || !is_vertex_input_subset(flags, uber_flags))
+		{
+			continue;
+		}
 
-	//m_back_buffer->GetSurfaceLevel(0, &current_render_target);
+		const size_t input_count = static_cast<size_t>(std::popcount(flags & ShaderFlags::fvf_fields)) + get_fvf_texcount(flags);
 
-	m_device->CreateRenderTargetView(pBackBuffer, nullptr, &m_back_buffer_view);
+		if (best == nullptr || input_count > best_input_count)
+		{
+			best = &shader;
+			best_input_count = input_count;
+		}
+	}
 
-	pBackBuffer->Release();
+	if (best != nullptr)
+	{
+		++m_vertex_shader_fallback_stats.compatible;
+		return *best;
+	}
 
-	ComPtr<Direct3DSurface8> ds_surface;
-	m_depth_stencil->GetSurfaceLevel(0, &ds_surface);
+	// the generic shader may have finished since the last Present collected results
+	const size_t collected = collect_compiled_shaders(m_compiling_uber_vertex_shaders, m_uber_vertex_shaders, m_failed_uber_vertex_shaders);
+	m_pending_uber_shader_count.fetch_sub(collected, std::memory_order_relaxed);
 
-	create_composite_texture(&tex_desc);
-	create_render_target(&tex_desc);
+	{
+		const auto it = m_uber_vertex_shaders.find(generic_flags);
+
+		if (it != m_uber_vertex_shaders.end())
+		{
+			++m_vertex_shader_fallback_stats.generic;
+			return it->second;
+		}
+	}
+
+	enqueue_uber_vertex_shader(generic_flags, TaskPriority::high);
+	++m_vertex_shader_fallback_stats.skipped;
+	return {};
+}
+
+PixelShader Direct3DDevice8::get_fallback_pixel_shader(ShaderFlags::type uber_flags)
+{
+	const auto generic_flags = ShaderFlags::generic_uber_ps(uber_flags);
+	const auto stage_count = uber_flags & ShaderFlags::stage_count_mask;
+
+	// a shader that runs more texture stages than needed gives the same result; take the one that runs the fewest
+	const PixelShader* best = nullptr;
+	ShaderFlags::type best_stage_count = 0;
+
+	for (const auto& [flags, shader] : m_uber_pixel_shaders)
+	{
+		if (flags == generic_flags)
+		{
+			continue;
+		}
+
+		const auto candidate_stage_count = flags & ShaderFlags::stage_count_mask;
+
+		if ((flags & ~ShaderFlags::stage_count_mask) != (uber_flags & ~ShaderFlags::stage_count_mask) ||
+		    candidate_stage_count < stage_count)
+		{
+			continue;
+		}
+
+		if (best == nullptr || candidate_stage_count < best_stage_count)
+		{
+			best = &shader;
+			best_stage_count = candidate_stage_count;
+		}
+	}
+
+	if (best != nullptr)
+	{
+		++m_pixel_shader_fallback_stats.compatible;
+		return *best;
+	}
+
+	// the generic shader may have finished since the last Present collected results
+	const size_t collected = collect_compiled_shaders(m_compiling_uber_pixel_shaders, m_uber_pixel_shaders, m_failed_uber_pixel_shaders);
+	m_pending_uber_shader_count.fetch_sub(collected, std::memory_order_relaxed);
+
+	{
+		const auto it = m_uber_pixel_shaders.find(generic_flags);
+
+		if (it != m_uber_pixel_shaders.end())
+		{
+			++m_pixel_shader_fallback_stats.generic;
+			return it->second;
+		}
+	}
+
+	enqueue_uber_pixel_shader(generic_flags, TaskPriority::high);
+	++m_pixel_shader_fallback_stats.skipped;
+	return {};
+}
+
+void Direct3DDevice8::collect_uber_shaders()
+{
+	collect_compiled_shaders(m_compiling_uber_vertex_shaders, m_uber_vertex_shaders, m_failed_uber_vertex_shaders);
+	collect_compiled_shaders(m_compiling_uber_pixel_shaders, m_uber_pixel_shaders, m_failed_uber_pixel_shaders);
+
+	const size_t pending = m_compiling_uber_vertex_shaders.size() + m_compiling_uber_pixel_shaders.size();
+	m_pending_uber_shader_count.store(pending, std::memory_order_relaxed);
+
+	if (m_uber_compile_reported || pending != 0)
+	{
+		return;
+	}
+
+	m_uber_compile_reported = true;
+
+	const auto uber_end = std::chrono::high_resolution_clock::now();
+	const auto uber_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(uber_end - m_uber_compile_start);
+
+	const size_t uber_vs_count = m_uber_vertex_shaders.size();
+	const size_t uber_ps_count = m_uber_pixel_shaders.size();
+
+	const auto& vs_stats = m_vertex_shader_fallback_stats;
+	const auto& ps_stats = m_pixel_shader_fallback_stats;
+
+	const std::string str =
+		std::format("uber shaders ready ({} vertex shader(s) and {} pixel shader(s) ({} total) in {} ms)\n"
+		            "uber shader fallbacks so far: vertex {} compatible, {} generic, {} skipped; "
+		            "pixel {} compatible, {} generic, {} skipped\n",
+		            uber_vs_count, uber_ps_count, uber_vs_count + uber_ps_count, uber_elapsed.count(),
+		            vs_stats.compatible, vs_stats.generic, vs_stats.skipped,
+		            ps_stats.compatible, ps_stats.generic, ps_stats.skipped);
+
+	OutputDebugStringA(str.c_str());
+
+	if (uber_shaders_ready)
+	{
+		uber_shaders_ready();
+	}
+}
+
+size_t Direct3DDevice8::get_pending_uber_shader_count() const
+{
+	return m_pending_uber_shader_count.load(std::memory_order_relaxed);
+}
+
+const Direct3DDevice8::ShaderFallbackStats& Direct3DDevice8::get_vertex_shader_fallback_stats() const
+{
+	return m_vertex_shader_fallback_stats;
+}
+
+const Direct3DDevice8::ShaderFallbackStats& Direct3DDevice8::get_pixel_shader_fallback_stats() const
+{
+	return m_pixel_shader_fallback_stats;
+}
+
+const BufferPool<Direct3DVertexBuffer8>& Direct3DDevice8::get_user_primitive_vertex_pool() const
+{
+	return m_up_vertex_pool;
+}
+
+const BufferPool<Direct3DIndexBuffer8>& Direct3DDevice8::get_user_primitive_index_pool(D3DFORMAT format) const
+{
+	return m_up_index_pools[format == D3DFMT_INDEX16 ? 0 : 1];
+}
+
+const StateFilteringContext::Stats& Direct3DDevice8::get_state_filter_stats() const
+{
+	return m_context.get_last_frame_stats();
+}
+
+const Direct3DDevice8::ShaderConstantStats& Direct3DDevice8::get_shader_constant_stats() const
+{
+	return m_last_frame_shader_constant_stats;
+}
+
+const StateObjectCacheStats& Direct3DDevice8::get_state_object_cache_stats(StateObjectType type) const
+{
+	switch (type)
+	{
+		case StateObjectType::blend:
+			return m_blend_states.get_stats();
+
+		case StateObjectType::depth_stencil:
+			return m_depth_states.get_stats();
+
+		case StateObjectType::rasterizer:
+			return m_raster_states.get_stats();
+
+		case StateObjectType::sampler:
+			return m_sampler_states.get_stats();
+
+		default:
+			throw std::runtime_error("invalid state object type");
+	}
+}
+
+void Direct3DDevice8::create_depth_stencil()
+{
+	m_depth_stencil = new Direct3DTexture8(this, m_present_params.BackBufferWidth, m_present_params.BackBufferHeight, 1,
+	                                       D3DUSAGE_DEPTHSTENCIL, m_present_params.AutoDepthStencilFormat, D3DPOOL_DEFAULT);
+
+	m_depth_stencil->create_native();
+	m_depth_stencil->GetSurfaceLevel(0, &m_current_depth_stencil);
+}
+
+void Direct3DDevice8::create_composite_texture(D3D11_TEXTURE2D_DESC* tex_desc)
+{
+	tex_desc->Usage     = D3D11_USAGE_DEFAULT;
+	tex_desc->BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	HRESULT hr = m_device->CreateTexture2D(tex_desc, nullptr, &m_oit_composite_texture);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("Failed to create composite target texture");
+	}
+
+	D3D11_RENDER_TARGET_VIEW_DESC view_desc {};
+
+	view_desc.Format             = tex_desc->Format;
+	view_desc.ViewDimension      = D3D11_RTV_DIMENSION_TEXTURE2D;
+	view_desc.Texture2D.MipSlice = 0;
+
+	hr = m_device->CreateRenderTargetView(m_oit_composite_texture.Get(), &view_desc, &m_oit_composite_view);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("Failed to create composite target view");
+	}
+
+	std::string composite_view_name = "m_oit_composite_view";
+	m_oit_composite_view->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(composite_view_name.size()), composite_view_name.data());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc {};
+
+	srv_desc.Format                    = tex_desc->Format;
+	srv_desc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MostDetailedMip = 0;
+	srv_desc.Texture2D.MipLevels       = 1;
+
+	hr = m_device->CreateShaderResourceView(m_oit_composite_texture.Get(), &srv_desc, &m_oit_composite_srv);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("Failed to create composite resource view");
+	}
+
+	std::string composite_srv_name = "m_oit_composite_srv";
+	m_oit_composite_srv->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(composite_srv_name.size()), composite_srv_name.data());
+
+	m_oit_composite_wrapper = new Direct3DTexture8(this, tex_desc->Width, tex_desc->Height, tex_desc->MipLevels, D3DUSAGE_RENDERTARGET, m_present_params.BackBufferFormat, D3DPOOL_DEFAULT);
+	m_oit_composite_wrapper->create_native(m_oit_composite_texture.Get());
+}
+
+void Direct3DDevice8::create_render_target(D3D11_TEXTURE2D_DESC* tex_desc)
+{
+	tex_desc->Usage     = D3D11_USAGE_DEFAULT;
+	tex_desc->BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	HRESULT hr = m_device->CreateTexture2D(tex_desc, nullptr, &m_render_target_texture);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("Failed to create render target texture");
+	}
+
+	D3D11_RENDER_TARGET_VIEW_DESC view_desc {};
+
+	view_desc.Format             = tex_desc->Format;
+	view_desc.ViewDimension      = D3D11_RTV_DIMENSION_TEXTURE2D;
+	view_desc.Texture2D.MipSlice = 0;
+
+	hr = m_device->CreateRenderTargetView(m_render_target_texture.Get(), &view_desc, &m_render_target_view);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("Failed to create render target view");
+	}
+
+	std::string view_name = "m_render_target_view";
+	m_render_target_view->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(view_name.size()), view_name.data());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc {};
+
+	srv_desc.Format                    = tex_desc->Format;
+	srv_desc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MostDetailedMip = 0;
+	srv_desc.Texture2D.MipLevels       = 1;
+
+	hr = m_device->CreateShaderResourceView(m_render_target_texture.Get(), &srv_desc, &m_render_target_srv);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("Failed to create composite resource view");
+	}
+
+	std::string render_target_srv_name = "m_render_target_srv";
+	m_render_target_srv->SetPrivateData(WKPDID_D3DDebugObjectName, static_cast<UINT>(render_target_srv_name.size()), render_target_srv_name.data());
+
+	m_render_target_wrapper = new Direct3DTexture8(this, tex_desc->Width, tex_desc->Height, tex_desc->MipLevels, D3DUSAGE_RENDERTARGET, m_present_params.BackBufferFormat, D3DPOOL_DEFAULT);
+	m_render_target_wrapper->create_native(m_render_target_texture.Get());
+}
+
+void Direct3DDevice8::get_back_buffer()
+{
+	ID3D11Texture2D* pBackBuffer = nullptr;
+	m_swap_chain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<LPVOID*>(&pBackBuffer));
+
+	D3D11_TEXTURE2D_DESC tex_desc {};
+	pBackBuffer->GetDesc(&tex_desc);
+
+	m_back_buffer = new Direct3DTexture8(this, tex_desc.Width, tex_desc.Height, tex_desc.MipLevels, D3DUSAGE_RENDERTARGET, m_present_params.BackBufferFormat, D3DPOOL_DEFAULT);
+	m_back_buffer->create_native(pBackBuffer);
+
+	//m_back_buffer->GetSurfaceLevel(0, &current_render_target);
+
+	m_device->CreateRenderTargetView(pBackBuffer, nullptr, &m_back_buffer_view);
+
+	pBackBuffer->Release();
+
+	ComPtr<Direct3DSurface8> ds_surface;
+	m_depth_stencil->GetSurfaceLevel(0, &ds_surface);
+
+	create_composite_texture(&tex_desc);
+	create_render_target(&tex_desc);
 
 	if (oit_enabled)
 	{
@@ -708,6 +793,18 @@ void Direct3DDevice8::create_native()
 {
 	m_shader_includer.set_base_directory(d3d8to11::config->get_shader_source_dir());
 	m_shader_includer.add_include_directory(d3d8to11::config->get_shader_source_dir());
+	m_shader_compiler.set_source_path(d3d8to11::config->get_shader_source_dir() / "shader.hlsl");
+
+	if (d3d8to11::config->get_shader_cache_pack_file_path().empty())
+	{
+		OutputDebugStringA("The file path for the shader pack was too long and extended-length paths are not enabled."
+		                   " Shaders will not be cached.\n");
+	}
+	else
+	{
+		m_shader_cache.open(d3d8to11::config->get_shader_cache_pack_file_path(),
+		                    d3d8to11::config->get_shader_cache_variants_file_path());
+	}
 
 	oit_enabled = d3d8to11::config->get_oit_config().enabled;
 
@@ -768,11 +865,13 @@ void Direct3DDevice8::create_native()
 	constexpr auto flag = 0;
 #endif
 
+	ComPtr<ID3D11DeviceContext> context;
+
 	// TODO: use more modern swap chain creation and management
 	auto error = D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, flag,
 	                                           FEATURE_LEVELS.data(), static_cast<UINT>(FEATURE_LEVELS.size()),
 	                                           D3D11_SDK_VERSION, &desc, &m_swap_chain,
-	                                           &m_device, &feature_level, &m_context);
+	                                           &m_device, &feature_level, &context);
 
 	if (feature_level < D3D_FEATURE_LEVEL_11_0)
 	{
@@ -784,6 +883,12 @@ void Direct3DDevice8::create_native()
 		throw std::runtime_error("Device creation failed with a known error that I'm too lazy to get the details of.");
 	}
 
+	m_context.reset(std::move(context));
+
+	// nothing is bound to a new context
+	m_dirty_texture_stages = (1u << TEXTURE_STAGE_MAX) - 1;
+	m_dirty_stream_sources = (1u << STREAM_SOURCE_MAX) - 1;
+
 	m_device->QueryInterface(__uuidof(ID3D11InfoQueue), &m_info_queue);
 
 	if (m_info_queue)
@@ -849,122 +954,86 @@ void Direct3DDevice8::create_native()
 	m_context->PSSetConstantBuffers(4, 1, m_per_texture_cbuffer.GetAddressOf());
 
 	{
-		const auto& permutation_file_path = d3d8to11::config->get_shader_cache_variants_file_path();
-		const bool exists = std::filesystem::exists(permutation_file_path);
+		D3D11_BUFFER_DESC desc {};
 
-		decltype(m_permutation_flags) temp_permutation_flags;
-		std::fstream permutation_file;
+		// default usage so that ranges of it can be updated with UpdateSubresource1
+		desc.ByteWidth = static_cast<UINT>(m_vs_constants.REGISTER_COUNT * m_vs_constants.REGISTER_SIZE);
+		desc.Usage     = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 
-		if (permutation_file_path.empty())
+		hr = m_device->CreateBuffer(&desc, nullptr, &m_vs_constant_cbuffer);
+		if (FAILED(hr))
 		{
-			OutputDebugStringA("The file path for the shader permutation cache was too long and extended-length paths are not enabled."
-			                   " Shaders will not be cached.\n");
+			throw std::runtime_error("vertex shader constant CreateBuffer failed");
 		}
-		else
-		{
-			permutation_file.open(permutation_file_path, std::ios::binary | std::ios::in | std::ios::out);
 
-			if (!permutation_file.is_open())
-			{
-				const std::string str =
-					std::format("Unable to open or create shader permutation cache file: \"{}\"\nShaders will not be cached.\n",
-					            permutation_file_path.string());
+		desc.ByteWidth = static_cast<UINT>(m_ps_constants.REGISTER_COUNT * m_ps_constants.REGISTER_SIZE);
 
-				OutputDebugStringA(str.c_str());
-			}
+		hr = m_device->CreateBuffer(&desc, nullptr, &m_ps_constant_cbuffer);
+		if (FAILED(hr))
+		{
+			throw std::runtime_error("pixel shader constant CreateBuffer failed");
 		}
 
-		if (exists)
+		// the new buffers hold none of the registers yet
+		m_vs_constants.mark();
+		m_ps_constants.mark();
+
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options {};
+
+		if (SUCCEEDED(m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
 		{
-			OutputDebugStringA("precompiling shaders...\n");
+			m_constant_buffer_partial_updates = options.ConstantBufferPartialUpdate != FALSE;
+		}
+	}
 
-			while (permutation_file.is_open() && !permutation_file.eof())
-			{
-				ShaderFlags::type flags = 0;
-				permutation_file.read(reinterpret_cast<char*>(&flags), sizeof(flags));
+	m_context->VSSetConstantBuffers(SHADER_CONSTANT_BUFFER_SLOT, 1, m_vs_constant_cbuffer.GetAddressOf());
+	m_context->PSSetConstantBuffers(SHADER_CONSTANT_BUFFER_SLOT, 1, m_ps_constant_cbuffer.GetAddressOf());
 
-				if (permutation_file.gcount() != sizeof(flags))
-				{
-					break;
-				}
+	load_state_object_keys();
 
-				// TODO: if there are duplicate entries (particularly after sanitizing), rewrite the permutation file
-				temp_permutation_flags.insert(flags);
-			}
+	{
+		const std::vector<ShaderFlags::type> permutation_flags = m_shader_cache.get_permutations();
 
-			if (permutation_file.is_open() && permutation_file.eof())
-			{
-				permutation_file.clear();
-			}
+		// input layouts don't depend on the shaders, so every vertex format seen before can have its layout right away
+		for (ShaderFlags::type flags : permutation_flags)
+		{
+			std::ignore = get_fvf_input_layout(static_cast<uint32_t>(fvf_sanitize(flags & ShaderFlags::fvf_mask)));
+		}
+
+		// the last resort for draws whose uber shader isn't ready yet, so these go first
+		m_uber_compile_start = std::chrono::high_resolution_clock::now();
+		m_uber_compile_reported = false;
+
+		for (const ShaderFlags::type position : { D3DFVF_XYZ, D3DFVF_XYZRHW })
+		{
+			enqueue_uber_vertex_shader(ShaderFlags::generic_uber_vs(position), TaskPriority::high);
+			enqueue_uber_pixel_shader(ShaderFlags::generic_uber_ps(position), TaskPriority::high);
+		}
+
+		if (!permutation_flags.empty())
+		{
+			OutputDebugStringA("precompiling shaders...\n");
 
-			auto compile_vertex_shader_wrapper = [this](ShaderFlags::type flags, bool is_uber)
+			auto compile_vertex_shader_wrapper = [this](ShaderFlags::type flags)
 			{
-				return compile_vertex_shader(flags, is_uber);
+				return compile_vertex_shader(flags, false);
 			};
 
-			auto compile_pixel_shader_wrapper = [this](ShaderFlags::type flags, bool is_uber)
+			auto compile_pixel_shader_wrapper = [this](ShaderFlags::type flags)
 			{
-				return compile_pixel_shader(flags, is_uber);
+				return compile_pixel_shader(flags, false);
 			};
 
+			// uber shaders are compiled in the background rather than waited on here;
+			// until one is ready, draws that need it fall back (see get_fallback_vertex_shader).
+			for (ShaderFlags::type flags : permutation_flags)
 			{
-				const auto uber_start = std::chrono::high_resolution_clock::now();
-
-				std::unordered_map<ShaderFlags::type, std::future<VertexShader>> uber_vs_tasks;
-				std::unordered_map<ShaderFlags::type, std::future<PixelShader>> uber_ps_tasks;
-
-				uber_vs_tasks.reserve(temp_permutation_flags.size());
-				uber_ps_tasks.reserve(temp_permutation_flags.size());
-
-				for (ShaderFlags::type flags : temp_permutation_flags)
-				{
-					const auto sanitized_vs = ShaderFlags::sanitize(flags & ShaderFlags::uber_vs_mask);
-					const auto sanitized_ps = ShaderFlags::sanitize(flags & ShaderFlags::uber_ps_mask);
-
-					if (!uber_vs_tasks.contains(sanitized_vs))
-					{
-						const std::string str = std::format("enqueueing uber vertex shader: 0x{:016X}\n", sanitized_vs);
-						OutputDebugStringA(str.c_str());
-
-						uber_vs_tasks[sanitized_vs] = m_thread_pool.enqueue(compile_vertex_shader_wrapper, sanitized_vs, true);
-					}
-
-					if (!uber_ps_tasks.contains(sanitized_ps))
-					{
-						const std::string str = std::format("enqueueing uber pixel shader: 0x{:016X}\n", sanitized_ps);
-						OutputDebugStringA(str.c_str());
-
-						uber_ps_tasks[sanitized_ps] = m_thread_pool.enqueue(compile_pixel_shader_wrapper, sanitized_ps, true);
-					}
-				}
-
-				OutputDebugStringA("waiting for uber shader compilation to finish...\n");
-
-				for (auto& [flags, task] : uber_vs_tasks)
-				{
-					m_uber_vertex_shaders[flags] = std::move(task.get());
-				}
-
-				for (auto& [flags, task] : uber_ps_tasks)
-				{
-					m_uber_pixel_shaders[flags] = std::move(task.get());
-				}
-
-				const auto uber_end = std::chrono::high_resolution_clock::now();
-				const auto uber_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(uber_end - uber_start);
-
-				const size_t uber_vs_count = m_uber_vertex_shaders.size();
-				const size_t uber_ps_count = m_uber_pixel_shaders.size();
-
-				const std::string str =
-					std::format("done ({} vertex shader(s) and {} pixel shader(s) ({} total) in {} ms)\n"
-					            "\nenqueueing standard shaders now...\n",
-					            uber_vs_count, uber_ps_count, uber_vs_count + uber_ps_count, uber_elapsed.count());
-
-				OutputDebugStringA(str.c_str());
+				enqueue_uber_vertex_shader(ShaderFlags::sanitize(flags & ShaderFlags::uber_vs_mask), TaskPriority::normal);
+				enqueue_uber_pixel_shader(ShaderFlags::sanitize(flags & ShaderFlags::uber_ps_mask), TaskPriority::normal);
 			}
 
-			for (ShaderFlags::type flags : temp_permutation_flags)
+			for (ShaderFlags::type flags : permutation_flags)
 			{
 				const auto sanitized_vs = ShaderFlags::sanitize(flags & ShaderFlags::vs_mask);
 				const auto sanitized_ps = ShaderFlags::sanitize(flags & ShaderFlags::ps_mask);
@@ -974,7 +1043,7 @@ void Direct3DDevice8::create_native()
 					const std::string str = std::format("enqueueing standard vertex shader: 0x{:016X}\n", sanitized_vs);
 					OutputDebugStringA(str.c_str());
 
-					m_compiling_vertex_shaders[sanitized_vs] = m_thread_pool.enqueue(compile_vertex_shader_wrapper, sanitized_vs, false);
+					m_compiling_vertex_shaders[sanitized_vs] = m_thread_pool.enqueue(TaskPriority::low, m_shader_compile_token, compile_vertex_shader_wrapper, sanitized_vs);
 				}
 
 				if (!m_compiling_pixel_shaders.contains(sanitized_ps))
@@ -982,28 +1051,18 @@ void Direct3DDevice8::create_native()
 					const std::string str = std::format("enqueueing standard pixel shader: 0x{:016X}\n", sanitized_ps);
 					OutputDebugStringA(str.c_str());
 
-					m_compiling_pixel_shaders[sanitized_ps] = m_thread_pool.enqueue(compile_pixel_shader_wrapper, sanitized_ps, false);
+					m_compiling_pixel_shaders[sanitized_ps] = m_thread_pool.enqueue(TaskPriority::low, m_shader_compile_token, compile_pixel_shader_wrapper, sanitized_ps);
 				}
 			}
 
 			OutputDebugStringA("done\n");
 		}
-
-		if (permutation_file.is_open())
-		{
-			// make sure the next write position is aligned sizeof(ShaderFlags::type)
-			// so that we don't write any malformed flags.
-			const auto position = align_down(permutation_file.tellg(), sizeof(ShaderFlags::type));
-			permutation_file.seekp(position);
-
-			m_permutation_cache_file = std::move(permutation_file);
-			m_permutation_flags = std::move(temp_permutation_flags);
-		}
 	}
 
 	m_blend_flags         = 0;
 	m_raster_flags        = 0;
 	m_depth_stencil_flags = {};
+	forget_render_states(RenderStateGroup::blend | RenderStateGroup::raster | RenderStateGroup::depth_stencil);
 
 	// TODO: properly set default for D3DRS_ZENABLE; see below
 	// The default value for this render state is D3DZB_TRUE if a depth stencil was created along with the swap chain by setting
@@ -1118,14 +1177,21 @@ Direct3DDevice8::Direct3DDevice8(Direct3D8* d3d, UINT adapter, D3DDEVTYPE device
 	  m_behavior_flags(behavior_flags),
 	  m_present_params(parameters),
 	  m_oit_fragments_str(std::to_string(globals::max_fragments)),
-	  m_thread_pool(std::max<size_t>(2, std::thread::hardware_concurrency()) - 1)
+	  m_thread_pool(std::max<size_t>(2, std::thread::hardware_concurrency()) - 1),
+	  m_shader_cache(m_shader_includer),
+	  m_shader_compiler(m_shader_includer, m_shader_cache),
+	  m_shader_compile_token(CancellationToken::create())
+{
+	m_shader_compiler.set_oit_max_fragments(globals::max_fragments);
+}
+
+Direct3DDevice8::~Direct3DDevice8()
 {
-	constexpr size_t max_digit_strings = std::max(static_cast<size_t>(TEXTURE_STAGE_MAX), FVF_TEXCOORD_MAX);
+	// queued compiles reference members that are destroyed before the pool, so stop them first
+	m_shader_compile_token.cancel();
+	m_thread_pool.shutdown();
 
-	for (size_t i = 0; i <= max_digit_strings; ++i)
-	{
-		m_digit_strings[i] = std::to_string(i);
-	}
+	flush_state_object_keys();
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::QueryInterface(REFIID riid, void** ppvObj)
@@ -1362,6 +1428,9 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::Reset(D3DPRESENT_PARAMETERS8* pPresen
 		m_shader_flags &= ~ShaderFlags::fvf_mask;
 		m_fvf_flags = 0;
 		m_fvf_flags.clear();
+
+		m_current_vertex_shader_handle = 0;
+		m_current_vertex_shader_info = nullptr;
 	}
 
 	return D3D_OK;
@@ -1420,10 +1489,9 @@ void Direct3DDevice8::oit_composite()
 	SetRenderState(D3DRS_ZENABLE, ZENABLE);
 	update();
 
-	for (auto& stream : m_stream_sources)
-	{
-		SetStreamSource(stream.first, stream.second.buffer, stream.second.stride);
-	}
+	// rebind what the composite replaced: oit_read's shader resources share slots with the first texture stages
+	m_dirty_texture_stages |= (1u << OIT_SHADER_RESOURCE_COUNT) - 1;
+	m_dirty_stream_sources |= (1u << STREAM_SOURCE_MAX) - 1;
 
 	ComPtr<Direct3DIndexBuffer8> index_buffer = std::move(m_current_index_buffer);
 	SetIndices(index_buffer.Get(), m_current_base_vertex_index);
@@ -1459,6 +1527,26 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::Present(const RECT* pSourceRect, cons
 	}
 
 	print_info_queue();
+	collect_uber_shaders();
+
+	// commit what was compiled and recorded recently so that a crash or kill doesn't lose it
+	m_shader_cache.flush_if_due();
+	flush_state_object_keys();
+
+	++m_frame_index;
+	m_context.end_frame();
+	m_last_frame_shader_constant_stats = std::exchange(m_shader_constant_stats, {});
+	m_up_vertex_pool.trim(m_frame_index, UP_POOL_MAX_IDLE_FRAMES);
+
+	for (auto& pool : m_up_index_pools)
+	{
+		pool.trim(m_frame_index, UP_POOL_MAX_IDLE_FRAMES);
+	}
+
+	std::erase_if(m_fan_list_cache, [this](const auto& pair)
+	{
+		return m_frame_index - pair.second.last_used_frame > FAN_LIST_MAX_IDLE_FRAMES;
+	});
 	UNREFERENCED_PARAMETER(pDirtyRegion);
 
 	auto interval = m_present_params.FullScreen_PresentationInterval;
@@ -2241,408 +2329,66 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetLightEnable(DWORD Index, BOOL* pEn
 	return D3D_OK;
 }
 
-HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetClipPlane(DWORD Index, const float* pPlane)
-{
-	if (pPlane == nullptr || Index >= MAX_CLIP_PLANES)
-	{
-		return D3DERR_INVALIDCALL;
-	}
-
-	memcpy(m_stored_clip_planes[Index], pPlane, sizeof(m_stored_clip_planes[0]));
-	return D3D_OK;
-}
-
-HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetClipPlane(DWORD Index, float* pPlane)
-{
-	if (pPlane == nullptr || Index >= MAX_CLIP_PLANES)
-	{
-		return D3DERR_INVALIDCALL;
-	}
-
-	memcpy(pPlane, m_stored_clip_planes[Index], sizeof(m_stored_clip_planes[0]));
-	return D3D_OK;
-}
-
-HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetRenderState(D3DRENDERSTATETYPE State, DWORD Value)
-{
-	switch (static_cast<DWORD>(State))
-	{
-		case D3DRS_LINEPATTERN:
-		case D3DRS_ZVISIBLE:
-		case D3DRS_EDGEANTIALIAS:
-		case D3DRS_PATCHSEGMENTS:
-		case D3DRS_CLIPPLANEENABLE:
-		case D3DRS_ZBIAS:
-			return D3DERR_INVALIDCALL;
-
-		case D3DRS_SOFTWAREVERTEXPROCESSING:
-			return D3D_OK;
-
-		default:
-			break;
-	}
-
-	if (State < D3DRS_ZENABLE || State > D3DRS_NORMALORDER)
-	{
-		return D3DERR_INVALIDCALL;
-	}
-
-	// even if we do custom handling for a render state, we
-	// store its value so the caller can retrieve it later in
-	// Direct3DDevice8::GetRenderState
-	auto& ref = m_render_state_values[State];
-
-	auto set_stencil_flags = [&](auto shift)
-	{
-		auto flags = m_depth_stencil_flags.stencil_flags.data();
-		flags &= ~(StencilFlags::op_mask << shift);
-		flags |= (Value & StencilFlags::op_mask) << shift;
-		m_depth_stencil_flags.stencil_flags = flags;
-	};
-
-	auto set_stencil_rw = [&](auto shift)
-	{
-		auto flags = m_depth_stencil_flags.stencil_flags.data();
-		flags &= ~(StencilFlags::rw_mask << shift);
-		flags |= (Value & StencilFlags::rw_mask) << shift;
-		m_depth_stencil_flags.stencil_flags = flags;
-	};
-
-	switch (State)
-	{
-		default:
-		{
-			ref = Value;
-
-			if (!ref.dirty())
-			{
-				break;
-			}
-
-			ref.clear();
-			const auto it = RS_STRINGS.find(State);
-
-			if (it == RS_STRINGS.end())
-			{
-				break;
-			}
-
-			const std::string str = std::format("{} unhandled render state type: {}; value: {}\n",
-			                                    __FUNCTION__, it->second, Value);
-
-			OutputDebugStringA(str.c_str());
-			break;
-		}
-
-		case D3DRS_COLORWRITEENABLE:
-		{
-			m_blend_flags = (m_blend_flags.data() & ~(0xF << BLEND_COLORMASK_SHIFT)) | ((Value & 0xF) << BLEND_COLORMASK_SHIFT);
-			ref = Value;
-			break;
-		}
-
-		case D3DRS_TEXTUREFACTOR:
-			m_per_pixel.texture_factor = to_color4(Value);
-			ref = Value;
-			break;
-
-		case D3DRS_FOGSTART:
-			m_per_pixel.fog_start = *reinterpret_cast<float*>(&Value);
-			ref = Value;
-			break;
-
-		case D3DRS_FOGEND:
-			m_per_pixel.fog_end = *reinterpret_cast<float*>(&Value);
-			ref = Value;
-			break;
-
-		case D3DRS_FOGCOLOR:
-			m_per_pixel.fog_color = to_color4(Value);
-			ref = Value;
-			break;
-
-		case D3DRS_FOGTABLEMODE:
-			m_shader_flags &= ~ShaderFlags::rs_fog_mode_mask;
-			m_shader_flags |= (static_cast<ShaderFlags::type>(Value) << ShaderFlags::rs_fog_mode_shift) & ShaderFlags::rs_fog_mode_mask;
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_FOGDENSITY:
-			m_per_pixel.fog_density = *reinterpret_cast<float*>(&Value);
-			ref = Value;
-			break;
-
-		case D3DRS_SPECULARENABLE:
-			if (Value != 0)
-			{
-				m_shader_flags |= ShaderFlags::rs_specular;
-			}
-			else
-			{
-				m_shader_flags &= ~ShaderFlags::rs_specular;
-			}
-
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_LIGHTING:
-			if (Value == 1)
-			{
-				m_shader_flags |= ShaderFlags::rs_lighting;
-			}
-			else
-			{
-				m_shader_flags &= ~ShaderFlags::rs_lighting;
-			}
-
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_FOGENABLE:
-			if (Value != 0)
-			{
-				m_shader_flags |= ShaderFlags::rs_fog;
-			}
-			else
-			{
-				m_shader_flags &= ~ShaderFlags::rs_fog;
-			}
-
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_ALPHATESTENABLE:
-		{
-			if (Value != 0)
-			{
-				m_shader_flags |= ShaderFlags::rs_alpha_test;
-			}
-			else
-			{
-				m_shader_flags &= ~ShaderFlags::rs_alpha_test;
-			}
-
-			ref = Value;
-			ref.clear();
-			break;
-		}
-
-		case D3DRS_ALPHAFUNC:
-		{
-			if (!Value)
-			{
-				return D3DERR_INVALIDCALL;
-			}
-
-			m_shader_flags &= ~ShaderFlags::rs_alpha_test_mode_mask;
-			m_shader_flags |= (static_cast<ShaderFlags::type>(Value) << ShaderFlags::rs_alpha_test_mode_shift) & ShaderFlags::rs_alpha_test_mode_mask;
-
-			ref = Value;
-			ref.clear();
-			break;
-		}
-
-		case D3DRS_ALPHAREF:
-		{
-			m_per_pixel.alpha_test_reference = static_cast<float>(Value) / 255.0f;
-			ref = Value;
-			ref.clear();
-			break;
-		}
-
-		case D3DRS_CULLMODE:
-		{
-			m_raster_flags = (m_raster_flags.data() & ~RasterFlags::cull_mask) | (Value & 3);
-			ref = Value;
-			ref.clear();
-			break;
-		}
-
-		case D3DRS_FILLMODE:
-		{
-			m_raster_flags = (m_raster_flags.data() & ~RasterFlags::fill_mask) | ((Value & 3) << 2);
-			ref = Value;
-			ref.clear();
-			break;
-		}
-
-		case D3DRS_ZENABLE:
-		{
-			if (Value)
-			{
-				m_depth_stencil_flags.flags = m_depth_stencil_flags.flags.data() | DepthStencilFlags::depth_test_enabled;
-			}
-			else
-			{
-				m_depth_stencil_flags.flags = m_depth_stencil_flags.flags.data() & ~DepthStencilFlags::depth_test_enabled;
-			}
-
-			ref = Value;
-			ref.clear();
-			break;
-		}
-
-		case D3DRS_ZFUNC:
-		{
-			if (!Value)
-			{
-				return D3DERR_INVALIDCALL;
-			}
-
-			m_depth_stencil_flags.depth_flags = (m_depth_stencil_flags.depth_flags.data() & ~DepthFlags::comparison_mask) | Value;
-			ref = Value;
-			ref.clear();
-			break;
-		}
-
-		case D3DRS_ZWRITEENABLE:
-			if (Value)
-			{
-				m_depth_stencil_flags.flags = m_depth_stencil_flags.flags.data() | DepthStencilFlags::depth_write_enabled;
-			}
-			else
-			{
-				m_depth_stencil_flags.flags = m_depth_stencil_flags.flags.data() & ~DepthStencilFlags::depth_write_enabled;
-			}
-
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_STENCILENABLE:
-			if (Value)
-			{
-				m_depth_stencil_flags.flags = m_depth_stencil_flags.flags.data() | DepthStencilFlags::stencil_enabled;
-			}
-			else
-			{
-				m_depth_stencil_flags.flags = m_depth_stencil_flags.flags.data() & ~DepthStencilFlags::stencil_enabled;
-			}
-
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_STENCILFAIL:
-			set_stencil_flags(StencilFlags::fail_shift);
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_STENCILZFAIL:
-			set_stencil_flags(StencilFlags::zfail_shift);
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_STENCILPASS:
-			set_stencil_flags(StencilFlags::pass_shift);
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_STENCILFUNC:
-			set_stencil_flags(StencilFlags::func_shift);
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_STENCILREF:
-			ref = Value;
-			break;
-
-		case D3DRS_STENCILMASK:
-			set_stencil_rw(StencilFlags::read_shift);
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_STENCILWRITEMASK:
-			set_stencil_rw(StencilFlags::write_shift);
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_AMBIENT:
-			m_per_model.ambient = to_color4(Value);
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_DIFFUSEMATERIALSOURCE:
-			m_per_model.material_sources.diffuse = Value;
-			ref = Value;
-			ref.clear();
-			break;
-
-		case D3DRS_SPECULARMATERIALSOURCE:
-			m_per_model.material_sources.specular = Value;
-			ref = Value;
-			ref.clear();
-			break;
+HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetClipPlane(DWORD Index, const float* pPlane)
+{
+	if (pPlane == nullptr || Index >= MAX_CLIP_PLANES)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-		case D3DRS_AMBIENTMATERIALSOURCE:
-			m_per_model.material_sources.ambient = Value;
-			ref = Value;
-			ref.clear();
-			break;
+	memcpy(m_stored_clip_planes[Index], pPlane, sizeof(m_stored_clip_planes[0]));
+	return D3D_OK;
+}
 
-		case D3DRS_EMISSIVEMATERIALSOURCE:
-			m_per_model.material_sources.emissive = Value;
-			ref = Value;
-			ref.clear();
-			break;
+HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetClipPlane(DWORD Index, float* pPlane)
+{
+	if (pPlane == nullptr || Index >= MAX_CLIP_PLANES)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-		case D3DRS_COLORVERTEX:
-			m_per_model.color_vertex = !!Value;
-			ref = Value;
-			ref.clear();
-			break;
+	memcpy(pPlane, m_stored_clip_planes[Index], sizeof(m_stored_clip_planes[0]));
+	return D3D_OK;
+}
 
-		case D3DRS_SRCBLEND:
-			m_per_pixel.src_blend = Value;
-			m_blend_flags = (m_blend_flags.data() & ~0x0F) | Value;
-			ref = Value;
-			ref.clear();
-			break;
+void Direct3DDevice8::forget_render_states(RenderStateGroup::type groups)
+{
+	const auto& table = RenderStateTable<Direct3DDevice8>::TABLE;
 
-		case D3DRS_DESTBLEND:
-			m_per_pixel.dst_blend = Value;
-			m_blend_flags = (m_blend_flags.data() & ~0xF0) | (Value << 4);
-			ref = Value;
-			ref.clear();
-			break;
+	for (size_t i = 0; i < table.size(); ++i)
+	{
+		if (table[i].groups & groups)
+		{
+			m_applied_render_states[i] = false;
+		}
+	}
+}
 
-		case D3DRS_ALPHABLENDENABLE:
-			m_blend_flags = (m_blend_flags.data() & ~0x8000) | (Value ? 0x8000 : 0);
+void Direct3DDevice8::log_unhandled_render_state(D3DRENDERSTATETYPE state, DWORD value)
+{
+	uint8_t& count = m_unhandled_render_state_logs[state];
 
-			if (Value != 1)
-			{
-				m_shader_flags &= ~ShaderFlags::rs_alpha;
-			}
-			else
-			{
-				m_shader_flags |= ShaderFlags::rs_alpha;
-			}
+	if (count > UNHANDLED_RENDER_STATE_LOG_LIMIT)
+	{
+		return;
+	}
 
-			ref = Value;
-			ref.clear();
-			break;
+	++count;
 
-		case D3DRS_BLENDOP:
-			m_blend_flags = (m_blend_flags.data() & ~0xF00) | (Value << 8);
-			m_per_pixel.blend_op = Value;
+	const std::string_view name = RenderStateTable<Direct3DDevice8>::TABLE[state].name;
 
-			ref = Value;
-			ref.clear();
-			break;
+	if (count > UNHANDLED_RENDER_STATE_LOG_LIMIT)
+	{
+		OutputDebugStringA(std::format("{}: not logging further changes to unhandled render state {}\n", __FUNCTION__, name).c_str());
+		return;
 	}
 
-	return D3D_OK;
+	OutputDebugStringA(std::format("{}: unhandled render state type: {}; value: {}\n", __FUNCTION__, name, value).c_str());
+}
+
+HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetRenderState(D3DRENDERSTATETYPE State, DWORD Value)
+{
+	return RenderStateTable<Direct3DDevice8>::set(*this, State, Value);
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetRenderState(D3DRENDERSTATETYPE State, DWORD* pValue)
@@ -2728,34 +2474,32 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetTexture(DWORD Stage, Direct3DBaseT
 
 	*ppTexture = nullptr;
 
-	const auto it = m_textures.find(Stage);
-
-	if (it == m_textures.end())
+	if (Stage >= TEXTURE_STAGE_MAX || m_textures[Stage] == nullptr)
 	{
 		return D3DERR_INVALIDCALL;
 	}
 
-	auto texture = it->second;
+	auto texture = m_textures[Stage];
 	texture->AddRef();
-	*ppTexture = it->second;
+	*ppTexture = texture;
 	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetTexture(DWORD Stage, Direct3DBaseTexture8* pTexture)
 {
-	auto it = m_textures.find(Stage);
+	if (Stage >= TEXTURE_STAGE_MAX)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
 	if (pTexture == nullptr)
 	{
 		m_per_texture.stages[Stage].bound = false;
 
-		ID3D11ShaderResourceView* dummy[1] {};
-		m_context->PSSetShaderResources(Stage, 1, &dummy[0]);
-
-		if (it != m_textures.end())
+		if (m_textures[Stage] != nullptr)
 		{
-			safe_release(&it->second);
-			m_textures.erase(it);
+			safe_release(&m_textures[Stage]);
+			m_dirty_texture_stages |= 1u << Stage;
 		}
 
 		return D3D_OK;
@@ -2771,27 +2515,19 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetTexture(DWORD Stage, Direct3DBaseT
 
 	auto texture = dynamic_cast<Direct3DTexture8*>(pTexture);
 
-	if (it != m_textures.end())
-	{
-		safe_release(&it->second);
-		it->second = texture;
-		texture->AddRef();
-	}
-	else
-	{
-		m_textures[Stage] = texture;
-		texture->AddRef();
-	}
+	texture->AddRef();
+	safe_release(&m_textures[Stage]);
+	m_textures[Stage] = texture;
 
+	// marked even if it's the same texture in case its view has changed since it was set
 	m_per_texture.stages[Stage].bound = true;
-	ID3D11ShaderResourceView* texture_srv = texture->get_native_srv();
-	m_context->PSSetShaderResources(Stage, 1, &texture_srv);
+	m_dirty_texture_stages |= 1u << Stage;
 	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetTextureStageState(DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD* pValue)
 {
-	if (!pValue)
+	if (!pValue || Stage >= TEXTURE_STAGE_MAX)
 	{
 		return D3DERR_INVALIDCALL;
 	}
@@ -2799,31 +2535,31 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetTextureStageState(DWORD Stage, D3D
 	switch (Type)
 	{
 		case D3DTSS_ADDRESSU:
-			*pValue = m_sampler_setting_values[Stage].address_u.data();
+			*pValue = m_sampler_setting_values[Stage].address_u();
 			break;
 		case D3DTSS_ADDRESSV:
-			*pValue = m_sampler_setting_values[Stage].address_v.data();
+			*pValue = m_sampler_setting_values[Stage].address_v();
 			break;
 		case D3DTSS_MAGFILTER:
-			*pValue = m_sampler_setting_values[Stage].filter_mag.data();
+			*pValue = m_sampler_setting_values[Stage].filter_mag();
 			break;
 		case D3DTSS_MINFILTER:
-			*pValue = m_sampler_setting_values[Stage].filter_min.data();
+			*pValue = m_sampler_setting_values[Stage].filter_min();
 			break;
 		case D3DTSS_MIPFILTER:
-			*pValue = m_sampler_setting_values[Stage].filter_mip.data();
+			*pValue = m_sampler_setting_values[Stage].filter_mip();
 			break;
 		case D3DTSS_MIPMAPLODBIAS:
-			*reinterpret_cast<float*>(pValue) = m_sampler_setting_values[Stage].mip_lod_bias.data();
+			*reinterpret_cast<float*>(pValue) = m_sampler_setting_values[Stage].mip_lod_bias();
 			break;
 		case D3DTSS_MAXMIPLEVEL:
-			*pValue = m_sampler_setting_values[Stage].max_mip_level.data();
+			*pValue = m_sampler_setting_values[Stage].max_mip_level();
 			break;
 		case D3DTSS_MAXANISOTROPY:
-			*pValue = m_sampler_setting_values[Stage].max_anisotropy.data();
+			*pValue = m_sampler_setting_values[Stage].max_anisotropy();
 			break;
 		case D3DTSS_ADDRESSW:
-			*pValue = m_sampler_setting_values[Stage].address_u.data();
+			*pValue = m_sampler_setting_values[Stage].address_w();
 			break;
 
 		case D3DTSS_COLOROP:
@@ -2888,42 +2624,56 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetTextureStageState(DWORD Stage, D3D
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetTextureStageState(DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value)
 {
+	if (Stage >= TEXTURE_STAGE_MAX)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
 	switch (Type)
 	{
 		case D3DTSS_ADDRESSU:
-			m_sampler_setting_values[Stage].address_u = static_cast<D3DTEXTUREADDRESS>(Value);
+			m_sampler_setting_values[Stage].address_u(static_cast<D3DTEXTUREADDRESS>(Value));
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_ADDRESSV:
-			m_sampler_setting_values[Stage].address_v = static_cast<D3DTEXTUREADDRESS>(Value);
+			m_sampler_setting_values[Stage].address_v(static_cast<D3DTEXTUREADDRESS>(Value));
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_MAGFILTER:
-			m_sampler_setting_values[Stage].filter_mag = static_cast<D3DTEXTUREFILTERTYPE>(Value);
+			m_sampler_setting_values[Stage].filter_mag(static_cast<D3DTEXTUREFILTERTYPE>(Value));
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_MINFILTER:
-			m_sampler_setting_values[Stage].filter_min = static_cast<D3DTEXTUREFILTERTYPE>(Value);
+			m_sampler_setting_values[Stage].filter_min(static_cast<D3DTEXTUREFILTERTYPE>(Value));
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_MIPFILTER:
-			m_sampler_setting_values[Stage].filter_mip = static_cast<D3DTEXTUREFILTERTYPE>(Value);
+			m_sampler_setting_values[Stage].filter_mip(static_cast<D3DTEXTUREFILTERTYPE>(Value));
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_MIPMAPLODBIAS:
-			m_sampler_setting_values[Stage].mip_lod_bias = *reinterpret_cast<float*>(&Value);
+			m_sampler_setting_values[Stage].mip_lod_bias(*reinterpret_cast<float*>(&Value));
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_MAXMIPLEVEL:
-			m_sampler_setting_values[Stage].max_mip_level = Value;
+			m_sampler_setting_values[Stage].max_mip_level(Value);
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_MAXANISOTROPY:
-			m_sampler_setting_values[Stage].max_anisotropy = Value;
+			m_sampler_setting_values[Stage].max_anisotropy(Value);
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_ADDRESSW:
-			m_sampler_setting_values[Stage].address_w = static_cast<D3DTEXTUREADDRESS>(Value);
+			m_sampler_setting_values[Stage].address_w(static_cast<D3DTEXTUREADDRESS>(Value));
+			m_dirty_samplers |= 1u << Stage;
 			break;
 
 		case D3DTSS_COLOROP:
@@ -3066,28 +2816,44 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetCurrentTexturePalette(UINT* pPalet
 	NOT_IMPLEMENTED_RETURN;
 }
 
-void Direct3DDevice8::run_draw_prologues(const std::string& callback)
+void Direct3DDevice8::run_draw_prologues(std::string_view callback)
 {
 #ifndef _DEBUG
-	shader_preprocess(m_shader_flags, false, m_draw_prologue_epilogue_preproc); // FIXME: assuming non-uber
-
-	for (auto& fn : draw_prologues[callback])
-	{
-		fn(m_draw_prologue_epilogue_preproc, m_shader_flags);
-	}
+	run_draw_callbacks(draw_prologues, callback);
 #endif
 }
 
-void Direct3DDevice8::run_draw_epilogues(const std::string& callback)
+void Direct3DDevice8::run_draw_epilogues(std::string_view callback)
 {
 #ifndef _DEBUG
-	shader_preprocess(m_shader_flags, false, m_draw_prologue_epilogue_preproc); // FIXME: assuming non-uber
+	run_draw_callbacks(draw_epilogues, callback);
+#endif
+}
 
-	for (auto& fn : draw_epilogues[callback])
+void Direct3DDevice8::run_draw_callbacks(const ShaderCallbackMap& callbacks, std::string_view callback) const
+{
+	// nothing is usually registered, so don't even hash the key
+	if (callbacks.empty())
 	{
-		fn(m_draw_prologue_epilogue_preproc, m_shader_flags);
+		return;
 	}
-#endif
+
+	const auto it = callbacks.find(callback);
+
+	if (it == callbacks.end() || it->second.empty())
+	{
+		return;
+	}
+
+	const auto& definitions = m_shader_compiler.get_definitions(m_shader_flags, false); // FIXME: assuming non-uber
+
+	for (auto& fn : it->second)
+	{
+		fn(definitions, m_shader_flags);
+	}
+
+	// the callbacks bind their own state through the native context behind the filter's back
+	m_context.invalidate();
 }
 
 bool Direct3DDevice8::set_primitive_type(D3DPRIMITIVETYPE primitive_type) const
@@ -3155,53 +2921,30 @@ void Direct3DDevice8::oit_zwrite_restore(DWORD ZWRITEENABLE, DWORD ZENABLE)
 // the other draw function (UP) gets routed through here
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawPrimitive(D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount)
 {
-	// convert triangle fan to indexed triangle list before rendering since D3D11 can't render fans
+	// draw triangle fans as indexed triangle lists since D3D11 can't render fans
 	if (PrimitiveType == D3DPT_TRIANGLEFAN)
 	{
-		ComPtr<Direct3DIndexBuffer8> last_index_buffer;
-		UINT last_index_base = 0;
-		GetIndices(&last_index_buffer, &last_index_base);
+		Direct3DIndexBuffer8* fan_index_buffer = get_canonical_fan_index_buffer(PrimitiveCount);
 
-		const size_t tri_list_index_count = 3 * PrimitiveCount;
-		const size_t tri_list_index_buffer_size = tri_list_index_count * 4;
-
-		auto up_index_buffer = get_user_primitive_index_buffer(tri_list_index_buffer_size, D3DFMT_INDEX32);
-
-		if (up_index_buffer == nullptr)
+		if (fan_index_buffer == nullptr)
 		{
 			return D3DERR_INVALIDCALL;
 		}
 
-		BYTE* raw_output_indices_ptr = nullptr;
-		up_index_buffer->Lock(0, static_cast<UINT>(tri_list_index_buffer_size), &raw_output_indices_ptr, D3DLOCK_DISCARD);
-
-		auto tri_list_indices = std::span(reinterpret_cast<uint32_t*>(raw_output_indices_ptr), tri_list_index_count);
-
-		{
-			UINT n = 1;
-			for (size_t i = 0; i < PrimitiveCount; ++i)
-			{
-				const size_t o = 3 * i;
-
-				tri_list_indices[o + 0] = StartVertex;
-				tri_list_indices[o + 1] = StartVertex + n++;
-				tri_list_indices[o + 2] = StartVertex + n;
-			}
-		}
+		ComPtr<Direct3DIndexBuffer8> last_index_buffer;
+		UINT last_index_base = 0;
+		GetIndices(&last_index_buffer, &last_index_base);
 
-		up_index_buffer->Unlock();
-		SetIndices(up_index_buffer.Get(), 0);
+		SetIndices(fan_index_buffer, StartVertex);
 
 		const auto result = DrawIndexedPrimitive(D3DPT_TRIANGLELIST,
 		                                         0,
-		                                         static_cast<UINT>(tri_list_index_count),
+		                                         PrimitiveCount + 2,
 		                                         0,
 		                                         PrimitiveCount);
 
 		SetIndices(last_index_buffer.Get(), last_index_base);
 
-		m_up_index_buffers.emplace_back(std::move(up_index_buffer));
-
 		return result;
 	}
 
@@ -3252,17 +2995,26 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawIndexedPrimitive(D3DPRIMITIVETYPE
 		return D3DERR_INVALIDCALL;
 	}
 
-	// TODO: convert triangle fan to triangle list before rendering since D3D11 can't render fans? details below
-	// we have to be able to reference the contents of the index buffer so that
-	// it can be (temporarily) converted to a triangle list index buffer. but
-	// with the vertex/index buffer rewrite, we no longer have a copy in system
-	// memory like in the past. that will need to be reimplemented :/
+	// draw triangle fans from a converted copy of the indices since D3D11 can't render fans
 	if (PrimitiveType == D3DPT_TRIANGLEFAN)
 	{
-		// hopefully not too spammy, but this case doesn't seem common
-		NOT_IMPLEMENTED;
-		// let's just pretend everything is fine
-		return D3D_OK;
+		Direct3DIndexBuffer8* list_index_buffer = nullptr;
+
+		const HRESULT hr = get_triangle_fan_list(StartIndex, PrimitiveCount, &list_index_buffer);
+
+		if (FAILED(hr) || list_index_buffer == nullptr)
+		{
+			return hr;
+		}
+
+		ComPtr<Direct3DIndexBuffer8> fan_index_buffer = m_current_index_buffer;
+		const auto base_vertex_index = static_cast<UINT>(m_current_base_vertex_index);
+
+		SetIndices(list_index_buffer, base_vertex_index);
+		const HRESULT result = DrawIndexedPrimitive(D3DPT_TRIANGLELIST, MinIndex, NumVertices, 0, PrimitiveCount);
+		SetIndices(fan_index_buffer.Get(), base_vertex_index);
+
+		return result;
 	}
 
 	if (!set_primitive_type(PrimitiveType))
@@ -3302,38 +3054,8 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawPrimitiveUP(D3DPRIMITIVETYPE Prim
 		return D3DERR_INVALIDCALL;
 	}
 
-	// D3D11 can't render triangle fans natively, so we'll forward this draw call to
-	// DrawIndexedPrimitiveUP and let it handle conversion to an indexed triangle list.
-	if (PrimitiveType == D3DPT_TRIANGLEFAN)
-	{
-		ComPtr<Direct3DIndexBuffer8> last_index_buffer;
-		UINT last_index_base = 0;
-		GetIndices(&last_index_buffer, &last_index_base);
-
-		const uint32_t vertex_count = primitive_vertex_count(PrimitiveType, PrimitiveCount);
-
-		m_trifan_index_buffer.resize(vertex_count);
-
-		for (uint32_t i = 0; i < vertex_count; ++i)
-		{
-			m_trifan_index_buffer[i] = i;
-		}
-
-		const auto result = DrawIndexedPrimitiveUP(PrimitiveType,
-		                                           0,
-		                                           vertex_count,
-		                                           PrimitiveCount,
-		                                           m_trifan_index_buffer.data(),
-		                                           D3DFMT_INDEX32,
-		                                           pVertexStreamZeroData,
-		                                           VertexStreamZeroStride);
-
-		SetIndices(last_index_buffer.Get(), last_index_base);
-
-		return result;
-	}
-
-	if (!set_primitive_type(PrimitiveType))
+	// triangle fans are drawn as lists by DrawPrimitive
+	if (!set_primitive_type(PrimitiveType == D3DPT_TRIANGLEFAN ? D3DPT_TRIANGLELIST : PrimitiveType))
 	{
 		return D3DERR_INVALIDCALL;
 	}
@@ -3359,16 +3081,15 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawPrimitiveUP(D3DPRIMITIVETYPE Prim
 
 	const auto vertex_buffer_size = vertex_count * VertexStreamZeroStride;
 
-	auto up_vertex_buffer = get_user_primitive_vertex_buffer(vertex_buffer_size);
+	ComPtr<Direct3DVertexBuffer8> up_vertex_buffer;
+	UINT start_vertex = 0;
+	BYTE* ptr = lock_user_primitive_vertices(vertex_buffer_size, VertexStreamZeroStride, up_vertex_buffer, start_vertex);
 
-	if (up_vertex_buffer == nullptr)
+	if (ptr == nullptr)
 	{
 		return D3DERR_INVALIDCALL;
 	}
 
-	BYTE* ptr;
-	up_vertex_buffer->Lock(0, vertex_buffer_size, &ptr, D3DLOCK_DISCARD);
-
 	memcpy(ptr, pVertexStreamZeroData, vertex_buffer_size);
 
 	up_vertex_buffer->Unlock();
@@ -3376,11 +3097,11 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawPrimitiveUP(D3DPRIMITIVETYPE Prim
 	SetStreamSource(0, up_vertex_buffer.Get(), VertexStreamZeroStride);
 
 	run_draw_prologues(__FUNCTION__);
-	const auto result = DrawPrimitive(PrimitiveType, 0, PrimitiveCount);
+	const auto result = DrawPrimitive(PrimitiveType, start_vertex, PrimitiveCount);
 	run_draw_epilogues(__FUNCTION__);
 
 	SetStreamSource(0, nullptr, 0);
-	m_up_vertex_buffers.emplace_back(std::move(up_vertex_buffer));
+	release_user_primitive_buffer(std::move(up_vertex_buffer));
 
 	return result;
 }
@@ -3403,8 +3124,15 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawIndexedPrimitiveUP(D3DPRIMITIVETY
 	}
 
 	ComPtr<Direct3DIndexBuffer8> up_index_buffer;
+	UINT start_index = 0;
 	const size_t index_size = IndexDataFormat == D3DFMT_INDEX16 ? sizeof(uint16_t) : sizeof(uint32_t);
 
+	// the index buffer goes back to its pool however this returns, including when the draw is rejected or skipped
+	const scope_exit release_index_buffer([&]
+	{
+		release_user_primitive_buffer(std::move(up_index_buffer));
+	});
+
 	const uint32_t vertex_count = primitive_vertex_count(PrimitiveType, PrimitiveCount);
 
 	if (!vertex_count)
@@ -3412,7 +3140,8 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawIndexedPrimitiveUP(D3DPRIMITIVETY
 		return D3DERR_INVALIDCALL;
 	}
 
-	const auto vertex_buffer_size = vertex_count * VertexStreamZeroStride;
+	// the indices can refer to any vertex up to the end of the given range
+	const auto vertex_buffer_size = (MinVertexIndex + NumVertexIndices) * VertexStreamZeroStride;
 
 	// convert triangle fan to triangle list before rendering since D3D11 can't render fans
 	if (PrimitiveType == D3DPT_TRIANGLEFAN)
@@ -3420,65 +3149,38 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawIndexedPrimitiveUP(D3DPRIMITIVETY
 		const size_t tri_list_index_count = 3 * PrimitiveCount;
 		const size_t tri_list_index_buffer_size = tri_list_index_count * index_size;
 
-		up_index_buffer = get_user_primitive_index_buffer(tri_list_index_buffer_size, IndexDataFormat);
+		BYTE* raw_output_indices_ptr = lock_user_primitive_indices(static_cast<UINT>(tri_list_index_buffer_size), IndexDataFormat, up_index_buffer, start_index);
 
-		if (up_index_buffer == nullptr)
+		if (raw_output_indices_ptr == nullptr)
 		{
 			return D3DERR_INVALIDCALL;
 		}
 
-		BYTE* raw_output_indices_ptr = nullptr;
-		up_index_buffer->Lock(0, static_cast<UINT>(tri_list_index_buffer_size), &raw_output_indices_ptr, D3DLOCK_DISCARD);
-
-		// copy/pasted code below to handle 16-bit and 32-bit indices because I was too lazy to make a template function
 		if (IndexDataFormat == D3DFMT_INDEX16)
 		{
-			const auto* index_0 = static_cast<const uint16_t*>(pIndexData);
-			const auto* input_indices = index_0 + 1;
-			auto tri_list_indices = std::span(reinterpret_cast<uint16_t*>(raw_output_indices_ptr), tri_list_index_count);
-
-			for (size_t i = 0; i < PrimitiveCount; ++i)
-			{
-				const size_t o = 3 * i;
-
-				tri_list_indices[o + 0] = *index_0;
-				tri_list_indices[o + 1] = *input_indices;
-
-				++input_indices;
-				tri_list_indices[o + 2] = *input_indices;
-			}
+			d3d8to11::triangle_fan_to_list(static_cast<const uint16_t*>(pIndexData), PrimitiveCount,
+			                               reinterpret_cast<uint16_t*>(raw_output_indices_ptr));
 		}
 		else
 		{
-			const auto* index_0 = static_cast<const uint32_t*>(pIndexData);
-			const auto* input_indices = index_0 + 1;
-			auto tri_list_indices = std::span(reinterpret_cast<uint32_t*>(raw_output_indices_ptr), tri_list_index_count);
-
-			for (size_t i = 0; i < PrimitiveCount; ++i)
-			{
-				const size_t o = 3 * i;
-
-				tri_list_indices[o + 0] = *index_0;
-				tri_list_indices[o + 1] = *input_indices;
-
-				++input_indices;
-				tri_list_indices[o + 2] = *input_indices;
-			}
+			d3d8to11::triangle_fan_to_list(static_cast<const uint32_t*>(pIndexData), PrimitiveCount,
+			                               reinterpret_cast<uint32_t*>(raw_output_indices_ptr));
 		}
 
 		up_index_buffer->Unlock();
 
 		PrimitiveType = D3DPT_TRIANGLELIST;
-		NumVertexIndices = static_cast<UINT>(tri_list_index_count);
 	}
 	else
 	{
 		const size_t index_buffer_size = index_size * vertex_count;
 
-		up_index_buffer = get_user_primitive_index_buffer(index_buffer_size, IndexDataFormat);
+		BYTE* raw_output_indices_ptr = lock_user_primitive_indices(static_cast<UINT>(index_buffer_size), IndexDataFormat, up_index_buffer, start_index);
 
-		BYTE* raw_output_indices_ptr = nullptr;
-		up_index_buffer->Lock(0, static_cast<UINT>(index_buffer_size), &raw_output_indices_ptr, D3DLOCK_DISCARD);
+		if (raw_output_indices_ptr == nullptr)
+		{
+			return D3DERR_INVALIDCALL;
+		}
 
 		memcpy(raw_output_indices_ptr, pIndexData, index_buffer_size);
 
@@ -3502,49 +3204,265 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawIndexedPrimitiveUP(D3DPRIMITIVETY
 		return D3D_OK;
 	}
 
-	ComPtr<Direct3DVertexBuffer8> up_vertex_buffer = get_user_primitive_vertex_buffer(vertex_buffer_size);
+	ComPtr<Direct3DVertexBuffer8> up_vertex_buffer;
+	UINT start_vertex = 0;
+	BYTE* ptr = lock_user_primitive_vertices(vertex_buffer_size, VertexStreamZeroStride, up_vertex_buffer, start_vertex);
+
+	if (ptr == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	memcpy(ptr, pVertexStreamZeroData, vertex_buffer_size);
+
+	up_vertex_buffer->Unlock();
+
+	// the vertices' offset in the ring becomes the base vertex
+	SetStreamSource(0, up_vertex_buffer.Get(), VertexStreamZeroStride);
+	SetIndices(up_index_buffer.Get(), start_vertex);
+
+	run_draw_prologues(__FUNCTION__);
+	const auto result = DrawIndexedPrimitive(PrimitiveType, MinVertexIndex, NumVertexIndices, start_index, PrimitiveCount);
+	run_draw_epilogues(__FUNCTION__);
+
+	SetIndices(nullptr, 0);
+	SetStreamSource(0, nullptr, 0);
+	release_user_primitive_buffer(std::move(up_vertex_buffer));
+
+	return result;
+}
+
+namespace
+{
+	/**
+	 * \brief The chunks of one ProcessVertices call, claimed one at a time by whichever thread gets to them first.
+	 * Shared with the pool tasks, which may only start once the calling thread has already done all the work.
+	 */
+	struct ProcessVerticesJob
+	{
+		FixedFunctionState state;
+		FVFLayout source;
+		FVFLayout dest;
+		const uint8_t* src = nullptr;
+		uint8_t* dst = nullptr;
+		size_t vertex_count = 0;
+		size_t chunk_size = 0;
+		size_t chunk_count = 0;
+		bool copy_data = true;
+
+		std::atomic_size_t next_chunk { 0 };
+		std::atomic_size_t finished_chunks { 0 };
+
+		void run()
+		{
+			for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++)
+			{
+				const size_t first = chunk * chunk_size;
+				const size_t count = std::min(chunk_size, vertex_count - first);
+
+				process_vertices(state, source, src + first * source.stride, dest, dst + first * dest.stride, count, copy_data);
+
+				if (++finished_chunks == chunk_count)
+				{
+					finished_chunks.notify_all();
+				}
+			}
+		}
+
+		void wait() const
+		{
+			for (size_t finished = finished_chunks.load(); finished != chunk_count; finished = finished_chunks.load())
+			{
+				finished_chunks.wait(finished);
+			}
+		}
+	};
+}
+
+HRESULT STDMETHODCALLTYPE Direct3DDevice8::ProcessVertices(UINT SrcStartIndex, UINT DestIndex, UINT VertexCount, Direct3DVertexBuffer8* pDestBuffer, DWORD Flags)
+{
+	// only the fixed-function pipeline is emulated on the CPU
+	if (pDestBuffer == nullptr || m_current_vertex_shader_info != nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	const StreamPair& stream = m_stream_sources[0];
+
+	if (stream.buffer == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	auto job = std::make_shared<ProcessVerticesJob>();
+
+	if (!job->source.assign(m_fvf_flags.data()) || (job->source.fvf & D3DFVF_POSITION_MASK) != D3DFVF_XYZ ||
+	    !job->dest.assign(pDestBuffer->get_d3d8_desc().FVF) || (job->dest.fvf & D3DFVF_POSITION_MASK) != D3DFVF_XYZRHW)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	if (stream.stride < job->source.stride)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	job->source.stride = stream.stride;
+
+	const uint64_t src_end  = (static_cast<uint64_t>(SrcStartIndex) + VertexCount) * job->source.stride;
+	const uint64_t dest_end = (static_cast<uint64_t>(DestIndex) + VertexCount) * job->dest.stride;
+
+	if (src_end > stream.buffer->get_d3d8_desc().Size || dest_end > pDestBuffer->get_d3d8_desc().Size)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	if (!VertexCount)
+	{
+		return D3D_OK;
+	}
+
+	const auto src_size  = static_cast<UINT>(VertexCount * job->source.stride);
+	const auto dest_size = static_cast<UINT>(VertexCount * job->dest.stride);
+
+	ID3D11Buffer* readback = get_process_vertices_staging(m_process_vertices_readback, src_size, D3D11_CPU_ACCESS_READ);
+	ID3D11Buffer* scratch  = get_process_vertices_staging(m_process_vertices_scratch, dest_size, D3D11_CPU_ACCESS_WRITE);
+
+	if (readback == nullptr || scratch == nullptr)
+	{
+		return D3DERR_OUTOFVIDEOMEMORY;
+	}
+
+	D3D11_BOX box {};
+	box.left   = static_cast<UINT>(SrcStartIndex * job->source.stride);
+	box.right  = static_cast<UINT>(src_end);
+	box.bottom = 1;
+	box.back   = 1;
+
+	m_context->CopySubresourceRegion(readback, 0, 0, 0, 0, stream.buffer->get_native_buffer(), 0, &box);
+
+	// waits for the copy
+	D3D11_MAPPED_SUBRESOURCE mapped {};
+
+	if (FAILED(m_context->Map(readback, 0, D3D11_MAP_READ, 0, &mapped)))
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	job->state        = get_fixed_function_state();
+	job->src          = static_cast<const uint8_t*>(mapped.pData);
+	job->vertex_count = VertexCount;
+	job->chunk_size   = PROCESS_VERTICES_CHUNK_SIZE;
+	job->chunk_count  = (job->vertex_count + job->chunk_size - 1) / job->chunk_size;
+	job->copy_data    = !(Flags & D3DPV_DONOTCOPYDATA);
+
+	const bool written = write_buffer_range(m_context, pDestBuffer->get_native_buffer(), pDestBuffer->get_d3d8_desc().Size, scratch,
+	                                        static_cast<UINT>(DestIndex * job->dest.stride), dest_size,
+	                                        overwrites_vertices(job->dest, job->copy_data),
+	                                        [&](uint8_t* dest_data)
+	{
+		job->dst = dest_data;
+
+		// this thread takes chunks too, so the pool only helps and the call never waits on a busy pool
+		const size_t helper_count = std::min(job->chunk_count - 1, m_thread_pool.thread_count());
+
+		for (size_t i = 0; i < helper_count; ++i)
+		{
+			std::ignore = m_thread_pool.enqueue(TaskPriority::high, [job]() { job->run(); });
+		}
+
+		job->run();
+		job->wait();
+	});
+
+	m_context->Unmap(readback, 0);
+	return written ? D3D_OK : D3DERR_INVALIDCALL;
+}
+
+HRESULT STDMETHODCALLTYPE Direct3DDevice8::CreateVertexShader(const DWORD* pDeclaration, const DWORD* pFunction, DWORD* pHandle, DWORD Usage)
+{
+	UNREFERENCED_PARAMETER(Usage);
+
+	if (pDeclaration == nullptr || pHandle == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	VertexShaderInfo info;
+
+	try
+	{
+		info.declaration = VertexDeclaration(pDeclaration);
 
-	if (up_vertex_buffer == nullptr)
+		if (pFunction != nullptr)
+		{
+			info.function.assign(pFunction, pFunction + shader_token_count(pFunction));
+			create_translated_vertex_shader(info);
+		}
+		else
+		{
+			info.fvf    = info.declaration.to_fvf();
+			info.layout = get_declaration_input_layout(info.declaration, info.fvf);
+		}
+	}
+	catch (std::exception& ex)
 	{
+		const std::string str = std::format(__FUNCTION__ ": {}\n", ex.what());
+		OutputDebugStringA(str.c_str());
 		return D3DERR_INVALIDCALL;
 	}
 
-	BYTE* ptr;
-	up_vertex_buffer->Lock(0, vertex_buffer_size, &ptr, D3DLOCK_DISCARD);
+	// handles with the top bit set are told apart from FVFs in SetVertexShader
+	const DWORD handle = 0x80000000 | m_next_vertex_shader_handle++;
+	m_vertex_shader_infos.emplace(handle, std::move(info));
+
+	*pHandle = handle;
+	return D3D_OK;
+}
 
-	memcpy(ptr, pVertexStreamZeroData, vertex_buffer_size);
+void Direct3DDevice8::create_translated_vertex_shader(VertexShaderInfo& info)
+{
+	const std::span<const DWORD> function(info.function);
 
-	up_vertex_buffer->Unlock();
+	ComPtr<ID3DBlob> blob = m_shader_compiler.compile_translated(vertex_shader_hash(function, info.declaration), "vs_5_0", [&]
+	{
+		return translate_vertex_shader(function, info.declaration);
+	});
 
-	SetStreamSource(0, up_vertex_buffer.Get(), VertexStreamZeroStride);
-	SetIndices(up_index_buffer.Get(), 0);
+	ComPtr<ID3D11VertexShader> shader;
+	HRESULT hr = m_device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader);
 
-	run_draw_prologues(__FUNCTION__);
-	const auto result = DrawIndexedPrimitive(PrimitiveType, MinVertexIndex, NumVertexIndices, 0, PrimitiveCount);
-	run_draw_epilogues(__FUNCTION__);
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("vertex shader creation failed");
+	}
 
-	SetIndices(nullptr, 0);
-	SetStreamSource(0, nullptr, 0);
-	m_up_vertex_buffers.emplace_back(std::move(up_vertex_buffer));
-	m_up_index_buffers.emplace_back(std::move(up_index_buffer));
+	// the layout is validated against the inputs this function happens to read, so it isn't shared between declarations
+	const std::vector<D3D11_INPUT_ELEMENT_DESC> elements = info.declaration.shader_input_elements();
 
-	return result;
-}
+	hr = m_device->CreateInputLayout(elements.data(), static_cast<UINT>(elements.size()),
+	                                 blob->GetBufferPointer(), blob->GetBufferSize(), &info.layout);
 
-HRESULT STDMETHODCALLTYPE Direct3DDevice8::ProcessVertices(UINT SrcStartIndex, UINT DestIndex, UINT VertexCount, Direct3DVertexBuffer8* pDestBuffer, DWORD Flags)
-{
-	NOT_IMPLEMENTED_RETURN;
-}
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("CreateInputLayout failed for translated vertex shader");
+	}
 
-HRESULT STDMETHODCALLTYPE Direct3DDevice8::CreateVertexShader(const DWORD* pDeclaration, const DWORD* pFunction, DWORD* pHandle, DWORD Usage)
-{
-	NOT_IMPLEMENTED_RETURN;
+	// the translated shader writes both colors, which is all a fixed-function pixel shader needs to know about it
+	info.fvf    = D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_SPECULAR;
+	info.shader = VertexShader(std::move(shader), std::move(blob));
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetVertexShader(DWORD Handle)
 {
 	HRESULT hr;
 
+	// switching to or from a translated shader doesn't change the flags, but it does change the shaders
+	if (Handle != m_current_vertex_shader_handle)
+	{
+		m_last_shader_flags = ShaderFlags::mask;
+	}
+
 	if ((Handle & 0x80000000) == 0)
 	{
 		if ((Handle & D3DFVF_XYZRHW) && D3DFVF_XYZRHW != (Handle & (D3DFVF_XYZRHW | D3DFVF_XYZ | D3DFVF_NORMAL)))
@@ -3559,11 +3477,33 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetVertexShader(DWORD Handle)
 		m_fvf_flags = fvf;
 
 		m_current_vertex_shader_handle = 0;
+		m_current_vertex_shader_info = nullptr;
 		hr = D3D_OK;
 	}
 	else
 	{
-		NOT_IMPLEMENTED_RETURN;
+		const auto it = m_vertex_shader_infos.find(Handle);
+
+		if (it == m_vertex_shader_infos.end())
+		{
+			return D3DERR_INVALIDCALL;
+		}
+
+		const VertexShaderInfo& info = it->second;
+
+		m_shader_flags &= ~ShaderFlags::fvf_mask;
+		m_shader_flags |= info.fvf;
+		m_fvf_flags = info.fvf;
+
+		m_current_vertex_shader_handle = Handle;
+		m_current_vertex_shader_info = &info;
+
+		for (const VertexDeclaration::Constant& constant : info.declaration.get_constants())
+		{
+			SetVertexShaderConstant(constant.index, constant.value.data(), 1);
+		}
+
+		hr = D3D_OK;
 	}
 
 	return hr;
@@ -3582,119 +3522,122 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetVertexShader(DWORD* pHandle)
 		return D3D_OK;
 	}
 
-	NOT_IMPLEMENTED_RETURN;
+	*pHandle = m_current_vertex_shader_handle;
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::DeleteVertexShader(DWORD Handle)
 {
-#if 1
-	NOT_IMPLEMENTED_RETURN;
-#else
-	if ((Handle & 0x80000000) == 0)
+	const auto it = m_vertex_shader_infos.find(Handle);
+
+	if (it == m_vertex_shader_infos.end())
 	{
 		return D3DERR_INVALIDCALL;
 	}
 
-	if (CurrentVertexShaderHandle == Handle)
+	if (m_current_vertex_shader_handle == Handle)
 	{
 		SetVertexShader(0);
 	}
 
-	const DWORD HandleMagic = Handle << 1;
-	VertexShaderInfo *const ShaderInfo = reinterpret_cast<VertexShaderInfo *>(HandleMagic);
-
-	if (ShaderInfo->Shader != nullptr)
-	{
-		ShaderInfo->Shader->Release();
-	}
-	if (ShaderInfo->Declaration != nullptr)
-	{
-		ShaderInfo->Declaration->Release();
-	}
-
-	delete ShaderInfo;
-
+	m_vertex_shader_infos.erase(it);
 	return D3D_OK;
-#endif
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetVertexShaderConstant(DWORD Register, const void* pConstantData, DWORD ConstantCount)
 {
-	NOT_IMPLEMENTED_RETURN;
+	if (pConstantData == nullptr || !m_vs_constants.contains(Register, ConstantCount))
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	m_vs_constants.set(Register, pConstantData, ConstantCount);
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetVertexShaderConstant(DWORD Register, void* pConstantData, DWORD ConstantCount)
 {
-	NOT_IMPLEMENTED_RETURN;
+	if (pConstantData == nullptr || !m_vs_constants.contains(Register, ConstantCount))
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	m_vs_constants.get(Register, pConstantData, ConstantCount);
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetVertexShaderDeclaration(DWORD Handle, void* pData, DWORD* pSizeOfData)
 {
-	UNREFERENCED_PARAMETER(Handle);
-	UNREFERENCED_PARAMETER(pData);
-	UNREFERENCED_PARAMETER(pSizeOfData);
+	const auto it = m_vertex_shader_infos.find(Handle);
+
+	if (it == m_vertex_shader_infos.end())
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-	return D3DERR_INVALIDCALL;
+	return copy_vertex_shader_tokens(it->second.declaration.get_tokens(), pData, pSizeOfData);
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetVertexShaderFunction(DWORD Handle, void* pData, DWORD* pSizeOfData)
 {
-#if 1
-	NOT_IMPLEMENTED_RETURN;
-#else
-	if ((Handle & 0x80000000) == 0)
+	const auto it = m_vertex_shader_infos.find(Handle);
+
+	if (it == m_vertex_shader_infos.end())
 	{
 		return D3DERR_INVALIDCALL;
 	}
 
-	const DWORD HandleMagic = Handle << 1;
-	IDirect3DVertexShader9 *VertexShaderInterface = reinterpret_cast<VertexShaderInfo *>(HandleMagic)->Shader;
+	return copy_vertex_shader_tokens(it->second.function, pData, pSizeOfData);
+}
 
-	if (VertexShaderInterface == nullptr)
+HRESULT Direct3DDevice8::copy_vertex_shader_tokens(const std::vector<DWORD>& tokens, void* pData, DWORD* pSizeOfData)
+{
+	if (pSizeOfData == nullptr)
 	{
 		return D3DERR_INVALIDCALL;
 	}
 
-	return VertexShaderInterface->GetFunction(pData, reinterpret_cast<UINT *>(pSizeOfData));
-#endif
-}
-
-HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetStreamSource(UINT StreamNumber, Direct3DVertexBuffer8* pStreamData, UINT Stride)
-{
-	const StreamPair pair = { pStreamData, pStreamData ? Stride : 0 };
-	auto it = m_stream_sources.find(StreamNumber);
+	const auto size = static_cast<DWORD>(tokens.size() * sizeof(DWORD));
 
-	if (it == m_stream_sources.end())
+	if (pData == nullptr)
 	{
-		m_stream_sources[StreamNumber] = pair;
-		// TODO: just use ComPtr in StreamPair
-		safe_addref(pStreamData);
+		*pSizeOfData = size;
+		return D3D_OK;
 	}
-	else
-	{
-		if (it->second == pair)
-		{
-			return D3D_OK;
-		}
-
-		// TODO: just use ComPtr in StreamPair
-		safe_addref(pStreamData);
 
-		safe_release(&it->second.buffer);
-		it->second = pair;
+	if (*pSizeOfData < size)
+	{
+		*pSizeOfData = size;
+		return D3DERR_MOREDATA;
 	}
 
-	if (pStreamData == nullptr)
+	memcpy(pData, tokens.data(), size);
+	*pSizeOfData = size;
+	return D3D_OK;
+}
+
+HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetStreamSource(UINT StreamNumber, Direct3DVertexBuffer8* pStreamData, UINT Stride)
+{
+	if (StreamNumber >= STREAM_SOURCE_MAX)
 	{
-		m_context->IASetVertexBuffers(StreamNumber, 0, nullptr, nullptr, nullptr);
+		return D3DERR_INVALIDCALL;
 	}
-	else
+
+	const StreamPair pair = { pStreamData, pStreamData ? Stride : 0 };
+	StreamPair& stream = m_stream_sources[StreamNumber];
+
+	if (stream == pair)
 	{
-		UINT zero = 0;
-		ID3D11Buffer* buffer_resource = pStreamData->get_native_buffer();
-		m_context->IASetVertexBuffers(StreamNumber, 1, &buffer_resource, &Stride, &zero);
+		return D3D_OK;
 	}
 
+	// TODO: just use ComPtr in StreamPair
+	safe_addref(pStreamData);
+
+	safe_release(&stream.buffer);
+	stream = pair;
+
+	m_dirty_stream_sources |= 1u << StreamNumber;
 	return D3D_OK;
 }
 
@@ -3712,16 +3655,21 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetStreamSource(UINT StreamNumber, Di
 		*pStride = 0;
 	}
 
-	auto it = m_stream_sources.find(StreamNumber);
+	if (StreamNumber >= STREAM_SOURCE_MAX)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	const StreamPair& stream = m_stream_sources[StreamNumber];
 
-	if (it != m_stream_sources.end() && it->second.buffer)
+	if (stream.buffer)
 	{
-		*ppStreamData = it->second.buffer;
-		it->second.buffer->AddRef();
+		*ppStreamData = stream.buffer;
+		stream.buffer->AddRef();
 
 		if (pStride)
 		{
-			*pStride = it->second.stride;
+			*pStride = stream.stride;
 		}
 	}
 
@@ -3780,37 +3728,137 @@ HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetIndices(Direct3DIndexBuffer8** ppI
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::CreatePixelShader(const DWORD* pFunction, DWORD* pHandle)
 {
-	return D3DERR_INVALIDCALL;
+	if (pFunction == nullptr || pHandle == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	PixelShaderInfo info;
+
+	try
+	{
+		info.function.assign(pFunction, pFunction + shader_token_count(pFunction));
+		info.shader = create_translated_pixel_shader(info.function);
+	}
+	catch (std::exception& ex)
+	{
+		const std::string str = std::format(__FUNCTION__ ": {}\n", ex.what());
+		OutputDebugStringA(str.c_str());
+		return D3DERR_INVALIDCALL;
+	}
+
+	const DWORD handle = m_next_pixel_shader_handle++;
+	m_pixel_shader_infos.emplace(handle, std::move(info));
+
+	*pHandle = handle;
+	return D3D_OK;
+}
+
+PixelShader Direct3DDevice8::create_translated_pixel_shader(std::span<const DWORD> function)
+{
+	ComPtr<ID3DBlob> blob = m_shader_compiler.compile_translated(pixel_shader_hash(function), "ps_5_0", [&]
+	{
+		return translate_pixel_shader(function);
+	});
+
+	ComPtr<ID3D11PixelShader> shader;
+	const HRESULT hr = m_device->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("pixel shader creation failed");
+	}
+
+	return PixelShader(std::move(shader), std::move(blob));
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetPixelShader(DWORD Handle)
 {
-	NOT_IMPLEMENTED_RETURN;
+	const PixelShaderInfo* info = nullptr;
+
+	if (Handle != 0)
+	{
+		const auto it = m_pixel_shader_infos.find(Handle);
+
+		if (it == m_pixel_shader_infos.end())
+		{
+			return D3DERR_INVALIDCALL;
+		}
+
+		info = &it->second;
+	}
+
+	if (Handle != m_current_pixel_shader_handle)
+	{
+		m_last_shader_flags = ShaderFlags::mask;
+	}
+
+	m_current_pixel_shader_handle = Handle;
+	m_current_pixel_shader_info = info;
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetPixelShader(DWORD* pHandle)
 {
-	NOT_IMPLEMENTED_RETURN;
+	if (pHandle == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	*pHandle = m_current_pixel_shader_handle;
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::DeletePixelShader(DWORD Handle)
 {
-	NOT_IMPLEMENTED_RETURN;
+	const auto it = m_pixel_shader_infos.find(Handle);
+
+	if (it == m_pixel_shader_infos.end())
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	if (m_current_pixel_shader_handle == Handle)
+	{
+		SetPixelShader(0);
+	}
+
+	m_pixel_shader_infos.erase(it);
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::SetPixelShaderConstant(DWORD Register, const void* pConstantData, DWORD ConstantCount)
 {
-	NOT_IMPLEMENTED_RETURN;
+	if (pConstantData == nullptr || !m_ps_constants.contains(Register, ConstantCount))
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	m_ps_constants.set(Register, pConstantData, ConstantCount);
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetPixelShaderConstant(DWORD Register, void* pConstantData, DWORD ConstantCount)
 {
-	NOT_IMPLEMENTED_RETURN;
+	if (pConstantData == nullptr || !m_ps_constants.contains(Register, ConstantCount))
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	m_ps_constants.get(Register, pConstantData, ConstantCount);
+	return D3D_OK;
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::GetPixelShaderFunction(DWORD Handle, void* pData, DWORD* pSizeOfData)
 {
-	return D3DERR_INVALIDCALL;
+	const auto it = m_pixel_shader_infos.find(Handle);
+
+	if (it == m_pixel_shader_infos.end())
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	return copy_vertex_shader_tokens(it->second.function, pData, pSizeOfData);
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DDevice8::DrawRectPatch(UINT Handle, const float* pNumSegs, const D3DRECTPATCH_INFO* pRectPatchInfo)
@@ -3871,230 +3919,99 @@ void Direct3DDevice8::print_info_queue() const
 #endif
 }
 
-bool Direct3DDevice8::update_input_layout()
+ID3D11InputLayout* Direct3DDevice8::get_fvf_input_layout(uint32_t fvf)
 {
-	auto key = fvf_sanitize(m_shader_flags & ShaderFlags::fvf_mask);
-	DWORD fvf = key;
-	m_fvf_flags.clear();
-
-	auto it = m_fvf_layouts.find(key);
+	const auto it = m_fvf_layouts.find(fvf);
 
 	if (it != m_fvf_layouts.end())
 	{
-		m_context->IASetInputLayout(it->second.Get());
-		return true;
+		return it->second.Get();
 	}
 
-	if (!m_fvf_flags.data())
-	{
-		return true;
-	}
+	d3d8to11::FVFInputElements elements;
+	const size_t count = d3d8to11::fvf_input_elements(fvf, elements);
 
-	D3D11_INPUT_ELEMENT_DESC pos_element {};
-	pos_element.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	ComPtr<ID3D11InputLayout> layout;
 
-	switch (fvf & D3DFVF_POSITION_MASK)
+	try
 	{
-		case D3DFVF_XYZ:
-			pos_element.SemanticName = "POSITION";
-			pos_element.Format       = DXGI_FORMAT_R32G32B32_FLOAT;
-			break;
-
-		case D3DFVF_XYZRHW:
-			pos_element.SemanticName = "POSITION";
-			pos_element.Format       = DXGI_FORMAT_R32G32B32A32_FLOAT;
-			break;
-
-		default:
-			throw std::runtime_error("unsupported D3DFVF_POSITION type");
-	}
+		const ComPtr<ID3DBlob> signature = d3d8to11::fvf_input_signature(fvf);
 
-	D3D11_INPUT_ELEMENT_DESC elements[16] {};
+		HRESULT hr = m_device->CreateInputLayout(elements.data(), static_cast<UINT>(count),
+		                                         signature->GetBufferPointer(), signature->GetBufferSize(), &layout);
 
-	size_t i = 0;
-	fvf &= ~D3DFVF_POSITION_MASK;
-	elements[i++] = pos_element;
-
-	if (fvf & D3DFVF_NORMAL)
-	{
-		fvf ^= D3DFVF_NORMAL;
-		D3D11_INPUT_ELEMENT_DESC e {};
-
-		e.SemanticName      = "NORMAL";
-		e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-		e.Format            = DXGI_FORMAT_R32G32B32_FLOAT;
-		e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+		if (FAILED(hr))
+		{
+			throw std::runtime_error("CreateInputLayout failed");
+		}
 
-		elements[i++] = e;
+		const std::string str = std::format("Created input layout #{} for vertex format 0x{:08X}\n", m_fvf_layouts.size() + 1, fvf);
+		OutputDebugStringA(str.c_str());
 	}
-
-	if (fvf & D3DFVF_DIFFUSE)
+	catch (std::exception& ex)
 	{
-		fvf ^= D3DFVF_DIFFUSE;
-		D3D11_INPUT_ELEMENT_DESC e {};
-
-		e.SemanticName      = "COLOR";
-		e.SemanticIndex     = 0;
-		e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-		e.Format            = DXGI_FORMAT_B8G8R8A8_UNORM;
-		e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-		elements[i++] = e;
+		const std::string str = std::format("unable to create input layout for vertex format 0x{:08X}: {}\n", fvf, ex.what());
+		OutputDebugStringA(str.c_str());
 	}
 
-	if (fvf & D3DFVF_SPECULAR)
-	{
-		fvf ^= D3DFVF_SPECULAR;
-		D3D11_INPUT_ELEMENT_DESC e {};
-
-		e.SemanticName      = "COLOR";
-		e.SemanticIndex     = 1;
-		e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-		e.Format            = DXGI_FORMAT_B8G8R8A8_UNORM;
-		e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-		elements[i++] = e;
-	}
+	// a failure is remembered as null so that draws with this format are skipped without trying again every time
+	return m_fvf_layouts.emplace(fvf, std::move(layout)).first->second.Get();
+}
 
-	auto tex = (fvf & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT;
+ComPtr<ID3D11InputLayout> Direct3DDevice8::get_declaration_input_layout(const VertexDeclaration& declaration, DWORD fvf)
+{
+	// the FVF is derived from the elements, so they are all the layout depends on
+	const uint64_t key = declaration.layout_hash();
+	const auto it = m_declaration_layouts.find(key);
 
-	if (tex > 0)
+	if (it != m_declaration_layouts.end())
 	{
-		fvf &= ~D3DFVF_TEXCOUNT_MASK;
-
-		if (tex >= 1)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
-
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 0;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-			elements[i++] = e;
-		}
-
-		if (tex >= 2)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
-
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 1;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-			elements[i++] = e;
-		}
-
-		if (tex >= 3)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
-
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 2;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-			elements[i++] = e;
-		}
-
-		if (tex >= 4)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
-
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 3;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-			elements[i++] = e;
-		}
-
-		if (tex >= 5)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
-
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 4;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-			elements[i++] = e;
-		}
-
-		if (tex >= 6)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
-
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 5;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-
-			elements[i++] = e;
-		}
+		return it->second;
+	}
 
-		if (tex >= 7)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
+	const std::vector<D3D11_INPUT_ELEMENT_DESC> elements = declaration.fixed_function_input_elements();
+	const ComPtr<ID3DBlob> signature = d3d8to11::fvf_input_signature(fvf);
 
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 6;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+	ComPtr<ID3D11InputLayout> layout;
+	HRESULT hr = m_device->CreateInputLayout(elements.data(), static_cast<UINT>(elements.size()),
+	                                         signature->GetBufferPointer(), signature->GetBufferSize(), &layout);
 
-			elements[i++] = e;
-		}
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("CreateInputLayout failed for vertex declaration");
+	}
 
-		if (tex == 8)
-		{
-			D3D11_INPUT_ELEMENT_DESC e {};
+	const std::string str = std::format("Created input layout #{} for a vertex declaration\n", m_declaration_layouts.size() + 1);
+	OutputDebugStringA(str.c_str());
 
-			e.SemanticName      = "TEXCOORD";
-			e.SemanticIndex     = 7;
-			e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
-			e.Format            = DXGI_FORMAT_R32G32_FLOAT;
-			e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+	m_declaration_layouts.emplace(key, layout);
+	return layout;
+}
 
-			elements[i++] = e;
-		}
-	}
+bool Direct3DDevice8::update_input_layout()
+{
+	const auto fvf = static_cast<uint32_t>(fvf_sanitize(m_shader_flags & ShaderFlags::fvf_mask));
+	m_fvf_flags.clear();
 
-	if (i >= 16)
+	if (m_current_vertex_shader_info != nullptr)
 	{
-		throw;
+		m_context->IASetInputLayout(m_current_vertex_shader_info->layout.Get());
+		return true;
 	}
 
-	if (fvf != 0)
+	if (!m_fvf_flags.data() && !m_fvf_layouts.contains(fvf))
 	{
-		return false;
+		return true;
 	}
 
-	VertexShader vs = get_vertex_shader(m_shader_flags);
-
-	ComPtr<ID3D11InputLayout> layout;
-
-	HRESULT hr = m_device->CreateInputLayout(elements, static_cast<UINT>(i),
-	                                         vs.blob->GetBufferPointer(), vs.blob->GetBufferSize(), &layout);
+	ID3D11InputLayout* layout = get_fvf_input_layout(fvf);
 
-	if (FAILED(hr))
+	if (!layout)
 	{
 		return false;
 	}
 
-	m_fvf_layouts[key] = layout;
-	m_context->IASetInputLayout(layout.Get());
-
-	const std::string str = std::format("Created input layout #{}\n", m_fvf_layouts.size());
-	OutputDebugStringA(str.c_str());
-
+	m_context->IASetInputLayout(layout);
 	return true;
 }
 
@@ -4166,6 +4083,56 @@ void Direct3DDevice8::commit_per_scene()
 	m_context->Unmap(m_per_scene_cbuffer.Get(), 0);
 }
 
+void Direct3DDevice8::commit_shader_constants()
+{
+	const auto commit = [this](ID3D11Buffer* cbuffer, auto& constants, uint64_t& uploaded_version)
+	{
+		if (constants.version() == uploaded_version)
+		{
+			return;
+		}
+
+		uploaded_version = constants.version();
+
+		if (!m_constant_buffer_partial_updates)
+		{
+			constants.flush([](size_t, size_t) {});
+			m_context->UpdateSubresource(cbuffer, 0, nullptr, constants.data(), 0, 0);
+
+			m_shader_constant_stats.upload_bytes += constants.REGISTER_COUNT * constants.REGISTER_SIZE;
+			++m_shader_constant_stats.upload_ranges;
+			return;
+		}
+
+		constants.flush([&](size_t first, size_t count)
+		{
+			D3D11_BOX box {};
+
+			box.left   = static_cast<UINT>(first * constants.REGISTER_SIZE);
+			box.right  = static_cast<UINT>((first + count) * constants.REGISTER_SIZE);
+			box.bottom = 1;
+			box.back   = 1;
+
+			// the source points at the first register of the box, not the start of the buffer
+			m_context->UpdateSubresource1(cbuffer, 0, &box, &constants.data()[first], 0, 0, 0);
+
+			m_shader_constant_stats.upload_bytes += count * constants.REGISTER_SIZE;
+			++m_shader_constant_stats.upload_ranges;
+		});
+	};
+
+	// only the translated shaders read these, so they can wait until one is bound
+	if (m_current_vertex_shader_info != nullptr && m_current_vertex_shader_info->shader.has_value())
+	{
+		commit(m_vs_constant_cbuffer.Get(), m_vs_constants, m_vs_constants_uploaded_version);
+	}
+
+	if (m_current_pixel_shader_info != nullptr)
+	{
+		commit(m_ps_constant_cbuffer.Get(), m_ps_constants, m_ps_constants_uploaded_version);
+	}
+}
+
 void Direct3DDevice8::commit_per_texture()
 {
 	if (!m_per_texture.dirty())
@@ -4182,11 +4149,51 @@ void Direct3DDevice8::commit_per_texture()
 	m_context->Unmap(m_per_texture_cbuffer.Get(), 0);
 }
 
+ComPtr<ID3D11SamplerState> Direct3DDevice8::create_sampler_state(SamplerSettings::type key) const
+{
+	const SamplerSettings setting = SamplerSettings::from_key(key);
+
+	D3D11_SAMPLER_DESC sampler_desc {};
+
+	sampler_desc.Filter         = to_d3d11(setting.filter_min(), setting.filter_mag(), setting.filter_mip());
+	sampler_desc.AddressU       = static_cast<D3D11_TEXTURE_ADDRESS_MODE>(setting.address_u());
+	sampler_desc.AddressV       = static_cast<D3D11_TEXTURE_ADDRESS_MODE>(setting.address_v());
+	sampler_desc.AddressW       = static_cast<D3D11_TEXTURE_ADDRESS_MODE>(setting.address_w());
+	// D3DTSS_MAXMIPLEVEL is the index of the most detailed level to use, so it limits the LOD from below
+	sampler_desc.MinLOD         = static_cast<float>(setting.max_mip_level());
+	// without mip filtering, only that one level is used
+	sampler_desc.MaxLOD         = setting.filter_mip() == D3DTEXF_NONE ? sampler_desc.MinLOD : D3D11_FLOAT32_MAX;
+	sampler_desc.MipLODBias     = std::clamp(setting.mip_lod_bias(), D3D11_MIP_LOD_BIAS_MIN, D3D11_MIP_LOD_BIAS_MAX);
+	sampler_desc.MaxAnisotropy  = std::max(setting.max_anisotropy(), 1u);
+	sampler_desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	sampler_desc.BorderColor[0] = 1.0f;
+	sampler_desc.BorderColor[1] = 1.0f;
+	sampler_desc.BorderColor[2] = 1.0f;
+	sampler_desc.BorderColor[3] = 1.0f;
+
+	ComPtr<ID3D11SamplerState> sampler_state;
+	HRESULT hr = m_device->CreateSamplerState(&sampler_desc, &sampler_state);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("CreateSamplerState failed");
+	}
+
+	return sampler_state;
+}
+
 void Direct3DDevice8::update_sampler()
 {
-	for (auto& setting_it : m_sampler_setting_values)
+	static_assert(TEXTURE_STAGE_MAX <= 32, "texture stages must fit in m_dirty_samplers");
+
+	uint32_t changed = 0;
+
+	while (m_dirty_samplers)
 	{
-		auto& setting = setting_it.second;
+		const auto stage = static_cast<UINT>(std::countr_zero(m_dirty_samplers));
+		m_dirty_samplers &= m_dirty_samplers - 1;
+
+		auto& setting = m_sampler_setting_values[stage];
 
 		if (!setting.dirty())
 		{
@@ -4195,41 +4202,33 @@ void Direct3DDevice8::update_sampler()
 
 		setting.clear();
 
-		const auto it = m_sampler_states.find(setting);
-
-		if (it != m_sampler_states.end())
+		m_samplers[stage] = m_sampler_states.get(setting.key.data(), [this](SamplerSettings::type key)
 		{
-			m_context->PSSetSamplers(setting_it.first, 1, it->second.GetAddressOf());
-			return;
-		}
+			record_state_object_key(StateObjectType::sampler, key);
+			return create_sampler_state(key);
+		});
 
-		D3D11_SAMPLER_DESC sampler_desc {};
-
-		sampler_desc.Filter         = to_d3d11(setting.filter_min, setting.filter_mag, setting.filter_mip);;
-		sampler_desc.AddressU       = static_cast<D3D11_TEXTURE_ADDRESS_MODE>(setting.address_u.data());
-		sampler_desc.AddressV       = static_cast<D3D11_TEXTURE_ADDRESS_MODE>(setting.address_v.data());
-		sampler_desc.AddressW       = static_cast<D3D11_TEXTURE_ADDRESS_MODE>(setting.address_w.data());
-		sampler_desc.MinLOD         = -D3D11_FLOAT32_MAX; // TODO: pull from render state values
-		sampler_desc.MaxLOD         = D3D11_FLOAT32_MAX;  // TODO: pull from render state values
-		sampler_desc.MipLODBias     = 0.0f;               // TODO: pull from render state values
-		sampler_desc.MaxAnisotropy  = setting.max_anisotropy;
-		sampler_desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-		sampler_desc.BorderColor[0] = 1.0f;
-		sampler_desc.BorderColor[1] = 1.0f;
-		sampler_desc.BorderColor[2] = 1.0f;
-		sampler_desc.BorderColor[3] = 1.0f;
-
-		ComPtr<ID3D11SamplerState> sampler_state;
-		HRESULT hr = m_device->CreateSamplerState(&sampler_desc, &sampler_state);
+		changed |= 1u << stage;
+	}
 
-		if (FAILED(hr))
-		{
-			throw std::runtime_error("CreateSamplerState failed");
-		}
+	if (!changed)
+	{
+		return;
+	}
+
+	// bind everything from the first to the last changed stage at once;
+	// the context filters out the unchanged ones at either end.
+	const auto first = static_cast<UINT>(std::countr_zero(changed));
+	const auto last  = static_cast<UINT>(31 - std::countl_zero(changed));
 
-		m_context->PSSetSamplers(setting_it.first, 1, sampler_state.GetAddressOf());
-		m_sampler_states[setting] = sampler_state;
+	std::array<ID3D11SamplerState*, TEXTURE_STAGE_MAX> samplers {};
+
+	for (UINT stage = first; stage <= last; ++stage)
+	{
+		samplers[stage] = m_samplers[stage].Get();
 	}
+
+	m_context->PSSetSamplers(first, last - first + 1, &samplers[first]);
 }
 
 void Direct3DDevice8::get_shaders(ShaderFlags::type flags, VertexShader* vs, PixelShader* ps)
@@ -4240,8 +4239,16 @@ void Direct3DDevice8::get_shaders(ShaderFlags::type flags, VertexShader* vs, Pix
 	{
 		try
 		{
-			*vs = get_vertex_shader(flags);
-			*ps = get_pixel_shader(flags);
+			if (vs != nullptr)
+			{
+				*vs = get_vertex_shader(flags);
+			}
+
+			if (ps != nullptr)
+			{
+				*ps = get_pixel_shader(flags);
+			}
+
 			break;
 		}
 		catch (std::exception& ex)
@@ -4283,7 +4290,22 @@ void Direct3DDevice8::update_shaders()
 	VertexShader vs;
 	PixelShader ps;
 
-	get_shaders(m_shader_flags, &vs, &ps);
+	// translated shaders stand in for their stage, so only the other one is generated
+	const bool has_translated_vs = m_current_vertex_shader_info != nullptr && m_current_vertex_shader_info->shader.has_value();
+	const bool has_translated_ps = m_current_pixel_shader_info != nullptr;
+
+	if (has_translated_vs)
+	{
+		vs = m_current_vertex_shader_info->shader;
+	}
+
+	if (has_translated_ps)
+	{
+		ps = m_current_pixel_shader_info->shader;
+	}
+
+	m_using_fallback_shaders = false;
+	get_shaders(m_shader_flags, has_translated_vs ? nullptr : &vs, has_translated_ps ? nullptr : &ps);
 
 	if (vs != m_current_vs)
 	{
@@ -4297,30 +4319,19 @@ void Direct3DDevice8::update_shaders()
 		m_current_ps = ps;
 	}
 
-	m_last_shader_flags = m_shader_flags;
-}
-
-void Direct3DDevice8::update_blend()
-{
-	if (!m_blend_flags.dirty())
+	// a stand-in (or a skipped draw) is only good until the real uber shader is ready, so look again next time
+	if (m_using_fallback_shaders)
 	{
 		return;
 	}
 
-	m_blend_flags.clear();
-
-	const auto it = m_blend_states.find(m_blend_flags.data());
-
-	if (it != m_blend_states.end())
-	{
-		m_context->OMSetBlendState(it->second.Get(), nullptr, 0xFFFFFFFF);
-		return;
-	}
+	m_last_shader_flags = m_shader_flags;
+}
 
+ComPtr<ID3D11BlendState> Direct3DDevice8::create_blend_state(uint32_t flags) const
+{
 	D3D11_BLEND_DESC desc {};
 
-	const auto flags = m_blend_flags.data();
-
 	for (auto& rt : desc.RenderTarget)
 	{
 		rt.BlendEnable           = flags >> 15 & 1;
@@ -4341,114 +4352,317 @@ void Direct3DDevice8::update_blend()
 		throw std::runtime_error("CreateBlendState failed");
 	}
 
-	m_blend_states[flags] = blend_state;
-	m_context->OMSetBlendState(blend_state.Get(), nullptr, 0xFFFFFFFF);
+	return blend_state;
+}
+
+void Direct3DDevice8::update_blend()
+{
+	if (!m_blend_flags.dirty())
+	{
+		return;
+	}
+
+	m_blend_flags.clear();
+
+	ID3D11BlendState* blend_state = m_blend_states.get(m_blend_flags.data(), [this](uint32_t key)
+	{
+		record_state_object_key(StateObjectType::blend, key);
+		return create_blend_state(key);
+	});
+
+	m_context->OMSetBlendState(blend_state, nullptr, 0xFFFFFFFF);
+}
+
+ComPtr<ID3D11DepthStencilState> Direct3DDevice8::create_depth_stencil_state(uint64_t key) const
+{
+	const DepthStencilFlags depth_stencil_flags = DepthStencilFlags::from_key(key);
+
+	D3D11_DEPTH_STENCIL_DESC depth_desc {};
+
+	const auto& flags = depth_stencil_flags.flags.data();
+
+	depth_desc.DepthEnable    = !!(flags & DepthStencilFlags::depth_test_enabled);
+	depth_desc.DepthWriteMask = (flags & DepthStencilFlags::depth_write_enabled) ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO;
+	depth_desc.StencilEnable  = !!(flags & DepthStencilFlags::stencil_enabled);
+
+	const auto& depth_flags = depth_stencil_flags.depth_flags.data();
+	depth_desc.DepthFunc = static_cast<D3D11_COMPARISON_FUNC>(depth_flags & DepthFlags::comparison_mask);
+
+	if (depth_desc.StencilEnable)
+	{
+		const auto& stencil_flags = depth_stencil_flags.stencil_flags.data();
+		D3D11_DEPTH_STENCILOP_DESC stencil_desc;
+
+		stencil_desc.StencilFailOp      = static_cast<D3D11_STENCIL_OP>((stencil_flags >> StencilFlags::fail_shift) & StencilFlags::op_mask);
+		stencil_desc.StencilDepthFailOp = static_cast<D3D11_STENCIL_OP>((stencil_flags >> StencilFlags::zfail_shift) & StencilFlags::op_mask);
+		stencil_desc.StencilPassOp      = static_cast<D3D11_STENCIL_OP>((stencil_flags >> StencilFlags::pass_shift) & StencilFlags::op_mask);
+		stencil_desc.StencilFunc        = static_cast<D3D11_COMPARISON_FUNC>((stencil_flags >> StencilFlags::func_shift) & StencilFlags::op_mask);
+
+		depth_desc.StencilReadMask  = (stencil_flags >> StencilFlags::read_shift) & StencilFlags::rw_mask;
+		depth_desc.StencilWriteMask = (stencil_flags >> StencilFlags::write_shift) & StencilFlags::rw_mask;
+
+		depth_desc.FrontFace = stencil_desc;
+		depth_desc.BackFace  = stencil_desc;
+	}
+	else
+	{
+		depth_desc.FrontFace = {
+			D3D11_STENCIL_OP_KEEP,
+			D3D11_STENCIL_OP_KEEP,
+			D3D11_STENCIL_OP_KEEP,
+			D3D11_COMPARISON_ALWAYS
+		};
+
+		depth_desc.BackFace = {
+			D3D11_STENCIL_OP_KEEP,
+			D3D11_STENCIL_OP_KEEP,
+			D3D11_STENCIL_OP_KEEP,
+			D3D11_COMPARISON_ALWAYS
+		};
+	}
+
+	ComPtr<ID3D11DepthStencilState> depth_state;
+	if (FAILED(m_device->CreateDepthStencilState(&depth_desc, &depth_state)))
+	{
+		throw std::runtime_error("Failed to create depth stencil!");
+	}
+
+	return depth_state;
 }
 
 void Direct3DDevice8::update_depth()
 {
 	auto& stencilref = m_render_state_values[D3DRS_STENCILREF];
 
-	if (!m_depth_stencil_flags.dirty() && !stencilref.dirty())
+	if (!m_depth_stencil_flags.dirty() && !stencilref.dirty())
+	{
+		return;
+	}
+
+	m_depth_stencil_flags.clear();
+	stencilref.clear();
+
+	ID3D11DepthStencilState* depth_state = m_depth_states.get(m_depth_stencil_flags.to_key(), [this](uint64_t key)
+	{
+		record_state_object_key(StateObjectType::depth_stencil, key);
+		return create_depth_stencil_state(key);
+	});
+
+	m_context->OMSetDepthStencilState(depth_state, stencilref.data());
+}
+
+ComPtr<ID3D11RasterizerState> Direct3DDevice8::create_rasterizer_state(uint32_t flags) const
+{
+	D3D11_RASTERIZER_DESC raster {};
+
+	raster.FillMode        = static_cast<D3D11_FILL_MODE>((flags >> 2) & 3);
+	raster.CullMode        = static_cast<D3D11_CULL_MODE>(flags & 3);
+	raster.DepthClipEnable = TRUE;
+
+	ComPtr<ID3D11RasterizerState> raster_state;
+	if (FAILED(m_device->CreateRasterizerState(&raster, &raster_state)))
+	{
+		throw std::runtime_error("failed to create rasterizer state");
+	}
+
+	return raster_state;
+}
+
+void Direct3DDevice8::update_rasterizers()
+{
+	if (!m_raster_flags.dirty())
+	{
+		return;
+	}
+
+	m_raster_flags.clear();
+
+	ID3D11RasterizerState* raster_state = m_raster_states.get(m_raster_flags.data(), [this](uint32_t key)
+	{
+		record_state_object_key(StateObjectType::rasterizer, key);
+		return create_rasterizer_state(key);
+	});
+
+	m_context->RSSetState(raster_state);
+}
+
+void Direct3DDevice8::load_state_object_keys()
+{
+	const std::filesystem::path& path = d3d8to11::config->get_state_object_keys_file_path();
+
+	flush_state_object_keys();
+	m_state_object_keys_file.close();
+
+	if (path.empty())
+	{
+		return;
+	}
+
+	std::vector<StateObjectKeyRecord> records;
+
+	if (std::filesystem::exists(path))
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+		const auto size = static_cast<size_t>(file.tellg());
+		file.seekg(0);
+
+		records.resize(size / sizeof(StateObjectKeyRecord));
+		file.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(StateObjectKeyRecord)));
+	}
+
+	for (const StateObjectKeyRecord& record : records)
+	{
+		try
+		{
+			switch (record.type)
+			{
+				case StateObjectType::blend:
+					m_blend_states.prewarm(static_cast<uint32_t>(record.key), [this](uint32_t key)
+					{
+						return create_blend_state(key);
+					});
+					break;
+
+				case StateObjectType::depth_stencil:
+					m_depth_states.prewarm(record.key, [this](uint64_t key)
+					{
+						return create_depth_stencil_state(key);
+					});
+					break;
+
+				case StateObjectType::rasterizer:
+					m_raster_states.prewarm(static_cast<uint32_t>(record.key), [this](uint32_t key)
+					{
+						return create_rasterizer_state(key);
+					});
+					break;
+
+				case StateObjectType::sampler:
+					m_sampler_states.prewarm(record.key, [this](SamplerSettings::type key)
+					{
+						return create_sampler_state(key);
+					});
+					break;
+
+				default:
+					// unknown; dropped when the file is compacted below
+					break;
+			}
+		}
+		catch (std::exception& ex)
+		{
+			OutputDebugStringA(std::format("skipping state object key 0x{:016X} of type {}: {}\n",
+			                               record.key, static_cast<uint32_t>(record.type), ex.what()).c_str());
+		}
+	}
+
+	const size_t cached_count = m_blend_states.size() + m_depth_states.size() + m_raster_states.size() + m_sampler_states.size();
+
+	OutputDebugStringA(std::format("pre-warmed {} state objects from {} recorded keys\n", cached_count, records.size()).c_str());
+
+	// every key is recorded on its first miss, so duplicates pile up only if a cache evicted it at some point;
+	// rewrite the file with just what is cached now so it doesn't grow without bound across runs.
+	if (cached_count != records.size())
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+		const auto write_keys = [&](StateObjectType type, const auto& cache)
+		{
+			cache.for_each_key([&](const auto& key)
+			{
+				const StateObjectKeyRecord record { type, 0, static_cast<uint64_t>(key) };
+				file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+			});
+		};
+
+		write_keys(StateObjectType::blend, m_blend_states);
+		write_keys(StateObjectType::depth_stencil, m_depth_states);
+		write_keys(StateObjectType::rasterizer, m_raster_states);
+		write_keys(StateObjectType::sampler, m_sampler_states);
+	}
+
+	m_state_object_keys_file.open(path, std::ios::binary | std::ios::app);
+}
+
+void Direct3DDevice8::record_state_object_key(StateObjectType type, uint64_t key)
+{
+	if (!m_state_object_keys_file.is_open())
 	{
 		return;
 	}
 
-	m_depth_stencil_flags.clear();
-	stencilref.clear();
-
-	const auto it = m_depth_states.find(m_depth_stencil_flags);
+	m_pending_state_object_keys.push_back({ type, 0, key });
+}
 
-	if (it != m_depth_states.end())
+void Direct3DDevice8::flush_state_object_keys()
+{
+	if (m_pending_state_object_keys.empty())
 	{
-		m_context->OMSetDepthStencilState(it->second.Get(), stencilref.data());
 		return;
 	}
 
-	D3D11_DEPTH_STENCIL_DESC depth_desc {};
-
-	const auto& flags = m_depth_stencil_flags.flags.data();
-
-	depth_desc.DepthEnable    = !!(flags & DepthStencilFlags::depth_test_enabled);
-	depth_desc.DepthWriteMask = (flags & DepthStencilFlags::depth_write_enabled) ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO;
-	depth_desc.StencilEnable  = !!(flags & DepthStencilFlags::stencil_enabled);
-
-	const auto& depth_flags = m_depth_stencil_flags.depth_flags.data();
-	depth_desc.DepthFunc = static_cast<D3D11_COMPARISON_FUNC>(depth_flags & DepthFlags::comparison_mask);
-
-	if (depth_desc.StencilEnable)
+	if (m_state_object_keys_file.is_open())
 	{
-		const auto& stencil_flags = m_depth_stencil_flags.stencil_flags.data();
-		D3D11_DEPTH_STENCILOP_DESC stencil_desc;
+		m_state_object_keys_file.write(reinterpret_cast<const char*>(m_pending_state_object_keys.data()),
+		                               static_cast<std::streamsize>(m_pending_state_object_keys.size() * sizeof(StateObjectKeyRecord)));
+		m_state_object_keys_file.flush();
+	}
 
-		stencil_desc.StencilFailOp      = static_cast<D3D11_STENCIL_OP>((stencil_flags >> StencilFlags::fail_shift) & StencilFlags::op_mask);
-		stencil_desc.StencilDepthFailOp = static_cast<D3D11_STENCIL_OP>((stencil_flags >> StencilFlags::zfail_shift) & StencilFlags::op_mask);
-		stencil_desc.StencilPassOp      = static_cast<D3D11_STENCIL_OP>((stencil_flags >> StencilFlags::pass_shift) & StencilFlags::op_mask);
-		stencil_desc.StencilFunc        = static_cast<D3D11_COMPARISON_FUNC>((stencil_flags >> StencilFlags::func_shift) & StencilFlags::op_mask);
+	m_pending_state_object_keys.clear();
+}
 
-		depth_desc.StencilReadMask  = (stencil_flags >> StencilFlags::read_shift) & StencilFlags::rw_mask;
-		depth_desc.StencilWriteMask = (stencil_flags >> StencilFlags::write_shift) & StencilFlags::rw_mask;
+void Direct3DDevice8::commit_textures()
+{
+	static_assert(TEXTURE_STAGE_MAX <= 32, "texture stages must fit in m_dirty_texture_stages");
 
-		depth_desc.FrontFace = stencil_desc;
-		depth_desc.BackFace  = stencil_desc;
-	}
-	else
+	if (!m_dirty_texture_stages)
 	{
-		depth_desc.FrontFace = {
-			D3D11_STENCIL_OP_KEEP,
-			D3D11_STENCIL_OP_KEEP,
-			D3D11_STENCIL_OP_KEEP,
-			D3D11_COMPARISON_ALWAYS
-		};
-
-		depth_desc.BackFace = {
-			D3D11_STENCIL_OP_KEEP,
-			D3D11_STENCIL_OP_KEEP,
-			D3D11_STENCIL_OP_KEEP,
-			D3D11_COMPARISON_ALWAYS
-		};
+		return;
 	}
 
-	ComPtr<ID3D11DepthStencilState> depth_state;
-	if (FAILED(m_device->CreateDepthStencilState(&depth_desc, &depth_state)))
+	std::array<ID3D11ShaderResourceView*, TEXTURE_STAGE_MAX> srvs {};
+
+	for_each_bit_range(m_dirty_texture_stages, [&](UINT first, UINT count)
 	{
-		throw std::runtime_error("Failed to create depth stencil!");
-	}
+		for (UINT stage = first; stage < first + count; ++stage)
+		{
+			srvs[stage] = m_textures[stage] ? m_textures[stage]->get_native_srv() : nullptr;
+		}
 
-	m_context->OMSetDepthStencilState(depth_state.Get(), stencilref.data());
-	m_depth_states[m_depth_stencil_flags] = std::move(depth_state);
+		m_context->PSSetShaderResources(first, count, &srvs[first]);
+	});
+
+	m_dirty_texture_stages = 0;
 }
 
-void Direct3DDevice8::update_rasterizers()
+void Direct3DDevice8::commit_stream_sources()
 {
-	if (!m_raster_flags.dirty())
+	static_assert(STREAM_SOURCE_MAX <= 32, "stream sources must fit in m_dirty_stream_sources");
+
+	if (!m_dirty_stream_sources)
 	{
 		return;
 	}
 
-	m_raster_flags.clear();
-	const auto it = m_raster_states.find(m_raster_flags);
+	std::array<ID3D11Buffer*, STREAM_SOURCE_MAX> buffers {};
+	std::array<UINT, STREAM_SOURCE_MAX> strides {};
+	const std::array<UINT, STREAM_SOURCE_MAX> offsets {};
 
-	if (it != m_raster_states.end())
+	for_each_bit_range(m_dirty_stream_sources, [&](UINT first, UINT count)
 	{
-		m_context->RSSetState(it->second.Get());
-		return;
-	}
-
-	D3D11_RASTERIZER_DESC raster {};
+		for (UINT stream = first; stream < first + count; ++stream)
+		{
+			const StreamPair& pair = m_stream_sources[stream];
 
-	raster.FillMode        = static_cast<D3D11_FILL_MODE>((m_raster_flags.data() >> 2) & 3);
-	raster.CullMode        = static_cast<D3D11_CULL_MODE>(m_raster_flags.data() & 3);
-	raster.DepthClipEnable = TRUE;
+			buffers[stream] = pair.buffer ? pair.buffer->get_native_buffer() : nullptr;
+			strides[stream] = pair.stride;
+		}
 
-	ComPtr<ID3D11RasterizerState> raster_state;
-	if (FAILED(m_device->CreateRasterizerState(&raster, &raster_state)))
-	{
-		throw std::runtime_error("failed to create rasterizer state");
-	}
+		m_context->IASetVertexBuffers(first, count, &buffers[first], &strides[first], &offsets[first]);
+	});
 
-	m_context->RSSetState(raster_state.Get());
-	m_raster_states.emplace(m_raster_flags, std::move(raster_state));
+	m_dirty_stream_sources = 0;
 }
 
 bool Direct3DDevice8::update()
@@ -4462,6 +4676,9 @@ bool Direct3DDevice8::update()
 	commit_per_texture();
 	commit_per_model();
 	commit_per_pixel();
+	commit_shader_constants();
+	commit_textures();
+	commit_stream_sources();
 
 	if (skip_draw())
 	{
@@ -4478,7 +4695,10 @@ bool Direct3DDevice8::skip_draw() const
 
 void Direct3DDevice8::free_shaders()
 {
+	// drop every compile that hasn't started yet; only the ones already running have to finish
+	m_shader_compile_token.cancel();
 	m_thread_pool.wait();
+	m_shader_compile_token = CancellationToken::create();
 
 	m_last_shader_flags = ShaderFlags::mask;
 
@@ -4490,22 +4710,18 @@ void Direct3DDevice8::free_shaders()
 	m_uber_vertex_shaders.clear();
 	m_uber_pixel_shaders.clear();
 
-	for (auto& future : m_compiling_vertex_shaders | std::views::values)
-	{
-		future.wait();
-	}
-
-	for (auto& future : m_compiling_pixel_shaders | std::views::values)
-	{
-		future.wait();
-	}
-
 	m_compiling_vertex_shaders.clear();
 	m_compiling_pixel_shaders.clear();
-
+	m_compiling_uber_vertex_shaders.clear();
+	m_compiling_uber_pixel_shaders.clear();
+	m_failed_uber_vertex_shaders.clear();
+	m_failed_uber_pixel_shaders.clear();
+	m_pending_uber_shader_count = 0;
+	m_uber_compile_reported = true;
+
+	m_shader_cache.flush();
 	m_shader_includer.clear_shader_source_cache();
-
-	m_fvf_layouts.clear();
+	m_shader_cache.prime_sources();
 
 	for (auto& value : m_render_state_values)
 	{
@@ -4515,11 +4731,13 @@ void Direct3DDevice8::free_shaders()
 	m_depth_stencil_flags.mark();
 	m_blend_flags.mark();
 
-	for (auto& pair : m_sampler_setting_values)
+	for (auto& setting : m_sampler_setting_values)
 	{
-		pair.second.mark();
+		setting.mark();
 	}
 
+	m_dirty_samplers = (1u << TEXTURE_STAGE_MAX) - 1;
+
 	m_uber_shader_flags.mark();
 	m_per_model.mark();
 	m_per_pixel.mark();
@@ -4624,9 +4842,12 @@ void Direct3DDevice8::oit_write()
 {
 	// Unbinds the shader resource views for our fragment list and list head.
 	// UAVs cannot be bound as standard resource views and UAVs simultaneously.
-	const std::array<ID3D11ShaderResourceView*, 5> srvs {};
+	const std::array<ID3D11ShaderResourceView*, OIT_SHADER_RESOURCE_COUNT> srvs {};
 	m_context->PSSetShaderResources(0, static_cast<UINT>(srvs.size()), &srvs[0]);
 
+	// ...which are shared with the first texture stages, so those need to be bound again.
+	m_dirty_texture_stages |= (1u << OIT_SHADER_RESOURCE_COUNT) - 1;
+
 	const std::array uavs = {
 		m_oit_frag_list_head_uav.Get(),
 		m_oit_frag_list_count_uav.Get(),
@@ -4659,7 +4880,7 @@ void Direct3DDevice8::oit_read() const
 	// Unbinds our UAVs.
 	m_context->OMSetRenderTargetsAndUnorderedAccessViews(1, m_render_target_view.GetAddressOf(), nullptr, 1, static_cast<UINT>(uavs.size()), &uavs[0], nullptr);
 
-	const std::array srvs {
+	const std::array<ID3D11ShaderResourceView*, OIT_SHADER_RESOURCE_COUNT> srvs {
 		m_oit_frag_list_head_srv.Get(),
 		m_oit_frag_list_count_srv.Get(),
 		m_oit_frag_list_nodes_srv.Get(),
@@ -4816,23 +5037,19 @@ void Direct3DDevice8::oit_frag_list_nodes_init()
 
 ComPtr<Direct3DVertexBuffer8> Direct3DDevice8::get_user_primitive_vertex_buffer(size_t target_size)
 {
-	ComPtr<Direct3DVertexBuffer8> up_buffer;
-	const size_t rounded = round_pow2(target_size);
+	ComPtr<Direct3DVertexBuffer8> up_buffer = m_up_vertex_pool.acquire(target_size);
 
-	for (auto it = m_up_vertex_buffers.begin(); it != m_up_vertex_buffers.end(); ++it)
+	if (up_buffer != nullptr)
 	{
-		if ((*it)->get_d3d8_desc().Size >= rounded && (*it)->get_d3d8_desc().Size < 2 * rounded)
-		{
-			up_buffer = std::move(*it);
-			m_up_vertex_buffers.erase(it);
-			return up_buffer;
-		}
+		return up_buffer;
 	}
 
+	const size_t rounded = round_pow2(target_size);
+
 #if _DEBUG
 	{
-		const std::string str = std::format("creating new UP vertex buffer. count: {}; target size: {}; rounded size: {}\n",
-		                                    m_up_vertex_buffers.size() + 1, target_size, rounded);
+		const std::string str = std::format("creating new UP vertex buffer. target size: {}; rounded size: {}\n",
+		                                    target_size, rounded);
 
 		OutputDebugStringA(str.c_str());
 	}
@@ -4844,33 +5061,346 @@ ComPtr<Direct3DVertexBuffer8> Direct3DDevice8::get_user_primitive_vertex_buffer(
 
 ComPtr<Direct3DIndexBuffer8> Direct3DDevice8::get_user_primitive_index_buffer(size_t target_size, D3DFORMAT format)
 {
-	ComPtr<Direct3DIndexBuffer8> up_buffer;
+	if (format != D3DFMT_INDEX16 && format != D3DFMT_INDEX32)
+	{
+		return nullptr;
+	}
+
+	ComPtr<Direct3DIndexBuffer8> up_buffer = m_up_index_pools[format == D3DFMT_INDEX16 ? 0 : 1].acquire(target_size);
+
+	if (up_buffer != nullptr)
+	{
+		return up_buffer;
+	}
+
 	const size_t rounded = round_pow2(target_size);
 
-	for (auto it = m_up_index_buffers.begin(); it != m_up_index_buffers.end(); ++it)
+#if _DEBUG
+	{
+		const std::string str = std::format("creating new UP index buffer. target size: {}; rounded size: {}\n",
+		                                    target_size, rounded);
+
+		OutputDebugStringA(str.c_str());
+	}
+#endif
+
+	CreateIndexBuffer(static_cast<UINT>(rounded), D3DUSAGE_DYNAMIC, format, D3DPOOL_DEFAULT, &up_buffer);
+	return up_buffer;
+}
+
+BYTE* Direct3DDevice8::lock_user_primitive_vertices(UINT size, UINT stride, ComPtr<Direct3DVertexBuffer8>& buffer, UINT& start_vertex)
+{
+	if (stride == 0)
+	{
+		return nullptr;
+	}
+
+	if (m_up_vertex_ring.get() == nullptr)
 	{
-		if ((*it)->get_d3d8_desc().Format != format)
+		ComPtr<Direct3DVertexBuffer8> ring_buffer;
+
+		if (SUCCEEDED(CreateVertexBuffer(UP_VERTEX_RING_SIZE, D3DUSAGE_DYNAMIC, 0, D3DPOOL_DEFAULT, &ring_buffer)))
 		{
-			continue;
+			m_up_vertex_ring.reset(std::move(ring_buffer));
 		}
+	}
+
+	if (size <= m_up_vertex_ring.capacity())
+	{
+		UINT offset = 0;
 
-		if ((*it)->get_d3d8_desc().Size >= rounded && (*it)->get_d3d8_desc().Size < 2 * rounded)
+		// aligned to the stride so that the offset can be expressed as a start vertex
+		if (BYTE* data = m_up_vertex_ring.lock(size, stride, offset))
 		{
-			up_buffer = std::move(*it);
-			m_up_index_buffers.erase(it);
-			return up_buffer;
+			buffer       = m_up_vertex_ring.get();
+			start_vertex = offset / stride;
+			return data;
 		}
 	}
 
-#if _DEBUG
+	buffer = get_user_primitive_vertex_buffer(size);
+
+	if (buffer == nullptr)
 	{
-		const std::string str = std::format("creating new UP index buffer. count: {}; target size: {}; rounded size: {}\n",
-		                                    m_up_index_buffers.size() + 1, target_size, rounded);
+		return nullptr;
+	}
 
-		OutputDebugStringA(str.c_str());
+	BYTE* data = nullptr;
+
+	if (FAILED(buffer->Lock(0, size, &data, D3DLOCK_DISCARD)))
+	{
+		release_user_primitive_buffer(std::move(buffer));
+		return nullptr;
 	}
-#endif
 
-	CreateIndexBuffer(static_cast<UINT>(rounded), D3DUSAGE_DYNAMIC, format, D3DPOOL_DEFAULT, &up_buffer);
-	return up_buffer;
+	start_vertex = 0;
+	return data;
+}
+
+BYTE* Direct3DDevice8::lock_user_primitive_indices(UINT size, D3DFORMAT format, ComPtr<Direct3DIndexBuffer8>& buffer, UINT& start_index)
+{
+	if (format != D3DFMT_INDEX16 && format != D3DFMT_INDEX32)
+	{
+		return nullptr;
+	}
+
+	const UINT index_size = format == D3DFMT_INDEX16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	DynamicBufferRing<Direct3DIndexBuffer8>& ring = m_up_index_rings[format == D3DFMT_INDEX16 ? 0 : 1];
+
+	if (ring.get() == nullptr)
+	{
+		ComPtr<Direct3DIndexBuffer8> ring_buffer;
+
+		if (SUCCEEDED(CreateIndexBuffer(UP_INDEX_RING_SIZE, D3DUSAGE_DYNAMIC, format, D3DPOOL_DEFAULT, &ring_buffer)))
+		{
+			ring.reset(std::move(ring_buffer));
+		}
+	}
+
+	if (size <= ring.capacity())
+	{
+		UINT offset = 0;
+
+		if (BYTE* data = ring.lock(size, index_size, offset))
+		{
+			buffer      = ring.get();
+			start_index = offset / index_size;
+			return data;
+		}
+	}
+
+	buffer = get_user_primitive_index_buffer(size, format);
+
+	if (buffer == nullptr)
+	{
+		return nullptr;
+	}
+
+	BYTE* data = nullptr;
+
+	if (FAILED(buffer->Lock(0, size, &data, D3DLOCK_DISCARD)))
+	{
+		release_user_primitive_buffer(std::move(buffer));
+		return nullptr;
+	}
+
+	start_index = 0;
+	return data;
+}
+
+ID3D11Buffer* Direct3DDevice8::get_process_vertices_staging(ComPtr<ID3D11Buffer>& buffer, UINT size, UINT cpu_access_flags) const
+{
+	if (buffer != nullptr)
+	{
+		D3D11_BUFFER_DESC desc {};
+		buffer->GetDesc(&desc);
+
+		if (desc.ByteWidth >= size)
+		{
+			return buffer.Get();
+		}
+
+		buffer.Reset();
+	}
+
+	D3D11_BUFFER_DESC desc {};
+
+	desc.ByteWidth      = static_cast<UINT>(round_pow2(size));
+	desc.Usage          = D3D11_USAGE_STAGING;
+	desc.CPUAccessFlags = cpu_access_flags;
+
+	if (FAILED(m_device->CreateBuffer(&desc, nullptr, &buffer)))
+	{
+		return nullptr;
+	}
+
+	return buffer.Get();
+}
+
+FixedFunctionState Direct3DDevice8::get_fixed_function_state() const
+{
+	FixedFunctionState state;
+
+	state.world_matrix      = m_per_model.world_matrix.data();
+	state.view_matrix       = m_per_scene.view_matrix.data();
+	state.projection_matrix = m_per_scene.projection_matrix.data();
+	state.wv_matrix_inv_t   = m_per_model.wv_matrix_inv_t.data();
+	state.view_position     = m_per_scene.view_position.data();
+
+	state.viewport_x      = m_viewport.TopLeftX;
+	state.viewport_y      = m_viewport.TopLeftY;
+	state.viewport_width  = m_viewport.Width;
+	state.viewport_height = m_viewport.Height;
+	state.viewport_min_z  = m_viewport.MinDepth;
+	state.viewport_max_z  = m_viewport.MaxDepth;
+
+	state.rs_lighting = (m_shader_flags & ShaderFlags::rs_lighting) != 0;
+	state.rs_specular = (m_shader_flags & ShaderFlags::rs_specular) != 0;
+	state.rs_fog      = (m_shader_flags & ShaderFlags::rs_fog) != 0;
+	state.rs_fog_mode = static_cast<uint32_t>((m_shader_flags & ShaderFlags::rs_fog_mode_mask) >> ShaderFlags::rs_fog_mode_shift);
+	state.fog_start   = m_per_pixel.fog_start.data();
+	state.fog_end     = m_per_pixel.fog_end.data();
+	state.fog_density = m_per_pixel.fog_density.data();
+
+	state.color_vertex    = m_per_model.color_vertex.data();
+	state.diffuse_source  = m_per_model.material_sources.diffuse.data();
+	state.specular_source = m_per_model.material_sources.specular.data();
+	state.ambient_source  = m_per_model.material_sources.ambient.data();
+	state.emissive_source = m_per_model.material_sources.emissive.data();
+	state.global_ambient  = m_per_model.ambient.data();
+	state.material        = m_per_model.material.data();
+
+	for (size_t i = 0; i < LIGHT_COUNT; ++i)
+	{
+		state.lights[i] = m_per_model.lights[i].data();
+	}
+
+	for (size_t i = 0; i < TEXTURE_STAGE_MAX; ++i)
+	{
+		state.texture_stages[i].tex_coord_index = m_per_texture.stages[i].tex_coord_index.data();
+		state.texture_stages[i].transform       = m_per_texture.stages[i].transform.data();
+	}
+
+	return state;
+}
+
+Direct3DIndexBuffer8* Direct3DDevice8::get_canonical_fan_index_buffer(size_t primitive_count)
+{
+	if (primitive_count <= m_canonical_fan_primitive_count)
+	{
+		return m_canonical_fan_index_buffer.Get();
+	}
+
+	// grow by powers of two so that a slowly growing fan doesn't rebuild it every draw
+	const size_t new_primitive_count = round_pow2(std::max<size_t>(primitive_count, 256));
+	const size_t buffer_size = 3 * new_primitive_count * sizeof(uint32_t);
+
+	if (buffer_size > std::numeric_limits<UINT>::max())
+	{
+		return nullptr;
+	}
+
+	ComPtr<Direct3DIndexBuffer8> buffer;
+
+	if (FAILED(CreateIndexBuffer(static_cast<UINT>(buffer_size), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, D3DFMT_INDEX32, D3DPOOL_DEFAULT, &buffer)))
+	{
+		return nullptr;
+	}
+
+	BYTE* data = nullptr;
+
+	if (FAILED(buffer->Lock(0, static_cast<UINT>(buffer_size), &data, D3DLOCK_DISCARD)))
+	{
+		return nullptr;
+	}
+
+	d3d8to11::canonical_triangle_fan(new_primitive_count, reinterpret_cast<uint32_t*>(data));
+	buffer->Unlock();
+
+	m_canonical_fan_index_buffer    = std::move(buffer);
+	m_canonical_fan_primitive_count = new_primitive_count;
+	return m_canonical_fan_index_buffer.Get();
+}
+
+HRESULT Direct3DDevice8::get_triangle_fan_list(UINT start_index, UINT primitive_count, Direct3DIndexBuffer8** list_index_buffer)
+{
+	*list_index_buffer = nullptr;
+
+	Direct3DIndexBuffer8* fan_index_buffer = m_current_index_buffer.Get();
+	const D3DINDEXBUFFER_DESC& fan_desc = fan_index_buffer->get_d3d8_desc();
+	const BYTE* fan_indices = fan_index_buffer->get_shadow_data();
+
+	if (fan_indices == nullptr)
+	{
+		// its current contents are lost, but once it has been filled completely or discarded they can be converted
+		fan_index_buffer->enable_shadow();
+
+		OutputDebugStringA("triangle fan drawn from an index buffer without a complete shadow copy; skipping until it is refilled\n");
+
+		// let's just pretend everything is fine
+		return D3D_OK;
+	}
+
+	const size_t index_size = fan_desc.Format == D3DFMT_INDEX16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	const size_t fan_index_count = static_cast<size_t>(primitive_count) + 2;
+
+	if ((static_cast<size_t>(start_index) + fan_index_count) * index_size > fan_desc.Size)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	const FanListKey key { fan_index_buffer, start_index, primitive_count };
+	FanListEntry& entry = m_fan_list_cache[key];
+
+	entry.last_used_frame = m_frame_index;
+
+	if (entry.list_buffer != nullptr && entry.generation == fan_index_buffer->get_generation())
+	{
+		*list_index_buffer = entry.list_buffer.Get();
+		return D3D_OK;
+	}
+
+	const size_t list_buffer_size = 3 * static_cast<size_t>(primitive_count) * index_size;
+
+	if (entry.list_buffer == nullptr)
+	{
+		if (FAILED(CreateIndexBuffer(static_cast<UINT>(list_buffer_size), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+		                             fan_desc.Format, D3DPOOL_DEFAULT, &entry.list_buffer)))
+		{
+			m_fan_list_cache.erase(key);
+			return D3DERR_INVALIDCALL;
+		}
+	}
+
+	BYTE* list_indices = nullptr;
+
+	if (FAILED(entry.list_buffer->Lock(0, static_cast<UINT>(list_buffer_size), &list_indices, D3DLOCK_DISCARD)))
+	{
+		m_fan_list_cache.erase(key);
+		return D3DERR_INVALIDCALL;
+	}
+
+	if (fan_desc.Format == D3DFMT_INDEX16)
+	{
+		d3d8to11::triangle_fan_to_list(reinterpret_cast<const uint16_t*>(fan_indices) + start_index, primitive_count,
+		                               reinterpret_cast<uint16_t*>(list_indices));
+	}
+	else
+	{
+		d3d8to11::triangle_fan_to_list(reinterpret_cast<const uint32_t*>(fan_indices) + start_index, primitive_count,
+		                               reinterpret_cast<uint32_t*>(list_indices));
+	}
+
+	entry.list_buffer->Unlock();
+	entry.generation = fan_index_buffer->get_generation();
+
+	*list_index_buffer = entry.list_buffer.Get();
+	return D3D_OK;
+}
+
+void Direct3DDevice8::release_user_primitive_buffer(ComPtr<Direct3DVertexBuffer8> buffer)
+{
+	if (buffer != nullptr && buffer.Get() != m_up_vertex_ring.get())
+	{
+		m_up_vertex_pool.release(std::move(buffer), m_frame_index);
+	}
+}
+
+void Direct3DDevice8::release_user_primitive_buffer(ComPtr<Direct3DIndexBuffer8> buffer)
+{
+	if (buffer == nullptr)
+	{
+		return;
+	}
+
+	for (const auto& ring : m_up_index_rings)
+	{
+		if (buffer.Get() == ring.get())
+		{
+			return;
+		}
+	}
+
+	const D3DFORMAT format = buffer->get_d3d8_desc().Format;
+	m_up_index_pools[format == D3DFMT_INDEX16 ? 0 : 1].release(std::move(buffer), m_frame_index);
 }
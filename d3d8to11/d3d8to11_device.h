@@ -1,9 +1,13 @@
 #pragma once
 
 #include <array>
+#include <bitset>
 #include <cstdint>
 #include <deque>
 #include <fstream>
+#include <functional>
+#include <span>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -13,15 +17,28 @@
 #include <dirty_t.h>
 
 #include "alignment.h"
+#include "BufferPool.h"
 #include "cbuffers.h"
+#include "ConstantRegisterFile.h"
 #include "DepthStencilFlags.h"
+#include "DynamicBufferRing.h"
+#include "hash_combine.h"
+#include "RenderStateTable.h"
 #include "SamplerSettings.h"
 #include "Shader.h"
+#include "ShaderCache.h"
+#include "ShaderCompiler.h"
 #include "ShaderFlags.h"
 #include "ShaderIncluder.h"
+#include "ShaderTranslator.h"
 #include "simple_math.h"
+#include "SoftwareVertexProcessor.h"
+#include "StateFilteringContext.h"
+#include "StateObjectCache.h"
+#include "string_util.h"
 #include "ThreadPool.h"
 #include "Unknown.h"
+#include "VertexDeclaration.h"
 
 class Direct3DBaseTexture8;
 class Direct3DIndexBuffer8;
@@ -48,17 +65,38 @@ public:
 	Direct3DDevice8& operator=(const Direct3DDevice8&)     = delete;
 	Direct3DDevice8& operator=(Direct3DDevice8&&) noexcept = delete;
 
+	enum class StateObjectType : uint32_t
+	{
+		blend,
+		depth_stencil,
+		rasterizer,
+		sampler,
+	};
+
 	Direct3DDevice8(Direct3D8* d3d, UINT adapter, D3DDEVTYPE device_type, HWND focus_window, DWORD behavior_flags, const D3DPRESENT_PARAMETERS8& parameters);
-	~Direct3DDevice8() = default;
+	~Direct3DDevice8();
 
 	[[nodiscard]] ID3D11Device* get_native_device() const
 	{
 		return m_device.Get();
 	}
 
+	/**
+	 * \brief The context the device draws with. Its state is shadowed to skip redundant changes,
+	 * so anything that binds state through it must call \c invalidate_native_context afterwards.
+	 * Draw prologues and epilogues don't need to; the device does that after running them.
+	 */
 	[[nodiscard]] ID3D11DeviceContext* get_native_context() const
 	{
-		return m_context.Get();
+		return m_context.get();
+	}
+
+	/**
+	 * \brief Makes the device rebind its state, after something else changed it through \c get_native_context.
+	 */
+	void invalidate_native_context() const
+	{
+		m_context.invalidate();
 	}
 
 	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObj) override;
@@ -160,14 +198,12 @@ public:
 	virtual HRESULT STDMETHODCALLTYPE DrawTriPatch(UINT Handle, const float* pNumSegs, const D3DTRIPATCH_INFO* pTriPatchInfo);
 	virtual HRESULT STDMETHODCALLTYPE DeletePatch(UINT Handle);
 
-	void run_draw_prologues(const std::string& callback);
-	void run_draw_epilogues(const std::string& callback);
+	void run_draw_prologues(std::string_view callback);
+	void run_draw_epilogues(std::string_view callback);
 
 	void print_info_queue() const;
 
 	[[nodiscard]] size_t count_texture_stages() const;
-	void shader_preprocess(ShaderFlags::type flags, bool is_uber, std::vector<D3D_SHADER_MACRO>& result) const;
-	[[nodiscard]] std::vector<D3D_SHADER_MACRO> shader_preprocess(ShaderFlags::type flags, bool is_uber) const;
 
 	void draw_call_increment();
 
@@ -176,6 +212,11 @@ public:
 	void store_permutation_flags(ShaderFlags::type flags);
 	[[nodiscard]] VertexShader get_vertex_shader(ShaderFlags::type flags);
 	[[nodiscard]] PixelShader get_pixel_shader(ShaderFlags::type flags);
+	void enqueue_uber_vertex_shader(ShaderFlags::type uber_flags, TaskPriority priority);
+	void enqueue_uber_pixel_shader(ShaderFlags::type uber_flags, TaskPriority priority);
+	[[nodiscard]] VertexShader get_fallback_vertex_shader(ShaderFlags::type uber_flags);
+	[[nodiscard]] PixelShader get_fallback_pixel_shader(ShaderFlags::type uber_flags);
+	void collect_uber_shaders();
 	void create_depth_stencil();
 	void create_composite_texture(D3D11_TEXTURE2D_DESC* tex_desc);
 	void create_render_target(D3D11_TEXTURE2D_DESC* tex_desc);
@@ -187,13 +228,45 @@ public:
 	void oit_start();
 	void oit_zwrite_force(DWORD* ZWRITEENABLE, DWORD* ZENABLE);
 	void oit_zwrite_restore(DWORD ZWRITEENABLE, DWORD ZENABLE);
+	/**
+	 * \brief Returns the input layout of the vertex format \p fvf, creating it if necessary,
+	 * or null if it can't be created.
+	 */
+	[[nodiscard]] ID3D11InputLayout* get_fvf_input_layout(uint32_t fvf);
+	/**
+	 * \brief Returns the input layout that feeds the elements of \p declaration to the fixed-function shaders for \p fvf,
+	 * sharing one between every declaration with the same elements.
+	 * \throws std::runtime_error if the layout can't be created.
+	 */
+	[[nodiscard]] ComPtr<ID3D11InputLayout> get_declaration_input_layout(const VertexDeclaration& declaration, DWORD fvf);
 	bool update_input_layout();
+	[[nodiscard]] PixelShader create_translated_pixel_shader(std::span<const DWORD> function);
+	void commit_shader_constants();
 	void commit_uber_shader_flags();
 	void commit_per_pixel();
 	void commit_per_model();
 	void commit_per_scene();
 	void commit_per_texture();
+	void commit_textures();
+	void commit_stream_sources();
+	[[nodiscard]] ComPtr<ID3D11BlendState> create_blend_state(uint32_t flags) const;
+	[[nodiscard]] ComPtr<ID3D11DepthStencilState> create_depth_stencil_state(uint64_t key) const;
+	[[nodiscard]] ComPtr<ID3D11RasterizerState> create_rasterizer_state(uint32_t flags) const;
+	[[nodiscard]] ComPtr<ID3D11SamplerState> create_sampler_state(SamplerSettings::type key) const;
+	void load_state_object_keys();
+	/**
+	 * \brief Queues \p key to be appended to the state object key file by the next \c flush_state_object_keys.
+	 */
+	void record_state_object_key(StateObjectType type, uint64_t key);
+	/**
+	 * \brief Appends the keys recorded since the last call to the state object key file in one write.
+	 * Called once per frame from \c Present, so cache misses mid-frame never touch the file.
+	 */
+	void flush_state_object_keys();
 	void update_sampler();
+	/**
+	 * \brief Gets the fixed-function shaders for \p flags, skipping either stage whose pointer is null.
+	 */
 	void get_shaders(ShaderFlags::type flags, VertexShader* vs, PixelShader* ps);
 	void update_shaders();
 	void update_blend();
@@ -201,6 +274,7 @@ public:
 	void update_rasterizers();
 	bool update();
 	bool skip_draw() const;
+	static HRESULT copy_vertex_shader_tokens(const std::vector<DWORD>& tokens, void* pData, DWORD* pSizeOfData);
 	void free_shaders();
 	void oit_load_shaders();
 	void oit_release();
@@ -223,12 +297,83 @@ public:
 
 	using ShaderCallback = std::function<void(const std::vector<D3D_SHADER_MACRO>&, ShaderFlags::type)>;
 
-	std::unordered_map<std::string, std::deque<ShaderCallback>> draw_prologues;
-	std::unordered_map<std::string, std::deque<ShaderCallback>> draw_epilogues;
+	// keyed with a transparent hash so that draws can look up their callbacks by string_view without allocating
+	using ShaderCallbackMap = std::unordered_map<std::string, std::deque<ShaderCallback>, d3d8to11::string_hash, std::equal_to<>>;
+
+	ShaderCallbackMap draw_prologues;
+	ShaderCallbackMap draw_epilogues;
+
+	/**
+	 * \brief Counts how draws were served while their uber shader wasn't ready.
+	 */
+	struct ShaderFallbackStats
+	{
+		size_t uber       = 0; // the uber shader itself was ready
+		size_t compatible = 0; // another compiled uber shader could stand in
+		size_t generic    = 0; // only the generic uber shader was ready
+		size_t skipped    = 0; // nothing usable was ready, so the draw was skipped
+	};
+
+	/**
+	 * \brief Called from \c Present once every uber shader precompiled at device creation is ready.
+	 */
+	std::function<void()> uber_shaders_ready;
+
+	/**
+	 * \brief Returns the number of precompiled uber shaders that are not ready yet. Safe to call from any thread.
+	 */
+	[[nodiscard]] size_t get_pending_uber_shader_count() const;
+	[[nodiscard]] const ShaderFallbackStats& get_vertex_shader_fallback_stats() const;
+	[[nodiscard]] const ShaderFallbackStats& get_pixel_shader_fallback_stats() const;
+
+	/**
+	 * \brief Pools of buffers for user primitives too large for the ring buffers; see \c BufferPool::get_stats.
+	 */
+	[[nodiscard]] const BufferPool<Direct3DVertexBuffer8>& get_user_primitive_vertex_pool() const;
+	[[nodiscard]] const BufferPool<Direct3DIndexBuffer8>& get_user_primitive_index_pool(D3DFORMAT format) const;
+
+	/**
+	 * \brief Counts of state changes forwarded to and filtered from the context during the last presented frame.
+	 */
+	[[nodiscard]] const StateFilteringContext::Stats& get_state_filter_stats() const;
+
+	/**
+	 * \brief Counts uploads of the translated shaders' constant registers.
+	 */
+	struct ShaderConstantStats
+	{
+		size_t upload_bytes  = 0; // bytes copied into the constant buffers
+		size_t upload_ranges = 0; // separate runs of registers uploaded
+	};
+
+	/**
+	 * \brief Shader constant uploads during the last presented frame.
+	 */
+	[[nodiscard]] const ShaderConstantStats& get_shader_constant_stats() const;
+
+	/**
+	 * \brief Hits, misses, evictions and creation time of the cache of the given type of state object.
+	 */
+	[[nodiscard]] const StateObjectCacheStats& get_state_object_cache_stats(StateObjectType type) const;
 
 	bool oit_enabled = false;
 
 private:
+	friend class RenderStateTable<Direct3DDevice8>;
+
+	// changes to each unhandled render state that are logged before it goes quiet
+	static constexpr uint8_t UNHANDLED_RENDER_STATE_LOG_LIMIT = 4;
+
+	/**
+	 * \brief Makes the next \c SetRenderState of any state in \p groups run its handler,
+	 * even if the value doesn't change. Needed whenever the state of those groups is reset.
+	 */
+	void forget_render_states(RenderStateGroup::type groups);
+	void log_unhandled_render_state(D3DRENDERSTATETYPE state, DWORD value);
+
+	// shader resources bound by oit_read and unbound by oit_write, starting from slot 0
+	static constexpr size_t OIT_SHADER_RESOURCE_COUNT = 5;
+
 	struct StreamPair
 	{
 		Direct3DVertexBuffer8* buffer;
@@ -241,6 +386,8 @@ private:
 		}
 	};
 
+	void run_draw_callbacks(const ShaderCallbackMap& callbacks, std::string_view callback) const;
+
 	void oit_write();
 	void oit_read() const;
 	void oit_init();
@@ -255,28 +402,26 @@ private:
 	DWORD m_behavior_flags;
 	D3DPRESENT_PARAMETERS8 m_present_params {};
 
-	std::unordered_map<size_t, std::string> m_digit_strings;
 	const std::string m_oit_fragments_str;
 
 	ThreadPool m_thread_pool;
 
 	ComPtr<ID3D11Device> m_device;
-	ComPtr<ID3D11DeviceContext> m_context;
+	// mutable because const methods bind state through it, just like they could through the ComPtr it wraps
+	mutable StateFilteringContext m_context;
 	ComPtr<ID3D11InfoQueue> m_info_queue;
 
 	ComPtr<IDXGISwapChain> m_swap_chain;
 
-	std::vector<uint32_t> m_trifan_index_buffer;
-
-	std::fstream m_permutation_cache_file;
-	std::unordered_set<ShaderFlags::type> m_permutation_flags;
-
 	bool m_freeing_shaders = false;
 
 	ShaderFlags::type m_shader_flags = ShaderFlags::none;
 	ShaderFlags::type m_last_shader_flags = ShaderFlags::mask;
 
 	ShaderIncluder m_shader_includer;
+	ShaderCache m_shader_cache;
+	ShaderCompiler m_shader_compiler;
+	CancellationToken m_shader_compile_token;
 
 	VertexShader m_current_vs;
 	PixelShader m_current_ps;
@@ -284,12 +429,26 @@ private:
 	std::unordered_map<ShaderFlags::type, VertexShader> m_vertex_shaders;
 	std::unordered_map<ShaderFlags::type, PixelShader> m_pixel_shaders;
 
-	std::unordered_map<ShaderFlags::type, std::future<VertexShader>> m_compiling_vertex_shaders;
-	std::unordered_map<ShaderFlags::type, std::future<PixelShader>>  m_compiling_pixel_shaders;
+	std::unordered_map<ShaderFlags::type, ThreadPool::Task<VertexShader>> m_compiling_vertex_shaders;
+	std::unordered_map<ShaderFlags::type, ThreadPool::Task<PixelShader>>  m_compiling_pixel_shaders;
 
 	std::unordered_map<ShaderFlags::type, VertexShader> m_uber_vertex_shaders;
 	std::unordered_map<ShaderFlags::type, PixelShader> m_uber_pixel_shaders;
 
+	std::unordered_map<ShaderFlags::type, ThreadPool::Task<VertexShader>> m_compiling_uber_vertex_shaders;
+	std::unordered_map<ShaderFlags::type, ThreadPool::Task<PixelShader>>  m_compiling_uber_pixel_shaders;
+
+	std::unordered_map<ShaderFlags::type, std::exception_ptr> m_failed_uber_vertex_shaders;
+	std::unordered_map<ShaderFlags::type, std::exception_ptr> m_failed_uber_pixel_shaders;
+
+	std::atomic_size_t m_pending_uber_shader_count { 0 };
+	std::chrono::high_resolution_clock::time_point m_uber_compile_start;
+	bool m_uber_compile_reported = true;
+	bool m_using_fallback_shaders = false;
+
+	ShaderFallbackStats m_vertex_shader_fallback_stats;
+	ShaderFallbackStats m_pixel_shader_fallback_stats;
+
 	bool m_oit_actually_enabled = false;
 
 	VertexShader m_oit_composite_vs;
@@ -323,33 +482,158 @@ private:
 	ComPtr<ID3D11ShaderResourceView>  m_oit_frag_list_nodes_srv;
 	ComPtr<ID3D11UnorderedAccessView> m_oit_frag_list_nodes_uav;
 
-	std::unordered_map<DWORD, Direct3DTexture8*> m_textures;
-	std::unordered_map<DWORD, SamplerSettings> m_sampler_setting_values;
-	std::array<dirty_t<DWORD>, 174> m_render_state_values;
-	std::unordered_map<ShaderFlags::type, ComPtr<ID3D11InputLayout>> m_fvf_layouts;
-	std::unordered_map<DWORD, StreamPair> m_stream_sources;
+	std::array<Direct3DTexture8*, TEXTURE_STAGE_MAX> m_textures {};
+	std::array<SamplerSettings, TEXTURE_STAGE_MAX> m_sampler_setting_values;
+	std::array<dirty_t<DWORD>, RENDER_STATE_COUNT> m_render_state_values;
+	// render states whose handler has run for the value in m_render_state_values
+	std::bitset<RENDER_STATE_COUNT> m_applied_render_states;
+	std::array<uint8_t, RENDER_STATE_COUNT> m_unhandled_render_state_logs {};
+	// keyed by sanitized FVF; shared by every vertex shader through a signature-only blob (see fvf_input_signature)
+	std::unordered_map<uint32_t, ComPtr<ID3D11InputLayout>> m_fvf_layouts;
+	std::array<StreamPair, STREAM_SOURCE_MAX> m_stream_sources {};
+
+	// one bit per texture stage or stream source that has changed since it was last bound
+	uint32_t m_dirty_texture_stages = 0;
+	uint32_t m_dirty_stream_sources = 0;
+	// one bit per texture stage whose sampler settings may have changed since they were last bound
+	uint32_t m_dirty_samplers = (1u << TEXTURE_STAGE_MAX) - 1;
 
 	dirty_t<uint32_t> m_raster_flags;
-	std::unordered_map<uint32_t, ComPtr<ID3D11RasterizerState>> m_raster_states;
+	StateObjectCache<uint32_t, ID3D11RasterizerState> m_raster_states;
 
-	std::unordered_map<SamplerSettings, ComPtr<ID3D11SamplerState>> m_sampler_states;
+	StateObjectCache<SamplerSettings::type, ID3D11SamplerState> m_sampler_states;
+	// what update_sampler last bound to each stage
+	std::array<ComPtr<ID3D11SamplerState>, TEXTURE_STAGE_MAX> m_samplers;
 
 	dirty_t<uint32_t> m_blend_flags;
-	std::unordered_map<uint32_t, ComPtr<ID3D11BlendState>> m_blend_states;
+	StateObjectCache<uint32_t, ID3D11BlendState> m_blend_states;
+
+	/**
+	 * \brief A key a state object was created from, recorded so that it can be created up front on the next run.
+	 */
+	struct StateObjectKeyRecord
+	{
+		StateObjectType type;
+		uint32_t reserved;
+		uint64_t key;
+	};
+
+	static_assert(sizeof(StateObjectKeyRecord) == 16, "state object key records are stored as-is");
+
+	std::ofstream m_state_object_keys_file;
+	// recorded since the last flush_state_object_keys
+	std::vector<StateObjectKeyRecord> m_pending_state_object_keys;
 
 	ComPtr<Direct3DIndexBuffer8> m_current_index_buffer = nullptr;
 
-	std::deque<ComPtr<Direct3DVertexBuffer8>> m_up_vertex_buffers;
+	// pooled buffers idle for longer than this are released
+	static constexpr uint64_t UP_POOL_MAX_IDLE_FRAMES = 300;
+
+	uint64_t m_frame_index = 0;
+
+	BufferPool<Direct3DVertexBuffer8> m_up_vertex_pool;
 	[[nodiscard]] ComPtr<Direct3DVertexBuffer8> get_user_primitive_vertex_buffer(size_t target_size);
 
-	std::deque<ComPtr<Direct3DIndexBuffer8>> m_up_index_buffers;
+	std::array<BufferPool<Direct3DIndexBuffer8>, 2> m_up_index_pools; // 16-bit, 32-bit
 	[[nodiscard]] ComPtr<Direct3DIndexBuffer8> get_user_primitive_index_buffer(size_t target_size, D3DFORMAT format);
 
+	// vertices processed per task by ProcessVertices
+	static constexpr size_t PROCESS_VERTICES_CHUNK_SIZE = 1024;
+
+	// staging copy of the source vertices of ProcessVertices, since vertex buffers can't be read from the CPU
+	ComPtr<ID3D11Buffer> m_process_vertices_readback; // the source vertices, read by the CPU
+	ComPtr<ID3D11Buffer> m_process_vertices_scratch;  // partial writes to the destination, copied over by the GPU
+	[[nodiscard]] ID3D11Buffer* get_process_vertices_staging(ComPtr<ID3D11Buffer>& buffer, UINT size, UINT cpu_access_flags) const;
+	[[nodiscard]] d3d8to11::FixedFunctionState get_fixed_function_state() const;
+
+	// triangle list indices of a fan over consecutive vertices, so that non-indexed fans are drawn with a base vertex
+	ComPtr<Direct3DIndexBuffer8> m_canonical_fan_index_buffer;
+	size_t m_canonical_fan_primitive_count = 0;
+
+	/**
+	 * \brief Returns the canonical fan index buffer, growing it first if it has fewer than \p primitive_count triangles.
+	 */
+	[[nodiscard]] Direct3DIndexBuffer8* get_canonical_fan_index_buffer(size_t primitive_count);
+
+	struct FanListKey
+	{
+		const Direct3DIndexBuffer8* buffer;
+		UINT start_index;
+		UINT primitive_count;
+
+		bool operator==(const FanListKey& other) const
+		{
+			return buffer == other.buffer &&
+			       start_index == other.start_index &&
+			       primitive_count == other.primitive_count;
+		}
+	};
+
+	struct FanListKeyHash
+	{
+		size_t operator()(const FanListKey& key) const
+		{
+			size_t h = std::hash<const Direct3DIndexBuffer8*>()(key.buffer);
+			hash_combine(h, key.start_index);
+			hash_combine(h, key.primitive_count);
+			return h;
+		}
+	};
+
+	struct FanListEntry
+	{
+		uint64_t generation = 0; // of the fan's index buffer when it was converted
+		uint64_t last_used_frame = 0;
+		ComPtr<Direct3DIndexBuffer8> list_buffer;
+	};
+
+	// converted lists unused for longer than this are released
+	static constexpr uint64_t FAN_LIST_MAX_IDLE_FRAMES = 300;
+
+	// triangle list copies of indexed fans, reconverted only when the fan's index buffer changes
+	std::unordered_map<FanListKey, FanListEntry, FanListKeyHash> m_fan_list_cache;
+
+	/**
+	 * \brief Gets the triangle list equivalent of an indexed fan drawn from the current index buffer.
+	 * \param list_index_buffer Receives the converted indices, or \c nullptr if the draw should be skipped.
+	 */
+	HRESULT get_triangle_fan_list(UINT start_index, UINT primitive_count, Direct3DIndexBuffer8** list_index_buffer);
+
+	// user primitives are suballocated from these; only draws too large for them fall back to the pools above
+	static constexpr UINT UP_VERTEX_RING_SIZE = 4 * 1024 * 1024;
+	static constexpr UINT UP_INDEX_RING_SIZE  = 1024 * 1024;
+
+	DynamicBufferRing<Direct3DVertexBuffer8> m_up_vertex_ring;
+	std::array<DynamicBufferRing<Direct3DIndexBuffer8>, 2> m_up_index_rings; // 16-bit, 32-bit
+
+	/**
+	 * \brief Locks space for \p size bytes of user primitive vertices.
+	 * \param buffer Receives the buffer to bind to stream 0.
+	 * \param start_vertex Receives the index of the first locked vertex within \p buffer.
+	 * \return The locked memory, or \c nullptr on failure.
+	 */
+	[[nodiscard]] BYTE* lock_user_primitive_vertices(UINT size, UINT stride, ComPtr<Direct3DVertexBuffer8>& buffer, UINT& start_vertex);
+
+	/**
+	 * \brief Locks space for \p size bytes of user primitive indices.
+	 * \param buffer Receives the buffer to bind with \c SetIndices.
+	 * \param start_index Receives the index of the first locked index within \p buffer.
+	 * \return The locked memory, or \c nullptr on failure.
+	 */
+	[[nodiscard]] BYTE* lock_user_primitive_indices(UINT size, D3DFORMAT format, ComPtr<Direct3DIndexBuffer8>& buffer, UINT& start_index);
+
+	/**
+	 * \brief Returns a buffer from \c lock_user_primitive_vertices or \c lock_user_primitive_indices to its pool
+	 * once the draw using it has been issued.
+	 */
+	void release_user_primitive_buffer(ComPtr<Direct3DVertexBuffer8> buffer);
+	void release_user_primitive_buffer(ComPtr<Direct3DIndexBuffer8> buffer);
+
 	dirty_t<DWORD> m_fvf_flags;
 	ComPtr<Direct3DTexture8> m_depth_stencil;
 
 	DepthStencilFlags m_depth_stencil_flags {};
-	std::unordered_map<DepthStencilFlags, ComPtr<ID3D11DepthStencilState>> m_depth_states;
+	StateObjectCache<uint64_t, ID3D11DepthStencilState> m_depth_states; // keyed by DepthStencilFlags::to_key
 
 	ComPtr<ID3D11Buffer> m_uber_shader_cbuffer;
 	ComPtr<ID3D11Buffer> m_per_scene_cbuffer;
@@ -366,7 +650,58 @@ private:
 	INT m_current_base_vertex_index = 0;
 	//const BOOL ZBufferDiscarding = FALSE;
 	DWORD m_current_vertex_shader_handle = 0;
-	//DWORD CurrentPixelShaderHandle = 0;
+
+	/**
+	 * \brief A vertex shader created with \c CreateVertexShader.
+	 */
+	struct VertexShaderInfo
+	{
+		VertexDeclaration declaration;
+		std::vector<DWORD> function; // empty for fixed-function processing
+		DWORD fvf = 0;               // what the fixed-function shaders are generated for
+		ComPtr<ID3D11InputLayout> layout;
+		VertexShader shader;         // translated from the function, if there is one
+	};
+
+	std::unordered_map<DWORD, VertexShaderInfo> m_vertex_shader_infos;
+	DWORD m_next_vertex_shader_handle = 1;
+	const VertexShaderInfo* m_current_vertex_shader_info = nullptr;
+
+	/**
+	 * \brief Translates and compiles the function of \p info and creates the input layout that feeds its declaration to it.
+	 * \throws std::runtime_error if the function can't be translated or compiled.
+	 */
+	void create_translated_vertex_shader(VertexShaderInfo& info);
+
+	// keyed by VertexDeclaration::layout_hash
+	std::unordered_map<uint64_t, ComPtr<ID3D11InputLayout>> m_declaration_layouts;
+
+	/**
+	 * \brief A pixel shader created with \c CreatePixelShader.
+	 */
+	struct PixelShaderInfo
+	{
+		std::vector<DWORD> function;
+		PixelShader shader;
+	};
+
+	std::unordered_map<DWORD, PixelShaderInfo> m_pixel_shader_infos;
+	DWORD m_next_pixel_shader_handle = 1;
+	DWORD m_current_pixel_shader_handle = 0;
+	const PixelShaderInfo* m_current_pixel_shader_info = nullptr;
+
+	// the constant registers of the translated shaders; only registers changed since the last upload are uploaded
+	ConstantRegisterFile<d3d8to11::VS_CONSTANT_REGISTER_MAX> m_vs_constants;
+	ConstantRegisterFile<d3d8to11::PS_CONSTANT_REGISTER_MAX> m_ps_constants;
+	uint64_t m_vs_constants_uploaded_version = 0;
+	uint64_t m_ps_constants_uploaded_version = 0;
+	ComPtr<ID3D11Buffer> m_vs_constant_cbuffer;
+	ComPtr<ID3D11Buffer> m_ps_constant_cbuffer;
+	// whether ranges of a constant buffer can be updated (D3D11_FEATURE_DATA_D3D11_OPTIONS::ConstantBufferPartialUpdate)
+	bool m_constant_buffer_partial_updates = false;
+	ShaderConstantStats m_shader_constant_stats;
+	ShaderConstantStats m_last_frame_shader_constant_stats;
+
 	bool m_palette_flag = false;
 
 	static constexpr size_t MAX_CLIP_PLANES = 6;
@@ -376,5 +711,4 @@ private:
 	D3D11_VIEWPORT m_viewport {};
 	D3DMATERIAL8 m_material {};
 
-	std::vector<D3D_SHADER_MACRO> m_draw_prologue_epilogue_preproc;
 };
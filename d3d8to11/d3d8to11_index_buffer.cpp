@@ -4,6 +4,10 @@
  */
 
 #include "pch.h"
+
+#include <algorithm>
+#include <atomic>
+
 #include "d3d8to11.hpp"
 #include "not_implemented.h"
 
@@ -24,6 +28,25 @@ void Direct3DIndexBuffer8::create_native()
 	}
 }
 
+namespace
+{
+std::atomic<uint64_t> g_index_buffer_generation = 0;
+
+uint64_t next_generation()
+{
+	return g_index_buffer_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+}
+
+void Direct3DIndexBuffer8::enable_shadow()
+{
+	// the contents haven't changed, and the copy can't be read back yet, so the generation stays the same
+	if (m_shadow.empty())
+	{
+		m_shadow.resize(m_desc8.Size);
+	}
+}
+
 // IDirect3DIndexBuffer8
 Direct3DIndexBuffer8::Direct3DIndexBuffer8(Direct3DDevice8* Device, UINT Length, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool)
 	: m_device8(Device)
@@ -33,6 +56,16 @@ Direct3DIndexBuffer8::Direct3DIndexBuffer8(Direct3DDevice8* Device, UINT Length,
 	m_desc8.Usage  = Usage;
 	m_desc8.Format = Format;
 	m_desc8.Pool   = Pool;
+
+	m_generation = next_generation();
+
+	// static buffers are rarely locked, so keeping a copy only costs memory,
+	// and it has to exist before they're filled for triangle fans to be drawn from them
+	if (!(Usage & D3DUSAGE_DYNAMIC))
+	{
+		enable_shadow();
+		m_shadow_valid = true;
+	}
 }
 
 HRESULT STDMETHODCALLTYPE Direct3DIndexBuffer8::QueryInterface(REFIID riid, void** ppvObj)
@@ -146,6 +179,36 @@ HRESULT STDMETHODCALLTYPE Direct3DIndexBuffer8::Lock(UINT OffsetToLock, UINT Siz
 		return D3DERR_INVALIDCALL;
 	}
 
+	if (!m_shadow.empty())
+	{
+		// writes go to the shadow and are uploaded once the last lock is released
+		if (!(Flags & D3DLOCK_READONLY))
+		{
+			// a size of 0 locks the entire buffer
+			const UINT lock_end = SizeToLock ? OffsetToLock + SizeToLock : m_desc8.Size;
+
+			if (!m_shadow_lock_write)
+			{
+				m_shadow_lock_begin = OffsetToLock;
+				m_shadow_lock_end   = lock_end;
+			}
+			else
+			{
+				m_shadow_lock_begin = std::min(m_shadow_lock_begin, OffsetToLock);
+				m_shadow_lock_end   = std::max(m_shadow_lock_end, lock_end);
+			}
+
+			m_shadow_lock_write = true;
+			m_shadow_lock_discard  |= (Flags & D3DLOCK_DISCARD) != 0;
+			m_shadow_lock_preserve |= !(Flags & (D3DLOCK_DISCARD | D3DLOCK_NOOVERWRITE));
+		}
+
+		*ppbData = m_shadow.data() + OffsetToLock;
+
+		++m_lock_count;
+		return D3D_OK;
+	}
+
 	const auto map_type = d3d8to11::d3dlock_to_map_type(Flags);
 
 	ID3D11DeviceContext* context = m_device8->get_native_context();
@@ -170,9 +233,55 @@ HRESULT STDMETHODCALLTYPE Direct3DIndexBuffer8::Unlock()
 		return D3DERR_INVALIDCALL;
 	}
 
+	--m_lock_count;
+
 	ID3D11DeviceContext* context = m_device8->get_native_context();
+
+	if (m_shadow.empty())
+	{
+		context->Unmap(m_buffer_resource.Get(), 0);
+		return D3D_OK;
+	}
+
+	if (m_lock_count || !m_shadow_lock_write)
+	{
+		return D3D_OK;
+	}
+
+	// a shadow enabled after creation matches the buffer once all of it has been written or its old contents discarded
+	if (m_shadow_lock_discard || (m_shadow_lock_begin == 0 && m_shadow_lock_end == m_desc8.Size))
+	{
+		m_shadow_valid = true;
+	}
+
+	UINT begin = m_shadow_lock_begin;
+	UINT end   = m_shadow_lock_end;
+	D3D11_MAP map_type = m_shadow_lock_discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+
+	// D3D11 can only map the whole buffer, so a plain lock that has to preserve the rest of the contents
+	// uploads the entire shadow with a discard. An incomplete shadow would replace the rest with zeros,
+	// so then only the locked range is written, without discarding.
+	if (m_shadow_lock_preserve && m_shadow_valid)
+	{
+		begin    = 0;
+		end      = m_desc8.Size;
+		map_type = D3D11_MAP_WRITE_DISCARD;
+	}
+
+	m_shadow_lock_write    = false;
+	m_shadow_lock_discard  = false;
+	m_shadow_lock_preserve = false;
+	m_generation = next_generation();
+
+	D3D11_MAPPED_SUBRESOURCE mapped_resource {};
+
+	if (FAILED(context->Map(m_buffer_resource.Get(), 0, map_type, 0, &mapped_resource)))
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	memcpy(static_cast<BYTE*>(mapped_resource.pData) + begin, m_shadow.data() + begin, end - begin);
 	context->Unmap(m_buffer_resource.Get(), 0);
-	--m_lock_count;
 
 	return D3D_OK;
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "d3d8to11_resource.h"
 
 class Direct3DDevice8;
@@ -49,10 +52,48 @@ public:
 		return m_buffer_resource.Get();
 	}
 
+	/**
+	 * \brief Keeps a system memory copy of the indices written from now on, so that they can be read back
+	 * with \c get_shadow_data. Static buffers are shadowed from creation.
+	 *
+	 * A copy made after creation doesn't know what the buffer already holds, so it can't be read back
+	 * until the whole buffer has been written or a discarding lock has been released.
+	 */
+	void enable_shadow();
+
+	/**
+	 * \brief Returns the system memory copy of the indices, or \c nullptr if the buffer isn't shadowed
+	 * or its copy doesn't match the buffer yet.
+	 */
+	[[nodiscard]] const BYTE* get_shadow_data() const
+	{
+		return m_shadow_valid ? m_shadow.data() : nullptr;
+	}
+
+	/**
+	 * \brief Changes every time the contents of a shadowed buffer change.
+	 * Unique across all index buffers, so it also tells buffers at a reused address apart.
+	 */
+	[[nodiscard]] uint64_t get_generation() const
+	{
+		return m_generation;
+	}
+
 private:
 	Direct3DDevice8* const m_device8;
 
 	size_t m_lock_count = 0;
 	ComPtr<ID3D11Buffer> m_buffer_resource;
 	D3DINDEXBUFFER_DESC m_desc8 {};
+
+	std::vector<BYTE> m_shadow;
+	bool m_shadow_valid = false; // whether m_shadow holds everything the buffer does
+	uint64_t m_generation = 0;
+
+	// union of the ranges locked since the last upload of the shadow
+	UINT m_shadow_lock_begin = 0;
+	UINT m_shadow_lock_end = 0;
+	bool m_shadow_lock_write = false;
+	bool m_shadow_lock_discard = false;
+	bool m_shadow_lock_preserve = false;
 };
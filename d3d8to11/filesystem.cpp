@@ -1,8 +1,9 @@
-#include "pch.h"
-
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
+#include <string>
+#include <type_traits>
+
 #include "filesystem.h"
 
 static_assert(std::is_same_v<std::wstring, d3d8to11::filesystem::fs_string>);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+constexpr uint64_t FNV1A_64_OFFSET = 0xCBF29CE484222325;
+constexpr uint64_t FNV1A_64_PRIME  = 0x00000100000001B3;
+
+/**
+ * \brief Computes or continues a 64-bit FNV-1a hash.
+ * \param data The bytes to hash.
+ * \param hash The hash to continue from. Defaults to the FNV-1a offset basis.
+ * \return The updated hash.
+ */
+constexpr uint64_t fnv1a_64(std::span<const uint8_t> data, uint64_t hash = FNV1A_64_OFFSET)
+{
+	for (const uint8_t byte : data)
+	{
+		hash ^= byte;
+		hash *= FNV1A_64_PRIME;
+	}
+
+	return hash;
+}
+
+inline uint64_t fnv1a_64(const void* data, size_t size, uint64_t hash = FNV1A_64_OFFSET)
+{
+	return fnv1a_64(std::span(static_cast<const uint8_t*>(data), size), hash);
+}
+
+template <typename T>
+uint64_t fnv1a_64_value(const T& value, uint64_t hash = FNV1A_64_OFFSET)
+{
+	return fnv1a_64(&value, sizeof(T), hash);
+}
@@ -0,0 +1,154 @@
+#include "pch.h"
+
+#include <d3dcompiler.h>
+
+#include "fvf_input_layout.h"
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+	struct FVFElement
+	{
+		uint32_t    flag;
+		const char* semantic_name;
+		UINT        semantic_index;
+		DXGI_FORMAT format;
+	};
+
+	// the optional components between the position and the texture coordinates, in the order they are laid out
+	constexpr std::array FVF_ELEMENTS = {
+		FVFElement { D3DFVF_NORMAL,   "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT },
+		FVFElement { D3DFVF_PSIZE,    "PSIZE",  0, DXGI_FORMAT_R32_FLOAT },
+		FVFElement { D3DFVF_DIFFUSE,  "COLOR",  0, DXGI_FORMAT_B8G8R8A8_UNORM },
+		FVFElement { D3DFVF_SPECULAR, "COLOR",  1, DXGI_FORMAT_B8G8R8A8_UNORM },
+	};
+
+	// indexed by D3DFVF_TEXTUREFORMATn
+	constexpr std::array TEXCOORD_FORMATS = {
+		DXGI_FORMAT_R32G32_FLOAT,       // D3DFVF_TEXTUREFORMAT2
+		DXGI_FORMAT_R32G32B32_FLOAT,    // D3DFVF_TEXTUREFORMAT3
+		DXGI_FORMAT_R32G32B32A32_FLOAT, // D3DFVF_TEXTUREFORMAT4
+		DXGI_FORMAT_R32_FLOAT,          // D3DFVF_TEXTUREFORMAT1
+	};
+
+	const char* hlsl_type(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+			case DXGI_FORMAT_R32_FLOAT:
+				return "float";
+
+			case DXGI_FORMAT_R32G32_FLOAT:
+				return "float2";
+
+			case DXGI_FORMAT_R32G32B32_FLOAT:
+				return "float3";
+
+			default:
+				return "float4";
+		}
+	}
+}
+
+namespace d3d8to11
+{
+size_t fvf_input_elements(uint32_t fvf, FVFInputElements& elements)
+{
+	size_t count = 0;
+
+	const auto append = [&](const char* semantic_name, UINT semantic_index, DXGI_FORMAT format)
+	{
+		D3D11_INPUT_ELEMENT_DESC& e = elements[count++];
+
+		e = {};
+		e.SemanticName      = semantic_name;
+		e.SemanticIndex     = semantic_index;
+		e.Format            = format;
+		e.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+		e.InputSlotClass    = D3D11_INPUT_PER_VERTEX_DATA;
+	};
+
+	switch (fvf & D3DFVF_POSITION_MASK)
+	{
+		case D3DFVF_XYZ:
+			append("POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT);
+			break;
+
+		case D3DFVF_XYZRHW:
+			append("POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT);
+			break;
+
+		default:
+			// no position, or blend weights, which nothing generates shaders for
+			return 0;
+	}
+
+	for (const FVFElement& element : FVF_ELEMENTS)
+	{
+		if (fvf & element.flag)
+		{
+			append(element.semantic_name, element.semantic_index, element.format);
+		}
+	}
+
+	const auto tex_count = static_cast<UINT>((fvf & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT);
+
+	if (tex_count > FVF_TEXCOORD_MAX)
+	{
+		return 0;
+	}
+
+	for (UINT i = 0; i < tex_count; ++i)
+	{
+		const auto format = (fvf >> (ShaderFlags::fvf_texfmt_shift + i * ShaderFlags::fvf_texfmt_bits)) & 3;
+		append("TEXCOORD", i, TEXCOORD_FORMATS[format]);
+	}
+
+	return count;
+}
+
+ComPtr<ID3DBlob> fvf_input_signature(uint32_t fvf)
+{
+	FVFInputElements elements;
+	const size_t count = fvf_input_elements(fvf, elements);
+
+	if (!count)
+	{
+		throw std::runtime_error(std::format("vertex format 0x{:08X} has no input layout", fvf));
+	}
+
+	std::string source = "float4 main(";
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const D3D11_INPUT_ELEMENT_DESC& e = elements[i];
+		source += std::format("{}{} i{} : {}{}", i ? ", " : "", hlsl_type(e.Format), i, e.SemanticName, e.SemanticIndex);
+	}
+
+	source += ") : SV_Position { return 0; }";
+
+	ComPtr<ID3DBlob> blob;
+	ComPtr<ID3DBlob> errors;
+
+	HRESULT hr = D3DCompile(source.data(), source.size(), nullptr, nullptr, nullptr, "main", "vs_5_0",
+	                        D3DCOMPILE_SKIP_OPTIMIZATION, 0, &blob, &errors);
+
+	if (FAILED(hr))
+	{
+		const std::string str = errors ? std::string(static_cast<char*>(errors->GetBufferPointer()), errors->GetBufferSize()) : source;
+		throw std::runtime_error(str);
+	}
+
+	// unused inputs stay in the signature, which is all a layout is validated against
+	ComPtr<ID3DBlob> signature;
+	hr = D3DGetInputSignatureBlob(blob->GetBufferPointer(), blob->GetBufferSize(), &signature);
+
+	if (FAILED(hr))
+	{
+		throw std::runtime_error("D3DGetInputSignatureBlob failed");
+	}
+
+	return signature;
+}
+}
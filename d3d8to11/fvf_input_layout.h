@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <d3d11.h>
+#include <d3dcommon.h>
+#include <wrl/client.h>
+
+#include "defs.h"
+
+namespace d3d8to11
+{
+// position, normal, point size, diffuse and specular, then the texture coordinates
+constexpr size_t FVF_INPUT_ELEMENT_MAX = 5 + FVF_TEXCOORD_MAX;
+
+using FVFInputElements = std::array<D3D11_INPUT_ELEMENT_DESC, FVF_INPUT_ELEMENT_MAX>;
+
+/**
+ * \brief Fills \p elements with the input elements of a vertex of the format \p fvf, in the order they are laid out,
+ * including the size of each set of texture coordinates.
+ * \return The number of elements written, or 0 if the format can't be described (e.g. it has blend weights).
+ */
+[[nodiscard]] size_t fvf_input_elements(uint32_t fvf, FVFInputElements& elements);
+
+/**
+ * \brief Compiles a vertex shader that takes exactly the inputs described by \c fvf_input_elements and does nothing else,
+ * and returns just its input signature.
+ *
+ * An input layout created against it matches every vertex shader generated for \p fvf,
+ * so one layout per vertex format can be shared by all of them.
+ * \throws std::runtime_error if \p fvf can't be described or the shader fails to compile.
+ */
+[[nodiscard]] Microsoft::WRL::ComPtr<ID3DBlob> fvf_input_signature(uint32_t fvf);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <utility>
+
+/**
+ * \brief Calls a function when it goes out of scope, so that cleanup runs on every path out of a scope.
+ */
+template <typename Func>
+class scope_exit
+{
+public:
+	explicit scope_exit(Func&& function)
+		: m_function(std::forward<Func>(function))
+	{
+	}
+
+	~scope_exit()
+	{
+		m_function();
+	}
+
+	scope_exit(const scope_exit&)     = delete;
+	scope_exit(scope_exit&&) noexcept = delete;
+
+	scope_exit& operator=(const scope_exit&)     = delete;
+	scope_exit& operator=(scope_exit&&) noexcept = delete;
+
+private:
+	Func m_function;
+};
+
+template <typename Func>
+scope_exit(Func) -> scope_exit<Func>;
@@ -1,4 +1,6 @@
-#include "pch.h"
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
 #include "simple_math.h"
 
 float4 to_color4(uint32_t color)
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 
 namespace d3d8to11
 {
@@ -11,4 +13,19 @@ void trim_right(std::string& str);
 void trim(std::string& str);
 
 bool equals_case_insensitive(const std::string_view& a, const std::string_view& b);
+
+/**
+ * \brief Transparent string hash so that unordered containers keyed by \c std::string
+ * can be searched with a \c std::string_view without constructing a key.
+ * Use together with \c std::equal_to<>.
+ */
+struct string_hash
+{
+	using is_transparent = void;
+
+	[[nodiscard]] size_t operator()(std::string_view str) const noexcept
+	{
+		return std::hash<std::string_view>{}(str);
+	}
+};
 }
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define D3D8TO11_TRIANGLE_FAN_SSE2
+#include <emmintrin.h>
+
+// the AVX2 path is compiled regardless of the target architecture and only taken if the CPU supports it
+#if defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__)
+#define D3D8TO11_TRIANGLE_FAN_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define D3D8TO11_TARGET_AVX2
+#else
+#define D3D8TO11_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+namespace d3d8to11
+{
+#ifdef D3D8TO11_TRIANGLE_FAN_SSE2
+namespace detail
+{
+/**
+ * \brief Expands four fan triangles (first, x[k], x[k + 1]) into twelve list indices,
+ * given \c x0..x3 in \p x and \c x1..x4 in \p y.
+ */
+inline void expand_fan_quad(__m128i first, __m128i x, __m128i y, __m128i& out0, __m128i& out1, __m128i& out2)
+{
+	// lanes that take the first vertex of the fan
+	const __m128i mask0 = _mm_setr_epi32(-1, 0, 0, -1);
+	const __m128i mask1 = _mm_setr_epi32(0, 0, -1, 0);
+	const __m128i mask2 = _mm_setr_epi32(0, -1, 0, 0);
+
+	// (c, x0, x1, c) (x1, x2, c, x2) (x3, c, x3, x4)
+	const __m128i s0 = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 0, 0));
+	const __m128i s1 = _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 2, 2, 1));
+	const __m128i s2 = _mm_shuffle_epi32(y, _MM_SHUFFLE(3, 2, 2, 2));
+
+	out0 = _mm_or_si128(_mm_and_si128(mask0, first), _mm_andnot_si128(mask0, s0));
+	out1 = _mm_or_si128(_mm_and_si128(mask1, first), _mm_andnot_si128(mask1, s1));
+	out2 = _mm_or_si128(_mm_and_si128(mask2, first), _mm_andnot_si128(mask2, s2));
+}
+
+#ifdef D3D8TO11_TRIANGLE_FAN_AVX2
+/**
+ * \brief Checks once whether the CPU and the operating system support AVX2.
+ */
+inline bool cpu_has_avx2()
+{
+	static const bool result = []
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		// AVX and OSXSAVE, then whether the OS saves the YMM registers
+		__cpuid(info, 1);
+
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}();
+
+	return result;
+}
+
+/**
+ * \brief Expands eight fan triangles (first, x[k], x[k + 1]) into twenty-four list indices,
+ * given \c x0..x7 in \p x and \c x1..x8 in \p y.
+ */
+D3D8TO11_TARGET_AVX2 inline void expand_fan_octet(__m256i first, __m256i x, __m256i y, __m256i& out0, __m256i& out1, __m256i& out2)
+{
+	// (c, x0, x1, c, x1, x2, c, x2) (x3, c, x3, x4, c, x4, x5, c) (x5, x6, c, x6, x7, c, x7, x8)
+	// lanes that don't take x below are overwritten by the blends
+	const __m256i x0 = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 0, 0, 0, 1, 0, 0, 2));
+	const __m256i y0 = _mm256_permutevar8x32_epi32(y, _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 0, 0));
+	const __m256i x1 = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 0, 3, 0, 0, 4, 0, 0));
+	const __m256i y1 = _mm256_permutevar8x32_epi32(y, _mm256_setr_epi32(2, 0, 0, 3, 0, 0, 4, 0));
+	const __m256i x2 = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(5, 0, 0, 6, 0, 0, 7, 0));
+	const __m256i y2 = _mm256_permutevar8x32_epi32(y, _mm256_setr_epi32(0, 5, 0, 0, 6, 0, 0, 7));
+
+	out0 = _mm256_blend_epi32(_mm256_blend_epi32(x0, y0, 0b00100100), first, 0b01001001);
+	out1 = _mm256_blend_epi32(_mm256_blend_epi32(x1, y1, 0b01001001), first, 0b10010010);
+	out2 = _mm256_blend_epi32(_mm256_blend_epi32(x2, y2, 0b10010010), first, 0b00100100);
+}
+
+/**
+ * \brief Converts eight fan triangles at a time.
+ * \return The number of triangles converted, a multiple of eight.
+ */
+D3D8TO11_TARGET_AVX2 inline size_t triangle_fan_to_list_avx2(const uint32_t* input, size_t primitive_count, uint32_t* output)
+{
+	const __m256i first = _mm256_set1_epi32(static_cast<int>(input[0]));
+	size_t i = 0;
+
+	// reads input[i + 1] through input[i + 9]
+	for (; i + 8 <= primitive_count; i += 8)
+	{
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i + 1));
+		const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i + 2));
+
+		__m256i out0, out1, out2;
+		expand_fan_octet(first, x, y, out0, out1, out2);
+
+		auto* out = reinterpret_cast<__m256i*>(output + 3 * i);
+		_mm256_storeu_si256(out + 0, out0);
+		_mm256_storeu_si256(out + 1, out1);
+		_mm256_storeu_si256(out + 2, out2);
+	}
+
+	return i;
+}
+
+D3D8TO11_TARGET_AVX2 inline size_t triangle_fan_to_list_avx2(const uint16_t* input, size_t primitive_count, uint16_t* output)
+{
+	const __m256i first = _mm256_set1_epi32(static_cast<int>(input[0]));
+	size_t i = 0;
+
+	// reads input[i + 1] through input[i + 9]
+	for (; i + 8 <= primitive_count; i += 8)
+	{
+		const __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 1)));
+		const __m256i y = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 2)));
+
+		__m256i out0, out1, out2;
+		expand_fan_octet(first, x, y, out0, out1, out2);
+
+		// the pack works within 128-bit halves, so the 64-bit quarters are put back in order afterwards
+		const __m256i packed01 = _mm256_permute4x64_epi64(_mm256_packus_epi32(out0, out1), _MM_SHUFFLE(3, 1, 2, 0));
+		const __m256i packed2  = _mm256_permute4x64_epi64(_mm256_packus_epi32(out2, out2), _MM_SHUFFLE(3, 1, 2, 0));
+
+		uint16_t* out = output + 3 * i;
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed01);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm256_castsi256_si128(packed2));
+	}
+
+	return i;
+}
+#endif
+}
+#endif
+
+#ifdef D3D8TO11_TRIANGLE_FAN_SSE2
+namespace detail
+{
+/**
+ * \brief Converts fan triangles four at a time, starting with triangle \p i.
+ * \return The index of the first triangle left over.
+ */
+template <typename T>
+size_t triangle_fan_to_list_sse2(const T* input, size_t primitive_count, T* output, size_t i)
+{
+	const __m128i first_x4 = _mm_set1_epi32(static_cast<int>(input[0]));
+
+	if constexpr (sizeof(T) == sizeof(uint32_t))
+	{
+		// reads input[i + 1] through input[i + 5]
+		for (; i + 4 <= primitive_count; i += 4)
+		{
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 1));
+			const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 2));
+
+			__m128i out0, out1, out2;
+			expand_fan_quad(first_x4, x, y, out0, out1, out2);
+
+			auto* out = reinterpret_cast<__m128i*>(output + 3 * i);
+			_mm_storeu_si128(out + 0, out0);
+			_mm_storeu_si128(out + 1, out1);
+			_mm_storeu_si128(out + 2, out2);
+		}
+	}
+	else
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i bias = _mm_set1_epi32(0x8000);
+		const __m128i flip = _mm_set1_epi16(static_cast<short>(0x8000));
+
+		// reads input[i + 1] through input[i + 8]
+		for (; i + 7 <= primitive_count; i += 4)
+		{
+			const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 1));
+			const __m128i x = _mm_unpacklo_epi16(raw, zero);
+			const __m128i y = _mm_unpacklo_epi16(_mm_srli_si128(raw, 2), zero);
+
+			__m128i out0, out1, out2;
+			expand_fan_quad(first_x4, x, y, out0, out1, out2);
+
+			// SSE2 can only pack with signed saturation, so shift into the signed range and back
+			const __m128i packed01 = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(out0, bias), _mm_sub_epi32(out1, bias)), flip);
+			const __m128i packed2  = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(out2, bias), zero), flip);
+
+			T* out = output + 3 * i;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed01);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 8), packed2);
+		}
+	}
+
+	return i;
+}
+}
+#endif
+
+/**
+ * \brief Converts fan triangles one at a time, starting with triangle \p i.
+ */
+template <typename T>
+void triangle_fan_to_list_scalar(const T* input, size_t primitive_count, T* output, size_t i = 0)
+{
+	const T first = input[0];
+
+	for (; i < primitive_count; ++i)
+	{
+		const size_t o = 3 * i;
+
+		output[o + 0] = first;
+		output[o + 1] = input[i + 1];
+		output[o + 2] = input[i + 2];
+	}
+}
+
+/**
+ * \brief Converts the indices of a triangle fan into those of the equivalent triangle list.
+ * Uses AVX2 where the CPU supports it and SSE2 otherwise; whatever doesn't fill a whole
+ * vector is converted by the next narrower path.
+ * \param input \p primitive_count + 2 fan indices.
+ * \param output Receives 3 * \p primitive_count list indices. Must not overlap \p input.
+ */
+template <typename T>
+void triangle_fan_to_list(const T* input, size_t primitive_count, T* output)
+{
+	static_assert(std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t>, "only 16-bit and 32-bit indices are supported");
+
+	size_t i = 0;
+
+#ifdef D3D8TO11_TRIANGLE_FAN_AVX2
+	if (detail::cpu_has_avx2())
+	{
+		i = detail::triangle_fan_to_list_avx2(input, primitive_count, output);
+	}
+#endif
+
+#ifdef D3D8TO11_TRIANGLE_FAN_SSE2
+	i = detail::triangle_fan_to_list_sse2(input, primitive_count, output, i);
+#endif
+
+	triangle_fan_to_list_scalar(input, primitive_count, output, i);
+}
+
+/**
+ * \brief Writes the triangle list indices of a fan over consecutive vertices starting at 0,
+ * so that any non-indexed fan can be drawn from them with a base vertex.
+ * \param output Receives 3 * \p primitive_count list indices.
+ */
+template <typename T>
+void canonical_triangle_fan(size_t primitive_count, T* output)
+{
+	static_assert(std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t>, "only 16-bit and 32-bit indices are supported");
+
+	for (size_t i = 0; i < primitive_count; ++i)
+	{
+		const size_t o = 3 * i;
+
+		output[o + 0] = 0;
+		output[o + 1] = static_cast<T>(i + 1);
+		output[o + 2] = static_cast<T>(i + 2);
+	}
+}
+}
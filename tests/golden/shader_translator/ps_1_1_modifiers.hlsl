@@ -0,0 +1,55 @@
+// translated from ps.1.1
+#define OIT_NODE_WRITE
+#include "d3d8to11.hlsl"
+
+cbuffer PixelShaderConstants : register(b5)
+{
+	float4 ps_c[8];
+}
+
+static const float4 def_c7 = float4(0.5, 0.25, 1, 0);
+
+float2 d3d8_bump(uint s, float4 bump)
+{
+	return float2(texture_stages[s].bump_env_mat00 * bump.x + texture_stages[s].bump_env_mat10 * bump.y,
+	              texture_stages[s].bump_env_mat01 * bump.x + texture_stages[s].bump_env_mat11 * bump.y);
+}
+
+float d3d8_luminance(uint s, float4 bump)
+{
+	return saturate(bump.z * texture_stages[s].bump_env_lscale + texture_stages[s].bump_env_loffset);
+}
+
+float4 translated_main(VS_OUTPUT input)
+{
+	float4 r0 = 0;
+	float4 r1 = 0;
+	float4 t0 = 0;
+	float4 t1 = 0;
+	float4 t2 = 0;
+
+	t0 = (textures[0].Sample(samplers[0], (input.uv[0]).xy));
+	t1 = (textures[1].Sample(samplers[1], (input.uv[1].xy + d3d8_bump(1, t0)).xy));
+	t2 = (float4(saturate(input.uv[2].xyz), 1));
+	clip(input.uv[3].xyz);
+	r1 = (saturate((t0 - 0.5) + -saturate(input.diffuse)));
+	const float4 coissue0 = clamp(((t1 * 2 - 1) * def_c7 + (1 - saturate(input.specular))) * 4, -8, 8);
+	r1.w = (clamp(((0.5 - t2) - ps_c[0].zzzz) * 0.5, -8, 8)).w;
+	r1.xyz = coissue0.xyz;
+	r0.xyz = (saturate((float4)dot((t0 * 2 - 1).xyz, (1 - ps_c[1] * 2).xyz))).xyz;
+	r0 = (clamp((r1.wwww > 0.5 ? r0 : t1), -8, 8));
+
+	return r0;
+}
+
+float4 main(VS_OUTPUT input) : SV_TARGET
+{
+	float4 result = apply_fog(translated_main(input), input.fog);
+
+	const bool standard_blending = is_standard_blending();
+
+	do_alpha_test(result, standard_blending);
+	do_oit(result, input, standard_blending);
+
+	return result;
+}
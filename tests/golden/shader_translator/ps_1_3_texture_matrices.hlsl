@@ -0,0 +1,50 @@
+// translated from ps.1.3
+#define OIT_NODE_WRITE
+#include "d3d8to11.hlsl"
+
+cbuffer PixelShaderConstants : register(b5)
+{
+	float4 ps_c[8];
+}
+
+float2 d3d8_bump(uint s, float4 bump)
+{
+	return float2(texture_stages[s].bump_env_mat00 * bump.x + texture_stages[s].bump_env_mat10 * bump.y,
+	              texture_stages[s].bump_env_mat01 * bump.x + texture_stages[s].bump_env_mat11 * bump.y);
+}
+
+float d3d8_luminance(uint s, float4 bump)
+{
+	return saturate(bump.z * texture_stages[s].bump_env_lscale + texture_stages[s].bump_env_loffset);
+}
+
+float4 translated_main(VS_OUTPUT input)
+{
+	float4 r0 = 0;
+	float4 t0 = 0;
+	float4 t1 = 0;
+	float4 t2 = 0;
+	float4 t3 = 0;
+
+	t0 = (textures[0].Sample(samplers[0], (input.uv[0]).xy));
+	t1 = ((float4)dot(input.uv[1].xyz, (t0 * 2 - 1).xyz));
+	t2 = (textures[2].Sample(samplers[2], (float2(t1.x, dot(input.uv[2].xyz, (t0 * 2 - 1).xyz))).xy));
+	t3 = (textures[3].Sample(samplers[3], (input.uv[3].xy + d3d8_bump(3, t0)).xy) * d3d8_luminance(3, t0));
+	const float4 coissue0 = clamp(t2 * t3, -8, 8);
+	r0.w = (saturate(-t3.zzzz)).w;
+	r0.xyz = coissue0.xyz;
+
+	return r0;
+}
+
+float4 main(VS_OUTPUT input) : SV_TARGET
+{
+	float4 result = apply_fog(translated_main(input), input.fog);
+
+	const bool standard_blending = is_standard_blending();
+
+	do_alpha_test(result, standard_blending);
+	do_oit(result, input, standard_blending);
+
+	return result;
+}
@@ -0,0 +1,60 @@
+// translated from ps.1.4
+#define OIT_NODE_WRITE
+#include "d3d8to11.hlsl"
+
+cbuffer PixelShaderConstants : register(b5)
+{
+	float4 ps_c[8];
+}
+
+static const float4 def_c1 = float4(0.5, 0.25, 1, 0);
+
+float2 d3d8_bump(uint s, float4 bump)
+{
+	return float2(texture_stages[s].bump_env_mat00 * bump.x + texture_stages[s].bump_env_mat10 * bump.y,
+	              texture_stages[s].bump_env_mat01 * bump.x + texture_stages[s].bump_env_mat11 * bump.y);
+}
+
+float d3d8_luminance(uint s, float4 bump)
+{
+	return saturate(bump.z * texture_stages[s].bump_env_lscale + texture_stages[s].bump_env_loffset);
+}
+
+float4 translated_main(VS_OUTPUT input)
+{
+	float4 r0 = 0;
+	float4 r1 = 0;
+	float4 r2 = 0;
+	float4 r3 = 0;
+	float4 r4 = 0;
+	float4 r5 = 0;
+
+	r0.xyz = ((input.uv[0] / input.uv[0].z)).xyz;
+	r1 = (textures[1].Sample(samplers[1], (input.uv[1]).xy));
+	r5 = ((input.uv[2] / input.uv[2].w));
+	r2.xy = (clamp(float4(ps_c[0].xy + d3d8_bump(2, r1), 0, 0), -8, 8)).xy;
+	const float4 coissue0 = clamp(((r1 * 2) * def_c1) * 2, -8, 8);
+	r3.w = (clamp((def_c1.zzzz * -2), -8, 8)).w;
+	r3.xyz = coissue0.xyz;
+	r2 = (textures[2].Sample(samplers[2], (r2).xy));
+	r4 = (textures[4].Sample(samplers[4], (r0).xy));
+	clip(r5.xyz);
+	const float4 coissue1 = clamp(((r3 - 0.5) >= 0 ? r2 : r4), -8, 8);
+	r0.w = (clamp((r3.wwww + -def_c1.yyyy) * 0.125, -8, 8)).w;
+	r0.xyz = coissue1.xyz;
+	r0.xyz = (saturate(r0 * saturate(input.diffuse) + (1 - r4))).xyz;
+
+	return r0;
+}
+
+float4 main(VS_OUTPUT input) : SV_TARGET
+{
+	float4 result = apply_fog(translated_main(input), input.fog);
+
+	const bool standard_blending = is_standard_blending();
+
+	do_alpha_test(result, standard_blending);
+	do_oit(result, input, standard_blending);
+
+	return result;
+}
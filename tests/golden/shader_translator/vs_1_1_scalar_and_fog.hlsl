@@ -0,0 +1,123 @@
+// translated from vs.1.1
+#define OIT_NODE_WRITE
+#include "d3d8to11.hlsl"
+
+cbuffer VertexShaderConstants : register(b5)
+{
+	float4 vs_c[96];
+}
+
+float4 d3d8_lit(float4 s)
+{
+	float4 result = float4(1, 0, 0, 1);
+
+	if (s.x > 0)
+	{
+		result.y = s.x;
+
+		if (s.y > 0)
+		{
+			result.z = pow(s.y, clamp(s.w, -128, 128));
+		}
+	}
+
+	return result;
+}
+
+float4 d3d8_dst(float4 a, float4 b)
+{
+	return float4(1, a.y * b.y, a.z, b.w);
+}
+
+float4 d3d8_expp(float w)
+{
+	return float4(exp2(floor(w)), frac(w), exp2(w), 1);
+}
+
+float4 d3d8_logp(float w)
+{
+	float value    = abs(w);
+	float exponent = floor(log2(value));
+	return float4(exponent, value / exp2(exponent), log2(value), 1);
+}
+
+// the pixel shaders compute the fog factor from a distance, so oFog is turned back into one
+float d3d8_fog_distance(float factor)
+{
+	factor = saturate(factor);
+
+	switch (rs_fog_mode)
+	{
+		case FOGMODE_LINEAR:
+			return fog_end - factor * (fog_end - fog_start);
+
+		case FOGMODE_EXP:
+			return -log(factor) / fog_density;
+
+		case FOGMODE_EXP2:
+			return sqrt(-log(factor)) / fog_density;
+
+		default:
+			return 0;
+	}
+}
+
+VS_OUTPUT main(float4 v0 : V0, float4 v3 : V3, float4 v7 : V7)
+{
+	float4 r0 = 0;
+	float4 r1 = 0;
+	float4 r2 = 0;
+	float4 r3 = 0;
+	float4 r4 = 0;
+	float4 r5 = 0;
+	float4 r6 = 0;
+	float4 r7 = 0;
+	float4 r8 = 0;
+	float4 r9 = 0;
+	float4 r10 = 0;
+	float4 r11 = 0;
+	int4 a0 = 0;
+	float4 o_pos = 0;
+	float4 o_fog = 0;
+	float4 o_pts = 0;
+	float4 o_d0 = 1;
+	float4 o_d1 = 0;
+	float4 o_t1 = 0;
+
+	o_pos = (float4(dot(v0, vs_c[0]), dot(v0, vs_c[1]), dot(v0, vs_c[2]), dot(v0, vs_c[3])));
+	r0 = (d3d8_lit(v3));
+	r1 = (d3d8_dst(r0, v3));
+	r2 = (d3d8_expp(v0.xxxx.w));
+	r3 = (d3d8_logp(v0.yyyy.w));
+	r4.xy = (frac(v7)).xy;
+	r5 = ((float4)(v0 >= vs_c[4]));
+	r6 = ((float4)(v0 < vs_c[4]));
+	r7 = (min(r5, r6));
+	r8 = ((float4)exp2(v0.zzzz.w));
+	r9 = ((float4)log2(abs(v0.wwww.w)));
+	r10.x = ((float4)(1 / vs_c[5].wwww.w)).x;
+	r11 = (r7 - r10.xxxx);
+	o_fog.x = ((float4)dot(v0, vs_c[6])).x;
+	o_d0 = (r0 + r11);
+	o_t1 = (r4);
+
+	VS_OUTPUT result = (VS_OUTPUT)0;
+
+	result.position = o_pos;
+	result.depth    = o_pos.zw;
+	result.fog      = d3d8_fog_distance(o_fog.x);
+	result.diffuse  = saturate(o_d0);
+	result.specular = saturate(o_d1);
+
+	result.uv_meta[0].component_count = 4;
+	result.uv[1] = o_t1;
+	result.uv_meta[1].component_count = 4;
+	result.uv_meta[2].component_count = 4;
+	result.uv_meta[3].component_count = 4;
+	result.uv_meta[4].component_count = 4;
+	result.uv_meta[5].component_count = 4;
+	result.uv_meta[6].component_count = 4;
+	result.uv_meta[7].component_count = 4;
+
+	return result;
+}
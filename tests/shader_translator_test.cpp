@@ -0,0 +1,414 @@
+#include <Windows.h>
+
+#include <bit>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ShaderTranslator.h"
+#include "VertexDeclaration.h"
+
+// Each shader in the corpus is translated and compared against golden/shader_translator/<name>.hlsl.
+// After an intended change to the generated HLSL, bump SHADER_TRANSLATOR_VERSION and regenerate
+// the golden files by running the tests with D3D8TO11_UPDATE_GOLDEN=1, then review their diff.
+
+namespace
+{
+constexpr DWORD PARAMETER = 0x80000000;
+
+constexpr DWORD X = D3DSP_WRITEMASK_0;
+constexpr DWORD Y = D3DSP_WRITEMASK_1;
+constexpr DWORD Z = D3DSP_WRITEMASK_2;
+constexpr DWORD W = D3DSP_WRITEMASK_3;
+
+constexpr DWORD XYZ  = X | Y | Z;
+constexpr DWORD XYZW = D3DSP_WRITEMASK_ALL;
+
+/**
+ * \brief Builds a swizzle from the component indices 0 through 3.
+ */
+constexpr DWORD swizzle(DWORD x, DWORD y, DWORD z, DWORD w)
+{
+	return (x | (y << 2) | (z << 4) | (w << 6)) << D3DSP_SWIZZLE_SHIFT;
+}
+
+/**
+ * \brief Encodes a result shift: 1 through 3 for _x2, _x4 and _x8; -1 through -3 for _d2, _d4 and _d8.
+ */
+constexpr DWORD shift(int exponent)
+{
+	return (static_cast<DWORD>(exponent) & 0xF) << D3DSP_DSTSHIFT_SHIFT;
+}
+
+constexpr DWORD dst(DWORD type, DWORD number, DWORD mask = XYZW, DWORD modifiers = 0)
+{
+	return PARAMETER | type | number | mask | modifiers;
+}
+
+constexpr DWORD src(DWORD type, DWORD number, DWORD swizzle = D3DSP_NOSWIZZLE, DWORD modifier = D3DSPSM_NONE)
+{
+	return PARAMETER | type | number | swizzle | modifier;
+}
+
+// c[a0.x + number]
+constexpr DWORD relative(DWORD number, DWORD swizzle = D3DSP_NOSWIZZLE, DWORD modifier = D3DSPSM_NONE)
+{
+	return src(D3DSPR_CONST, number, swizzle, modifier) | D3DVS_ADDRMODE_RELATIVE;
+}
+
+DWORD literal(float value)
+{
+	return std::bit_cast<DWORD>(value);
+}
+
+struct CorpusShader
+{
+	std::string name;
+	std::vector<DWORD> function;
+};
+
+// v0 position, v1 blend indices, v3 normal, v5 diffuse, v7 texture coordinates
+const std::vector<DWORD> VERTEX_DECLARATION = {
+	D3DVSD_STREAM(0),
+	D3DVSD_REG(0, D3DVSDT_FLOAT3),
+	D3DVSD_REG(1, D3DVSDT_UBYTE4),
+	D3DVSD_REG(3, D3DVSDT_FLOAT3),
+	D3DVSD_REG(5, D3DVSDT_D3DCOLOR),
+	D3DVSD_REG(7, D3DVSDT_FLOAT2),
+	D3DVSD_END(),
+};
+
+std::vector<CorpusShader> make_corpus()
+{
+	std::vector<CorpusShader> corpus;
+
+	// vs.1.1
+	// m4x4 oPos, v0, c0
+	// m3x3 r0.xyz, v3, c4
+	// dp3 r0.w, r0, r0
+	// rsq r0.w, r0.w
+	// mul r0.xyz, r0, r0.w
+	// dp3 r1.x, r0, -c8
+	// max r1.x, r1.x, c9.x
+	// mad oD0, v5, r1.x, c10
+	// mov oD1, c11.zyxw
+	// mov oT0.xy, v7
+	corpus.push_back({ "vs_1_1_transform_and_light", {
+		D3DVS_VERSION(1, 1),
+		D3DSIO_M4x4, dst(D3DSPR_RASTOUT, D3DSRO_POSITION), src(D3DSPR_INPUT, 0), src(D3DSPR_CONST, 0),
+		D3DSIO_M3x3, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_INPUT, 3), src(D3DSPR_CONST, 4),
+		D3DSIO_DP3, dst(D3DSPR_TEMP, 0, W), src(D3DSPR_TEMP, 0), src(D3DSPR_TEMP, 0),
+		D3DSIO_RSQ, dst(D3DSPR_TEMP, 0, W), src(D3DSPR_TEMP, 0, D3DSP_REPLICATEALPHA),
+		D3DSIO_MUL, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_TEMP, 0), src(D3DSPR_TEMP, 0, D3DSP_REPLICATEALPHA),
+		D3DSIO_DP3, dst(D3DSPR_TEMP, 1, X), src(D3DSPR_TEMP, 0), src(D3DSPR_CONST, 8, D3DSP_NOSWIZZLE, D3DSPSM_NEG),
+		D3DSIO_MAX, dst(D3DSPR_TEMP, 1, X), src(D3DSPR_TEMP, 1, D3DSP_REPLICATERED), src(D3DSPR_CONST, 9, D3DSP_REPLICATERED),
+		D3DSIO_MAD, dst(D3DSPR_ATTROUT, 0), src(D3DSPR_INPUT, 5), src(D3DSPR_TEMP, 1, D3DSP_REPLICATERED), src(D3DSPR_CONST, 10),
+		D3DSIO_MOV, dst(D3DSPR_ATTROUT, 1), src(D3DSPR_CONST, 11, swizzle(2, 1, 0, 3)),
+		D3DSIO_MOV, dst(D3DSPR_TEXCRDOUT, 0, X | Y), src(D3DSPR_INPUT, 7),
+		D3DVS_END(),
+	} });
+
+	// vs.1.1
+	// mov a0.x, v1.x
+	// m4x3 r0.xyz, v0, c[a0.x + 12]
+	// mov r0.w, c9.y
+	// m4x4 oPos, r0, c0
+	// m3x3 r1.xyz, v3, c[a0.x + 12]
+	// mov oT0, -c[a0.x + 13].wzyx
+	// mov oPts.x, c9.z
+	corpus.push_back({ "vs_1_1_relative_addressing", {
+		D3DVS_VERSION(1, 1),
+		D3DSIO_MOV, dst(D3DSPR_ADDR, 0, X), src(D3DSPR_INPUT, 1, D3DSP_REPLICATERED),
+		D3DSIO_M4x3, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_INPUT, 0), relative(12),
+		D3DSIO_MOV, dst(D3DSPR_TEMP, 0, W), src(D3DSPR_CONST, 9, D3DSP_REPLICATEGREEN),
+		D3DSIO_M4x4, dst(D3DSPR_RASTOUT, D3DSRO_POSITION), src(D3DSPR_TEMP, 0), src(D3DSPR_CONST, 0),
+		D3DSIO_M3x3, dst(D3DSPR_TEMP, 1, XYZ), src(D3DSPR_INPUT, 3), relative(12),
+		D3DSIO_MOV, dst(D3DSPR_TEXCRDOUT, 0), relative(13, swizzle(3, 2, 1, 0), D3DSPSM_NEG),
+		D3DSIO_MOV, dst(D3DSPR_RASTOUT, D3DSRO_POINT_SIZE, X), src(D3DSPR_CONST, 9, D3DSP_REPLICATEBLUE),
+		D3DVS_END(),
+	} });
+
+	// vs.1.1
+	// m4x4 oPos, v0, c0
+	// lit r0, v3
+	// dst r1, r0, v3
+	// expp r2, v0.x
+	// logp r3, v0.y
+	// frc r4.xy, v7
+	// sge r5, v0, c4
+	// slt r6, v0, c4
+	// min r7, r5, r6
+	// exp r8, v0.z
+	// log r9, v0.w
+	// rcp r10.x, c5.w
+	// sub r11, r7, r10.x
+	// dp4 oFog.x, v0, c6
+	// add oD0, r0, r11
+	// mov oT1, r4
+	corpus.push_back({ "vs_1_1_scalar_and_fog", {
+		D3DVS_VERSION(1, 1),
+		D3DSIO_M4x4, dst(D3DSPR_RASTOUT, D3DSRO_POSITION), src(D3DSPR_INPUT, 0), src(D3DSPR_CONST, 0),
+		D3DSIO_LIT, dst(D3DSPR_TEMP, 0), src(D3DSPR_INPUT, 3),
+		D3DSIO_DST, dst(D3DSPR_TEMP, 1), src(D3DSPR_TEMP, 0), src(D3DSPR_INPUT, 3),
+		D3DSIO_EXPP, dst(D3DSPR_TEMP, 2), src(D3DSPR_INPUT, 0, D3DSP_REPLICATERED),
+		D3DSIO_LOGP, dst(D3DSPR_TEMP, 3), src(D3DSPR_INPUT, 0, D3DSP_REPLICATEGREEN),
+		D3DSIO_FRC, dst(D3DSPR_TEMP, 4, X | Y), src(D3DSPR_INPUT, 7),
+		D3DSIO_SGE, dst(D3DSPR_TEMP, 5), src(D3DSPR_INPUT, 0), src(D3DSPR_CONST, 4),
+		D3DSIO_SLT, dst(D3DSPR_TEMP, 6), src(D3DSPR_INPUT, 0), src(D3DSPR_CONST, 4),
+		D3DSIO_MIN, dst(D3DSPR_TEMP, 7), src(D3DSPR_TEMP, 5), src(D3DSPR_TEMP, 6),
+		D3DSIO_EXP, dst(D3DSPR_TEMP, 8), src(D3DSPR_INPUT, 0, D3DSP_REPLICATEBLUE),
+		D3DSIO_LOG, dst(D3DSPR_TEMP, 9), src(D3DSPR_INPUT, 0, D3DSP_REPLICATEALPHA),
+		D3DSIO_RCP, dst(D3DSPR_TEMP, 10, X), src(D3DSPR_CONST, 5, D3DSP_REPLICATEALPHA),
+		D3DSIO_SUB, dst(D3DSPR_TEMP, 11), src(D3DSPR_TEMP, 7), src(D3DSPR_TEMP, 10, D3DSP_REPLICATERED),
+		D3DSIO_DP4, dst(D3DSPR_RASTOUT, D3DSRO_FOG, X), src(D3DSPR_INPUT, 0), src(D3DSPR_CONST, 6),
+		D3DSIO_ADD, dst(D3DSPR_ATTROUT, 0), src(D3DSPR_TEMP, 0), src(D3DSPR_TEMP, 11),
+		D3DSIO_MOV, dst(D3DSPR_TEXCRDOUT, 1), src(D3DSPR_TEMP, 4),
+		D3DVS_END(),
+	} });
+
+	// ps.1.0
+	// tex t0
+	// tex t1
+	// mul_x2 r0.rgb, t0, v0
+	// +mov r0.a, t0.a
+	// lrp r0.rgb, v1.a, t1, r0
+	corpus.push_back({ "ps_1_0_coissue", {
+		D3DPS_VERSION(1, 0),
+		D3DSIO_TEX, dst(D3DSPR_TEXTURE, 0),
+		D3DSIO_TEX, dst(D3DSPR_TEXTURE, 1),
+		D3DSIO_MUL, dst(D3DSPR_TEMP, 0, XYZ, shift(1)), src(D3DSPR_TEXTURE, 0), src(D3DSPR_INPUT, 0),
+		D3DSIO_MOV | D3DSI_COISSUE, dst(D3DSPR_TEMP, 0, W), src(D3DSPR_TEXTURE, 0, D3DSP_REPLICATEALPHA),
+		D3DSIO_LRP, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_INPUT, 1, D3DSP_REPLICATEALPHA), src(D3DSPR_TEXTURE, 1), src(D3DSPR_TEMP, 0),
+		D3DPS_END(),
+	} });
+
+	// ps.1.1
+	// def c7, 0.5, 0.25, 1, 0
+	// tex t0
+	// texbem t1, t0
+	// texcoord t2
+	// texkill t3
+	// add_sat r1, t0_bias, -v0
+	// mad_x4 r1.rgb, t1_bx2, c7, 1-v1
+	// +sub_d2 r1.a, -t2_bias, c0.b
+	// dp3_sat r0.rgb, t0_bx2, -c1_bx2
+	// cnd r0, r1.a, r0, t1
+	corpus.push_back({ "ps_1_1_modifiers", {
+		D3DPS_VERSION(1, 1),
+		D3DSIO_DEF, dst(D3DSPR_CONST, 7), literal(0.5f), literal(0.25f), literal(1.0f), literal(0.0f),
+		D3DSIO_TEX, dst(D3DSPR_TEXTURE, 0),
+		D3DSIO_TEXBEM, dst(D3DSPR_TEXTURE, 1), src(D3DSPR_TEXTURE, 0),
+		D3DSIO_TEXCOORD, dst(D3DSPR_TEXTURE, 2),
+		D3DSIO_TEXKILL, dst(D3DSPR_TEXTURE, 3),
+		D3DSIO_ADD, dst(D3DSPR_TEMP, 1, XYZW, D3DSPDM_SATURATE), src(D3DSPR_TEXTURE, 0, D3DSP_NOSWIZZLE, D3DSPSM_BIAS), src(D3DSPR_INPUT, 0, D3DSP_NOSWIZZLE, D3DSPSM_NEG),
+		D3DSIO_MAD, dst(D3DSPR_TEMP, 1, XYZ, shift(2)), src(D3DSPR_TEXTURE, 1, D3DSP_NOSWIZZLE, D3DSPSM_SIGN), src(D3DSPR_CONST, 7), src(D3DSPR_INPUT, 1, D3DSP_NOSWIZZLE, D3DSPSM_COMP),
+		D3DSIO_SUB | D3DSI_COISSUE, dst(D3DSPR_TEMP, 1, W, shift(-1)), src(D3DSPR_TEXTURE, 2, D3DSP_NOSWIZZLE, D3DSPSM_BIASNEG), src(D3DSPR_CONST, 0, D3DSP_REPLICATEBLUE),
+		D3DSIO_DP3, dst(D3DSPR_TEMP, 0, XYZ, D3DSPDM_SATURATE), src(D3DSPR_TEXTURE, 0, D3DSP_NOSWIZZLE, D3DSPSM_SIGN), src(D3DSPR_CONST, 1, D3DSP_NOSWIZZLE, D3DSPSM_SIGNNEG),
+		D3DSIO_CND, dst(D3DSPR_TEMP, 0), src(D3DSPR_TEMP, 1, D3DSP_REPLICATEALPHA), src(D3DSPR_TEMP, 0), src(D3DSPR_TEXTURE, 1),
+		D3DPS_END(),
+	} });
+
+	// ps.1.2
+	// tex t0
+	// texreg2ar t1, t0
+	// texreg2gb t2, t0
+	// texdp3tex t3, t0_bx2
+	// cmp r0, t0_bias, t1, t2
+	// dp4_d4 r1, t3, c2
+	// add r0.rgb, r0, r1
+	// +mov_x8 r0.a, r1.a
+	corpus.push_back({ "ps_1_2_dependent_reads", {
+		D3DPS_VERSION(1, 2),
+		D3DSIO_TEX, dst(D3DSPR_TEXTURE, 0),
+		D3DSIO_TEXREG2AR, dst(D3DSPR_TEXTURE, 1), src(D3DSPR_TEXTURE, 0),
+		D3DSIO_TEXREG2GB, dst(D3DSPR_TEXTURE, 2), src(D3DSPR_TEXTURE, 0),
+		D3DSIO_TEXDP3TEX, dst(D3DSPR_TEXTURE, 3), src(D3DSPR_TEXTURE, 0, D3DSP_NOSWIZZLE, D3DSPSM_SIGN),
+		D3DSIO_CMP, dst(D3DSPR_TEMP, 0), src(D3DSPR_TEXTURE, 0, D3DSP_NOSWIZZLE, D3DSPSM_BIAS), src(D3DSPR_TEXTURE, 1), src(D3DSPR_TEXTURE, 2),
+		D3DSIO_DP4, dst(D3DSPR_TEMP, 1, XYZW, shift(-2)), src(D3DSPR_TEXTURE, 3), src(D3DSPR_CONST, 2),
+		D3DSIO_ADD, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_TEMP, 0), src(D3DSPR_TEMP, 1),
+		D3DSIO_MOV | D3DSI_COISSUE, dst(D3DSPR_TEMP, 0, W, shift(3)), src(D3DSPR_TEMP, 1, D3DSP_REPLICATEALPHA),
+		D3DPS_END(),
+	} });
+
+	// ps.1.3
+	// tex t0
+	// texm3x2pad t1, t0_bx2
+	// texm3x2tex t2, t0_bx2
+	// texbeml t3, t0
+	// mul r0, t2, t3
+	// +mov_sat r0.a, -t3.b
+	corpus.push_back({ "ps_1_3_texture_matrices", {
+		D3DPS_VERSION(1, 3),
+		D3DSIO_TEX, dst(D3DSPR_TEXTURE, 0),
+		D3DSIO_TEXM3x2PAD, dst(D3DSPR_TEXTURE, 1), src(D3DSPR_TEXTURE, 0, D3DSP_NOSWIZZLE, D3DSPSM_SIGN),
+		D3DSIO_TEXM3x2TEX, dst(D3DSPR_TEXTURE, 2), src(D3DSPR_TEXTURE, 0, D3DSP_NOSWIZZLE, D3DSPSM_SIGN),
+		D3DSIO_TEXBEML, dst(D3DSPR_TEXTURE, 3), src(D3DSPR_TEXTURE, 0),
+		D3DSIO_MUL, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_TEXTURE, 2), src(D3DSPR_TEXTURE, 3),
+		D3DSIO_MOV | D3DSI_COISSUE, dst(D3DSPR_TEMP, 0, W, D3DSPDM_SATURATE), src(D3DSPR_TEXTURE, 3, D3DSP_REPLICATEBLUE, D3DSPSM_NEG),
+		D3DPS_END(),
+	} });
+
+	// ps.1.4
+	// def c1, 0.5, 0.25, 1, 0
+	// texcrd r0.rgb, t0_dz
+	// texld r1, t1
+	// texcrd r5, t2_dw
+	// bem r2.rg, c0, r1
+	// mul_x2 r3.rgb, r1_x2, c1
+	// +mov r3.a, -c1_x2.b
+	// phase
+	// texld r2, r2
+	// texld r4, r0
+	// texkill r5
+	// cmp r0.rgb, r3_bias, r2, r4
+	// +add_d8 r0.a, r3.a, -c1.g
+	// mad_sat r0.rgb, r0, v0, 1-r4
+	corpus.push_back({ "ps_1_4_phases", {
+		D3DPS_VERSION(1, 4),
+		D3DSIO_DEF, dst(D3DSPR_CONST, 1), literal(0.5f), literal(0.25f), literal(1.0f), literal(0.0f),
+		D3DSIO_TEXCOORD, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_TEXTURE, 0, D3DSP_NOSWIZZLE, D3DSPSM_DZ),
+		D3DSIO_TEX, dst(D3DSPR_TEMP, 1), src(D3DSPR_TEXTURE, 1),
+		D3DSIO_TEXCOORD, dst(D3DSPR_TEMP, 5), src(D3DSPR_TEXTURE, 2, D3DSP_NOSWIZZLE, D3DSPSM_DW),
+		D3DSIO_BEM, dst(D3DSPR_TEMP, 2, X | Y), src(D3DSPR_CONST, 0), src(D3DSPR_TEMP, 1),
+		D3DSIO_MUL, dst(D3DSPR_TEMP, 3, XYZ, shift(1)), src(D3DSPR_TEMP, 1, D3DSP_NOSWIZZLE, D3DSPSM_X2), src(D3DSPR_CONST, 1),
+		D3DSIO_MOV | D3DSI_COISSUE, dst(D3DSPR_TEMP, 3, W), src(D3DSPR_CONST, 1, D3DSP_REPLICATEBLUE, D3DSPSM_X2NEG),
+		D3DSIO_PHASE,
+		D3DSIO_TEX, dst(D3DSPR_TEMP, 2), src(D3DSPR_TEMP, 2),
+		D3DSIO_TEX, dst(D3DSPR_TEMP, 4), src(D3DSPR_TEMP, 0),
+		D3DSIO_TEXKILL, dst(D3DSPR_TEMP, 5),
+		D3DSIO_CMP, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_TEMP, 3, D3DSP_NOSWIZZLE, D3DSPSM_BIAS), src(D3DSPR_TEMP, 2), src(D3DSPR_TEMP, 4),
+		D3DSIO_ADD | D3DSI_COISSUE, dst(D3DSPR_TEMP, 0, W, shift(-3)), src(D3DSPR_TEMP, 3, D3DSP_REPLICATEALPHA), src(D3DSPR_CONST, 1, D3DSP_REPLICATEGREEN, D3DSPSM_NEG),
+		D3DSIO_MAD, dst(D3DSPR_TEMP, 0, XYZ, D3DSPDM_SATURATE), src(D3DSPR_TEMP, 0), src(D3DSPR_INPUT, 0), src(D3DSPR_TEMP, 4, D3DSP_NOSWIZZLE, D3DSPSM_COMP),
+		D3DPS_END(),
+	} });
+
+	return corpus;
+}
+
+std::string translate(const CorpusShader& shader)
+{
+	if ((shader.function[0] & 0xFFFF0000) == 0xFFFF0000)
+	{
+		return d3d8to11::translate_pixel_shader(shader.function);
+	}
+
+	const VertexDeclaration declaration(VERTEX_DECLARATION.data());
+	return d3d8to11::translate_vertex_shader(shader.function, declaration);
+}
+
+std::filesystem::path golden_path(const std::string& name)
+{
+	return std::filesystem::path(D3D8TO11_GOLDEN_DIR) / "shader_translator" / (name + ".hlsl");
+}
+
+class ShaderTranslatorGoldenTest : public testing::TestWithParam<CorpusShader>
+{
+};
+}
+
+TEST_P(ShaderTranslatorGoldenTest, MatchesGolden)
+{
+	const CorpusShader& shader = GetParam();
+
+	EXPECT_EQ(d3d8to11::shader_token_count(shader.function.data()), shader.function.size());
+
+	const std::string hlsl = translate(shader);
+	const std::filesystem::path path = golden_path(shader.name);
+
+	const char* update = std::getenv("D3D8TO11_UPDATE_GOLDEN");
+
+	if (update != nullptr && std::string(update) == "1")
+	{
+		std::ofstream(path, std::ios::binary) << hlsl;
+		GTEST_SKIP() << "updated " << path;
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	ASSERT_TRUE(file.is_open()) << path << " is missing; run with D3D8TO11_UPDATE_GOLDEN=1 to create it";
+
+	std::stringstream golden;
+	golden << file.rdbuf();
+
+	EXPECT_EQ(hlsl, golden.str()) << "translation of " << shader.name << " differs from " << path;
+}
+
+INSTANTIATE_TEST_SUITE_P(Corpus, ShaderTranslatorGoldenTest, testing::ValuesIn(make_corpus()),
+                         [](const testing::TestParamInfo<CorpusShader>& info)
+                         {
+	                         return info.param.name;
+                         });
+
+TEST(ShaderTranslator, TokenCountSkipsComments)
+{
+	const std::vector<DWORD> function = {
+		D3DPS_VERSION(1, 1),
+		D3DSIO_COMMENT | (2 << D3DSI_COMMENTSIZE_SHIFT), D3DPS_END(), D3DPS_END(),
+		D3DSIO_TEX, dst(D3DSPR_TEXTURE, 0),
+		D3DSIO_MOV, dst(D3DSPR_TEMP, 0), src(D3DSPR_TEXTURE, 0),
+		D3DPS_END(),
+	};
+
+	EXPECT_EQ(d3d8to11::shader_token_count(function.data()), function.size());
+}
+
+TEST(ShaderTranslator, CoissueReadsSourcesBeforeEitherWrite)
+{
+	// mov r0.rgb, r1
+	// +mov r1.a, r0.a
+	const std::vector<DWORD> function = {
+		D3DPS_VERSION(1, 1),
+		D3DSIO_MOV, dst(D3DSPR_TEMP, 0, XYZ), src(D3DSPR_TEMP, 1),
+		D3DSIO_MOV | D3DSI_COISSUE, dst(D3DSPR_TEMP, 1, W), src(D3DSPR_TEMP, 0, D3DSP_REPLICATEALPHA),
+		D3DPS_END(),
+	};
+
+	const std::string hlsl = d3d8to11::translate_pixel_shader(function);
+
+	const size_t first  = hlsl.find("const float4 coissue0 = clamp(r1, -8, 8);");
+	const size_t second = hlsl.find("r1.w = (clamp(r0.wwww, -8, 8)).w;");
+	const size_t third  = hlsl.find("r0.xyz = coissue0.xyz;");
+
+	ASSERT_NE(first, std::string::npos) << hlsl;
+	ASSERT_NE(second, std::string::npos) << hlsl;
+	ASSERT_NE(third, std::string::npos) << hlsl;
+	EXPECT_LT(first, second);
+	EXPECT_LT(second, third);
+}
+
+TEST(ShaderTranslator, RejectsUnsupportedVersions)
+{
+	const std::vector<DWORD> ps_2_0 = { D3DPS_VERSION(2, 0), D3DPS_END() };
+	const std::vector<DWORD> vs_2_0 = { D3DVS_VERSION(2, 0), D3DVS_END() };
+	const VertexDeclaration declaration(VERTEX_DECLARATION.data());
+
+	EXPECT_THROW(std::ignore = d3d8to11::translate_pixel_shader(ps_2_0), std::runtime_error);
+	EXPECT_THROW(std::ignore = d3d8to11::translate_vertex_shader(vs_2_0, declaration), std::runtime_error);
+	EXPECT_THROW(std::ignore = d3d8to11::translate_pixel_shader(vs_2_0), std::runtime_error);
+}
+
+TEST(ShaderTranslator, RejectsOutOfRangeRegisters)
+{
+	// ps.1.1 only has r0 and r1
+	const std::vector<DWORD> temp = {
+		D3DPS_VERSION(1, 1),
+		D3DSIO_MOV, dst(D3DSPR_TEMP, 2), src(D3DSPR_INPUT, 0),
+		D3DPS_END(),
+	};
+
+	// pixel shaders can't address constants relatively
+	const std::vector<DWORD> relative_constant = {
+		D3DPS_VERSION(1, 1),
+		D3DSIO_MOV, dst(D3DSPR_TEMP, 0), relative(0),
+		D3DPS_END(),
+	};
+
+	EXPECT_THROW(std::ignore = d3d8to11::translate_pixel_shader(temp), std::runtime_error);
+	EXPECT_THROW(std::ignore = d3d8to11::translate_pixel_shader(relative_constant), std::runtime_error);
+}
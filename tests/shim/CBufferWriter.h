@@ -0,0 +1,5 @@
+#pragma once
+
+// Material.h only declares its constant buffer writer, so the tests never need the real one.
+
+class CBufferBase;
@@ -0,0 +1,68 @@
+#pragma once
+
+// Stands in for DirectXTK's SimpleMath with just the members SoftwareVertexProcessor, the types it
+// reads (Light, Material) and the render state handlers use. Same layouts, and Matrix defaults to
+// identity like the real one.
+
+namespace DirectX::SimpleMath
+{
+struct Vector2
+{
+	float x = 0.0f;
+	float y = 0.0f;
+
+	Vector2() = default;
+
+	Vector2(float x_, float y_)
+		: x(x_), y(y_)
+	{
+	}
+};
+
+struct Vector3
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+
+	Vector3() = default;
+
+	Vector3(float x_, float y_, float z_)
+		: x(x_), y(y_), z(z_)
+	{
+	}
+};
+
+struct Vector4
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+	float w = 0.0f;
+
+	Vector4() = default;
+
+	Vector4(float x_, float y_, float z_, float w_)
+		: x(x_), y(y_), z(z_), w(w_)
+	{
+	}
+
+	bool operator==(const Vector4& rhs) const
+	{
+		return x == rhs.x && y == rhs.y && z == rhs.z && w == rhs.w;
+	}
+
+	bool operator!=(const Vector4& rhs) const
+	{
+		return !(*this == rhs);
+	}
+};
+
+struct Matrix
+{
+	float _11 = 1.0f, _12 = 0.0f, _13 = 0.0f, _14 = 0.0f;
+	float _21 = 0.0f, _22 = 1.0f, _23 = 0.0f, _24 = 0.0f;
+	float _31 = 0.0f, _32 = 0.0f, _33 = 1.0f, _34 = 0.0f;
+	float _41 = 0.0f, _42 = 0.0f, _43 = 0.0f, _44 = 1.0f;
+};
+}
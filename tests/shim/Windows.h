@@ -0,0 +1,71 @@
+#pragma once
+
+// The subset of the Windows types used by the platform-independent sources under test.
+// Only for building tests and benchmarks on other platforms; never part of d3d8to11 itself.
+
+#include <cstdint>
+
+using BYTE      = uint8_t;
+using WORD      = uint16_t;
+using DWORD     = uint32_t;
+using UINT      = unsigned int;
+using UINT8     = uint8_t;
+using INT       = int;
+using BOOL      = int;
+using LONG      = int32_t;
+using ULONG     = uint32_t;
+using FLOAT     = float;
+using HRESULT   = int32_t;
+using HANDLE    = void*;
+using HWND      = void*;
+using LPCSTR    = const char*;
+using LPCVOID   = const void*;
+using LPVOID    = void*;
+
+struct RECT
+{
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+};
+
+struct POINT
+{
+	LONG x;
+	LONG y;
+};
+
+struct GUID
+{
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t  Data4[8];
+};
+
+union LARGE_INTEGER
+{
+	struct
+	{
+		DWORD LowPart;
+		LONG  HighPart;
+	};
+
+	int64_t QuadPart;
+};
+
+constexpr HRESULT S_OK          = 0;
+constexpr HRESULT S_FALSE       = 1;
+constexpr HRESULT E_FAIL        = static_cast<HRESULT>(0x80004005);
+constexpr HRESULT E_NOINTERFACE = static_cast<HRESULT>(0x80004002);
+
+#define SUCCEEDED(hr) (static_cast<HRESULT>(hr) >= 0)
+#define FAILED(hr)    (static_cast<HRESULT>(hr) < 0)
+
+#define MAKE_HRESULT(sev, fac, code) \
+	static_cast<HRESULT>((static_cast<uint32_t>(sev) << 31) | (static_cast<uint32_t>(fac) << 16) | static_cast<uint32_t>(code))
+
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) \
+	(static_cast<DWORD>(static_cast<BYTE>(ch0)) | (static_cast<DWORD>(static_cast<BYTE>(ch1)) << 8) | \
+	 (static_cast<DWORD>(static_cast<BYTE>(ch2)) << 16) | (static_cast<DWORD>(static_cast<BYTE>(ch3)) << 24))
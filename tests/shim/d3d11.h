@@ -0,0 +1,106 @@
+#pragma once
+
+// Declares just enough of Direct3D 11 for the sources under test: StateFilteringContext instantiated
+// with a mock context, and VertexDeclaration. The interfaces are opaque; tests only ever compare their addresses.
+
+#include "Windows.h"
+
+struct ID3D11DeviceContext;
+
+struct ID3D11Resource;
+struct ID3D11Buffer;
+struct ID3D11InputLayout;
+struct ID3D11VertexShader;
+struct ID3D11PixelShader;
+struct ID3D11ClassInstance;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11RasterizerState;
+struct ID3D11BlendState;
+struct ID3D11DepthStencilState;
+struct ID3D11RenderTargetView;
+struct ID3D11DepthStencilView;
+struct ID3D11UnorderedAccessView;
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN            = 0,
+	DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+	DXGI_FORMAT_R32G32B32_FLOAT    = 6,
+	DXGI_FORMAT_R16G16B16A16_SINT  = 14,
+	DXGI_FORMAT_R32G32_FLOAT       = 16,
+	DXGI_FORMAT_R8G8B8A8_UINT      = 30,
+	DXGI_FORMAT_R16G16_SINT        = 38,
+	DXGI_FORMAT_R32_FLOAT          = 41,
+	DXGI_FORMAT_R32_UINT           = 42,
+	DXGI_FORMAT_R16_UINT           = 57,
+	DXGI_FORMAT_B8G8R8A8_UNORM     = 87,
+};
+
+enum D3D11_INPUT_CLASSIFICATION
+{
+	D3D11_INPUT_PER_VERTEX_DATA   = 0,
+	D3D11_INPUT_PER_INSTANCE_DATA = 1,
+};
+
+struct D3D11_INPUT_ELEMENT_DESC
+{
+	LPCSTR SemanticName;
+	UINT SemanticIndex;
+	DXGI_FORMAT Format;
+	UINT InputSlot;
+	UINT AlignedByteOffset;
+	D3D11_INPUT_CLASSIFICATION InputSlotClass;
+	UINT InstanceDataStepRate;
+};
+
+enum D3D11_PRIMITIVE_TOPOLOGY
+{
+	D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED     = 0,
+	D3D11_PRIMITIVE_TOPOLOGY_POINTLIST     = 1,
+	D3D11_PRIMITIVE_TOPOLOGY_LINELIST      = 2,
+	D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP     = 3,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST  = 4,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5,
+};
+
+enum D3D11_MAP
+{
+	D3D11_MAP_READ               = 1,
+	D3D11_MAP_WRITE              = 2,
+	D3D11_MAP_READ_WRITE         = 3,
+	D3D11_MAP_WRITE_DISCARD      = 4,
+	D3D11_MAP_WRITE_NO_OVERWRITE = 5,
+};
+
+struct D3D11_VIEWPORT
+{
+	FLOAT TopLeftX;
+	FLOAT TopLeftY;
+	FLOAT Width;
+	FLOAT Height;
+	FLOAT MinDepth;
+	FLOAT MaxDepth;
+};
+
+struct D3D11_BOX
+{
+	UINT left;
+	UINT top;
+	UINT front;
+	UINT right;
+	UINT bottom;
+	UINT back;
+};
+
+struct D3D11_MAPPED_SUBRESOURCE
+{
+	void* pData;
+	UINT RowPitch;
+	UINT DepthPitch;
+};
+
+constexpr UINT D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT         = 32;
+constexpr UINT D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT = 14;
+constexpr UINT D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT      = 128;
+constexpr UINT D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT             = 16;
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "d3d11.h"
+
+struct ID3D11DeviceContext1;
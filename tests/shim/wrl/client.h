@@ -0,0 +1,66 @@
+#pragma once
+
+// A non-owning stand-in for Microsoft::WRL::ComPtr. Tests own the objects they wrap.
+
+#include <cstddef>
+#include <type_traits>
+
+#include "../Windows.h"
+
+namespace Microsoft::WRL
+{
+template <typename T>
+class ComPtr
+{
+public:
+	ComPtr() = default;
+
+	ComPtr(std::nullptr_t)
+	{
+	}
+
+	ComPtr(T* ptr)
+		: m_ptr(ptr)
+	{
+	}
+
+	T* Get() const
+	{
+		return m_ptr;
+	}
+
+	T* operator->() const
+	{
+		return m_ptr;
+	}
+
+	explicit operator bool() const
+	{
+		return m_ptr != nullptr;
+	}
+
+	void Reset()
+	{
+		m_ptr = nullptr;
+	}
+
+	// succeeds only if T is, or derives from, U; the real one asks QueryInterface
+	template <typename U>
+	HRESULT As(ComPtr<U>* other) const
+	{
+		if constexpr (std::is_base_of_v<U, T> || std::is_same_v<U, T>)
+		{
+			*other = ComPtr<U>(m_ptr);
+			return S_OK;
+		}
+		else
+		{
+			other->Reset();
+			return E_NOINTERFACE;
+		}
+	}
+
+private:
+	T* m_ptr = nullptr;
+};
+}
@@ -0,0 +1,396 @@
+#include <Windows.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "buffer_range.h"
+#include "SoftwareVertexProcessor.h"
+
+// process_vertices checked against outputs worked out by hand from the fixed-function formulas,
+// so a change to the SSE paths can't quietly agree with itself. The ProcessVertices tests write
+// into a mock context's buffers through write_buffer_range like the device does.
+
+using namespace d3d8to11;
+
+namespace
+{
+constexpr uint32_t SOURCE_FVF = D3DFVF_XYZ | D3DFVF_NORMAL | D3DFVF_DIFFUSE | D3DFVF_TEX1;
+constexpr uint32_t DEST_FVF   = D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR | D3DFVF_TEX1;
+
+struct SourceVertex
+{
+	float    position[3];
+	float    normal[3];
+	uint32_t diffuse;
+	float    texcoord[2];
+};
+
+struct DestVertex
+{
+	float    position[4];
+	uint32_t diffuse;
+	uint32_t specular;
+	float    texcoord[2];
+};
+
+/**
+ * \brief Moves everything 1 further from the camera and projects with w = z and z' = z - 1,
+ * onto a 640x480 viewport at (10, 20). A vertex at view space z = 2 lands at depth 0.5 with rhw 0.5.
+ */
+FixedFunctionState make_state()
+{
+	FixedFunctionState state;
+
+	state.world_matrix._43 = 1.0f;
+
+	state.projection_matrix._34 = 1.0f;
+	state.projection_matrix._43 = -1.0f;
+	state.projection_matrix._44 = 0.0f;
+
+	state.viewport_x      = 10.0f;
+	state.viewport_y      = 20.0f;
+	state.viewport_width  = 640.0f;
+	state.viewport_height = 480.0f;
+
+	state.color_vertex = true;
+
+	return state;
+}
+
+/**
+ * \brief Keeps a destination vertex buffer and a staging buffer in memory and applies maps and copies
+ * to them like the GPU would, so that tests can see what a write leaves in the rest of the buffer.
+ */
+class MockBufferContext
+{
+public:
+	MockBufferContext(size_t vertex_count, const DestVertex& fill)
+		: m_dest(vertex_count * sizeof(DestVertex)),
+		  m_scratch(vertex_count * sizeof(DestVertex), 0xCD)
+	{
+		for (size_t i = 0; i < vertex_count; ++i)
+		{
+			std::memcpy(m_dest.data() + i * sizeof(DestVertex), &fill, sizeof(DestVertex));
+		}
+	}
+
+	[[nodiscard]] static ID3D11Resource* dest()
+	{
+		return reinterpret_cast<ID3D11Resource*>(16);
+	}
+
+	[[nodiscard]] static ID3D11Resource* scratch()
+	{
+		return reinterpret_cast<ID3D11Resource*>(32);
+	}
+
+	[[nodiscard]] UINT dest_size() const
+	{
+		return static_cast<UINT>(m_dest.size());
+	}
+
+	[[nodiscard]] DestVertex vertex(size_t index) const
+	{
+		DestVertex result;
+		std::memcpy(&result, m_dest.data() + index * sizeof(DestVertex), sizeof(DestVertex));
+		return result;
+	}
+
+	HRESULT Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP map_type, UINT map_flags, D3D11_MAPPED_SUBRESOURCE* mapped_resource)
+	{
+		std::span<uint8_t> data = bytes(resource);
+
+		// a discarded buffer comes back with undefined contents
+		if (map_type == D3D11_MAP_WRITE_DISCARD)
+		{
+			std::ranges::fill(data, uint8_t { 0xEE });
+		}
+
+		maps.emplace_back(resource, map_type);
+		mapped_resource->pData = data.data();
+		return S_OK;
+	}
+
+	void Unmap(ID3D11Resource* resource, UINT subresource)
+	{
+	}
+
+	void CopySubresourceRegion(ID3D11Resource* dst_resource, UINT dst_subresource, UINT dst_x, UINT dst_y, UINT dst_z,
+	                           ID3D11Resource* src_resource, UINT src_subresource, const D3D11_BOX* src_box)
+	{
+		std::memcpy(bytes(dst_resource).data() + dst_x, bytes(src_resource).data() + src_box->left, src_box->right - src_box->left);
+	}
+
+	std::vector<std::pair<ID3D11Resource*, D3D11_MAP>> maps;
+
+private:
+	[[nodiscard]] std::span<uint8_t> bytes(ID3D11Resource* resource)
+	{
+		return resource == dest() ? std::span(m_dest) : std::span(m_scratch);
+	}
+
+	std::vector<uint8_t> m_dest;
+	std::vector<uint8_t> m_scratch;
+};
+
+class SoftwareVertexProcessorTest : public testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		ASSERT_TRUE(m_source.assign(SOURCE_FVF));
+		ASSERT_TRUE(m_dest.assign(DEST_FVF));
+		ASSERT_EQ(m_source.stride, sizeof(SourceVertex));
+		ASSERT_EQ(m_dest.stride, sizeof(DestVertex));
+	}
+
+	std::vector<DestVertex> process(const FixedFunctionState& state, const std::vector<SourceVertex>& input, bool copy_data = true)
+	{
+		// a pattern that no output in these tests matches, to catch components that aren't written
+		std::vector<DestVertex> output(input.size());
+		std::memset(output.data(), 0xCD, output.size() * sizeof(DestVertex));
+
+		process_vertices(state, m_source, reinterpret_cast<const uint8_t*>(input.data()),
+		                 m_dest, reinterpret_cast<uint8_t*>(output.data()), input.size(), copy_data);
+
+		return output;
+	}
+
+	/**
+	 * \brief Processes \p input into the destination buffer of \p context from vertex \p dest_index on, like \c ProcessVertices.
+	 */
+	void process_range(MockBufferContext& context, UINT dest_index, const FixedFunctionState& state,
+	                   const std::vector<SourceVertex>& input, bool copy_data)
+	{
+		const bool written = write_buffer_range(context, MockBufferContext::dest(), context.dest_size(), MockBufferContext::scratch(),
+		                                        static_cast<UINT>(dest_index * sizeof(DestVertex)),
+		                                        static_cast<UINT>(input.size() * sizeof(DestVertex)),
+		                                        overwrites_vertices(m_dest, copy_data),
+		                                        [&](uint8_t* dest_data)
+		{
+			process_vertices(state, m_source, reinterpret_cast<const uint8_t*>(input.data()), m_dest, dest_data, input.size(), copy_data);
+		});
+
+		ASSERT_TRUE(written);
+	}
+
+	FVFLayout m_source;
+	FVFLayout m_dest;
+};
+}
+
+TEST_F(SoftwareVertexProcessorTest, TransformsToScreenSpace)
+{
+	// five vertices, so the last block of four has only one lane in use
+	std::vector<SourceVertex> input;
+
+	for (int i = 0; i < 5; ++i)
+	{
+		input.push_back({ { static_cast<float>(i), 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF000000u | static_cast<uint32_t>(i), { 0.25f * i, 1.0f } });
+	}
+
+	const auto output = process(make_state(), input);
+
+	for (int i = 0; i < 5; ++i)
+	{
+		SCOPED_TRACE(i);
+
+		// clip space (i, 0, 1, 2), so NDC (i / 2, 0, 0.5)
+		EXPECT_FLOAT_EQ(output[i].position[0], 10.0f + (1.0f + i / 2.0f) * 320.0f);
+		EXPECT_FLOAT_EQ(output[i].position[1], 20.0f + 240.0f);
+		EXPECT_FLOAT_EQ(output[i].position[2], 0.5f);
+		EXPECT_FLOAT_EQ(output[i].position[3], 0.5f);
+
+		// unlit vertex colors pass through, and there's no specular to pass
+		EXPECT_EQ(output[i].diffuse, input[i].diffuse);
+		EXPECT_EQ(output[i].specular, 0u);
+
+		EXPECT_FLOAT_EQ(output[i].texcoord[0], input[i].texcoord[0]);
+		EXPECT_FLOAT_EQ(output[i].texcoord[1], input[i].texcoord[1]);
+	}
+}
+
+TEST_F(SoftwareVertexProcessorTest, LightsWithDirectionalLight)
+{
+	FixedFunctionState state = make_state();
+
+	state.rs_lighting  = true;
+	state.color_vertex = false;
+
+	state.material.diffuse  = float4(1.0f, 0.5f, 0.25f, 1.0f);
+	state.material.specular = float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+	Light& light    = state.lights[0];
+	light.enabled   = true;
+	light.type      = D3DLIGHT_DIRECTIONAL;
+	light.diffuse   = float4(1.0f, 1.0f, 1.0f, 1.0f);
+	light.direction = float3(0.0f, 0.0f, 1.0f);
+
+	const std::vector<SourceVertex> input = {
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFFFFFFFF, { 0.0f, 0.0f } }, // facing the light
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, -2.0f, -2.0f }, 0xFFFFFFFF, { 0.0f, 0.0f } }, // 45 degrees off, unnormalized
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f }, 0xFFFFFFFF, { 0.0f, 0.0f } }, // facing away
+	};
+
+	const auto output = process(state, input);
+
+	// material diffuse * N.L, rounded to the nearest of 255 steps, with the material's alpha
+	EXPECT_EQ(output[0].diffuse, 0xFFFF8040u); // (255, 127.5, 63.75)
+	EXPECT_EQ(output[1].diffuse, 0xFFB45A2Du); // (180.3, 90.2, 45.1)
+	EXPECT_EQ(output[2].diffuse, 0xFF000000u);
+
+	for (const DestVertex& vertex : output)
+	{
+		EXPECT_EQ(vertex.specular, 0u);
+	}
+}
+
+TEST_F(SoftwareVertexProcessorTest, WritesLinearFogToSpecularAlpha)
+{
+	FixedFunctionState state = make_state();
+
+	state.rs_fog      = true;
+	state.rs_fog_mode = D3DFOG_LINEAR;
+	state.fog_start   = 1.0f;
+	state.fog_end     = 5.0f;
+
+	const std::vector<SourceVertex> input = {
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFFFFFFFF, { 0.0f, 0.0f } }, // view z 2
+		{ { 0.0f, 0.0f, 3.0f }, { 0.0f, 0.0f, -1.0f }, 0xFFFFFFFF, { 0.0f, 0.0f } }, // view z 4
+		{ { 0.0f, 0.0f, 9.0f }, { 0.0f, 0.0f, -1.0f }, 0xFFFFFFFF, { 0.0f, 0.0f } }, // past the fog end
+	};
+
+	const auto output = process(state, input);
+
+	// (end - z) / (end - start)
+	EXPECT_EQ(output[0].specular, 0xBF000000u); // 0.75
+	EXPECT_EQ(output[1].specular, 0x40000000u); // 0.25
+	EXPECT_EQ(output[2].specular, 0x00000000u);
+
+	for (const DestVertex& vertex : output)
+	{
+		EXPECT_EQ(vertex.diffuse, 0xFFFFFFFFu);
+	}
+}
+
+TEST_F(SoftwareVertexProcessorTest, DoNotCopyDataWritesOnlyPositions)
+{
+	const std::vector<SourceVertex> input = {
+		{ { 1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF102030, { 0.5f, 0.5f } },
+	};
+
+	const auto output = process(make_state(), input, false);
+
+	EXPECT_FLOAT_EQ(output[0].position[0], 490.0f);
+	EXPECT_FLOAT_EQ(output[0].position[1], 260.0f);
+	EXPECT_FLOAT_EQ(output[0].position[2], 0.5f);
+	EXPECT_FLOAT_EQ(output[0].position[3], 0.5f);
+
+	DestVertex untouched;
+	std::memset(&untouched, 0xCD, sizeof(untouched));
+
+	EXPECT_EQ(output[0].diffuse, untouched.diffuse);
+	EXPECT_EQ(output[0].specular, untouched.specular);
+	EXPECT_EQ(std::memcmp(output[0].texcoord, untouched.texcoord, sizeof(untouched.texcoord)), 0);
+}
+
+TEST_F(SoftwareVertexProcessorTest, PartialWriteKeepsRestOfBuffer)
+{
+	// what earlier calls left in the buffer
+	const DestVertex previous { { 1.0f, 2.0f, 3.0f, 4.0f }, 0x11223344, 0x55667788, { 5.0f, 6.0f } };
+	MockBufferContext context(6, previous);
+
+	const std::vector<SourceVertex> input = {
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF0000FF, { 0.5f, 0.25f } },
+		{ { 2.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF00FF00, { 0.75f, 1.0f } },
+	};
+
+	process_range(context, 3, make_state(), input, true);
+
+	for (size_t i : { 0, 1, 2, 5 })
+	{
+		SCOPED_TRACE(i);
+
+		const DestVertex vertex = context.vertex(i);
+		EXPECT_EQ(std::memcmp(&vertex, &previous, sizeof(DestVertex)), 0);
+	}
+
+	EXPECT_FLOAT_EQ(context.vertex(3).position[0], 330.0f);
+	EXPECT_FLOAT_EQ(context.vertex(4).position[0], 650.0f);
+	EXPECT_EQ(context.vertex(3).diffuse, 0xFF0000FFu);
+	EXPECT_EQ(context.vertex(4).diffuse, 0xFF00FF00u);
+	EXPECT_FLOAT_EQ(context.vertex(4).texcoord[0], 0.75f);
+
+	// the destination itself is never mapped, so nothing that earlier draws read from it is discarded
+	ASSERT_EQ(context.maps.size(), 1u);
+	EXPECT_EQ(context.maps[0], std::make_pair(MockBufferContext::scratch(), D3D11_MAP_WRITE));
+}
+
+TEST_F(SoftwareVertexProcessorTest, DoNotCopyDataKeepsComponentsInRange)
+{
+	const DestVertex previous { { 1.0f, 2.0f, 3.0f, 4.0f }, 0x11223344, 0x55667788, { 5.0f, 6.0f } };
+	MockBufferContext context(2, previous);
+
+	const std::vector<SourceVertex> input = {
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF0000FF, { 0.5f, 0.25f } },
+		{ { 2.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF00FF00, { 0.75f, 1.0f } },
+	};
+
+	// all of the buffer, but not all of each vertex, so it still can't be discarded
+	process_range(context, 0, make_state(), input, false);
+
+	for (size_t i = 0; i < input.size(); ++i)
+	{
+		SCOPED_TRACE(i);
+
+		const DestVertex vertex = context.vertex(i);
+
+		EXPECT_FLOAT_EQ(vertex.position[0], 330.0f + 320.0f * i);
+		EXPECT_EQ(vertex.diffuse, previous.diffuse);
+		EXPECT_EQ(vertex.specular, previous.specular);
+		EXPECT_FLOAT_EQ(vertex.texcoord[0], previous.texcoord[0]);
+		EXPECT_FLOAT_EQ(vertex.texcoord[1], previous.texcoord[1]);
+	}
+
+	ASSERT_EQ(context.maps.size(), 1u);
+	EXPECT_EQ(context.maps[0].first, MockBufferContext::scratch());
+}
+
+TEST_F(SoftwareVertexProcessorTest, WholeBufferWriteDiscards)
+{
+	const DestVertex previous { { 1.0f, 2.0f, 3.0f, 4.0f }, 0x11223344, 0x55667788, { 5.0f, 6.0f } };
+	MockBufferContext context(2, previous);
+
+	const std::vector<SourceVertex> input = {
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF0000FF, { 0.5f, 0.25f } },
+		{ { 2.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, 0xFF00FF00, { 0.75f, 1.0f } },
+	};
+
+	process_range(context, 0, make_state(), input, true);
+
+	ASSERT_EQ(context.maps.size(), 1u);
+	EXPECT_EQ(context.maps[0], std::make_pair(MockBufferContext::dest(), D3D11_MAP_WRITE_DISCARD));
+
+	// every byte is rewritten, so none of the discarded contents show through
+	for (size_t i = 0; i < input.size(); ++i)
+	{
+		SCOPED_TRACE(i);
+
+		const DestVertex vertex = context.vertex(i);
+
+		EXPECT_FLOAT_EQ(vertex.position[0], 330.0f + 320.0f * i);
+		EXPECT_FLOAT_EQ(vertex.position[1], 260.0f);
+		EXPECT_FLOAT_EQ(vertex.position[2], 0.5f);
+		EXPECT_FLOAT_EQ(vertex.position[3], 0.5f);
+		EXPECT_EQ(vertex.diffuse, input[i].diffuse);
+		EXPECT_EQ(vertex.specular, 0u);
+		EXPECT_FLOAT_EQ(vertex.texcoord[0], input[i].texcoord[0]);
+		EXPECT_FLOAT_EQ(vertex.texcoord[1], input[i].texcoord[1]);
+	}
+}
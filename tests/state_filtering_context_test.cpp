@@ -0,0 +1,416 @@
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "StateFilteringContext.h"
+
+namespace
+{
+/**
+ * \brief One call that reached the mock context. Multi-slot setters record their range and the first
+ * element they were given; everything else only records its name.
+ */
+struct Call
+{
+	std::string name;
+	UINT start = 0;
+	UINT count = 0;
+	const void* first = nullptr;
+};
+
+/**
+ * \brief Stands in for \c ID3D11DeviceContext and records every call made to it.
+ */
+struct MockContext
+{
+	std::vector<Call> calls;
+
+	void record(std::string name, UINT start = 0, UINT count = 0, const void* first = nullptr)
+	{
+		calls.push_back({ std::move(name), start, count, first });
+	}
+
+	void IASetInputLayout(ID3D11InputLayout*)
+	{
+		record("IASetInputLayout");
+	}
+
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY)
+	{
+		record("IASetPrimitiveTopology");
+	}
+
+	void IASetVertexBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers, const UINT*, const UINT*)
+	{
+		record("IASetVertexBuffers", start_slot, num_buffers, buffers);
+	}
+
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT)
+	{
+		record("IASetIndexBuffer");
+	}
+
+	void VSSetShader(ID3D11VertexShader*, ID3D11ClassInstance* const*, UINT)
+	{
+		record("VSSetShader");
+	}
+
+	void PSSetShader(ID3D11PixelShader*, ID3D11ClassInstance* const*, UINT)
+	{
+		record("PSSetShader");
+	}
+
+	void VSGetShader(ID3D11VertexShader**, ID3D11ClassInstance**, UINT*)
+	{
+		record("VSGetShader");
+	}
+
+	void PSGetShader(ID3D11PixelShader**, ID3D11ClassInstance**, UINT*)
+	{
+		record("PSGetShader");
+	}
+
+	void VSSetConstantBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers)
+	{
+		record("VSSetConstantBuffers", start_slot, num_buffers, buffers);
+	}
+
+	void PSSetConstantBuffers(UINT start_slot, UINT num_buffers, ID3D11Buffer* const* buffers)
+	{
+		record("PSSetConstantBuffers", start_slot, num_buffers, buffers);
+	}
+
+	void PSSetShaderResources(UINT start_slot, UINT num_views, ID3D11ShaderResourceView* const* views)
+	{
+		record("PSSetShaderResources", start_slot, num_views, views);
+	}
+
+	void PSSetSamplers(UINT start_slot, UINT num_samplers, ID3D11SamplerState* const* samplers)
+	{
+		record("PSSetSamplers", start_slot, num_samplers, samplers);
+	}
+
+	void RSSetState(ID3D11RasterizerState*)
+	{
+		record("RSSetState");
+	}
+
+	void RSSetViewports(UINT, const D3D11_VIEWPORT*)
+	{
+		record("RSSetViewports");
+	}
+
+	void OMSetBlendState(ID3D11BlendState*, const FLOAT[4], UINT)
+	{
+		record("OMSetBlendState");
+	}
+
+	void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT)
+	{
+		record("OMSetDepthStencilState");
+	}
+
+	void OMSetRenderTargets(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*)
+	{
+		record("OMSetRenderTargets");
+	}
+
+	void OMSetRenderTargetsAndUnorderedAccessViews(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*, UINT, UINT,
+	                                               ID3D11UnorderedAccessView* const*, const UINT*)
+	{
+		record("OMSetRenderTargetsAndUnorderedAccessViews");
+	}
+
+	void Draw(UINT, UINT)
+	{
+		record("Draw");
+	}
+
+	void DrawIndexed(UINT, UINT, INT)
+	{
+		record("DrawIndexed");
+	}
+
+	HRESULT Map(ID3D11Resource*, UINT, D3D11_MAP, UINT, D3D11_MAPPED_SUBRESOURCE*)
+	{
+		record("Map");
+		return S_OK;
+	}
+
+	void Unmap(ID3D11Resource*, UINT)
+	{
+		record("Unmap");
+	}
+
+	void CopySubresourceRegion(ID3D11Resource*, UINT, UINT, UINT, UINT, ID3D11Resource*, UINT, const D3D11_BOX*)
+	{
+		record("CopySubresourceRegion");
+	}
+
+	void UpdateSubresource(ID3D11Resource*, UINT, const D3D11_BOX*, const void*, UINT, UINT)
+	{
+		record("UpdateSubresource");
+	}
+
+	void ClearRenderTargetView(ID3D11RenderTargetView*, const FLOAT[4])
+	{
+		record("ClearRenderTargetView");
+	}
+
+	void ClearDepthStencilView(ID3D11DepthStencilView*, UINT, FLOAT, UINT8)
+	{
+		record("ClearDepthStencilView");
+	}
+
+	void ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView*, const UINT[4])
+	{
+		record("ClearUnorderedAccessViewUint");
+	}
+};
+
+/**
+ * \brief Stands in for \c ID3D11DeviceContext1.
+ */
+struct MockContext1 : MockContext
+{
+	void UpdateSubresource1(ID3D11Resource*, UINT, const D3D11_BOX*, const void*, UINT, UINT, UINT)
+	{
+		record("UpdateSubresource1");
+	}
+};
+
+/**
+ * \brief Makes up a distinct, never dereferenced pointer to an opaque interface.
+ */
+template <typename T>
+T* fake(uintptr_t id)
+{
+	return reinterpret_cast<T*>(id * 16);
+}
+
+class StateFilteringContextTest : public testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		m_filter.reset(&m_mock);
+	}
+
+	[[nodiscard]] std::vector<Call>& calls()
+	{
+		return m_mock.calls;
+	}
+
+	MockContext1 m_mock;
+	BasicStateFilteringContext<MockContext1, MockContext1> m_filter;
+};
+}
+
+template class BasicStateFilteringContext<MockContext, MockContext1>;
+template class BasicStateFilteringContext<MockContext1, MockContext1>;
+
+TEST_F(StateFilteringContextTest, FiltersRedundantSingleStateChanges)
+{
+	m_filter->RSSetState(fake<ID3D11RasterizerState>(1));
+	m_filter->RSSetState(fake<ID3D11RasterizerState>(1));
+	m_filter->RSSetState(fake<ID3D11RasterizerState>(2));
+
+	m_filter->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	m_filter->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	m_filter->IASetIndexBuffer(fake<ID3D11Buffer>(1), DXGI_FORMAT_R16_UINT, 0);
+	m_filter->IASetIndexBuffer(fake<ID3D11Buffer>(1), DXGI_FORMAT_R16_UINT, 0);
+	m_filter->IASetIndexBuffer(fake<ID3D11Buffer>(1), DXGI_FORMAT_R16_UINT, 4);
+
+	ASSERT_EQ(calls().size(), 5u);
+	EXPECT_EQ(calls()[0].name, "RSSetState");
+	EXPECT_EQ(calls()[1].name, "RSSetState");
+	EXPECT_EQ(calls()[2].name, "IASetPrimitiveTopology");
+	EXPECT_EQ(calls()[3].name, "IASetIndexBuffer");
+	EXPECT_EQ(calls()[4].name, "IASetIndexBuffer");
+
+	m_filter.end_frame();
+	EXPECT_EQ(m_filter.get_last_frame_stats().forwarded, 5u);
+	EXPECT_EQ(m_filter.get_last_frame_stats().filtered, 3u);
+
+	m_filter.end_frame();
+	EXPECT_EQ(m_filter.get_last_frame_stats().forwarded, 0u);
+	EXPECT_EQ(m_filter.get_last_frame_stats().filtered, 0u);
+}
+
+TEST_F(StateFilteringContextTest, ForwardsFirstBindOfNullState)
+{
+	// the shadow starts out unknown, not null, so binding null must still reach the context
+	m_filter->RSSetState(nullptr);
+	m_filter->RSSetState(nullptr);
+
+	ASSERT_EQ(calls().size(), 1u);
+}
+
+TEST_F(StateFilteringContextTest, NullBlendFactorEqualsOnes)
+{
+	const FLOAT ones[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	const FLOAT half[4] = { 0.5f, 0.5f, 0.5f, 0.5f };
+
+	m_filter->OMSetBlendState(fake<ID3D11BlendState>(1), nullptr, 0xffffffff);
+	m_filter->OMSetBlendState(fake<ID3D11BlendState>(1), ones, 0xffffffff);
+	m_filter->OMSetBlendState(fake<ID3D11BlendState>(1), half, 0xffffffff);
+	m_filter->OMSetBlendState(fake<ID3D11BlendState>(1), half, 0x0000ffff);
+
+	EXPECT_EQ(calls().size(), 3u);
+}
+
+TEST_F(StateFilteringContextTest, ShaderWithClassInstancesAlwaysForwarded)
+{
+	ID3D11ClassInstance* instance = fake<ID3D11ClassInstance>(1);
+
+	m_filter->PSSetShader(fake<ID3D11PixelShader>(1), nullptr, 0);
+	m_filter->PSSetShader(fake<ID3D11PixelShader>(1), nullptr, 0);
+	m_filter->PSSetShader(fake<ID3D11PixelShader>(1), &instance, 1);
+
+	EXPECT_EQ(calls().size(), 2u);
+}
+
+TEST_F(StateFilteringContextTest, InvalidateForgetsShadowedState)
+{
+	ID3D11SamplerState* sampler = fake<ID3D11SamplerState>(1);
+
+	m_filter->VSSetShader(fake<ID3D11VertexShader>(1), nullptr, 0);
+	m_filter->PSSetSamplers(0, 1, &sampler);
+
+	m_filter.invalidate();
+
+	m_filter->VSSetShader(fake<ID3D11VertexShader>(1), nullptr, 0);
+	m_filter->PSSetSamplers(0, 1, &sampler);
+
+	EXPECT_EQ(calls().size(), 4u);
+}
+
+TEST_F(StateFilteringContextTest, NarrowsShaderResourcesToChangedRange)
+{
+	std::array<ID3D11ShaderResourceView*, 6> views {};
+
+	for (size_t i = 0; i < views.size(); ++i)
+	{
+		views[i] = fake<ID3D11ShaderResourceView>(i + 1);
+	}
+
+	m_filter->PSSetShaderResources(2, static_cast<UINT>(views.size()), views.data());
+	ASSERT_EQ(calls().size(), 1u);
+	EXPECT_EQ(calls()[0].start, 2u);
+	EXPECT_EQ(calls()[0].count, 6u);
+	EXPECT_EQ(calls()[0].first, views.data());
+
+	// only slots 4 and 6 (views[2] and views[4]) change; the range between them is forwarded as a whole
+	views[2] = fake<ID3D11ShaderResourceView>(100);
+	views[4] = fake<ID3D11ShaderResourceView>(101);
+
+	m_filter->PSSetShaderResources(2, static_cast<UINT>(views.size()), views.data());
+	ASSERT_EQ(calls().size(), 2u);
+	EXPECT_EQ(calls()[1].start, 4u);
+	EXPECT_EQ(calls()[1].count, 3u);
+	EXPECT_EQ(calls()[1].first, &views[2]);
+
+	m_filter->PSSetShaderResources(2, static_cast<UINT>(views.size()), views.data());
+	EXPECT_EQ(calls().size(), 2u);
+}
+
+TEST_F(StateFilteringContextTest, NarrowsVertexBuffersToChangedRange)
+{
+	std::array<ID3D11Buffer*, 3> buffers = { fake<ID3D11Buffer>(1), fake<ID3D11Buffer>(2), fake<ID3D11Buffer>(3) };
+	std::array<UINT, 3> strides = { 12, 16, 20 };
+	std::array<UINT, 3> offsets = { 0, 0, 0 };
+
+	m_filter->IASetVertexBuffers(0, 3, buffers.data(), strides.data(), offsets.data());
+
+	// the same buffer with a different stride is a different binding
+	strides[1] = 24;
+	m_filter->IASetVertexBuffers(0, 3, buffers.data(), strides.data(), offsets.data());
+
+	offsets[2] = 64;
+	m_filter->IASetVertexBuffers(0, 3, buffers.data(), strides.data(), offsets.data());
+
+	ASSERT_EQ(calls().size(), 3u);
+	EXPECT_EQ(calls()[1].start, 1u);
+	EXPECT_EQ(calls()[1].count, 1u);
+	EXPECT_EQ(calls()[1].first, &buffers[1]);
+	EXPECT_EQ(calls()[2].start, 2u);
+	EXPECT_EQ(calls()[2].count, 1u);
+	EXPECT_EQ(calls()[2].first, &buffers[2]);
+}
+
+TEST_F(StateFilteringContextTest, ClampsAndDropsOutOfRangeSlots)
+{
+	std::array<ID3D11Buffer*, 4> buffers = { fake<ID3D11Buffer>(1), fake<ID3D11Buffer>(2), fake<ID3D11Buffer>(3), fake<ID3D11Buffer>(4) };
+
+	constexpr UINT last_slot = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT - 2;
+
+	m_filter->PSSetConstantBuffers(last_slot, 4, buffers.data());
+	ASSERT_EQ(calls().size(), 1u);
+	EXPECT_EQ(calls()[0].start, last_slot);
+	EXPECT_EQ(calls()[0].count, 2u);
+
+	m_filter->PSSetConstantBuffers(D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT, 1, buffers.data());
+	m_filter->PSSetConstantBuffers(0, 0, buffers.data());
+	EXPECT_EQ(calls().size(), 1u);
+}
+
+TEST_F(StateFilteringContextTest, OMSetRenderTargetsForgetsShaderResources)
+{
+	ID3D11ShaderResourceView* view = fake<ID3D11ShaderResourceView>(1);
+	ID3D11SamplerState* sampler = fake<ID3D11SamplerState>(1);
+	ID3D11RenderTargetView* rtv = fake<ID3D11RenderTargetView>(1);
+
+	m_filter->PSSetShaderResources(0, 1, &view);
+	m_filter->PSSetSamplers(0, 1, &sampler);
+	m_filter->OMSetRenderTargets(1, &rtv, nullptr);
+
+	// the view may have been unbound by the runtime; the sampler can't have been
+	m_filter->PSSetShaderResources(0, 1, &view);
+	m_filter->PSSetSamplers(0, 1, &sampler);
+
+	ASSERT_EQ(calls().size(), 4u);
+	EXPECT_EQ(calls()[2].name, "OMSetRenderTargets");
+	EXPECT_EQ(calls()[3].name, "PSSetShaderResources");
+}
+
+TEST_F(StateFilteringContextTest, OMSetRenderTargetsAndUnorderedAccessViewsForgetsShaderResources)
+{
+	ID3D11ShaderResourceView* view = fake<ID3D11ShaderResourceView>(1);
+	ID3D11SamplerState* sampler = fake<ID3D11SamplerState>(1);
+	ID3D11UnorderedAccessView* uav = fake<ID3D11UnorderedAccessView>(1);
+
+	m_filter->PSSetShaderResources(0, 1, &view);
+	m_filter->PSSetSamplers(0, 1, &sampler);
+	m_filter->OMSetRenderTargetsAndUnorderedAccessViews(0, nullptr, nullptr, 1, 1, &uav, nullptr);
+
+	m_filter->PSSetShaderResources(0, 1, &view);
+	m_filter->PSSetSamplers(0, 1, &sampler);
+
+	ASSERT_EQ(calls().size(), 4u);
+	EXPECT_EQ(calls()[2].name, "OMSetRenderTargetsAndUnorderedAccessViews");
+	EXPECT_EQ(calls()[3].name, "PSSetShaderResources");
+}
+
+TEST_F(StateFilteringContextTest, UpdateSubresource1UsesContext1)
+{
+	m_filter->UpdateSubresource1(nullptr, 0, nullptr, nullptr, 0, 0, 0);
+
+	ASSERT_EQ(calls().size(), 1u);
+	EXPECT_EQ(calls()[0].name, "UpdateSubresource1");
+}
+
+TEST(StateFilteringContext, UpdateSubresource1FallsBackWithoutContext1)
+{
+	MockContext mock;
+	BasicStateFilteringContext<MockContext, MockContext1> filter;
+	filter.reset(&mock);
+
+	filter->UpdateSubresource1(nullptr, 0, nullptr, nullptr, 0, 0, 0);
+
+	ASSERT_EQ(mock.calls.size(), 1u);
+	EXPECT_EQ(mock.calls[0].name, "UpdateSubresource");
+}